@@ -58,6 +58,8 @@
 #define MONERO_DEFAULT_LOG_CATEGORY "net"
 
 #define ABSTRACT_SERVER_SEND_QUE_MAX_COUNT 1000
+#define ABSTRACT_SERVER_SEND_GATHER_MAX_COUNT 64 // queued slices written by one async_write
+#define ABSTRACT_SERVER_SEND_GATHER_MAX_SIZE (256 * 1024) // bytes written by one async_write, unless a single slice is larger
 
 namespace epee
 {
@@ -134,6 +136,8 @@ namespace net_utils
   private:
     //----------------- i_service_endpoint ---------------------
     virtual bool do_send(byte_slice message); ///< (see do_send from i_service_endpoint)
+    virtual bool do_send_prioritized(byte_slice message, traffic_class priority); ///< (see do_send_prioritized from i_service_endpoint)
+    virtual bool do_send_slices(std::vector<byte_slice> slices); ///< queues all slices at once, written with as few async_write as possible
     virtual bool send_done();
     virtual bool close();
     virtual bool call_run_once_service_io();
@@ -142,7 +146,9 @@ namespace net_utils
     virtual bool add_ref();
     virtual bool release();
     //------------------------------------------------------
-    bool do_send_chunk(byte_slice chunk); ///< will send (or queue) a part of data. internal use only
+    bool send_slices(std::vector<byte_slice> slices, traffic_class priority); ///< will send (or queue) the slices of one message. internal use only
+    bool queue_send_slices(std::vector<byte_slice> slices, traffic_class priority); ///< queues the slices of one message by priority, waiting for room. m_send_que_lock must be held
+    void start_write(); ///< writes queued slices with one gathering async_write. m_send_que_lock must be held
 
     std::shared_ptr<connection<t_protocol_handler> > safe_shared_from_this();
     bool shutdown();
@@ -179,6 +185,8 @@ namespace net_utils
     std::shared_ptr<connection<t_protocol_handler> > m_self_ref; // the reference to hold
     critical_section m_self_refs_lock;
     critical_section m_chunking_lock; // held while we add small chunks of the big do_send() to small do_send_chunk()
+    size_t m_send_in_flight = 0; // number of m_send_que slices being written, under m_send_que_lock
+    traffic_class m_send_in_flight_priority = traffic_class::peers; // class of the slices being written, under m_send_que_lock
     critical_section m_shutdown_lock; // held while shutting down
 
     t_connection_type m_connection_type;
@@ -235,6 +243,14 @@ namespace net_utils
 	const std::string port_ipv6 = "", const std::string address_ipv6 = "::", bool use_ipv6 = false, bool require_ipv4 = true,
 	ssl_options_t ssl_options = ssl_support_t::e_ssl_support_autodetect);
 
+    /// Split the server into `count` io_services, each run by at least two
+    /// worker threads. Connections, idle handlers and posted calls are spread
+    /// over the shards round-robin. Must be called before `init_server`; 0 or 1
+    /// keeps the single shared io_service.
+    void set_io_service_shards(size_t count);
+
+    size_t get_io_service_shards_count() const { return m_shards.size() + 1; }
+
     /// Run the server's io_service loop.
     bool run_server(size_t threads_count, bool wait = true, const boost::thread::attributes& attrs = boost::thread::attributes());
 
@@ -328,7 +344,7 @@ namespace net_utils
     template<class t_handler>
     bool add_idle_handler(t_handler t_callback, uint64_t timeout_ms)
       {
-        std::shared_ptr<idle_callback_conext<t_handler>> ptr(new idle_callback_conext<t_handler>(io_service_, t_callback, timeout_ms));
+        std::shared_ptr<idle_callback_conext<t_handler>> ptr(new idle_callback_conext<t_handler>(next_io_service(), t_callback, timeout_ms));
         //needed call handler here ?...
         ptr->m_timer.expires_from_now(boost::posix_time::milliseconds(ptr->m_period));
         ptr->m_timer.async_wait(std::bind(&boosted_tcp_server<t_protocol_handler>::global_timer_handler<t_handler>, this, ptr));
@@ -349,11 +365,18 @@ namespace net_utils
     template<class t_handler>
     bool async_call(t_handler t_callback)
     {
-      io_service_.post(t_callback);
+      next_io_service().post(t_callback);
       return true;
     }
 
   private:
+    /// Pick the io_service for a new connection or timer, round-robin over the shards.
+    /// Blocking connects skip the calling thread's shard, which could not
+    /// dispatch the completion while we wait on it.
+    boost::asio::io_service& next_io_service(bool skip_current = false);
+    boost::asio::io_service& get_shard_io_service(size_t index);
+    static boost::asio::io_service*& current_thread_io_service();
+
     /// Run the server's io_service loop.
     bool worker_thread();
     /// Handle completion of an asynchronous accept operation.
@@ -377,6 +400,9 @@ namespace net_utils
     };
     std::unique_ptr<worker> m_io_service_local_instance;
     boost::asio::io_service& io_service_;
+    /// Extra io_services in sharded mode; shard 0 is always io_service_.
+    std::vector<std::unique_ptr<worker>> m_shards;
+    std::atomic<size_t> m_next_shard;
 
     /// Acceptor used to listen for incoming connections.
     boost::asio::ip::tcp::acceptor acceptor_;
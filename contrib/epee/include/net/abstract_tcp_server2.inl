@@ -540,6 +540,11 @@ PRAGMA_WARNING_DISABLE_VS(4355)
   //---------------------------------------------------------------------------------
     template<class t_protocol_handler>
   bool connection<t_protocol_handler>::do_send(byte_slice message) {
+    return do_send_prioritized(std::move(message), traffic_class::peers);
+  }
+  //---------------------------------------------------------------------------------
+    template<class t_protocol_handler>
+  bool connection<t_protocol_handler>::do_send_prioritized(byte_slice message, const traffic_class priority) {
     TRY_ENTRY();
 
     // Use safe_shared_from_this, because of this is public method and it can be called on the object being deleted
@@ -573,24 +578,19 @@ PRAGMA_WARNING_DISABLE_VS(4355)
 				// const size_t bufsize = chunksize_good; // TODO safecast
 				// char* buf = new char[ bufsize ];
 
-				bool all_ok = true;
-				while (!message.empty()) {
-					byte_slice chunk = message.take_slice(chunksize_good);
-
-					MDEBUG("chunk_start="<<(void*)chunk.data()<<" ptr="<<(const void*)message_data<<" pos="<<(chunk.data() - message_data));
-					MDEBUG("part of " << message.size() << ": pos="<<(chunk.data() - message_data) << " len="<<chunk.size());
-
-					bool ok = do_send_chunk(std::move(chunk)); // <====== ***
-
-					all_ok = all_ok && ok;
-					if (!all_ok) {
-						MDEBUG("do_send() DONE ***FAILED*** from packet="<<message_size<<" B for ptr="<<(const void*)message_data);
-						MDEBUG("do_send() SEND was aborted in middle of big package - this is mostly harmless "
-							<< " (e.g. peer closed connection) but if it causes trouble tell us at #monero-dev. " << message_size);
-						return false; // partial failure in sending
-					}
-					// (in catch block, or uniq pointer) delete buf;
-				} // each chunk
+				// queue all the chunks at once, so they get written together
+				std::vector<byte_slice> chunks;
+				chunks.reserve(message_size / chunksize_good + 1);
+				while (!message.empty())
+					chunks.push_back(message.take_slice(chunksize_good));
+
+				const bool all_ok = send_slices(std::move(chunks), priority); // <====== ***
+				if (!all_ok) {
+					MDEBUG("do_send() DONE ***FAILED*** from packet="<<message_size<<" B for ptr="<<(const void*)message_data);
+					MDEBUG("do_send() SEND was aborted in middle of big package - this is mostly harmless "
+						<< " (e.g. peer closed connection) but if it causes trouble tell us at #monero-dev. " << message_size);
+					return false; // partial failure in sending
+				}
 
 				MDEBUG("do_send() DONE SPLIT from packet="<<message_size<<" B for ptr="<<(const void*)message_data);
 
@@ -600,15 +600,23 @@ PRAGMA_WARNING_DISABLE_VS(4355)
 			} // LOCK: chunking
 		} // a big block (to be chunked) - all chunks
 		else { // small block
-			return do_send_chunk(std::move(message)); // just send as 1 big chunk
+			std::vector<byte_slice> chunk;
+			chunk.push_back(std::move(message));
+			return send_slices(std::move(chunk), priority); // just send as 1 big chunk
 		}
 
-    CATCH_ENTRY_L0("connection<t_protocol_handler>::do_send", false);
-	} // do_send()
+    CATCH_ENTRY_L0("connection<t_protocol_handler>::do_send_prioritized", false);
+	} // do_send_prioritized()
 
   //---------------------------------------------------------------------------------
   template<class t_protocol_handler>
-  bool connection<t_protocol_handler>::do_send_chunk(byte_slice chunk)
+  bool connection<t_protocol_handler>::do_send_slices(std::vector<byte_slice> slices)
+  {
+    return send_slices(std::move(slices), traffic_class::peers);
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  bool connection<t_protocol_handler>::send_slices(std::vector<byte_slice> slices, const traffic_class priority)
   {
     TRY_ENTRY();
     // Use safe_shared_from_this, because of this is public method and it can be called on the object being deleted
@@ -617,26 +625,49 @@ PRAGMA_WARNING_DISABLE_VS(4355)
       return false;
     if(m_was_shutdown)
       return false;
+    if(slices.empty())
+      return true;
+
+    size_t total_size = 0;
+    for (const byte_slice &slice : slices)
+      total_size += slice.size();
     double current_speed_up;
     {
-		CRITICAL_REGION_LOCAL(m_throttle_speed_out_mutex);
-		m_throttle_speed_out.handle_trafic_exact(chunk.size());
-		current_speed_up = m_throttle_speed_out.get_current_speed();
-	}
+      CRITICAL_REGION_LOCAL(m_throttle_speed_out_mutex);
+      m_throttle_speed_out.handle_trafic_exact(total_size);
+      current_speed_up = m_throttle_speed_out.get_current_speed();
+    }
     context.m_current_speed_up = current_speed_up;
     context.m_max_speed_up = std::max(context.m_max_speed_up, current_speed_up);
-
-    //_info("[sock " << socket().native_handle() << "] SEND " << cb);
     context.m_last_send = time(NULL);
-    context.m_send_cnt += chunk.size();
-    //some data should be wrote to stream
-    //request complete
+    context.m_send_cnt += total_size;
 
     // No sleeping here; sleeping is done once and for all in "handle_write"
 
     m_send_que_lock.lock(); // *** critical ***
     epee::misc_utils::auto_scope_leave_caller scope_exit_handler = epee::misc_utils::create_scope_leave_handler([&](){m_send_que_lock.unlock();});
 
+    const size_t count = slices.size();
+    if (!queue_send_slices(std::move(slices), priority))
+      return false;
+
+    if(m_send_in_flight)
+    { // active operation should be in progress, nothing to do, just wait last operation callback
+      MDEBUG("send_slices() NOW just queues: " << count << " slices, " << total_size << " B, class " << traffic_class_to_string(priority) << ", queue-size=" << m_send_que.size());
+      LOG_TRACE_CC(context, "[sock " << socket().native_handle() << "] Async send requested " << m_send_que.front().data.size());
+    }
+    else
+    { // no active operation
+      start_write();
+    }
+    return true;
+
+    CATCH_ENTRY_L0("connection<t_protocol_handler>::send_slices", false);
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  bool connection<t_protocol_handler>::queue_send_slices(std::vector<byte_slice> slices, const traffic_class priority)
+  {
     long int retry=0;
     const long int retry_limit = 5*4;
     while (m_send_que.size() > ABSTRACT_SERVER_SEND_QUE_MAX_COUNT)
@@ -659,7 +690,7 @@ PRAGMA_WARNING_DISABLE_VS(4355)
         rng.seed(seed);
 
         long int ms = 250 + (rng() % 50);
-        MDEBUG("Sleeping because QUEUE is FULL, in " << __FUNCTION__ << " for " << ms << " ms before packet_size="<<chunk.size()); // XXX debug sleep
+        MDEBUG("Sleeping because QUEUE is FULL, in " << __FUNCTION__ << " for " << ms << " ms before packet_size="<<slices.front().size()); // XXX debug sleep
         m_send_que_lock.unlock();
         boost::this_thread::sleep(boost::posix_time::milliseconds( ms ) );
         m_send_que_lock.lock();
@@ -674,48 +705,39 @@ PRAGMA_WARNING_DISABLE_VS(4355)
         }
     }
 
-    m_send_que.push_back(std::move(chunk));
-
-    if(m_send_que.size() > 1)
-    { // active operation should be in progress, nothing to do, just wait last operation callback
-        auto size_now = m_send_que.back().size();
-        MDEBUG("do_send_chunk() NOW just queues: packet="<<size_now<<" B, is added to queue-size="<<m_send_que.size());
-        //do_send_handler_delayed( ptr , size_now ); // (((H))) // empty function
-
-      LOG_TRACE_CC(context, "[sock " << socket().native_handle() << "] Async send requested " << m_send_que.front().size());
-    }
-    else
-    { // no active operation
-
-        if(m_send_que.size()!=1)
-        {
-            _erro("Looks like no active operations, but send que size != 1!!");
-            return false;
-        }
-
-        auto size_now = m_send_que.front().size();
-        MDEBUG("do_send_chunk() NOW SENSD: packet="<<size_now<<" B");
-        if (speed_limit_is_enabled())
-			do_send_handler_write( m_send_que.back().data(), m_send_que.back().size() ); // (((H)))
+    queue_message(m_send_que, m_send_in_flight, std::move(slices), priority);
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  void connection<t_protocol_handler>::start_write()
+  {
+    CHECK_AND_ASSERT_MES(!m_send_que.empty() && !m_send_in_flight, void(), "Unexpected send queue state");
 
-        CHECK_AND_ASSERT_MES( size_now == m_send_que.front().size(), false, "Unexpected queue size");
-        reset_timer(get_default_timeout(), false);
-            async_write(boost::asio::buffer(m_send_que.front().data(), size_now ) ,
-                                 strand_.wrap(
-                                 std::bind(&connection<t_protocol_handler>::handle_write, self, std::placeholders::_1, std::placeholders::_2)
-                                 )
-                                 );
-        //_dbg3("(chunk): " << size_now);
-        //logger_handle_net_write(size_now);
-        //_info("[sock " << socket().native_handle() << "] Async send requested " << m_send_que.front().size());
+    // gather queued slices into one write, so small messages and chunks do not cost a syscall each.
+    // A write never mixes classes, so handle_write throttles it as its class
+    std::vector<boost::asio::const_buffer> buffers;
+    size_t size_now = 0;
+    m_send_in_flight_priority = m_send_que.front().priority;
+    m_send_in_flight = get_gather_count(m_send_que, ABSTRACT_SERVER_SEND_GATHER_MAX_COUNT, ABSTRACT_SERVER_SEND_GATHER_MAX_SIZE);
+    buffers.reserve(m_send_in_flight);
+    for (size_t i = 0; i < m_send_in_flight; ++i)
+    {
+      buffers.emplace_back(m_send_que[i].data.data(), m_send_que[i].data.size());
+      size_now += m_send_que[i].data.size();
     }
 
-    //do_send_handler_stop( ptr , cb ); // empty function
-
-    return true;
+    MDEBUG("start_write() NOW SENDS: packet="<<size_now<<" B in "<<buffers.size()<<" slices, class "<<traffic_class_to_string(m_send_in_flight_priority)<<", from queue size="<<m_send_que.size());
+    if (speed_limit_is_enabled())
+      do_send_handler_write(m_send_que.front().data.data(), size_now); // (((H)))
 
-    CATCH_ENTRY_L0("connection<t_protocol_handler>::do_send_chunk", false);
-  } // do_send_chunk
+    reset_timer(get_default_timeout(), false);
+    async_write(buffers,
+      strand_.wrap(
+        std::bind(&connection<t_protocol_handler>::handle_write, connection<t_protocol_handler>::shared_from_this(), std::placeholders::_1, std::placeholders::_2)
+      )
+    );
+  }
   //---------------------------------------------------------------------------------
   template<class t_protocol_handler>
   boost::posix_time::milliseconds connection<t_protocol_handler>::get_default_timeout()
@@ -880,7 +902,7 @@ PRAGMA_WARNING_DISABLE_VS(4355)
 
                 // The single sleeping that is needed for correctly handling "out" speed throttling
 		if (speed_limit_is_enabled()) {
-			sleep_before_packet(cb, 1, 1);
+			sleep_before_packet(cb, 1, 1, m_send_in_flight_priority);
 		}
 
     bool do_shutdown = false;
@@ -891,7 +913,9 @@ PRAGMA_WARNING_DISABLE_VS(4355)
       return;
     }
 
-    m_send_que.pop_front();
+    CHECK_AND_ASSERT_MES(m_send_in_flight <= m_send_que.size(), void(), "Unexpected send queue size");
+    m_send_que.erase(m_send_que.begin(), m_send_que.begin() + m_send_in_flight);
+    m_send_in_flight = 0;
     if(m_send_que.empty())
     {
       if(boost::interprocess::ipcdetail::atomic_read32(&m_want_close_connection))
@@ -901,18 +925,9 @@ PRAGMA_WARNING_DISABLE_VS(4355)
     }else
     {
       //have more data to send
-		reset_timer(get_default_timeout(), false);
-		auto size_now = m_send_que.front().size();
-		MDEBUG("handle_write() NOW SENDS: packet="<<size_now<<" B" <<", from  queue size="<<m_send_que.size());
-		if (speed_limit_is_enabled())
-			do_send_handler_write_from_queue(e, m_send_que.front().size() , m_send_que.size()); // (((H)))
-		CHECK_AND_ASSERT_MES( size_now == m_send_que.front().size(), void(), "Unexpected queue size");
-		  async_write(boost::asio::buffer(m_send_que.front().data(), size_now) ,
-           strand_.wrap(
-            std::bind(&connection<t_protocol_handler>::handle_write, connection<t_protocol_handler>::shared_from_this(), std::placeholders::_1, std::placeholders::_2)
-			  )
-          );
-      //_dbg3("(normal)" << size_now);
+      if (speed_limit_is_enabled())
+        do_send_handler_write_from_queue(e, m_send_que.front().data.size() , m_send_que.size()); // (((H)))
+      start_write();
     }
     CRITICAL_REGION_END();
 
@@ -946,6 +961,7 @@ PRAGMA_WARNING_DISABLE_VS(4355)
     m_state(std::make_shared<typename connection<t_protocol_handler>::shared_state>()),
     m_io_service_local_instance(new worker()),
     io_service_(m_io_service_local_instance->io_service),
+    m_next_shard(0),
     acceptor_(io_service_),
     acceptor_ipv6(io_service_),
     default_remote(),
@@ -964,6 +980,7 @@ PRAGMA_WARNING_DISABLE_VS(4355)
   boosted_tcp_server<t_protocol_handler>::boosted_tcp_server(boost::asio::io_service& extarnal_io_service, t_connection_type connection_type) :
     m_state(std::make_shared<typename connection<t_protocol_handler>::shared_state>()),
     io_service_(extarnal_io_service),
+    m_next_shard(0),
     acceptor_(io_service_),
     acceptor_ipv6(io_service_),
     default_remote(),
@@ -1026,7 +1043,7 @@ PRAGMA_WARNING_DISABLE_VS(4355)
       boost::asio::ip::tcp::endpoint binded_endpoint = acceptor_.local_endpoint();
       m_port = binded_endpoint.port();
       MDEBUG("start accept (IPv4)");
-      new_connection_.reset(new connection<t_protocol_handler>(io_service_, m_state, m_connection_type, m_state->ssl_options().support));
+      new_connection_.reset(new connection<t_protocol_handler>(next_io_service(), m_state, m_connection_type, m_state->ssl_options().support));
       acceptor_.async_accept(new_connection_->socket(),
 	boost::bind(&boosted_tcp_server<t_protocol_handler>::handle_accept_ipv4, this,
 	boost::asio::placeholders::error));
@@ -1063,7 +1080,7 @@ PRAGMA_WARNING_DISABLE_VS(4355)
         boost::asio::ip::tcp::endpoint binded_endpoint = acceptor_ipv6.local_endpoint();
         m_port_ipv6 = binded_endpoint.port();
         MDEBUG("start accept (IPv6)");
-        new_connection_ipv6.reset(new connection<t_protocol_handler>(io_service_, m_state, m_connection_type, m_state->ssl_options().support));
+        new_connection_ipv6.reset(new connection<t_protocol_handler>(next_io_service(), m_state, m_connection_type, m_state->ssl_options().support));
         acceptor_ipv6.async_accept(new_connection_ipv6->socket(),
             boost::bind(&boosted_tcp_server<t_protocol_handler>::handle_accept_ipv6, this,
               boost::asio::placeholders::error));
@@ -1129,11 +1146,13 @@ POP_WARNINGS
     thread_name += boost::to_string(local_thr_index) + "]";
     MLOG_SET_THREAD_NAME(thread_name);
     //   _fact("Thread name: " << m_thread_name_prefix);
+    boost::asio::io_service& shard_io_service = get_shard_io_service(local_thr_index % get_io_service_shards_count());
+    current_thread_io_service() = &shard_io_service;
     while(!m_stop_signal_sent)
     {
       try
       {
-        io_service_.run();
+        shard_io_service.run();
         return true;
       }
       catch(const std::exception& ex)
@@ -1151,6 +1170,41 @@ POP_WARNINGS
   }
   //---------------------------------------------------------------------------------
   template<class t_protocol_handler>
+  void boosted_tcp_server<t_protocol_handler>::set_io_service_shards(size_t count)
+  {
+    CHECK_AND_ASSERT_THROW_MES(m_threads.empty(), "Cannot shard io_service of a running server");
+    m_shards.clear();
+    for (size_t i = 1; i < count; ++i)
+      m_shards.emplace_back(new worker());
+    m_next_shard = 0;
+    MINFO("Set " << get_io_service_shards_count() << " io_service shard(s) for " << m_thread_name_prefix << " server");
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  boost::asio::io_service& boosted_tcp_server<t_protocol_handler>::get_shard_io_service(size_t index)
+  {
+    return index == 0 ? io_service_ : m_shards[index - 1]->io_service;
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  boost::asio::io_service& boosted_tcp_server<t_protocol_handler>::next_io_service(bool skip_current)
+  {
+    if (m_shards.empty())
+      return io_service_;
+    boost::asio::io_service* service = &get_shard_io_service(m_next_shard++ % get_io_service_shards_count());
+    if (skip_current && service == current_thread_io_service())
+      service = &get_shard_io_service(m_next_shard++ % get_io_service_shards_count());
+    return *service;
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  boost::asio::io_service*& boosted_tcp_server<t_protocol_handler>::current_thread_io_service()
+  {
+    static thread_local boost::asio::io_service* service = nullptr;
+    return service;
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
   void boosted_tcp_server<t_protocol_handler>::set_threads_prefix(const std::string& prefix_name)
   {
     m_thread_name_prefix = prefix_name;
@@ -1171,6 +1225,13 @@ POP_WARNINGS
   bool boosted_tcp_server<t_protocol_handler>::run_server(size_t threads_count, bool wait, const boost::thread::attributes& attrs)
   {
     TRY_ENTRY();
+    // a blocking connect ties up its thread until another thread of the target shard completes it,
+    // so every shard needs a spare thread
+    if (m_shards.size() && threads_count < 2 * get_io_service_shards_count())
+    {
+      MWARNING("Running " << 2 * get_io_service_shards_count() << " threads instead of " << threads_count << ", two per io_service shard");
+      threads_count = 2 * get_io_service_shards_count();
+    }
     m_threads_count = threads_count;
     m_main_thread_id = boost::this_thread::get_id();
     MLOG_SET_THREAD_NAME("[SRV_MAIN]");
@@ -1270,6 +1331,8 @@ POP_WARNINGS
     connections_.clear();
     connections_mutex.unlock();
     io_service_.stop();
+    for (auto &shard: m_shards)
+      shard->io_service.stop();
     CATCH_ENTRY_L0("boosted_tcp_server<t_protocol_handler>::send_stop_signal()", void());
   }
   //---------------------------------------------------------------------------------
@@ -1316,7 +1379,7 @@ POP_WARNINGS
         (*current_new_connection)->setRpcStation(); // hopefully this is not needed actually
       }
       connection_ptr conn(std::move((*current_new_connection)));
-      (*current_new_connection).reset(new connection<t_protocol_handler>(io_service_, m_state, m_connection_type, conn->get_ssl_support()));
+      (*current_new_connection).reset(new connection<t_protocol_handler>(next_io_service(), m_state, m_connection_type, conn->get_ssl_support()));
       current_acceptor->async_accept((*current_new_connection)->socket(),
           boost::bind(accept_function_pointer, this,
             boost::asio::placeholders::error));
@@ -1351,7 +1414,7 @@ POP_WARNINGS
     assert(m_state != nullptr); // always set in constructor
     _erro("Some problems at accept: " << e.message() << ", connections_count = " << m_state->sock_count);
     misc_utils::sleep_no_w(100);
-    (*current_new_connection).reset(new connection<t_protocol_handler>(io_service_, m_state, m_connection_type, (*current_new_connection)->get_ssl_support()));
+    (*current_new_connection).reset(new connection<t_protocol_handler>(next_io_service(), m_state, m_connection_type, (*current_new_connection)->get_ssl_support()));
     current_acceptor->async_accept((*current_new_connection)->socket(),
         boost::bind(accept_function_pointer, this,
           boost::asio::placeholders::error));
@@ -1479,7 +1542,7 @@ POP_WARNINGS
   {
     TRY_ENTRY();
 
-    connection_ptr new_connection_l(new connection<t_protocol_handler>(io_service_, m_state, m_connection_type, ssl_support) );
+    connection_ptr new_connection_l(new connection<t_protocol_handler>(next_io_service(true), m_state, m_connection_type, ssl_support) );
     connections_mutex.lock();
     connections_.insert(new_connection_l);
     MDEBUG("connections_ size now " << connections_.size());
@@ -1604,7 +1667,7 @@ POP_WARNINGS
   bool boosted_tcp_server<t_protocol_handler>::connect_async(const std::string& adr, const std::string& port, uint32_t conn_timeout, const t_callback &cb, const std::string& bind_ip, epee::net_utils::ssl_support_t ssl_support)
   {
     TRY_ENTRY();
-    connection_ptr new_connection_l(new connection<t_protocol_handler>(io_service_, m_state, m_connection_type, ssl_support) );
+    connection_ptr new_connection_l(new connection<t_protocol_handler>(next_io_service(), m_state, m_connection_type, ssl_support) );
     connections_mutex.lock();
     connections_.insert(new_connection_l);
     MDEBUG("connections_ size now " << connections_.size());
@@ -1682,7 +1745,7 @@ POP_WARNINGS
       }
     }
 
-    std::shared_ptr<boost::asio::deadline_timer> sh_deadline(new boost::asio::deadline_timer(io_service_));
+    std::shared_ptr<boost::asio::deadline_timer> sh_deadline(new boost::asio::deadline_timer(GET_IO_SERVICE(sock_)));
     //start deadline
     sh_deadline->expires_from_now(boost::posix_time::milliseconds(conn_timeout));
     sh_deadline->async_wait([=](const boost::system::error_code& error)
@@ -109,7 +109,13 @@ class connection_basic { // not-templated base class for rapid developmet of som
     volatile uint32_t m_want_close_connection;
     std::atomic<bool> m_was_shutdown;
     critical_section m_send_que_lock;
-    std::deque<byte_slice> m_send_que;
+    struct send_slice
+    {
+      byte_slice data;
+      traffic_class priority;
+      bool message_start; // messages are queued whole, a higher priority one may only go before this
+    };
+    std::deque<send_slice> m_send_que; // ordered by priority, except for the slices being written
     volatile bool m_is_multithreaded;
     /// Strand to ensure the connection's handlers are not called concurrently.
     boost::asio::io_service::strand strand_;
@@ -184,9 +190,16 @@ class connection_basic { // not-templated base class for rapid developmet of som
 		static int get_tos_flag();
 
 		// handlers and sleep
-		void sleep_before_packet(size_t packet_size, int phase, int q_len); // execute a sleep ; phase is not really used now(?)
+		void sleep_before_packet(size_t packet_size, int phase, int q_len, traffic_class priority); // execute a sleep ; phase is not really used now(?)
 		static void save_limit_to_file(int limit); ///< for dr-monero
 		static double get_sleep_time(size_t cb);
+
+		// stats
+		static void get_traffic_class_stats(traffic_class priority, uint64_t &total_packets, uint64_t &total_bytes);
+
+		// send queue
+		static void queue_message(std::deque<send_slice> &que, size_t in_flight, std::vector<byte_slice> slices, traffic_class priority); ///< queues one message whole, before the first lower class message that is not being written
+		static size_t get_gather_count(const std::deque<send_slice> &que, size_t max_count, size_t max_size); ///< how many slices from the front one write takes, within the limits and never mixing classes
 };
 
 } // nameserver
@@ -53,6 +53,16 @@ namespace net_utils
 		tor = 3
 	};
 
+	//! Send priority of outgoing traffic, lower values are written and throttled first
+	enum class traffic_class : std::uint8_t
+	{
+		block = 0, // new blocks, fluffy or full
+		sync,      // responses to chain sync requests
+		tx,        // transaction relay
+		peers,     // peer exchange, and anything without a class
+		count
+	};
+
 	// implementations in src/net_utils_base.cpp
 
 	//! \return String name of zone or "invalid" on error.
@@ -60,6 +70,9 @@ namespace net_utils
 
 	//! \return `zone` enum of `value` or `zone::invalid` on error.
 	zone zone_from_string(boost::string_ref value) noexcept;
+
+	//! \return String name of traffic class or "invalid" on error.
+	const char* traffic_class_to_string(traffic_class value) noexcept;
 } // net_utils
 } // epee
 
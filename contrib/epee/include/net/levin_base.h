@@ -30,6 +30,7 @@
 #define _LEVIN_BASE_H_
 
 #include <cstdint>
+#include <string>
 
 #include "byte_stream.h"
 #include "net_utils_base.h"
@@ -80,6 +81,9 @@ namespace levin
 #define LEVIN_PACKET_RESPONSE		0x00000002
 #define LEVIN_PACKET_BEGIN		0x00000004
 #define LEVIN_PACKET_END		0x00000008
+#define LEVIN_PACKET_COMPRESSED		0x00000010 // body is a zstd frame of the original body
+
+#define LEVIN_COMPRESSION_MIN_SIZE	4096 // smaller bodies are always sent as-is
 
 
 #define LEVIN_PROTOCOL_VER_0         0
@@ -175,6 +179,24 @@ namespace levin
       Otherwise, a levin notification message OR 2+ levin fragment messages.
       Each message is `noise.size()` in length. */
   byte_slice make_fragmented_notify(const std::size_t noise_size, int command, message_writer message);
+
+  //! \return True if this build can compress and decompress levin bodies.
+  bool compression_available() noexcept;
+
+  /*! Compress the body of a complete levin `message`.
+
+      \param message Levin header followed by `m_cb` body bytes.
+      \return `nullptr` if compression is unavailable or does not shrink the
+        body. Otherwise, a copy of the header with `LEVIN_PACKET_COMPRESSED`
+        and the new `m_cb`, followed by the compressed body. */
+  byte_slice compress_message(span<const std::uint8_t> message);
+
+  /*! Decompress a body received with `LEVIN_PACKET_COMPRESSED`.
+
+      \param max_size Bodies that would decompress beyond this are rejected.
+      \return False if `body` is not a single zstd frame of at most
+        `max_size` bytes, or if compression is unavailable. */
+  bool decompress_body(span<const std::uint8_t> body, std::size_t max_size, std::string& out);
 }
 }
 
@@ -143,7 +143,27 @@ class async_protocol_handler
 
     message_writer::header head;
     std::memcpy(std::addressof(head), message.data(), sizeof(head));
-    if(!m_pservice_endpoint->do_send(std::move(message)))
+
+    // noise and fragments keep their sizes, zones that use them never negotiate compression.
+    // Only bulk commands are compressed, relayed blocks and txes go to many peers and would
+    // be compressed once per connection.
+    if (m_connection_context.levin_compression() && m_connection_context.compress_command(head.m_command) &&
+        head.m_cb >= LEVIN_COMPRESSION_MIN_SIZE &&
+        (head.m_flags & (LEVIN_PACKET_REQUEST | LEVIN_PACKET_RESPONSE)) && !(head.m_flags & LEVIN_PACKET_COMPRESSED))
+    {
+      const auto start = std::chrono::steady_clock::now();
+      byte_slice compressed = compress_message(to_span(message));
+      m_connection_context.m_compression.compress_us += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+      if (!compressed.empty())
+      {
+        m_connection_context.m_compression.raw_out += head.m_cb;
+        std::memcpy(std::addressof(head), compressed.data(), sizeof(head));
+        m_connection_context.m_compression.wire_out += head.m_cb;
+        message = std::move(compressed);
+      }
+    }
+
+    if(!m_pservice_endpoint->do_send_prioritized(std::move(message), m_connection_context.get_traffic_class(head.m_command)))
       return false;
 
     on_levin_traffic(m_connection_context, true, true, false, head.m_cb, head.m_command);
@@ -464,6 +484,28 @@ public:
           epee::span<const uint8_t> buff_to_invoke = m_cache_in_buffer.carve((std::string::size_type)m_current_head.m_cb);
           m_state = stream_state_head;
 
+          if (m_current_head.m_flags & LEVIN_PACKET_COMPRESSED)
+          {
+            if (!(m_current_head.m_flags & (LEVIN_PACKET_REQUEST | LEVIN_PACKET_RESPONSE)))
+            {
+              MERROR(m_connection_context << "Compressed levin fragment received, connection will be closed.");
+              return false;
+            }
+
+            const size_t max_bytes = std::min<size_t>(max_packet_size, m_connection_context.get_max_bytes(m_current_head.m_command));
+            const auto start = std::chrono::steady_clock::now();
+            if (!decompress_body(buff_to_invoke, max_bytes, temp))
+            {
+              MERROR(m_connection_context << "Failed to decompress levin body of " << m_current_head.m_cb << " bytes (limit " << max_bytes
+                << "), command " << m_current_head.m_command << ", connection will be closed.");
+              return false;
+            }
+            m_connection_context.m_compression.decompress_us += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+            m_connection_context.m_compression.wire_in += buff_to_invoke.size();
+            m_connection_context.m_compression.raw_in += temp.size();
+            buff_to_invoke = {reinterpret_cast<const uint8_t*>(temp.data()), temp.size()};
+          }
+
           // abstract_tcp_server2.h manages max bandwidth for a p2p link
           if (!(m_current_head.m_flags & (LEVIN_PACKET_REQUEST | LEVIN_PACKET_RESPONSE)))
           {
@@ -32,8 +32,10 @@
 #include <boost/uuid/uuid.hpp>
 #include <boost/asio/io_service.hpp>
 #include <boost/asio/ip/address_v6.hpp>
+#include <atomic>
 #include <typeinfo>
 #include <type_traits>
+#include <vector>
 #include "byte_slice.h"
 #include "enums.h"
 #include "misc_log_ex.h"
@@ -358,6 +360,22 @@ namespace net_utils
 	inline bool operator>=(const network_address& lhs, const network_address& rhs)
 	{ return !lhs.less(rhs); }
 
+	//! Totals for levin bodies that went over one connection compressed
+	struct compression_stats
+	{
+		compression_stats() noexcept
+		  : raw_out(0), wire_out(0), raw_in(0), wire_in(0), compress_us(0), decompress_us(0)
+		{}
+
+		// updated by whichever thread sends, so atomic
+		std::atomic<uint64_t> raw_out;        //!< body bytes before compression
+		std::atomic<uint64_t> wire_out;       //!< compressed body bytes sent
+		std::atomic<uint64_t> raw_in;         //!< body bytes after decompression
+		std::atomic<uint64_t> wire_in;        //!< compressed body bytes received
+		std::atomic<uint64_t> compress_us;    //!< time spent compressing, including attempts not sent
+		std::atomic<uint64_t> decompress_us;  //!< time spent decompressing
+	};
+
 	/************************************************************************/
 	/*                                                                      */
 	/************************************************************************/
@@ -376,6 +394,7 @@ namespace net_utils
     double m_current_speed_up;
     double m_max_speed_down;
     double m_max_speed_up;
+    compression_stats m_compression;
 
     connection_context_base(boost::uuids::uuid connection_id,
                             const network_address &remote_address, bool is_income, bool ssl,
@@ -422,6 +441,15 @@ namespace net_utils
       return *this;
     }
 
+    //! \return Send priority of levin `command`, protocols with their own classes hide this.
+    static constexpr traffic_class get_traffic_class(int command) noexcept { return traffic_class::peers; }
+
+    //! \return True if the peer accepts compressed levin bodies, protocols that negotiate it hide this.
+    static constexpr bool levin_compression() noexcept { return false; }
+
+    //! \return True if levin `command` carries bulk data worth compressing, protocols with such commands hide this.
+    static constexpr bool compress_command(int command) noexcept { return false; }
+
   private:
     template<class t_protocol_handler>
     friend class connection;
@@ -439,6 +467,21 @@ namespace net_utils
 	struct i_service_endpoint
 	{
 		virtual bool do_send(byte_slice message)=0;
+		//! Sends `message` ahead of queued messages of a lower `priority`, the default ignores `priority`
+		virtual bool do_send_prioritized(byte_slice message, traffic_class priority)
+		{
+			return do_send(std::move(message));
+		}
+		//! Sends `slices` back to back, the default sends them one at a time
+		virtual bool do_send_slices(std::vector<byte_slice> slices)
+		{
+			for (byte_slice& slice : slices)
+			{
+				if (!do_send(std::move(slice)))
+					return false;
+			}
+			return true;
+		}
     virtual bool close()=0;
     virtual bool send_done()=0;
     virtual bool call_run_once_service_io()=0;
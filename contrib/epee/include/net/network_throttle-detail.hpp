@@ -92,6 +92,7 @@ class network_throttle : public i_network_throttle {
 		virtual void calculate_times(size_t packet_size, calculate_times_struct &cts, bool dbg, double force_window) const; ///< MAIN LOGIC (see base class for info)
 
 		virtual network_time_seconds get_sleep_time_after_tick(size_t packet_size); ///< increase the timer if needed, and get the package size
+		virtual network_time_seconds get_sleep_time_for_share(size_t packet_size, double share); ///< ditto, for traffic allowed only `share` of the target speed
 		virtual network_time_seconds get_sleep_time(size_t packet_size) const; ///< gets the Delay (recommended Delay time) from calc. (not safe: only if time didnt change?) TODO
 
 		virtual size_t get_recommended_size_of_planned_transport() const; ///< what should be the size (bytes) of next data block to be transported
@@ -101,6 +102,7 @@ class network_throttle : public i_network_throttle {
 
 	private:
 		virtual network_time_seconds time_to_slot(network_time_seconds t) const { return std::floor( t ); } // convert exact time eg 13.7 to rounded time for slot number in history 13
+        void calculate_times_at(size_t packet_size, calculate_times_struct &cts, bool dbg, double force_window, network_speed_bps target) const; ///< calculate_times for a given target speed
         virtual void _handle_trafic_exact(size_t packet_size, size_t orginal_size);
         virtual void logger_handle_net(const std::string &filename, double time, size_t size);
 };
@@ -108,6 +108,7 @@ class network_throttle_manager {
     static boost::mutex m_lock_get_global_throttle_in;
     static boost::mutex m_lock_get_global_throttle_inreq;
     static boost::mutex m_lock_get_global_throttle_out;
+    static boost::mutex m_lock_get_class_throttle_out;
 
 		friend class connection_basic; // FRIEND - to directly access global throttle-s. !! REMEMBER TO USE LOCKS!
 		friend class connection_basic_pimpl; // ditto
@@ -116,6 +117,7 @@ class network_throttle_manager {
 		static i_network_throttle & get_global_throttle_in(); ///< singleton ; for friend class ; caller MUST use proper locks! like m_lock_get_global_throttle_in
 		static i_network_throttle & get_global_throttle_inreq(); ///< ditto ; use lock ... use m_lock_get_global_throttle_inreq obviously
 		static i_network_throttle & get_global_throttle_out(); ///< ditto ; use lock ... use m_lock_get_global_throttle_out obviously
+		static i_network_throttle & get_class_throttle_out(traffic_class priority); ///< the part of global-out sent in one traffic class, for stats ; use m_lock_get_class_throttle_out
 };
 
 
@@ -142,6 +144,7 @@ class i_network_throttle {
 
 		virtual network_time_seconds get_sleep_time(size_t packet_size) const =0; // gets the D (recommended Delay time) from calc
 		virtual network_time_seconds get_sleep_time_after_tick(size_t packet_size) =0; // ditto, but first tick the timer
+		virtual network_time_seconds get_sleep_time_for_share(size_t packet_size, double share) =0; // ditto, as if only `share` of the target speed was available
 
 		virtual size_t get_recommended_size_of_planned_transport() const =0; // what should be the recommended limit of data size that we can transport over current network_throttle in near future
 
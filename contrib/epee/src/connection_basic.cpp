@@ -226,8 +226,17 @@ int connection_basic::get_tos_flag() {
 	return connection_basic_pimpl::m_default_tos;
 }
 
-void connection_basic::sleep_before_packet(size_t packet_size, int phase,  int q_len) {
+void connection_basic::sleep_before_packet(size_t packet_size, int phase,  int q_len, traffic_class priority) {
+	// new blocks are never held back but still count against the limit. Lower classes wait until
+	// less of the limit is in use, so a burst of them leaves room for the classes above, but for
+	// one throttle window at most: after that they are limited like everything else, so a link
+	// kept full by sync traffic does not starve them (and the io thread they sleep on).
+	static const double share[] = { 1.0, 1.0, 0.85, 0.7 };
+	static_assert(sizeof(share) / sizeof(share[0]) == std::size_t(traffic_class::count), "missing traffic class share");
+	const std::size_t index = std::min(std::size_t(priority), std::size_t(traffic_class::peers));
+
 	double delay=0; // will be calculated
+	double waited=0, max_wait=-1;
 	do
 	{ // rate limiting
 		if (m_was_shutdown) { 
@@ -235,9 +244,22 @@ void connection_basic::sleep_before_packet(size_t packet_size, int phase,  int q
 			return;
 		}
 
+		if (priority == traffic_class::block)
+			break;
+
 		{ 
 			CRITICAL_REGION_LOCAL(	network_throttle_manager::m_lock_get_global_throttle_out );
-			delay = network_throttle_manager::get_global_throttle_out().get_sleep_time_after_tick( packet_size );
+			i_network_throttle &throttle = network_throttle_manager::get_global_throttle_out();
+			if (max_wait < 0)
+			{
+				calculate_times_struct cts = { 0, 0, 0, 0 };
+				throttle.calculate_times(0, cts, false, -1);
+				max_wait = std::max(cts.window, 1.0);
+			}
+			if (waited < max_wait)
+				delay = throttle.get_sleep_time_for_share( packet_size, share[index] );
+			else
+				delay = throttle.get_sleep_time_after_tick( packet_size );
 		}
 
 		delay *= 0.50;
@@ -245,6 +267,7 @@ void connection_basic::sleep_before_packet(size_t packet_size, int phase,  int q
             long int ms = (long int)(delay * 1000);
 			MTRACE("Sleeping in " << __FUNCTION__ << " for " << ms << " ms before packet_size="<<packet_size); // debug sleep
 			boost::this_thread::sleep(boost::posix_time::milliseconds( ms ) );
+			waited += delay;
 		}
 	} while(delay > 0);
 
@@ -253,7 +276,10 @@ void connection_basic::sleep_before_packet(size_t packet_size, int phase,  int q
 	  CRITICAL_REGION_LOCAL(	network_throttle_manager::m_lock_get_global_throttle_out );
 		network_throttle_manager::get_global_throttle_out().handle_trafic_exact( packet_size ); // increase counter - global
 	}
-
+	{
+	  CRITICAL_REGION_LOCAL(	network_throttle_manager::m_lock_get_class_throttle_out );
+		network_throttle_manager::get_class_throttle_out(priority).handle_trafic_exact( packet_size ); // increase counter - per class
+	}
 }
 
 void connection_basic::do_send_handler_write(const void* ptr , size_t cb ) {
@@ -272,6 +298,39 @@ void connection_basic::logger_handle_net_read(size_t size) { // network data rea
 void connection_basic::logger_handle_net_write(size_t size) {
 }
 
+void connection_basic::get_traffic_class_stats(traffic_class priority, uint64_t &total_packets, uint64_t &total_bytes) {
+	CRITICAL_REGION_LOCAL(network_throttle_manager::m_lock_get_class_throttle_out);
+	network_throttle_manager::get_class_throttle_out(priority).get_stats(total_packets, total_bytes);
+}
+
+void connection_basic::queue_message(std::deque<send_slice> &que, size_t in_flight, std::vector<byte_slice> slices, traffic_class priority) {
+	// the slices being written stay first, and a message only goes whole before another
+	auto position = que.begin() + std::min(in_flight, que.size());
+	while (position != que.end() && !(position->message_start && priority < position->priority))
+		++position;
+
+	std::vector<send_slice> message;
+	message.reserve(slices.size());
+	for (byte_slice &slice : slices)
+		message.push_back({std::move(slice), priority, message.empty()});
+	que.insert(position, std::make_move_iterator(message.begin()), std::make_move_iterator(message.end()));
+}
+
+size_t connection_basic::get_gather_count(const std::deque<send_slice> &que, size_t max_count, size_t max_size) {
+	if (que.empty())
+		return 0;
+	const traffic_class priority = que.front().priority;
+	size_t count = 0, size = 0;
+	for (const send_slice &slice : que)
+	{
+		if (count && (count >= max_count || size + slice.data.size() > max_size || slice.priority != priority))
+			break;
+		++count;
+		size += slice.data.size();
+	}
+	return count;
+}
+
 double connection_basic::get_sleep_time(size_t cb) {
 	CRITICAL_REGION_LOCAL(epee::net_utils::network_throttle_manager::network_throttle_manager::m_lock_get_global_throttle_out);
     auto t = network_throttle_manager::get_global_throttle_out().get_sleep_time(cb);
@@ -28,10 +28,35 @@
 
 #include "net/levin_base.h"
 
+#include <memory>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
 namespace epee
 {
 namespace levin
 {
+#ifdef HAVE_ZSTD
+namespace
+{
+  // favour speed, most of the gain on block and tx blobs is already there
+  constexpr const int compression_level = 1;
+
+  ZSTD_CCtx* get_zstd_cctx()
+  {
+    static thread_local std::unique_ptr<ZSTD_CCtx, size_t(*)(ZSTD_CCtx*)> cctx(ZSTD_createCCtx(), &ZSTD_freeCCtx);
+    return cctx.get();
+  }
+
+  ZSTD_DCtx* get_zstd_dctx()
+  {
+    static thread_local std::unique_ptr<ZSTD_DCtx, size_t(*)(ZSTD_DCtx*)> dctx(ZSTD_createDCtx(), &ZSTD_freeDCtx);
+    return dctx.get();
+  }
+}
+#endif
+
   message_writer::message_writer(const std::size_t reserve)
     : buffer()
   {
@@ -130,5 +155,72 @@ namespace levin
 
     return byte_slice{std::move(buffer)};
   }
+
+  bool compression_available() noexcept
+  {
+#ifdef HAVE_ZSTD
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  byte_slice compress_message(const span<const std::uint8_t> message)
+  {
+#ifdef HAVE_ZSTD
+    if (message.size() < sizeof(bucket_head2))
+      return nullptr;
+
+    bucket_head2 head;
+    std::memcpy(std::addressof(head), message.data(), sizeof(head));
+    const std::size_t body_size = message.size() - sizeof(head);
+    if (SWAP64LE(head.m_cb) != body_size)
+      return nullptr;
+
+    ZSTD_CCtx* const cctx = get_zstd_cctx();
+    if (!cctx)
+      return nullptr;
+
+    std::string buffer(sizeof(head) + ZSTD_compressBound(body_size), char(0));
+    const std::size_t res = ZSTD_compressCCtx(
+      cctx, std::addressof(buffer[sizeof(head)]), buffer.size() - sizeof(head), message.data() + sizeof(head), body_size, compression_level
+    );
+    if (ZSTD_isError(res))
+    {
+      MWARNING("Failed to compress levin body: " << ZSTD_getErrorName(res));
+      return nullptr;
+    }
+    if (res >= body_size)
+      return nullptr;
+
+    buffer.resize(sizeof(head) + res);
+    head.m_cb = SWAP64LE(res);
+    head.m_flags = SWAP32LE(SWAP32LE(head.m_flags) | LEVIN_PACKET_COMPRESSED);
+    std::memcpy(std::addressof(buffer[0]), std::addressof(head), sizeof(head));
+    return byte_slice{std::move(buffer)};
+#else
+    return nullptr;
+#endif
+  }
+
+  bool decompress_body(const span<const std::uint8_t> body, const std::size_t max_size, std::string& out)
+  {
+#ifdef HAVE_ZSTD
+    const unsigned long long content_size = ZSTD_getFrameContentSize(body.data(), body.size());
+    if (content_size == ZSTD_CONTENTSIZE_ERROR || content_size == ZSTD_CONTENTSIZE_UNKNOWN || content_size > max_size)
+      return false;
+
+    // output is capped to the first frame, so trailing frames or junk fail below
+    ZSTD_DCtx* const dctx = get_zstd_dctx();
+    if (!dctx)
+      return false;
+
+    out.resize(content_size);
+    const std::size_t res = ZSTD_decompressDCtx(dctx, out.empty() ? nullptr : std::addressof(out[0]), out.size(), body.data(), body.size());
+    return !ZSTD_isError(res) && res == content_size;
+#else
+    return false;
+#endif
+  }
 } // levin
 } // epee
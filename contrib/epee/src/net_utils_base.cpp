@@ -158,4 +158,22 @@ namespace epee { namespace net_utils
       return zone::tor;
     return zone::invalid;
   }
+
+  const char* traffic_class_to_string(const traffic_class value) noexcept
+  {
+    switch (value)
+    {
+    case traffic_class::block:
+      return "block";
+    case traffic_class::sync:
+      return "sync";
+    case traffic_class::tx:
+      return "tx";
+    case traffic_class::peers:
+      return "peers";
+    default:
+      break;
+    }
+    return "invalid";
+  }
 }}
@@ -204,6 +204,13 @@ network_time_seconds network_throttle::get_sleep_time_after_tick(size_t packet_s
 	return get_sleep_time(packet_size);
 }
 
+network_time_seconds network_throttle::get_sleep_time_for_share(size_t packet_size, double share) {
+	tick();
+	calculate_times_struct cts = { 0, 0, 0, 0};
+	calculate_times_at(packet_size, cts, false, m_window_size, m_target_speed * share);
+	return cts.delay;
+}
+
 void network_throttle::logger_handle_net(const std::string &filename, double time, size_t size) {
     static boost::mutex mutex;
 
@@ -230,6 +237,11 @@ network_time_seconds network_throttle::get_sleep_time(size_t packet_size) const
 
 // MAIN LOGIC:
 void network_throttle::calculate_times(size_t packet_size, calculate_times_struct &cts, bool dbg, double force_window) const 
+{
+	calculate_times_at(packet_size, cts, dbg, force_window, m_target_speed);
+}
+
+void network_throttle::calculate_times_at(size_t packet_size, calculate_times_struct &cts, bool dbg, double force_window, network_speed_bps target) const
 {
     const double the_window_size = std::max( (double)m_window_size ,
 		((force_window>0) ? force_window : m_window_size) 
@@ -255,7 +267,7 @@ void network_throttle::calculate_times(size_t packet_size, calculate_times_struc
 	const size_t E = Epast;
 	const size_t Enow = Epast + packet_size ; // including the data we're about to send now
 
-	const double M = m_target_speed; // max
+	const double M = target; // max
 	const double D1 = (Epast - M*cts.window) / M; // delay - how long to sleep to get back to target speed
 	const double D2 = (Enow  - M*cts.window) / M; // delay - how long to sleep to get back to target speed (including current packet)
 
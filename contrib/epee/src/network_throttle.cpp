@@ -70,6 +70,7 @@ namespace net_utils
 boost::mutex network_throttle_manager::m_lock_get_global_throttle_in;
 boost::mutex network_throttle_manager::m_lock_get_global_throttle_inreq;
 boost::mutex network_throttle_manager::m_lock_get_global_throttle_out;
+boost::mutex network_throttle_manager::m_lock_get_class_throttle_out;
 
 // ================================================================================================
 // methods:
@@ -92,6 +93,18 @@ i_network_throttle & network_throttle_manager::get_global_throttle_out() {
 }
 
 
+i_network_throttle & network_throttle_manager::get_class_throttle_out(traffic_class priority) {
+	static network_throttle obj_get_class_throttle_out[] = {
+		{"out/block", ">>> block-OUT", 10},
+		{"out/sync", ">>> sync-OUT", 10},
+		{"out/tx", ">>> tx-OUT", 10},
+		{"out/peers", ">>> peers-OUT", 10}
+	};
+	static_assert(sizeof(obj_get_class_throttle_out) / sizeof(obj_get_class_throttle_out[0]) == std::size_t(traffic_class::count), "missing traffic class throttle");
+	return obj_get_class_throttle_out[std::min(std::size_t(priority), std::size_t(traffic_class::peers))];
+}
+
+
 
 
 network_throttle_bw::network_throttle_bw(const std::string &name1) 
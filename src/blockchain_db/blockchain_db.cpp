@@ -35,6 +35,7 @@
 #include "ringct/rctOps.h"
 
 #include "lmdb/db_lmdb.h"
+#include "memory/db_memory.h"
 
 #undef MONERO_DEFAULT_LOG_CATEGORY
 #define MONERO_DEFAULT_LOG_CATEGORY "blockchain.db"
@@ -160,16 +161,56 @@ const command_line::arg_descriptor<bool> arg_db_salvage  = {
 , "Try to salvage a blockchain database if it seems corrupted"
 , false
 };
+const command_line::arg_descriptor<bool> arg_db_compression  = {
+  "db-compression"
+, "Compress prunable transaction data and large blocks in the database with zstd (converts an existing database once, and cannot be undone)"
+, false
+};
+const command_line::arg_descriptor<bool> arg_db_cold_segments  = {
+  "db-cold-segments"
+, "Move prunable transaction data older than the pruning tip out of the database, to append-only segment files next to it (cannot be undone)"
+, false
+};
+const command_line::arg_descriptor<bool> arg_db_sparse_map  = {
+  "db-sparse-map"
+, "Reserve address space for the whole disk when opening the database, so it does not need to pause all readers to grow its memory map"
+, false
+};
+const command_line::arg_descriptor<bool> arg_db_spent_key_index  = {
+  "db-spent-key-index"
+, "Keep an index from spent key images to the transaction spending them, so is_key_image_spent can report it (built once for existing blocks)"
+, false
+};
+
+const command_line::arg_descriptor<std::string> arg_db_type = {
+  "db-type"
+, "Specify database type, available: lmdb, memory (keeps the whole chain in RAM, saved to a bootstrap file on sync and exit)"
+, "lmdb"
+};
 
 BlockchainDB *new_db()
 {
   return new BlockchainLMDB();
 }
 
+BlockchainDB *new_db(const std::string& db_type)
+{
+  if (db_type == "lmdb")
+    return new BlockchainLMDB();
+  if (db_type == "memory")
+    return new BlockchainMemory();
+  return NULL;
+}
+
 void BlockchainDB::init_options(boost::program_options::options_description& desc)
 {
+  command_line::add_arg(desc, arg_db_type);
   command_line::add_arg(desc, arg_db_sync_mode);
   command_line::add_arg(desc, arg_db_salvage);
+  command_line::add_arg(desc, arg_db_compression);
+  command_line::add_arg(desc, arg_db_cold_segments);
+  command_line::add_arg(desc, arg_db_sparse_map);
+  command_line::add_arg(desc, arg_db_spent_key_index);
 }
 
 void BlockchainDB::pop_block()
@@ -207,7 +248,7 @@ void BlockchainDB::add_transaction(const crypto::hash& blk_hash, const std::pair
   {
     if (tx_input.type() == typeid(txin_to_key))
     {
-      add_spent_key(boost::get<txin_to_key>(tx_input).k_image);
+      add_spent_key(boost::get<txin_to_key>(tx_input).k_image, tx_hash);
     }
     else if (tx_input.type() == typeid(txin_gen))
     {
@@ -300,7 +341,9 @@ uint64_t BlockchainDB::add_block( const std::pair<block, blobdata>& blck
   TIME_MEASURE_FINISH(time1);
   time_add_block1 += time1;
 
-  m_hardfork->add(blk, prev_height);
+  // a db caught up from another one, like a compacted copy, has no tracker and takes its versions as they are
+  if (m_hardfork)
+    m_hardfork->add(blk, prev_height);
 
   ++num_calls;
 
@@ -1449,7 +1492,7 @@ void BlockchainDB::fixup()
         if (!has_key_image(ki))
         {
           LOG_PRINT_L1("Fixup: adding missing spent key " << ki);
-          add_spent_key(ki);
+          add_spent_key(ki, crypto::null_hash);
         }
       }
     }
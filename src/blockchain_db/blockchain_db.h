@@ -103,8 +103,13 @@ namespace cryptonote
 /** a pair of <transaction hash, output index>, typedef for convenience */
 typedef std::pair<crypto::hash, uint64_t> tx_out_index;
 
+extern const command_line::arg_descriptor<std::string> arg_db_type;
 extern const command_line::arg_descriptor<std::string> arg_db_sync_mode;
 extern const command_line::arg_descriptor<bool, false> arg_db_salvage;
+extern const command_line::arg_descriptor<bool> arg_db_compression;
+extern const command_line::arg_descriptor<bool> arg_db_cold_segments;
+extern const command_line::arg_descriptor<bool> arg_db_sparse_map;
+extern const command_line::arg_descriptor<bool> arg_db_spent_key_index;
 
 enum class relay_category : uint8_t
 {
@@ -148,6 +153,43 @@ struct alt_block_data_t
   uint64_t already_generated_coins;
 };
 
+/**
+ * @brief page and entry counts of one database table
+ */
+struct db_table_stats
+{
+  std::string name;
+  uint64_t entries;
+  uint32_t depth;
+  uint64_t branch_pages;
+  uint64_t leaf_pages;
+  uint64_t overflow_pages;
+  uint32_t page_size;
+};
+
+/**
+ * @brief call count and latency histogram of one database operation
+ */
+struct db_operation_stats
+{
+  std::string name;
+  uint64_t count;
+  uint64_t total_us;
+  uint64_t max_us;
+  std::vector<uint64_t> histogram; //!< bucket i counts calls taking [2^(i-1), 2^i) us, the first 0 us and the last anything longer
+};
+
+#pragma pack(push, 1)
+/**
+ * @brief where a blockchain pruning run stands, kept in the database between steps
+ */
+struct pruning_progress_t
+{
+  uint64_t next_height; //!< the first block height not visited yet
+  uint64_t end_height;  //!< the blockchain height when the run started, blocks added later go to the tip table
+};
+#pragma pack(pop)
+
 /**
  * @brief a struct containing txpool per transaction metadata
  */
@@ -193,6 +235,10 @@ struct txpool_tx_meta_t
 #define DBF_FASTEST    4
 #define DBF_RDONLY     8
 #define DBF_SALVAGE 0x10
+#define DBF_COMPRESS 0x20
+#define DBF_COLD_SEGMENTS 0x40
+#define DBF_SPARSE_MAP 0x80
+#define DBF_SPENT_KEY_INDEX 0x100
 
 /***********************************
  * Exception Definitions
@@ -511,9 +557,14 @@ private:
    * If any of this cannot be done, the subclass should throw the corresponding
    * subclass of DB_EXCEPTION
    *
+   * If the subclass keeps a key image to spending transaction index, it
+   * also records tx_hash and the height of the block being added. A null
+   * tx_hash means the spender is unknown and no index entry is written.
+   *
    * @param k_image the spent key image to store
+   * @param tx_hash the hash of the transaction spending the key image
    */
-  virtual void add_spent_key(const crypto::key_image& k_image) = 0;
+  virtual void add_spent_key(const crypto::key_image& k_image, const crypto::hash& tx_hash) = 0;
 
   /**
    * @brief remove a spent key
@@ -1512,6 +1563,31 @@ public:
    */
   virtual bool has_key_image(const crypto::key_image& img) const = 0;
 
+  /**
+   * @brief check which of a set of key images are stored as spent
+   *
+   * The images need not be sorted, the subclass should look them up in
+   * the order in which they are stored rather than one by one.
+   *
+   * @param images the key images to check for
+   * @param spent return-by-reference, true for each image which is present
+   */
+  virtual void has_key_images(const epee::span<const crypto::key_image> &images, std::vector<bool> &spent) const = 0;
+
+  /**
+   * @brief look up the transaction which spent a key image
+   *
+   * This needs the optional key image to spending transaction index
+   * (see --db-spent-key-index), and fails if it is not kept.
+   *
+   * @param img the key image to look up
+   * @param tx_hash return-by-reference the hash of the spending transaction
+   * @param height return-by-reference the height of the block containing it
+   *
+   * @return true if the spender was found, false otherwise
+   */
+  virtual bool get_key_image_spender(const crypto::key_image& img, crypto::hash &tx_hash, uint64_t &height) const = 0;
+
   /**
    * @brief add a txpool transaction
    *
@@ -1604,6 +1680,31 @@ public:
    */
   virtual bool prune_blockchain(uint32_t pruning_seed = 0) = 0;
 
+  /**
+   * @brief prunes the blockchain by a bounded number of blocks
+   *
+   * The first step records the pruning seed, and each step saves where it
+   * stopped in the same write transaction as the data it pruned, so a run
+   * can be interrupted at any time and resumes from there.
+   *
+   * @param pruning_seed the seed to use, 0 for default or for the one already recorded
+   * @param max_records the number of transactions after which to stop
+   * @param max_bytes the number of prunable bytes deleted after which to stop
+   * @param pruned_bytes return-by-reference the number of prunable bytes deleted
+   *
+   * @return true iff the pruning run is complete
+   */
+  virtual bool prune_blockchain_step(uint32_t pruning_seed, size_t max_records, uint64_t max_bytes, uint64_t &pruned_bytes) = 0;
+
+  /**
+   * @brief gets the progress of an unfinished pruning run
+   *
+   * @param progress return-by-reference the progress of the run
+   *
+   * @return true iff a pruning run was started and is not complete yet
+   */
+  virtual bool get_pruning_progress(pruning_progress_t &progress) const = 0;
+
   /**
    * @brief prunes recent blockchain changes as needed, iff pruning is enabled
    * @return success iff true
@@ -1616,6 +1717,52 @@ public:
    */
   virtual bool check_pruning() = 0;
 
+  /**
+   * @brief writes a compacted copy of the database, without the free space
+   *
+   * The copy is taken from a read snapshot, so this does not need writers
+   * to be held off, and blocks may be added while it runs.
+   *
+   * @return success iff true
+   */
+  virtual bool compact_start() = 0;
+
+  /**
+   * @brief brings the compacted copy up to date and swaps it in
+   *
+   * Blocks added or removed since compact_start are replayed into the copy,
+   * and the txpool and alternative blocks are copied over as they are.
+   * The caller must hold off all writers until this returns. The swap waits
+   * for the read transactions of all other threads to end, so no thread may
+   * wait for the caller while holding one.
+   *
+   * @return success iff true
+   */
+  virtual bool compact_finish() = 0;
+
+  /**
+   * @brief starts a trusted bulk load, for importing blocks known to be valid
+   *
+   * Until bulk_load_finish, the hash keyed indexes (block heights, tx
+   * indices and spent key images) are not updated as blocks are added, but
+   * spooled to sorted runs, and duplicates are only detected at the end.
+   * Lookups by hash do not see the blocks added in the meantime, and blocks
+   * cannot be popped. Must not be called while a write txn is active.
+   *
+   * @return true if the bulk load was started, false if not supported
+   */
+  virtual bool bulk_load_start() = 0;
+
+  /**
+   * @brief builds the indexes deferred since bulk_load_start, in one sorted append pass
+   *
+   * Entries for blocks which were not committed are dropped. Must not be
+   * called while a write txn is active. Closing the db does this too.
+   *
+   * If a duplicate block, tx or key image is found, throw DB_ERROR
+   */
+  virtual void bulk_load_finish() = 0;
+
   /**
    * @brief get the max block size
    */
@@ -1827,6 +1974,21 @@ public:
    */
   virtual bool is_read_only() const = 0;
 
+  /**
+   * @brief gets per table statistics and per operation latencies
+   *
+   * @param tables return-by-reference the page and entry counts of each table
+   * @param operations return-by-reference the latencies of the instrumented operations
+   *
+   * @return false if the backend does not keep statistics, true otherwise
+   */
+  virtual bool get_db_stats(std::vector<db_table_stats> &tables, std::vector<db_operation_stats> &operations) const = 0;
+
+  /**
+   * @brief clears the operation latencies, so the next ones cover a new period
+   */
+  virtual void reset_db_stats() = 0;
+
   /**
    * @brief get disk space requirements
    *
@@ -1903,6 +2065,7 @@ class db_rtxn_guard: public db_txn_guard { public: db_rtxn_guard(BlockchainDB *d
 class db_wtxn_guard: public db_txn_guard { public: db_wtxn_guard(BlockchainDB *db): db_txn_guard(db, false) {} };
 
 BlockchainDB *new_db();
+BlockchainDB *new_db(const std::string& db_type);
 
 }  // namespace cryptonote
 
@@ -29,11 +29,14 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
 #include <fcntl.h>
 #endif
 
 #include "db_lmdb.h"
 
+#include <list>
+#include <unordered_map>
 #include <boost/filesystem.hpp>
 #include <boost/format.hpp>
 #include <boost/circular_buffer.hpp>
@@ -46,6 +49,11 @@
 #include "profile_tools.h"
 #include "ringct/rctOps.h"
 
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#include <zdict.h>
+#endif
+
 #undef MONERO_DEFAULT_LOG_CATEGORY
 #define MONERO_DEFAULT_LOG_CATEGORY "blockchain.db.lmdb"
 
@@ -195,6 +203,7 @@ namespace
  * txs_prunable     txn ID       prunable txn blob
  * txs_prunable_hash txn ID      prunable txn hash
  * txs_prunable_tip txn ID       height
+ * txs_prunable_cold txn ID      {segment, size, offset}
  * tx_indices       txn hash     {txn ID, metadata}
  * tx_outputs       txn ID       [txn amount output indices]
  *
@@ -202,6 +211,7 @@ namespace
  * output_amounts   amount       [{amount output index, metadata}...]
  *
  * spent_keys       input hash   -
+ * spent_key_txs    input hash   {txn hash, height}
  *
  * txpool_meta      txn hash     txn metadata
  * txpool_blob      txn hash     txn blob
@@ -215,6 +225,22 @@ namespace
  * (DUPFIXED saves 8 bytes per record.)
  *
  * The output_amounts table doesn't use a dummy key, but uses DUPSORT.
+ *
+ * When the "compression" property is set, each txs_prunable record starts
+ * with a prunable_compression byte, and blocks larger than
+ * COMPRESSED_BLOCK_MIN_SIZE may be stored as COMPRESSED_BLOCK_MARKER
+ * followed by a zstd frame. Blocks whose blob starts with that byte are
+ * always stored that way, whatever their size.
+ *
+ * When the "cold_next_tx_id" property is set, txs_prunable records below
+ * that tx id have been moved to segment files, and txs_prunable_cold has
+ * their locations. The records are moved as they are, so compressed ones
+ * stay compressed.
+ *
+ * When the "spent_key_index_height" property is set, spent_key_txs has
+ * the spending tx of each key image in blocks below that height, and of
+ * every key image added after it reached the chain height (it then holds
+ * SPENT_KEY_INDEX_COMPLETE). Key images added by fixup() have no entry.
  */
 const char* const LMDB_BLOCKS = "blocks";
 const char* const LMDB_BLOCK_HEIGHTS = "block_heights";
@@ -225,12 +251,14 @@ const char* const LMDB_TXS_PRUNED = "txs_pruned";
 const char* const LMDB_TXS_PRUNABLE = "txs_prunable";
 const char* const LMDB_TXS_PRUNABLE_HASH = "txs_prunable_hash";
 const char* const LMDB_TXS_PRUNABLE_TIP = "txs_prunable_tip";
+const char* const LMDB_TXS_PRUNABLE_COLD = "txs_prunable_cold";
 const char* const LMDB_TX_INDICES = "tx_indices";
 const char* const LMDB_TX_OUTPUTS = "tx_outputs";
 
 const char* const LMDB_OUTPUT_TXS = "output_txs";
 const char* const LMDB_OUTPUT_AMOUNTS = "output_amounts";
 const char* const LMDB_SPENT_KEYS = "spent_keys";
+const char* const LMDB_SPENT_KEY_TXS = "spent_key_txs";
 
 const char* const LMDB_TXPOOL_META = "txpool_meta";
 const char* const LMDB_TXPOOL_BLOB = "txpool_blob";
@@ -257,6 +285,135 @@ inline void lmdb_db_open(MDB_txn* txn, const char* name, int flags, MDB_dbi& dbi
     throw0(cryptonote::DB_OPEN_FAILURE((lmdb_error(error_string + " : ", res) + std::string(" - you may want to start with --db-salvage")).c_str()));
 }
 
+// value of the "compression" property
+const uint32_t COMPRESSION_ZSTD = 1;
+
+enum prunable_compression: uint8_t
+{
+  PRUNABLE_RAW = 0,
+  PRUNABLE_ZSTD = 1,
+  PRUNABLE_ZSTD_DICT = 2, // zstd with the dictionary in the "compression_dict" property
+};
+
+// a serialized block starts with its major version varint, whose first byte is 0xff
+// only for version 255, so such a block is always stored compressed (see compress_block)
+const uint8_t COMPRESSED_BLOCK_MARKER = 0xff;
+const size_t COMPRESSED_BLOCK_MIN_SIZE = 4096;
+
+const int COMPRESSION_LEVEL = 3;
+const size_t COMPRESSION_DICT_SIZE = 110 * 1024;
+const size_t COMPRESSION_DICT_MIN_SAMPLES = 1000;
+const size_t COMPRESSION_DICT_MAX_SAMPLES = 50000;
+const size_t COMPRESSION_DICT_MAX_SAMPLE_BYTES = 100 * COMPRESSION_DICT_SIZE;
+
+const size_t COLD_PRUNABLE_BATCH_SIZE = 1000;
+const char* const COLD_SEGMENTS_FOLDER = "segments";
+
+const size_t SPENT_KEY_INDEX_BATCH_SIZE = 1000;
+const uint64_t SPENT_KEY_INDEX_COMPLETE = std::numeric_limits<uint64_t>::max();
+
+const char* const BULK_LOAD_FOLDER = "bulk-load";
+const uint64_t BULK_LOAD_COMMIT_INTERVAL = 1000000;
+
+// the compacted copy is built next to the db folder, since open() refuses a
+// folder whose parent holds lmdb files
+std::string get_compact_folder(std::string folder)
+{
+  while (folder.size() > 1 && (folder.back() == '/' || folder.back() == '\\'))
+    folder.pop_back();
+  return folder + "-compact";
+}
+const char* const PRE_COMPACT_FILENAME = "data.mdb.old";
+
+const size_t BLOCK_CACHE_BLOCKS = 1024;
+const size_t BLOCK_CACHE_INFOS = 8192;
+
+#ifndef _WIN32
+const uint64_t SPARSE_MAPSIZE_MAX = 1ull << 44;
+
+// a sparse map covers the whole disk the db is on, so it cannot fill up while
+// there is space to write to, within the address space the process may map
+uint64_t get_sparse_mapsize(const std::string &folder)
+{
+  uint64_t size = SPARSE_MAPSIZE_MAX;
+  struct rlimit rl;
+  if (getrlimit(RLIMIT_AS, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY)
+    size = std::min<uint64_t>(size, rl.rlim_cur / 2);
+  boost::system::error_code ec;
+  const boost::filesystem::space_info si = boost::filesystem::space(folder, ec);
+  if (!ec)
+    size = std::min<uint64_t>(size, si.capacity);
+  return size & ~((1ull << 20) - 1);
+}
+#endif
+
+// replaces the contents of a table with those of the same table in another env
+void copy_table(MDB_txn *src_txn, MDB_dbi src_dbi, MDB_txn *dst_txn, MDB_dbi dst_dbi, const char *name)
+{
+  int result = mdb_drop(dst_txn, dst_dbi, 0);
+  if (result)
+    throw0(cryptonote::DB_ERROR(lmdb_error(std::string("Failed to empty ") + name + ": ", result).c_str()));
+  MDB_cursor *cursor;
+  result = mdb_cursor_open(src_txn, src_dbi, &cursor);
+  if (result)
+    throw0(cryptonote::DB_ERROR(lmdb_error(std::string("Failed to open a cursor for ") + name + ": ", result).c_str()));
+  MDB_val k, v;
+  MDB_cursor_op op = MDB_FIRST;
+  while ((result = mdb_cursor_get(cursor, &k, &v, op)) == 0)
+  {
+    op = MDB_NEXT;
+    // same comparator on both sides, so records come in order
+    if ((result = mdb_put(dst_txn, dst_dbi, &k, &v, MDB_APPEND)))
+      break;
+  }
+  mdb_cursor_close(cursor);
+  if (result != MDB_NOTFOUND)
+    throw0(cryptonote::DB_ERROR(lmdb_error(std::string("Failed to copy ") + name + ": ", result).c_str()));
+}
+
+#ifdef HAVE_ZSTD
+ZSTD_DCtx *get_zstd_dctx()
+{
+  static thread_local std::unique_ptr<ZSTD_DCtx, size_t(*)(ZSTD_DCtx*)> dctx(ZSTD_createDCtx(), &ZSTD_freeDCtx);
+  if (!dctx)
+    throw0(cryptonote::DB_ERROR("Failed to create zstd decompression context"));
+  return dctx.get();
+}
+
+// appends the decompressed frame to out
+void zstd_decompress(const uint8_t *src, size_t size, const ZSTD_DDict *ddict, cryptonote::blobdata &out)
+{
+  const unsigned long long content_size = ZSTD_getFrameContentSize(src, size);
+  if (content_size == ZSTD_CONTENTSIZE_ERROR || content_size == ZSTD_CONTENTSIZE_UNKNOWN)
+    throw0(cryptonote::DB_ERROR("Invalid compressed record in the db"));
+  const size_t offset = out.size();
+  out.resize(offset + content_size);
+  ZSTD_DCtx *dctx = get_zstd_dctx();
+  const size_t res = ddict ?
+      ZSTD_decompress_usingDDict(dctx, &out[offset], content_size, src, size, ddict) :
+      ZSTD_decompressDCtx(dctx, &out[offset], content_size, src, size);
+  if (ZSTD_isError(res) || res != content_size)
+    throw0(cryptonote::DB_ERROR((std::string("Failed to decompress record from the db: ") + (ZSTD_isError(res) ? ZSTD_getErrorName(res) : "size mismatch")).c_str()));
+}
+
+// writes header followed by the compressed frame to out, returns false if it does not save space
+bool zstd_compress(ZSTD_CCtx *cctx, const ZSTD_CDict *cdict, uint8_t header, const uint8_t *src, size_t size, std::string &out, bool keep_larger = false)
+{
+  out.resize(1 + ZSTD_compressBound(size));
+  out[0] = header;
+  const size_t res = cdict ?
+      ZSTD_compress_usingCDict(cctx, &out[1], out.size() - 1, src, size, cdict) :
+      ZSTD_compressCCtx(cctx, &out[1], out.size() - 1, src, size, COMPRESSION_LEVEL);
+  if (ZSTD_isError(res))
+  {
+    MWARNING("Failed to compress record: " << ZSTD_getErrorName(res));
+    return false;
+  }
+  out.resize(1 + res);
+  return res < size || keep_larger;
+}
+#endif
+
 
 }  // anonymous namespace
 
@@ -281,9 +438,54 @@ inline void lmdb_db_open(MDB_txn* txn, const char* name, int flags, MDB_dbi& dbi
 	  m_tinfo->m_ti_rflags.m_rf_ ## name = true; \
 	}
 
+// the txs_prunable_cold table is only opened when segment storage is enabled
+#define RCURSOR_COLD_PRUNABLE() \
+	MDB_cursor *cur_txs_prunable_cold = NULL; \
+	if (m_cold_segments) { \
+	  RCURSOR(txs_prunable_cold); \
+	  cur_txs_prunable_cold = m_cur_txs_prunable_cold; \
+	}
+
 namespace cryptonote
 {
 
+struct BlockchainLMDB::compression_context
+{
+#ifdef HAVE_ZSTD
+  compression_context(): cctx(ZSTD_createCCtx()), cdict(NULL), ddict(NULL)
+  {
+    if (!cctx)
+      throw0(DB_ERROR("Failed to create zstd compression context"));
+  }
+  ~compression_context()
+  {
+    clear_dictionary();
+    ZSTD_freeCCtx(cctx);
+  }
+
+  void set_dictionary(const void *data, size_t size)
+  {
+    clear_dictionary();
+    cdict = ZSTD_createCDict(data, size, COMPRESSION_LEVEL);
+    ddict = ZSTD_createDDict(data, size);
+    if (!cdict || !ddict)
+      throw0(DB_ERROR("Failed to load compression dictionary"));
+  }
+
+  void clear_dictionary()
+  {
+    ZSTD_freeCDict(cdict);
+    ZSTD_freeDDict(ddict);
+    cdict = NULL;
+    ddict = NULL;
+  }
+
+  ZSTD_CCtx *cctx; // only used by the writer
+  ZSTD_CDict *cdict;
+  ZSTD_DDict *ddict;
+#endif
+};
+
 typedef struct mdb_block_info_1
 {
   uint64_t bi_height;
@@ -355,40 +557,230 @@ typedef struct outtx {
     uint64_t local_index;
 } outtx;
 
+// parsed blocks and block_info records of recently read heights. Records read
+// from a snapshot older than the last block removal are neither returned nor
+// kept, as such a snapshot may still hold a block which has since been replaced.
+struct BlockchainLMDB::block_cache
+{
+  template<typename T>
+  class height_lru
+  {
+  public:
+    height_lru(size_t capacity): m_capacity(capacity) {}
+
+    bool get(uint64_t height, T &t)
+    {
+      const auto i = m_index.find(height);
+      if (i == m_index.end())
+        return false;
+      m_entries.splice(m_entries.begin(), m_entries, i->second);
+      t = i->second->second;
+      return true;
+    }
+
+    void put(uint64_t height, const T &t)
+    {
+      const auto i = m_index.find(height);
+      if (i != m_index.end())
+      {
+        m_entries.splice(m_entries.begin(), m_entries, i->second);
+        return;
+      }
+      m_entries.emplace_front(height, t);
+      m_index[height] = m_entries.begin();
+      if (m_index.size() > m_capacity)
+      {
+        m_index.erase(m_entries.back().first);
+        m_entries.pop_back();
+      }
+    }
+
+    void erase_from(uint64_t height)
+    {
+      for (auto i = m_entries.begin(); i != m_entries.end(); )
+      {
+        if (i->first >= height)
+        {
+          m_index.erase(i->first);
+          i = m_entries.erase(i);
+        }
+        else
+          ++i;
+      }
+    }
+
+    void clear()
+    {
+      m_index.clear();
+      m_entries.clear();
+    }
+
+  private:
+    typedef std::list<std::pair<uint64_t, T>> entries_t;
+    const size_t m_capacity;
+    entries_t m_entries; // most recently used first
+    std::unordered_map<uint64_t, typename entries_t::iterator> m_index;
+  };
+
+  block_cache(): blocks(BLOCK_CACHE_BLOCKS), infos(BLOCK_CACHE_INFOS), min_txnid(0) {}
+
+  bool get_block(MDB_txn *txn, uint64_t height, block &b)
+  {
+    CRITICAL_REGION_LOCAL(lock);
+    return mdb_txn_id(txn) >= min_txnid && blocks.get(height, b);
+  }
+
+  bool get_info(MDB_txn *txn, uint64_t height, mdb_block_info &bi)
+  {
+    CRITICAL_REGION_LOCAL(lock);
+    return mdb_txn_id(txn) >= min_txnid && infos.get(height, bi);
+  }
+
+  // what a write txn sees may yet be aborted, so only read txns fill the cache
+  void put_block(MDB_txn *txn, bool write_txn, uint64_t height, const block &b)
+  {
+    if (write_txn)
+      return;
+    CRITICAL_REGION_LOCAL(lock);
+    if (mdb_txn_id(txn) >= min_txnid)
+      blocks.put(height, b);
+  }
+
+  void put_info(MDB_txn *txn, bool write_txn, uint64_t height, const mdb_block_info &bi)
+  {
+    if (write_txn)
+      return;
+    CRITICAL_REGION_LOCAL(lock);
+    if (mdb_txn_id(txn) >= min_txnid)
+      infos.put(height, bi);
+  }
+
+  // called by the write txn removing the blocks from height on, readers see
+  // the removal from the snapshot it commits
+  void invalidate(MDB_txn *write_txn, uint64_t height)
+  {
+    CRITICAL_REGION_LOCAL(lock);
+    min_txnid = std::max<uint64_t>(min_txnid, mdb_txn_id(write_txn));
+    blocks.erase_from(height);
+    infos.erase_from(height);
+  }
+
+  void clear()
+  {
+    CRITICAL_REGION_LOCAL(lock);
+    blocks.clear();
+    infos.clear();
+    min_txnid = 0;
+  }
+
+  epee::critical_section lock;
+  height_lru<block> blocks;
+  height_lru<mdb_block_info> infos;
+  uint64_t min_txnid;
+};
+
+// the records spooled for the hash keyed tables carry the height of their
+// block, so that those of blocks which were not committed can be dropped
+struct BlockchainLMDB::bulk_load_state
+{
+  typedef struct spooled_key_image {
+    crypto::key_image k_image;
+    uint64_t height;
+  } spooled_key_image;
+
+  static int compare_hash(const void *a, const void *b)
+  {
+    const MDB_val va = {sizeof(crypto::hash), (void*)a}, vb = {sizeof(crypto::hash), (void*)b};
+    return compare_hash32(&va, &vb);
+  }
+
+  bulk_load_state(const std::string &folder):
+    folder(folder),
+    block_heights(folder, LMDB_BLOCK_HEIGHTS, sizeof(blk_height), compare_hash),
+    tx_indices(folder, LMDB_TX_INDICES, sizeof(txindex), compare_hash),
+    spent_keys(folder, LMDB_SPENT_KEYS, sizeof(spooled_key_image), compare_hash),
+    spent_key_txs(folder, LMDB_SPENT_KEY_TXS, sizeof(spent_key_tx), compare_hash)
+  {}
+
+  // drop the records of blocks at or above height, which an aborted txn did not commit
+  void drop_from(uint64_t height)
+  {
+    block_heights.retain([height](const void *r) { return ((const blk_height*)r)->bh_height < height; });
+    tx_indices.retain([height](const void *r) { return ((const txindex*)r)->data.block_id < height; });
+    spent_keys.retain([height](const void *r) { return ((const spooled_key_image*)r)->height < height; });
+    spent_key_txs.retain([height](const void *r) { return ((const spent_key_tx*)r)->height < height; });
+  }
+
+  std::string folder;
+  sorted_spool block_heights;
+  sorted_spool tx_indices;
+  sorted_spool spent_keys;
+  sorted_spool spent_key_txs; // only used with the spent key index
+};
+
 std::atomic<uint64_t> mdb_txn_safe::num_active_txns{0};
 std::atomic_flag mdb_txn_safe::creation_gate = ATOMIC_FLAG_INIT;
+thread_local unsigned int mdb_txn_safe::creation_gate_holds = 0;
 
 mdb_threadinfo::~mdb_threadinfo()
+{
+  if (m_ti_rflags.m_rf_txn)
+    mdb_txn_safe::remove_active_txn();
+  if (!m_ti_set)
+    return;
+  // the env's close frees the txns of the infos still in the set, so stay in it until done
+  boost::lock_guard<boost::mutex> lock(m_ti_set->lock);
+  m_ti_set->infos.erase(this);
+  // the env this txn was made on was closed since, along with its reader table
+  if (m_ti_env_generation && *m_ti_env_generation != m_ti_generation)
+    return;
+  free_rtxn();
+}
+
+void mdb_threadinfo::end_rtxn()
+{
+  if (m_ti_rflags.m_rf_txn)
+  {
+    if (!m_ti_env_generation || *m_ti_env_generation == m_ti_generation)
+      mdb_txn_reset(m_ti_rtxn);
+    mdb_txn_safe::remove_active_txn();
+  }
+  memset(&m_ti_rflags, 0, sizeof(m_ti_rflags));
+}
+
+void mdb_threadinfo::free_rtxn()
 {
   MDB_cursor **cur = &m_ti_rcursors.m_txc_blocks;
   unsigned i;
   for (i=0; i<sizeof(mdb_txn_cursors)/sizeof(MDB_cursor *); i++)
+  {
     if (cur[i])
       mdb_cursor_close(cur[i]);
+    cur[i] = NULL;
+  }
   if (m_ti_rtxn)
     mdb_txn_abort(m_ti_rtxn);
+  m_ti_rtxn = NULL;
 }
 
 mdb_txn_safe::mdb_txn_safe(const bool check) : m_txn(NULL), m_tinfo(NULL), m_check(check)
 {
   if (check)
-  {
-    while (creation_gate.test_and_set());
-    num_active_txns++;
-    creation_gate.clear();
-  }
+    add_active_txn();
 }
 
 mdb_txn_safe::~mdb_txn_safe()
 {
+  // a thread's read txn, counted when it was started
+  if (m_tinfo != nullptr)
+  {
+    m_tinfo->end_rtxn();
+    return;
+  }
   if (!m_check)
     return;
   LOG_PRINT_L3("mdb_txn_safe: destructor");
-  if (m_tinfo != nullptr)
-  {
-    mdb_txn_reset(m_tinfo->m_ti_rtxn);
-    memset(&m_tinfo->m_ti_rflags, 0, sizeof(m_tinfo->m_ti_rflags));
-  } else if (m_txn != nullptr)
+  if (m_txn != nullptr)
   {
     if (m_batch_txn) // this is a batch txn and should have been handled before this point for safety
     {
@@ -449,9 +841,27 @@ uint64_t mdb_txn_safe::num_active_tx() const
   return num_active_txns;
 }
 
-void mdb_txn_safe::prevent_new_txns()
+void mdb_txn_safe::add_active_txn()
 {
+  if (creation_gate_holds > 0)
+  {
+    num_active_txns++;
+    return;
+  }
   while (creation_gate.test_and_set());
+  num_active_txns++;
+  creation_gate.clear();
+}
+
+void mdb_txn_safe::remove_active_txn()
+{
+  num_active_txns--;
+}
+
+void mdb_txn_safe::prevent_new_txns()
+{
+  if (creation_gate_holds++ == 0)
+    while (creation_gate.test_and_set());
 }
 
 void mdb_txn_safe::wait_no_active_txns()
@@ -461,7 +871,41 @@ void mdb_txn_safe::wait_no_active_txns()
 
 void mdb_txn_safe::allow_new_txns()
 {
-  creation_gate.clear();
+  if (creation_gate_holds > 0 && --creation_gate_holds == 0)
+    creation_gate.clear();
+}
+
+void mdb_op_latency::add(uint64_t us)
+{
+  ++count;
+  total_us += us;
+  uint64_t max = max_us;
+  while (us > max && !max_us.compare_exchange_weak(max, us));
+  size_t bucket = 0;
+  while (us && bucket < BUCKETS - 1)
+  {
+    us >>= 1;
+    ++bucket;
+  }
+  ++buckets[bucket];
+}
+
+void mdb_op_latency::reset()
+{
+  count = 0;
+  total_us = 0;
+  max_us = 0;
+  for (auto &b: buckets)
+    b = 0;
+}
+
+mdb_op_timer::mdb_op_timer(mdb_op_latency &op): m_op(op), m_start_ns(epee::misc_utils::get_ns_count())
+{
+}
+
+mdb_op_timer::~mdb_op_timer()
+{
+  m_op.add((epee::misc_utils::get_ns_count() - m_start_ns) / 1000);
 }
 
 void lmdb_resized(MDB_env *env)
@@ -556,9 +1000,18 @@ void BlockchainLMDB::do_resize(uint64_t increase_size)
   if (increase_size > 0)
     new_mapsize = mei.me_mapsize + increase_size;
 
+#ifndef _WIN32
+  // a sparse map only runs out when the disk under it grew, so make that rare,
+  // within the same limits as when it was opened
+  if (m_sparse_map)
+    new_mapsize = std::max<uint64_t>(new_mapsize, std::min<uint64_t>(mei.me_mapsize * 2, get_sparse_mapsize(m_folder)));
+#endif
+
   new_mapsize += (new_mapsize % mst.ms_psize);
 
+  const uint64_t stall_start = epee::misc_utils::get_tick_count();
   mdb_txn_safe::prevent_new_txns();
+  epee::misc_utils::auto_scope_leave_caller gate = epee::misc_utils::create_scope_leave_handler([](){ mdb_txn_safe::allow_new_txns(); });
 
   if (m_write_txn != nullptr)
   {
@@ -572,11 +1025,15 @@ void BlockchainLMDB::do_resize(uint64_t increase_size)
     }
   }
 
+  // this thread's read txn is counted too, and would never end
+  if (m_tinfo.get())
+    m_tinfo->end_rtxn();
   mdb_txn_safe::wait_no_active_txns();
 
   int result = mdb_env_set_mapsize(m_env, new_mapsize);
   if (result)
     throw0(DB_ERROR(lmdb_error("Failed to set new mapsize: ", result).c_str()));
+  MINFO("Transactions were held off for " << epee::misc_utils::get_tick_count() - stall_start << " ms by the resize");
 
   boost::filesystem::path path(m_folder);
   boost::filesystem::space_info si = boost::filesystem::space(path);
@@ -593,8 +1050,6 @@ void BlockchainLMDB::do_resize(uint64_t increase_size)
   {
     MGINFO("LMDB Mapsize increased." << "  Old: " << mei.me_mapsize / (1024 * 1024) << "MiB" << ", New: " << new_mapsize / (1024 * 1024) << "MiB");
   }
-
-  mdb_txn_safe::allow_new_txns();
 }
 
 // threshold_size is used for batch transactions
@@ -763,10 +1218,16 @@ void BlockchainLMDB::add_block(const block& blk, size_t block_weight, uint64_t l
   CURSOR(block_heights)
   blk_height bh = {blk_hash, m_height};
   MDB_val_set(val_h, bh);
-  if (mdb_cursor_get(m_cur_block_heights, (MDB_val *)&zerokval, &val_h, MDB_GET_BOTH) == 0)
+  if (m_bulk_load)
+  {
+    // block_heights lags behind, but the top block's hash is in block_info
+    if (m_height > 0 && top_block_hash() != blk.prev_id)
+      throw0(BLOCK_PARENT_DNE("Top block is not new block's parent"));
+  }
+  else if (mdb_cursor_get(m_cur_block_heights, (MDB_val *)&zerokval, &val_h, MDB_GET_BOTH) == 0)
     throw1(BLOCK_EXISTS("Attempting to add block that's already in the db"));
 
-  if (m_height > 0)
+  if (m_height > 0 && !m_bulk_load)
   {
     MDB_val_set(parent_key, blk.prev_id);
     int result = mdb_cursor_get(m_cur_block_heights, (MDB_val *)&zerokval, &parent_key, MDB_GET_BOTH);
@@ -790,7 +1251,10 @@ void BlockchainLMDB::add_block(const block& blk, size_t block_weight, uint64_t l
 
   // this call to mdb_cursor_put will change height()
   cryptonote::blobdata block_blob(block_to_blob(blk));
+  std::string compressed_block_blob;
   MDB_val_sized(blob, block_blob);
+  if (compress_block(block_blob, compressed_block_blob))
+    blob = {compressed_block_blob.size(), (void*)compressed_block_blob.data()};
   result = mdb_cursor_put(m_cur_blocks, &key, &blob, MDB_APPEND);
   if (result)
     throw0(DB_ERROR(lmdb_error("Failed to add block blob to db transaction: ", result).c_str()));
@@ -820,9 +1284,37 @@ void BlockchainLMDB::add_block(const block& blk, size_t block_weight, uint64_t l
   if (result)
     throw0(DB_ERROR(lmdb_error("Failed to add block info to db transaction: ", result).c_str()));
 
-  result = mdb_cursor_put(m_cur_block_heights, (MDB_val *)&zerokval, &val_h, 0);
-  if (result)
-    throw0(DB_ERROR(lmdb_error("Failed to add block height by hash to db transaction: ", result).c_str()));
+  if (m_bulk_load)
+  {
+    m_bulk_load->block_heights.add(&bh);
+  }
+  else
+  {
+    result = mdb_cursor_put(m_cur_block_heights, (MDB_val *)&zerokval, &val_h, 0);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to add block height by hash to db transaction: ", result).c_str()));
+  }
+
+  if (m_cold_segments)
+  {
+    // the block's txes were just added, so its first tx id is known without parsing it once it leaves the tip
+    if (m_tip_first_tx_ids.empty() || m_tip_first_tx_ids_height + m_tip_first_tx_ids.size() != m_height)
+    {
+      m_tip_first_tx_ids.clear();
+      m_tip_first_tx_ids_height = m_height;
+    }
+    m_tip_first_tx_ids.push_back(get_tx_count() - 1 - blk.tx_hashes.size());
+    if (m_tip_first_tx_ids.size() > CRYPTONOTE_PRUNING_TIP_BLOCKS)
+    {
+      m_tip_first_tx_ids.pop_front();
+      ++m_tip_first_tx_ids_height;
+    }
+
+    // moving needs tx_indices, so a bulk load leaves it to catch up afterwards; moving
+    // a batch at a time keeps the segment syncs down to one per batch of txes
+    if (!m_bulk_load)
+      move_cold_prunable(*m_write_txn, m_height + 1, COLD_PRUNABLE_BATCH_SIZE, COLD_PRUNABLE_BATCH_SIZE);
+  }
 
   // we use weight as a proxy for size, since we don't have size but weight is >= size
   // and often actually equal
@@ -845,6 +1337,9 @@ void BlockchainLMDB::remove_block()
   CURSOR(block_info)
   CURSOR(block_heights)
   CURSOR(blocks)
+  m_block_cache->invalidate(*m_write_txn, m_height - 1);
+  if (!m_tip_first_tx_ids.empty() && m_tip_first_tx_ids_height + m_tip_first_tx_ids.size() == m_height)
+    m_tip_first_tx_ids.pop_back();
   MDB_val_copy<uint64_t> k(m_height - 1);
   MDB_val h = k;
   if ((result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &h, MDB_GET_BOTH)))
@@ -860,6 +1355,9 @@ void BlockchainLMDB::remove_block()
   if ((result = mdb_cursor_del(m_cur_block_heights, 0)))
       throw1(DB_ERROR(lmdb_error("Failed to add removal of block height by hash to db transaction: ", result).c_str()));
 
+  // the block may have been served from the cache, so m_cur_blocks is not necessarily on it
+  if ((result = mdb_cursor_get(m_cur_blocks, &k, NULL, MDB_SET)))
+      throw1(DB_ERROR(lmdb_error("Failed to locate block for removal: ", result).c_str()));
   if ((result = mdb_cursor_del(m_cur_blocks, 0)))
       throw1(DB_ERROR(lmdb_error("Failed to add removal of block to db transaction: ", result).c_str()));
 
@@ -885,7 +1383,7 @@ uint64_t BlockchainLMDB::add_transaction_data(const crypto::hash& blk_hash, cons
 
   MDB_val_set(val_tx_id, tx_id);
   MDB_val_set(val_h, tx_hash);
-  result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &val_h, MDB_GET_BOTH);
+  result = m_bulk_load ? MDB_NOTFOUND : mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &val_h, MDB_GET_BOTH);
   if (result == 0) {
     txindex *tip = (txindex *)val_h.mv_data;
     throw1(TX_EXISTS(std::string("Attempting to add transaction that's already in the db (tx id ").append(boost::lexical_cast<std::string>(tip->data.tx_id)).append(")").c_str()));
@@ -903,9 +1401,16 @@ uint64_t BlockchainLMDB::add_transaction_data(const crypto::hash& blk_hash, cons
   val_h.mv_size = sizeof(ti);
   val_h.mv_data = (void *)&ti;
 
-  result = mdb_cursor_put(m_cur_tx_indices, (MDB_val *)&zerokval, &val_h, 0);
-  if (result)
-    throw0(DB_ERROR(lmdb_error("Failed to add tx data to db transaction: ", result).c_str()));
+  if (m_bulk_load)
+  {
+    m_bulk_load->tx_indices.add(&ti);
+  }
+  else
+  {
+    result = mdb_cursor_put(m_cur_tx_indices, (MDB_val *)&zerokval, &val_h, 0);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to add tx data to db transaction: ", result).c_str()));
+  }
 
   const cryptonote::blobdata_ref &blob = txp.second;
   MDB_val_sized(blobval, blob);
@@ -930,6 +1435,12 @@ uint64_t BlockchainLMDB::add_transaction_data(const crypto::hash& blk_hash, cons
     throw0(DB_ERROR(lmdb_error("Failed to add pruned tx blob to db transaction: ", result).c_str()));
 
   MDB_val prunable_blob = {blob.size() - unprunable_size, (void*)(blob.data() + unprunable_size)};
+  std::string compressed_prunable_blob;
+  if (m_prunable_compressed)
+  {
+    compress_prunable({(const uint8_t*)prunable_blob.mv_data, prunable_blob.mv_size}, compressed_prunable_blob);
+    prunable_blob = {compressed_prunable_blob.size(), (void*)compressed_prunable_blob.data()};
+  }
   result = mdb_cursor_put(m_cur_txs_prunable, &val_tx_id, &prunable_blob, MDB_APPEND);
   if (result)
     throw0(DB_ERROR(lmdb_error("Failed to add prunable tx blob to db transaction: ", result).c_str()));
@@ -992,6 +1503,32 @@ void BlockchainLMDB::remove_transaction_data(const crypto::hash& tx_hash, const
   }
   else if (result != MDB_NOTFOUND)
       throw1(DB_ERROR(lmdb_error("Failed to locate prunable tx for removal: ", result).c_str()));
+  else if (m_cold_segments)
+  {
+    // the location goes now, its segment space once the txn is committed; the tx id
+    // will be reused, so it has to be moved again once it leaves the tip
+    CURSOR(txs_prunable_cold)
+    MDB_val loc_val;
+    result = mdb_cursor_get(m_cur_txs_prunable_cold, &val_tx_id, &loc_val, MDB_SET);
+    if (result == 0)
+    {
+      if (loc_val.mv_size != sizeof(segment_store::location))
+          throw1(DB_ERROR("Unexpected cold prunable tx data location size"));
+      segment_store::location loc;
+      memcpy(&loc, loc_val.mv_data, sizeof(loc));
+      m_cold_freed.push_back(loc);
+      result = mdb_cursor_del(m_cur_txs_prunable_cold, 0);
+      if (result)
+          throw1(DB_ERROR(lmdb_error("Failed to add removal of cold prunable tx to db transaction: ", result).c_str()));
+      MDB_val_str(pk, "cold_next_tx_id");
+      MDB_val_copy<uint64_t> pv(tip->data.tx_id);
+      result = mdb_put(*m_write_txn, m_properties, &pk, &pv, 0);
+      if (result)
+          throw1(DB_ERROR(lmdb_error("Failed to update cold prunable tx id: ", result).c_str()));
+    }
+    else if (result != MDB_NOTFOUND)
+      throw1(DB_ERROR(lmdb_error("Failed to locate cold prunable tx for removal: ", result).c_str()));
+  }
 
   result = mdb_cursor_get(m_cur_txs_prunable_tip, &val_tx_id, NULL, MDB_SET);
   if (result && result != MDB_NOTFOUND)
@@ -1235,12 +1772,26 @@ void BlockchainLMDB::prune_outputs(uint64_t amount)
   }
 }
 
-void BlockchainLMDB::add_spent_key(const crypto::key_image& k_image)
+void BlockchainLMDB::add_spent_key(const crypto::key_image& k_image, const crypto::hash& tx_hash)
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
   mdb_txn_cursors *m_cursors = &m_wcursors;
 
+  const bool index = m_spent_key_index && tx_hash != crypto::null_hash;
+  if (m_bulk_load)
+  {
+    const uint64_t m_height = height();
+    const bulk_load_state::spooled_key_image ski = {k_image, m_height};
+    m_bulk_load->spent_keys.add(&ski);
+    if (index)
+    {
+      const spent_key_tx skt = {k_image, tx_hash, m_height};
+      m_bulk_load->spent_key_txs.add(&skt);
+    }
+    return;
+  }
+
   CURSOR(spent_keys)
 
   MDB_val k = {sizeof(k_image), (void *)&k_image};
@@ -1250,6 +1801,16 @@ void BlockchainLMDB::add_spent_key(const crypto::key_image& k_image)
     else
       throw1(DB_ERROR(lmdb_error("Error adding spent key image to db transaction: ", result).c_str()));
   }
+
+  if (index)
+  {
+    CURSOR(spent_key_txs)
+
+    const spent_key_tx skt = {k_image, tx_hash, height()};
+    MDB_val_set(v, skt);
+    if (auto result = mdb_cursor_put(m_cur_spent_key_txs, (MDB_val *)&zerokval, &v, MDB_NODUPDATA))
+      throw1(DB_ERROR(lmdb_error("Error adding spent key image tx to db transaction: ", result).c_str()));
+  }
 }
 
 void BlockchainLMDB::remove_spent_key(const crypto::key_image& k_image)
@@ -1270,26 +1831,619 @@ void BlockchainLMDB::remove_spent_key(const crypto::key_image& k_image)
     if (result)
         throw1(DB_ERROR(lmdb_error("Error adding removal of key image to db transaction", result).c_str()));
   }
+
+  if (m_spent_key_index)
+  {
+    CURSOR(spent_key_txs)
+
+    // the index compares the key image only
+    MDB_val v = {sizeof(k_image), (void *)&k_image};
+    result = mdb_cursor_get(m_cur_spent_key_txs, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+    if (result != 0 && result != MDB_NOTFOUND)
+      throw1(DB_ERROR(lmdb_error("Error finding spent key tx to remove", result).c_str()));
+    if (!result)
+    {
+      result = mdb_cursor_del(m_cur_spent_key_txs, 0);
+      if (result)
+        throw1(DB_ERROR(lmdb_error("Error adding removal of key image tx to db transaction", result).c_str()));
+    }
+  }
 }
 
-BlockchainLMDB::~BlockchainLMDB()
+void BlockchainLMDB::get_block_blob_from_value(const MDB_val &v, cryptonote::blobdata &bd)
 {
-  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  const uint8_t *data = (const uint8_t*)v.mv_data;
+  if (v.mv_size == 0 || data[0] != COMPRESSED_BLOCK_MARKER)
+  {
+    bd.assign((const char*)data, v.mv_size);
+    return;
+  }
+#ifdef HAVE_ZSTD
+  bd.clear();
+  zstd_decompress(data + 1, v.mv_size - 1, NULL, bd);
+#else
+  throw0(DB_ERROR("Found a compressed block in the db, but zstd support was not built in"));
+#endif
+}
 
-  // batch transaction shouldn't be active at this point. If it is, consider it aborted.
-  if (m_batch_active)
+bool BlockchainLMDB::compress_block(const cryptonote::blobdata &blob, std::string &out) const
+{
+  // stored as is, this blob would be read back as a compressed one
+  const bool marked = !blob.empty() && (uint8_t)blob[0] == COMPRESSED_BLOCK_MARKER;
+#ifdef HAVE_ZSTD
+  if (m_compression && (marked || blob.size() >= COMPRESSED_BLOCK_MIN_SIZE))
   {
-    try { batch_abort(); }
-    catch (...) { /* ignore */ }
+    if (zstd_compress(m_compression->cctx, NULL, COMPRESSED_BLOCK_MARKER, (const uint8_t*)blob.data(), blob.size(), out, marked))
+      return true;
   }
-  if (m_open)
-    close();
+#endif
+  if (marked)
+    throw0(DB_ERROR("Block blob starts with the compressed block marker, it can only be stored with compression enabled"));
+  return false;
 }
 
-BlockchainLMDB::BlockchainLMDB(bool batch_transactions): BlockchainDB()
+void BlockchainLMDB::compress_prunable(const epee::span<const uint8_t> &data, std::string &out) const
 {
-  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
-  // initialize folder to something "safe" just in case
+#ifdef HAVE_ZSTD
+  if (m_compression && !data.empty())
+  {
+    const uint8_t header = m_compression->cdict ? PRUNABLE_ZSTD_DICT : PRUNABLE_ZSTD;
+    if (zstd_compress(m_compression->cctx, m_compression->cdict, header, data.data(), data.size(), out))
+      return;
+  }
+#endif
+  out.resize(1 + data.size());
+  out[0] = PRUNABLE_RAW;
+  if (!data.empty())
+    memcpy(&out[1], data.data(), data.size());
+}
+
+void BlockchainLMDB::append_prunable(const MDB_val &v, cryptonote::blobdata &bd) const
+{
+  const uint8_t *data = (const uint8_t*)v.mv_data;
+  if (!m_prunable_compressed)
+  {
+    bd.append((const char*)data, v.mv_size);
+    return;
+  }
+  if (v.mv_size == 0)
+    throw0(DB_ERROR("Invalid prunable tx data in the db"));
+  switch (data[0])
+  {
+    case PRUNABLE_RAW:
+      bd.append((const char*)data + 1, v.mv_size - 1);
+      break;
+#ifdef HAVE_ZSTD
+    case PRUNABLE_ZSTD:
+      zstd_decompress(data + 1, v.mv_size - 1, NULL, bd);
+      break;
+    case PRUNABLE_ZSTD_DICT:
+      if (!m_compression->ddict)
+        throw0(DB_ERROR("Prunable tx data needs the compression dictionary, but it is not in the db"));
+      zstd_decompress(data + 1, v.mv_size - 1, m_compression->ddict, bd);
+      break;
+#endif
+    default:
+      throw0(DB_ERROR("Unknown compression type for prunable tx data in the db"));
+  }
+}
+
+bool BlockchainLMDB::load_compression_dictionary(MDB_txn *txn)
+{
+  MDB_val_str(k, "compression_dict");
+  MDB_val v;
+  int result = mdb_get(txn, m_properties, &k, &v);
+  if (result == MDB_NOTFOUND)
+    return false;
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to retrieve compression dictionary: ", result).c_str()));
+#ifdef HAVE_ZSTD
+  m_compression->set_dictionary(v.mv_data, v.mv_size);
+  return true;
+#else
+  return false;
+#endif
+}
+
+void BlockchainLMDB::init_compression(bool requested)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+
+  m_compression.reset();
+  m_prunable_compressed = false;
+
+  mdb_txn_safe txn;
+  if (auto result = lmdb_txn_begin(m_env, NULL, MDB_RDONLY, txn))
+    throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+
+  MDB_val_str(k, "compression");
+  MDB_val v;
+  int result = mdb_get(txn, m_properties, &k, &v);
+  if (result && result != MDB_NOTFOUND)
+    throw0(DB_ERROR(lmdb_error("Failed to retrieve compression mode: ", result).c_str()));
+  const bool compressed = result == 0;
+  if (compressed && (v.mv_size != sizeof(uint32_t) || *(const uint32_t*)v.mv_data != COMPRESSION_ZSTD))
+    throw0(DB_ERROR("Unknown compression mode in the db"));
+
+  MDB_val_str(pk, "compression_next_tx_id");
+  result = mdb_get(txn, m_properties, &pk, &v);
+  if (result && result != MDB_NOTFOUND)
+    throw0(DB_ERROR(lmdb_error("Failed to retrieve compression progress: ", result).c_str()));
+  const bool migrating = result == 0;
+
+#ifdef HAVE_ZSTD
+  if (!compressed && !migrating && !requested)
+    return;
+
+  m_compression.reset(new compression_context());
+  if (compressed)
+  {
+    load_compression_dictionary(txn);
+    txn.commit();
+    m_prunable_compressed = true;
+    // a database compressed when still small gets its dictionary once there is enough to train on
+    if (!m_compression->cdict && !is_read_only())
+      train_compression_dictionary();
+    return;
+  }
+  txn.commit();
+
+  if (is_read_only())
+  {
+    m_compression.reset();
+    if (migrating)
+      throw0(DB_ERROR("Database compression is incomplete, run sumokoind once to finish it"));
+    MWARNING("Database compression cannot be enabled on a read-only database");
+    return;
+  }
+
+  migrate_compression();
+  m_prunable_compressed = true;
+#else
+  if (compressed || migrating)
+    throw0(DB_ERROR("The database is compressed, but zstd support was not built in"));
+  if (requested)
+    MWARNING("Database compression was requested, but zstd support was not built in");
+#endif
+}
+
+void BlockchainLMDB::train_compression_dictionary()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+#ifdef HAVE_ZSTD
+  int result;
+  mdb_txn_safe txn(false);
+  MDB_val k, v;
+
+  result = mdb_txn_begin(m_env, NULL, 0, txn);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+
+  MDB_stat db_stats;
+  if ((result = mdb_stat(txn, m_txs_prunable, &db_stats)))
+    throw0(DB_ERROR(lmdb_error("Failed to query m_txs_prunable: ", result).c_str()));
+  if (db_stats.ms_entries < COMPRESSION_DICT_MIN_SAMPLES)
+  {
+    txn.abort();
+    return;
+  }
+
+  MDB_cursor *c_prunable;
+  result = mdb_cursor_open(txn, m_txs_prunable, &c_prunable);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to open a cursor for txs_prunable: ", result).c_str()));
+
+  // tx ids are sparse on a pruned database, so sample evenly over the id range
+  result = mdb_cursor_get(c_prunable, &k, &v, MDB_LAST);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to enumerate prunable tx data: ", result).c_str()));
+  const uint64_t last_tx_id = *(const uint64_t*)k.mv_data;
+  const uint64_t step = std::max<uint64_t>(1, last_tx_id / COMPRESSION_DICT_MAX_SAMPLES);
+
+  std::string samples;
+  std::vector<size_t> sample_sizes;
+  for (uint64_t tx_id = 0; tx_id <= last_tx_id && samples.size() < COMPRESSION_DICT_MAX_SAMPLE_BYTES; tx_id += step)
+  {
+    MDB_val_set(key, tx_id);
+    result = mdb_cursor_get(c_prunable, &key, &v, MDB_SET_RANGE);
+    if (result == MDB_NOTFOUND)
+      break;
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to enumerate prunable tx data: ", result).c_str()));
+    cryptonote::blobdata bd;
+    append_prunable(v, bd);
+    if (bd.empty())
+      continue;
+    samples += bd;
+    sample_sizes.push_back(bd.size());
+  }
+  if (sample_sizes.size() < COMPRESSION_DICT_MIN_SAMPLES)
+  {
+    txn.abort();
+    return;
+  }
+
+  std::string dict(COMPRESSION_DICT_SIZE, '\0');
+  const size_t dict_size = ZDICT_trainFromBuffer(&dict[0], dict.size(), samples.data(), sample_sizes.data(), sample_sizes.size());
+  if (ZDICT_isError(dict_size))
+  {
+    MWARNING("Failed to train compression dictionary: " << ZDICT_getErrorName(dict_size));
+    txn.abort();
+    return;
+  }
+  dict.resize(dict_size);
+
+  MDB_val_str(dk, "compression_dict");
+  MDB_val_sized(dv, dict);
+  result = mdb_put(txn, m_properties, &dk, &dv, 0);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to store compression dictionary: ", result).c_str()));
+  txn.commit();
+
+  m_compression->set_dictionary(dict.data(), dict.size());
+  MGINFO("Trained a " << dict_size << " byte compression dictionary from " << sample_sizes.size() << " prunable tx records");
+#endif
+}
+
+int BlockchainLMDB::get_prunable_value(MDB_cursor *c_prunable, MDB_cursor *c_cold, const MDB_val &k, MDB_val &v) const
+{
+  MDB_val key = k;
+  int result = mdb_cursor_get(c_prunable, &key, &v, MDB_SET);
+  if (result != MDB_NOTFOUND || !c_cold)
+    return result;
+
+  MDB_val loc_val;
+  key = k;
+  result = mdb_cursor_get(c_cold, &key, &loc_val, MDB_SET);
+  if (result)
+    return result;
+  if (loc_val.mv_size != sizeof(segment_store::location))
+    throw0(DB_ERROR("Unexpected cold prunable tx data location size"));
+  segment_store::location loc;
+  memcpy(&loc, loc_val.mv_data, sizeof(loc));
+  const epee::span<const uint8_t> data = m_cold_segments->get(loc);
+  v.mv_size = data.size();
+  v.mv_data = (void*)data.data();
+  return 0;
+}
+
+void BlockchainLMDB::init_cold_storage(bool requested)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+
+  m_cold_segments.reset();
+
+  const bool read_only = is_read_only();
+  mdb_txn_safe txn;
+  if (auto result = lmdb_txn_begin(m_env, NULL, read_only ? MDB_RDONLY : 0, txn))
+    throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+
+  MDB_val_str(k, "cold_next_tx_id");
+  MDB_val v;
+  int result = mdb_get(txn, m_properties, &k, &v);
+  if (result && result != MDB_NOTFOUND)
+    throw0(DB_ERROR(lmdb_error("Failed to retrieve cold prunable tx id: ", result).c_str()));
+  const bool enabled = result == 0;
+  if (!enabled && !requested)
+    return;
+  if (!enabled && read_only)
+  {
+    MWARNING("Cold segment storage cannot be enabled on a read-only database");
+    return;
+  }
+
+  lmdb_db_open(txn, LMDB_TXS_PRUNABLE_COLD, MDB_INTEGERKEY | (read_only ? 0 : MDB_CREATE), m_txs_prunable_cold, "Failed to open db handle for m_txs_prunable_cold");
+  mdb_set_compare(txn, m_txs_prunable_cold, compare_uint64);
+  if (!enabled)
+  {
+    MDB_val_copy<uint64_t> nv(0);
+    result = mdb_put(txn, m_properties, &k, &nv, 0);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to write cold prunable tx id: ", result).c_str()));
+  }
+  txn.commit();
+
+  m_cold_segments.reset(new segment_store());
+  const std::string folder = m_cold_segments_folder.empty() ? (boost::filesystem::path(m_folder) / COLD_SEGMENTS_FOLDER).string() : m_cold_segments_folder;
+  m_cold_segments->open(folder, read_only);
+
+  if (!read_only)
+    migrate_cold_prunable();
+}
+
+void BlockchainLMDB::sync_cold_segments()
+{
+  // even without a sync on commit, LMDB pages may reach the disk at any time
+  if (m_cold_segments)
+    m_cold_segments->sync();
+}
+
+void BlockchainLMDB::cold_segments_committed(std::vector<segment_store::location> &freed)
+{
+  if (m_cold_segments && !freed.empty())
+  {
+    // until a commit is synced, a crash may bring back the locations it removed
+    unsigned int env_flags = 0;
+    mdb_env_get_flags(m_env, &env_flags);
+    std::vector<segment_store::location> &committed = (env_flags & (MDB_NOSYNC | MDB_NOMETASYNC | MDB_MAPASYNC)) ? m_cold_freed_unsynced : m_cold_reclaimable;
+    committed.insert(committed.end(), freed.begin(), freed.end());
+  }
+  freed.clear();
+  reclaim_cold_segments();
+}
+
+void BlockchainLMDB::reclaim_cold_segments()
+{
+  // a read txn started before the commit may still get the data, so wait for a time none is open
+  if (!m_cold_segments || m_cold_reclaimable.empty() || mdb_txn_safe::num_active_txns > 0)
+    return;
+
+  // latest first, so blobs freed by popping several blocks are all truncated off the end
+  std::sort(m_cold_reclaimable.begin(), m_cold_reclaimable.end(), [](const segment_store::location &a, const segment_store::location &b) {
+    return a.segment > b.segment || (a.segment == b.segment && a.offset > b.offset);
+  });
+  uint64_t n_bytes = 0;
+  for (const segment_store::location &loc: m_cold_reclaimable)
+  {
+    // the commit is done, so failing to reclaim only wastes space
+    try { m_cold_segments->release(loc); }
+    catch (const std::exception &e) { MWARNING("Failed to release segment space: " << e.what()); continue; }
+    n_bytes += loc.size;
+  }
+  MDEBUG("Released " << n_bytes << " bytes of segment space from " << m_cold_reclaimable.size() << " records");
+  m_cold_reclaimable.clear();
+}
+
+uint64_t BlockchainLMDB::get_block_first_tx_id(MDB_txn *txn, uint64_t height, size_t *n_txes) const
+{
+  MDB_val_copy<uint64_t> bk(height);
+  MDB_val v;
+  int result = mdb_get(txn, m_blocks, &bk, &v);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to get block at height " + std::to_string(height) + ": ", result).c_str()));
+  cryptonote::blobdata bd;
+  get_block_blob_from_value(v, bd);
+  block b;
+  if (!parse_and_validate_block_from_blob(bd, b))
+    throw0(DB_ERROR("Failed to parse block from blob retrieved from the db"));
+  if (n_txes)
+    *n_txes = 1 + b.tx_hashes.size();
+  const crypto::hash miner_tx_hash = get_transaction_hash(b.miner_tx);
+  MDB_cursor *c_tx_indices;
+  result = mdb_cursor_open(txn, m_tx_indices, &c_tx_indices);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to open a cursor for tx_indices: ", result).c_str()));
+  MDB_val_set(iv, miner_tx_hash);
+  result = mdb_cursor_get(c_tx_indices, (MDB_val *)&zerokval, &iv, MDB_GET_BOTH);
+  if (result)
+  {
+    mdb_cursor_close(c_tx_indices);
+    throw0(DB_ERROR(lmdb_error("Failed to get the miner tx of block at height " + std::to_string(height) + ": ", result).c_str()));
+  }
+  const uint64_t tx_id = ((const txindex *)iv.mv_data)->data.tx_id;
+  mdb_cursor_close(c_tx_indices);
+  return tx_id;
+}
+
+size_t BlockchainLMDB::move_cold_prunable(MDB_txn *txn, uint64_t blockchain_height, size_t max_records, uint64_t min_txes)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  if (blockchain_height <= CRYPTONOTE_PRUNING_TIP_BLOCKS)
+    return 0;
+  int result;
+
+  MDB_val_str(pk, "cold_next_tx_id");
+  MDB_val v;
+  result = mdb_get(txn, m_properties, &pk, &v);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to retrieve cold prunable tx id: ", result).c_str()));
+  uint64_t next_tx_id;
+  memcpy(&next_tx_id, v.mv_data, sizeof(next_tx_id));
+
+  // records from the first tx of the oldest block still in the tip on are hot
+  const uint64_t tip_height = blockchain_height - CRYPTONOTE_PRUNING_TIP_BLOCKS;
+  uint64_t end_tx_id;
+  if (tip_height >= m_tip_first_tx_ids_height && tip_height - m_tip_first_tx_ids_height < m_tip_first_tx_ids.size())
+    end_tx_id = m_tip_first_tx_ids[tip_height - m_tip_first_tx_ids_height];
+  else
+    end_tx_id = get_block_first_tx_id(txn, tip_height);
+  if (next_tx_id >= end_tx_id || end_tx_id - next_tx_id < min_txes)
+    return 0;
+
+  MDB_cursor *c_prunable, *c_cold;
+  result = mdb_cursor_open(txn, m_txs_prunable, &c_prunable);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to open a cursor for txs_prunable: ", result).c_str()));
+  result = mdb_cursor_open(txn, m_txs_prunable_cold, &c_cold);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to open a cursor for txs_prunable_cold: ", result).c_str()));
+
+  size_t n_records = 0;
+  MDB_val_set(k, next_tx_id);
+  MDB_cursor_op op = MDB_SET_RANGE;
+  while (1)
+  {
+    if (n_records >= max_records)
+      break;
+    result = mdb_cursor_get(c_prunable, &k, &v, op);
+    op = MDB_NEXT;
+    if (result == MDB_NOTFOUND)
+    {
+      next_tx_id = end_tx_id;
+      break;
+    }
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to enumerate prunable tx data: ", result).c_str()));
+    const uint64_t tx_id = *(const uint64_t*)k.mv_data;
+    if (tx_id >= end_tx_id)
+    {
+      next_tx_id = end_tx_id;
+      break;
+    }
+
+    const segment_store::location loc = m_cold_segments->append({(const uint8_t*)v.mv_data, v.mv_size});
+    MDB_val_set(ck, tx_id);
+    MDB_val_set(lv, loc);
+    result = mdb_cursor_put(c_cold, &ck, &lv, 0);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to add cold prunable tx data location: ", result).c_str()));
+    result = mdb_cursor_del(c_prunable, 0);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to delete prunable tx data: ", result).c_str()));
+    next_tx_id = tx_id + 1;
+    ++n_records;
+  }
+  mdb_cursor_close(c_cold);
+  mdb_cursor_close(c_prunable);
+
+  MDB_val_copy<uint64_t> nv(next_tx_id);
+  result = mdb_put(txn, m_properties, &pk, &nv, 0);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to update cold prunable tx id: ", result).c_str()));
+  return n_records;
+}
+
+void BlockchainLMDB::init_spent_key_index(bool requested)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+
+  m_spent_key_index = false;
+
+  const bool read_only = is_read_only();
+  mdb_txn_safe txn;
+  if (auto result = lmdb_txn_begin(m_env, NULL, read_only ? MDB_RDONLY : 0, txn))
+    throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+
+  MDB_val_str(k, "spent_key_index_height");
+  MDB_val v;
+  int result = mdb_get(txn, m_properties, &k, &v);
+  if (result && result != MDB_NOTFOUND)
+    throw0(DB_ERROR(lmdb_error("Failed to retrieve spent key index height: ", result).c_str()));
+  const bool enabled = result == 0;
+  if (!enabled && !requested)
+    return;
+  if (read_only)
+  {
+    uint64_t index_height = 0;
+    if (enabled)
+      memcpy(&index_height, v.mv_data, sizeof(index_height));
+    if (index_height != SPENT_KEY_INDEX_COMPLETE)
+    {
+      MWARNING("The spent key index cannot be " << (enabled ? "finished" : "enabled") << " on a read-only database");
+      return;
+    }
+  }
+
+  lmdb_db_open(txn, LMDB_SPENT_KEY_TXS, MDB_INTEGERKEY | MDB_DUPSORT | MDB_DUPFIXED | (read_only ? 0 : MDB_CREATE), m_spent_key_txs, "Failed to open db handle for m_spent_key_txs");
+  mdb_set_dupsort(txn, m_spent_key_txs, compare_hash32);
+  if (!enabled)
+  {
+    MDB_val_copy<uint64_t> nv(0);
+    result = mdb_put(txn, m_properties, &k, &nv, 0);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to write spent key index height: ", result).c_str()));
+  }
+  txn.commit();
+
+  if (!read_only)
+    migrate_spent_key_index();
+  m_spent_key_index = true;
+}
+
+size_t BlockchainLMDB::index_spent_keys(MDB_txn *txn, uint64_t blockchain_height, size_t max_blocks)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  int result;
+
+  MDB_val_str(pk, "spent_key_index_height");
+  MDB_val v;
+  result = mdb_get(txn, m_properties, &pk, &v);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to retrieve spent key index height: ", result).c_str()));
+  uint64_t next_height;
+  memcpy(&next_height, v.mv_data, sizeof(next_height));
+  if (next_height == SPENT_KEY_INDEX_COMPLETE)
+    return 0;
+
+  MDB_cursor *c_tx_indices, *c_spent_key_txs;
+  result = mdb_cursor_open(txn, m_tx_indices, &c_tx_indices);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to open a cursor for tx_indices: ", result).c_str()));
+  result = mdb_cursor_open(txn, m_spent_key_txs, &c_spent_key_txs);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to open a cursor for spent_key_txs: ", result).c_str()));
+
+  size_t n_blocks = 0;
+  for (; next_height < blockchain_height && n_blocks < max_blocks; ++next_height, ++n_blocks)
+  {
+    MDB_val_copy<uint64_t> bk(next_height);
+    result = mdb_get(txn, m_blocks, &bk, &v);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to get block at height " + std::to_string(next_height) + ": ", result).c_str()));
+    cryptonote::blobdata bd;
+    get_block_blob_from_value(v, bd);
+    block b;
+    if (!parse_and_validate_block_from_blob(bd, b))
+      throw0(DB_ERROR("Failed to parse block from blob retrieved from the db"));
+
+    // the miner tx has no key images
+    for (const crypto::hash &tx_hash: b.tx_hashes)
+    {
+      MDB_val_set(iv, tx_hash);
+      result = mdb_cursor_get(c_tx_indices, (MDB_val *)&zerokval, &iv, MDB_GET_BOTH);
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to get tx index for " + epee::string_tools::pod_to_hex(tx_hash) + ": ", result).c_str()));
+      MDB_val_set(tk, ((const txindex *)iv.mv_data)->data.tx_id);
+      result = mdb_get(txn, m_txs_pruned, &tk, &v);
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to get tx " + epee::string_tools::pod_to_hex(tx_hash) + ": ", result).c_str()));
+      transaction_prefix tx;
+      if (!parse_and_validate_tx_prefix_from_blob(blobdata_ref{(const char*)v.mv_data, v.mv_size}, tx))
+        throw0(DB_ERROR("Failed to parse tx from blob retrieved from the db"));
+
+      for (const txin_v &in: tx.vin)
+      {
+        if (in.type() != typeid(txin_to_key))
+          continue;
+        const spent_key_tx skt = {boost::get<txin_to_key>(in).k_image, tx_hash, next_height};
+        MDB_val_set(sv, skt);
+        result = mdb_cursor_put(c_spent_key_txs, (MDB_val *)&zerokval, &sv, MDB_NODUPDATA);
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to add spent key tx: ", result).c_str()));
+      }
+    }
+  }
+  mdb_cursor_close(c_spent_key_txs);
+  mdb_cursor_close(c_tx_indices);
+
+  // from here, blocks index their key images as they are added
+  if (next_height >= blockchain_height)
+    next_height = SPENT_KEY_INDEX_COMPLETE;
+  MDB_val_copy<uint64_t> nv(next_height);
+  result = mdb_put(txn, m_properties, &pk, &nv, 0);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to update spent key index height: ", result).c_str()));
+  return n_blocks;
+}
+
+BlockchainLMDB::~BlockchainLMDB()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+
+  // batch transaction shouldn't be active at this point. If it is, consider it aborted.
+  if (m_batch_active)
+  {
+    try { batch_abort(); }
+    catch (...) { /* ignore */ }
+  }
+  if (m_open)
+    close();
+}
+
+BlockchainLMDB::BlockchainLMDB(bool batch_transactions): BlockchainDB()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  // initialize folder to something "safe" just in case
   // someone accidentally misuses this class...
   m_folder = "thishsouldnotexistbecauseitisgibberish";
 
@@ -1299,6 +2453,14 @@ BlockchainLMDB::BlockchainLMDB(bool batch_transactions): BlockchainDB()
   m_batch_active = false;
   m_cum_size = 0;
   m_cum_count = 0;
+  m_prunable_compressed = false;
+  m_spent_key_index = false;
+  m_tip_first_tx_ids_height = 0;
+  m_env_generation = std::make_shared<std::atomic<uint64_t>>(0);
+  m_thread_infos = std::make_shared<mdb_threadinfo_set>();
+  m_db_flags = 0;
+  m_sparse_map = false;
+  m_block_cache.reset(new block_cache());
 
   // reset may also need changing when initialize things here
 
@@ -1365,6 +2527,7 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
   }
 
   m_folder = filename;
+  m_db_flags = db_flags;
 
  check_mmap_support();
 
@@ -1396,6 +2559,22 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
   if (db_flags & DBF_SALVAGE)
     mdb_flags |= MDB_PREVSNAPSHOT;
 
+  m_sparse_map = false;
+  if ((db_flags & DBF_SPARSE_MAP) && !(db_flags & DBF_RDONLY))
+  {
+#ifdef _WIN32
+    MWARNING("A sparse memory map is not available on Windows, where the file grows with the map");
+#else
+    if (sizeof(size_t) < sizeof(uint64_t))
+      MWARNING("A sparse memory map needs a 64 bit address space");
+    else
+    {
+      mapsize = std::max<uint64_t>(mapsize, get_sparse_mapsize(filename));
+      m_sparse_map = true;
+    }
+#endif
+  }
+
   if (auto result = mdb_env_open(m_env, filename.c_str(), mdb_flags, 0644))
     throw0(DB_ERROR(lmdb_error("Failed to open lmdb environment: ", result).c_str()));
 
@@ -1411,6 +2590,8 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
     cur_mapsize = (uint64_t)mei.me_mapsize;
     LOG_PRINT_L1("LMDB memory map size: " << cur_mapsize);
   }
+  if (m_sparse_map)
+    MGINFO("LMDB memory map reserved: " << cur_mapsize / (1024 * 1024) << " MiB");
 
   if (need_resize())
   {
@@ -1525,6 +2706,9 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
       txn.commit();
       m_open = true;
       migrate(db_version);
+      init_compression(db_flags & DBF_COMPRESS);
+      init_cold_storage(db_flags & DBF_COLD_SEGMENTS);
+      init_spent_key_index(db_flags & DBF_SPENT_KEY_INDEX);
       return;
     }
 #endif
@@ -1548,6 +2732,19 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
     return;
   }
 
+  MDB_val_str(bk, "bulk_load_height");
+  if (mdb_get(txn, m_properties, &bk, &v) == 0)
+  {
+    uint64_t bulk_load_height;
+    memcpy(&bulk_load_height, v.mv_data, sizeof(bulk_load_height));
+    txn.abort();
+    mdb_env_close(m_env);
+    m_open = false;
+    MFATAL("Existing lmdb database was left without its indexes from height " << bulk_load_height << " by an interrupted bulk load.");
+    MFATAL("Please delete the existing database and import again.");
+    return;
+  }
+
   if (!(mdb_flags & MDB_RDONLY))
   {
     // only write version on an empty DB
@@ -1571,6 +2768,10 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
   txn.commit();
 
   m_open = true;
+
+  init_compression(db_flags & DBF_COMPRESS);
+  init_cold_storage(db_flags & DBF_COLD_SEGMENTS);
+  init_spent_key_index(db_flags & DBF_SPENT_KEY_INDEX);
   // from here, init should be finished
 }
 
@@ -1582,8 +2783,33 @@ void BlockchainLMDB::close()
     LOG_PRINT_L3("close() first calling batch_abort() due to active batch transaction");
     batch_abort();
   }
+  if (m_bulk_load)
+  {
+    try { bulk_load_finish(); }
+    catch (const std::exception &e) { MERROR("Failed to build the bulk load indexes: " << e.what()); }
+  }
   this->sync();
   m_tinfo.reset();
+  m_compression.reset();
+  m_prunable_compressed = false;
+  // space still waiting for readers is left behind, unreferenced
+  m_cold_segments.reset();
+  m_cold_freed.clear();
+  m_cold_freed_unsynced.clear();
+  m_cold_reclaimable.clear();
+  m_tip_first_tx_ids.clear();
+  m_spent_key_index = false;
+  m_block_cache->clear();
+
+  // free the other threads' read txns while the env is still there, those in use are left to leak
+  {
+    boost::lock_guard<boost::mutex> lock(m_thread_infos->lock);
+    for (mdb_threadinfo *tinfo: m_thread_infos->infos)
+      if (!tinfo->m_ti_rflags.m_rf_txn)
+        tinfo->free_rtxn();
+    m_thread_infos->infos.clear();
+    ++*m_env_generation;
+  }
 
   // FIXME: not yet thread safe!!!  Use with care.
   mdb_env_close(m_env);
@@ -1598,12 +2824,20 @@ void BlockchainLMDB::sync()
   if (is_read_only())
     return;
 
+  // segment data must be on disk before the locations pointing to it
+  sync_cold_segments();
+
   // Does nothing unless LMDB environment was opened with MDB_NOSYNC or in part
   // MDB_NOMETASYNC. Force flush to be synchronous.
   if (auto result = mdb_env_sync(m_env, true))
   {
     throw0(DB_ERROR(lmdb_error("Failed to sync database: ", result).c_str()));
   }
+
+  // the commits which freed segment space are now on disk too
+  m_cold_reclaimable.insert(m_cold_reclaimable.end(), m_cold_freed_unsynced.begin(), m_cold_freed_unsynced.end());
+  m_cold_freed_unsynced.clear();
+  reclaim_cold_segments();
 }
 
 void BlockchainLMDB::safesyncmode(const bool onoff)
@@ -1657,6 +2891,45 @@ void BlockchainLMDB::reset()
   if (auto result = mdb_put(txn, m_properties, &k, &v, 0))
     throw0(DB_ERROR(lmdb_error("Failed to write version to database: ", result).c_str()));
 
+  // an empty table is trivially compressed, keep the mode; the dictionary went with the properties
+  if (m_prunable_compressed)
+  {
+    MDB_val_str(ck, "compression");
+    MDB_val_copy<uint32_t> cv(COMPRESSION_ZSTD);
+    if (auto result = mdb_put(txn, m_properties, &ck, &cv, 0))
+      throw0(DB_ERROR(lmdb_error("Failed to write compression mode to database: ", result).c_str()));
+#ifdef HAVE_ZSTD
+    m_compression->clear_dictionary();
+#endif
+  }
+
+  if (m_cold_segments)
+  {
+    if (auto result = mdb_drop(txn, m_txs_prunable_cold, 0))
+      throw0(DB_ERROR(lmdb_error("Failed to drop m_txs_prunable_cold: ", result).c_str()));
+    MDB_val_str(ck, "cold_next_tx_id");
+    MDB_val_copy<uint64_t> cv(0);
+    if (auto result = mdb_put(txn, m_properties, &ck, &cv, 0))
+      throw0(DB_ERROR(lmdb_error("Failed to write cold prunable tx id to database: ", result).c_str()));
+    m_cold_segments->clear();
+    m_cold_freed.clear();
+    m_cold_freed_unsynced.clear();
+    m_cold_reclaimable.clear();
+    m_tip_first_tx_ids.clear();
+  }
+
+  // an empty chain is fully indexed
+  if (m_spent_key_index)
+  {
+    if (auto result = mdb_drop(txn, m_spent_key_txs, 0))
+      throw0(DB_ERROR(lmdb_error("Failed to drop m_spent_key_txs: ", result).c_str()));
+    MDB_val_str(sk, "spent_key_index_height");
+    MDB_val_copy<uint64_t> sv(SPENT_KEY_INDEX_COMPLETE);
+    if (auto result = mdb_put(txn, m_properties, &sk, &sv, 0))
+      throw0(DB_ERROR(lmdb_error("Failed to write spent key index height to database: ", result).c_str()));
+  }
+
+  m_block_cache->invalidate(txn, 0);
   txn.commit();
   m_cum_size = 0;
   m_cum_count = 0;
@@ -1729,10 +3002,9 @@ void BlockchainLMDB::unlock()
 #define TXN_PREFIX_RDONLY() \
   MDB_txn *m_txn; \
   mdb_txn_cursors *m_cursors; \
-  mdb_txn_safe auto_txn; \
+  mdb_txn_safe auto_txn(false); \
   bool my_rtxn = block_rtxn_start(&m_txn, &m_cursors); \
-  if (my_rtxn) auto_txn.m_tinfo = m_tinfo.get(); \
-  else auto_txn.uncheck()
+  if (my_rtxn) auto_txn.m_tinfo = m_tinfo.get()
 #define TXN_POSTFIX_RDONLY()
 
 #define TXN_POSTFIX_SUCCESS() \
@@ -2019,7 +3291,7 @@ static bool is_v1_tx(MDB_cursor *c_txs_pruned, MDB_val *tx_id)
   return cryptonote::is_v1_tx(cryptonote::blobdata_ref{(const char*)v.mv_data, v.mv_size});
 }
 
-enum { prune_mode_prune, prune_mode_update, prune_mode_check };
+enum { prune_mode_update, prune_mode_check };
 
 bool BlockchainLMDB::prune_worker(int mode, uint32_t pruning_seed)
 {
@@ -2053,23 +3325,11 @@ bool BlockchainLMDB::prune_worker(int mode, uint32_t pruning_seed)
   bool prune_tip_table = false;
   if (result == MDB_NOTFOUND)
   {
-    // not pruned yet
-    if (mode != prune_mode_prune)
-    {
-      txn.abort();
-      TIME_MEASURE_FINISH(t);
-      MDEBUG("Pruning not enabled, nothing to do");
-      return true;
-    }
-    if (pruning_seed == 0)
-      pruning_seed = tools::get_random_stripe();
-    pruning_seed = tools::make_pruning_seed(pruning_seed, CRYPTONOTE_PRUNING_LOG_STRIPES);
-    v.mv_data = &pruning_seed;
-    v.mv_size = sizeof(pruning_seed);
-    result = mdb_put(txn, m_properties, &k, &v, 0);
-    if (result)
-      throw0(DB_ERROR("Failed to save pruning seed"));
-    prune_tip_table = false;
+    // not pruned yet, pruning itself is done by prune_blockchain_step
+    txn.abort();
+    TIME_MEASURE_FINISH(t);
+    MDEBUG("Pruning not enabled, nothing to do");
+    return true;
   }
   else if (result == 0)
   {
@@ -2096,6 +3356,22 @@ bool BlockchainLMDB::prune_worker(int mode, uint32_t pruning_seed)
   else
     MINFO("Pruning blockchain...");
 
+  // prunable data moved to segment files leaves only its location in txs_prunable_cold,
+  // pruning drops the location and the space in the segment is not reclaimed
+  auto find_cold_prunable = [&](MDB_val *key, bool del) -> bool {
+    if (!m_cold_segments)
+      return false;
+    MDB_val cv;
+    int ret = mdb_get(txn, m_txs_prunable_cold, key, &cv);
+    if (ret == MDB_NOTFOUND)
+      return false;
+    if (ret)
+      throw0(DB_ERROR(lmdb_error("Failed to find cold transaction prunable data: ", ret).c_str()));
+    if (del && (ret = mdb_del(txn, m_txs_prunable_cold, key, NULL)))
+      throw0(DB_ERROR(lmdb_error("Failed to delete cold transaction prunable data: ", ret).c_str()));
+    return true;
+  };
+
   MDB_cursor *c_txs_pruned, *c_txs_prunable, *c_txs_prunable_tip;
   result = mdb_cursor_open(txn, m_txs_pruned, &c_txs_pruned);
   if (result)
@@ -2129,7 +3405,13 @@ bool BlockchainLMDB::prune_worker(int mode, uint32_t pruning_seed)
         {
           ++n_prunable_records;
           result = mdb_cursor_get(c_txs_prunable, &k, &v, MDB_SET);
-          if (result == MDB_NOTFOUND)
+          if (result == MDB_NOTFOUND && find_cold_prunable(&k, true))
+          {
+            MDEBUG("Pruning cold data at height " << block_height << "/" << blockchain_height);
+            ++n_pruned_records;
+            ++commit_counter;
+          }
+          else if (result == MDB_NOTFOUND)
             MDEBUG("Already pruned at height " << block_height << "/" << blockchain_height);
           else if (result)
             throw0(DB_ERROR(lmdb_error("Failed to find transaction prunable data: ", result).c_str()));
@@ -2210,103 +3492,308 @@ bool BlockchainLMDB::prune_worker(int mode, uint32_t pruning_seed)
             throw0(DB_ERROR(lmdb_error("Error looking for transaction prunable data: ", result).c_str()));
         }
       }
-      MDB_val_set(kp, ti.data.tx_id);
-      if (!tools::has_unpruned_block(block_height, blockchain_height, pruning_seed) && !is_v1_tx(c_txs_pruned, &kp))
+      MDB_val_set(kp, ti.data.tx_id);
+      if (!tools::has_unpruned_block(block_height, blockchain_height, pruning_seed) && !is_v1_tx(c_txs_pruned, &kp))
+      {
+        result = mdb_cursor_get(c_txs_prunable, &kp, &v, MDB_SET);
+        if (result && result != MDB_NOTFOUND)
+          throw0(DB_ERROR(lmdb_error("Error looking for transaction prunable data: ", result).c_str()));
+        if (mode == prune_mode_check)
+        {
+          if (result != MDB_NOTFOUND || find_cold_prunable(&kp, false))
+            MERROR("Prunable data found for pruned height " << block_height << "/" << blockchain_height <<
+                ", seed " << epee::string_tools::to_string_hex(pruning_seed));
+        }
+        else
+        {
+          ++n_prunable_records;
+          if (result == MDB_NOTFOUND && find_cold_prunable(&kp, true))
+          {
+            MDEBUG("Pruning cold data at height " << block_height << "/" << blockchain_height);
+            ++n_pruned_records;
+            ++commit_counter;
+          }
+          else if (result == MDB_NOTFOUND)
+            MDEBUG("Already pruned at height " << block_height << "/" << blockchain_height);
+          else
+          {
+            MDEBUG("Pruning at height " << block_height << "/" << blockchain_height);
+            ++n_pruned_records;
+            n_bytes += kp.mv_size + v.mv_size;
+            result = mdb_cursor_del(c_txs_prunable, 0);
+            if (result)
+              throw0(DB_ERROR(lmdb_error("Failed to delete transaction prunable data: ", result).c_str()));
+            ++commit_counter;
+          }
+        }
+      }
+      else
+      {
+        if (mode == prune_mode_check)
+        {
+          MDB_val_set(kp, ti.data.tx_id);
+          result = mdb_cursor_get(c_txs_prunable, &kp, &v, MDB_SET);
+          if (result && result != MDB_NOTFOUND)
+            throw0(DB_ERROR(lmdb_error("Error looking for transaction prunable data: ", result).c_str()));
+          if (result == MDB_NOTFOUND && !find_cold_prunable(&kp, false))
+            MERROR("Prunable data not found for unpruned height " << block_height << "/" << blockchain_height <<
+                ", seed " << epee::string_tools::to_string_hex(pruning_seed));
+        }
+      }
+
+      if (mode != prune_mode_check && commit_counter >= 4096)
+      {
+        MDEBUG("Committing txn at checkpoint...");
+        txn.commit();
+        result = mdb_txn_begin(m_env, NULL, 0, txn);
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+        result = mdb_cursor_open(txn, m_txs_pruned, &c_txs_pruned);
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for txs_pruned: ", result).c_str()));
+        result = mdb_cursor_open(txn, m_txs_prunable, &c_txs_prunable);
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for txs_prunable: ", result).c_str()));
+        result = mdb_cursor_open(txn, m_txs_prunable_tip, &c_txs_prunable_tip);
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for txs_prunable_tip: ", result).c_str()));
+        result = mdb_cursor_open(txn, m_tx_indices, &c_tx_indices);
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for tx_indices: ", result).c_str()));
+        MDB_val val;
+        val.mv_size = sizeof(ti);
+        val.mv_data = (void *)&ti;
+        result = mdb_cursor_get(c_tx_indices, (MDB_val*)&zerokval, &val, MDB_GET_BOTH);
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to restore cursor for tx_indices: ", result).c_str()));
+        commit_counter = 0;
+      }
+    }
+    mdb_cursor_close(c_tx_indices);
+  }
+
+  if ((result = mdb_stat(txn, m_txs_prunable, &db_stats)))
+    throw0(DB_ERROR(lmdb_error("Failed to query m_txs_prunable: ", result).c_str()));
+  const size_t pages1 = db_stats.ms_branch_pages + db_stats.ms_leaf_pages + db_stats.ms_overflow_pages;
+  const size_t db_bytes = (pages0 - pages1) * db_stats.ms_psize;
+
+  mdb_cursor_close(c_txs_prunable_tip);
+  mdb_cursor_close(c_txs_prunable);
+  mdb_cursor_close(c_txs_pruned);
+
+  txn.commit();
+
+  TIME_MEASURE_FINISH(t);
+
+  MINFO((mode == prune_mode_check ? "Checked" : "Pruned") << " blockchain in " <<
+      t << " ms: " << (n_bytes/1024.0f/1024.0f) << " MB (" << db_bytes/1024.0f/1024.0f << " MB) pruned in " <<
+      n_pruned_records << " records (" << pages0 - pages1 << "/" << pages0 << " " << db_stats.ms_psize << " byte pages), " <<
+      n_prunable_records << "/" << n_total_records << " pruned records");
+  return true;
+}
+
+bool BlockchainLMDB::prune_blockchain(uint32_t pruning_seed)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  TIME_MEASURE_START(t);
+  uint64_t n_bytes = 0, pruned_bytes;
+  while (!prune_blockchain_step(pruning_seed, 4096, std::numeric_limits<uint64_t>::max(), pruned_bytes))
+    n_bytes += pruned_bytes;
+  n_bytes += pruned_bytes;
+  TIME_MEASURE_FINISH(t);
+  MINFO("Pruned blockchain in " << t << " ms: " << (n_bytes/1024.0f/1024.0f) << " MB pruned");
+  return true;
+}
+
+bool BlockchainLMDB::prune_blockchain_step(uint32_t pruning_seed, size_t max_records, uint64_t max_bytes, uint64_t &pruned_bytes)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  const uint32_t log_stripes = tools::get_pruning_log_stripes(pruning_seed);
+  if (log_stripes && log_stripes != CRYPTONOTE_PRUNING_LOG_STRIPES)
+    throw0(DB_ERROR("Pruning seed not in range"));
+  pruning_seed = tools::get_pruning_stripe(pruning_seed);
+  if (pruning_seed > (1ul << CRYPTONOTE_PRUNING_LOG_STRIPES))
+    throw0(DB_ERROR("Pruning seed not in range"));
+  check_open();
+
+  pruned_bytes = 0;
+  const uint64_t blockchain_height = height();
+
+  mdb_txn_safe txn;
+  if (auto result = lmdb_txn_begin(m_env, NULL, 0, txn))
+    throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+
+  MDB_val_str(sk, "pruning_seed");
+  MDB_val_str(pk, "pruning_progress");
+  MDB_val v;
+  pruning_progress_t progress;
+  int result = mdb_get(txn, m_properties, &sk, &v);
+  if (result == MDB_NOTFOUND)
+  {
+    // txes added from now on go to the tip table, the run covers the blocks we have now
+    if (pruning_seed == 0)
+      pruning_seed = tools::get_random_stripe();
+    pruning_seed = tools::make_pruning_seed(pruning_seed, CRYPTONOTE_PRUNING_LOG_STRIPES);
+    v.mv_data = &pruning_seed;
+    v.mv_size = sizeof(pruning_seed);
+    if ((result = mdb_put(txn, m_properties, &sk, &v, 0)))
+      throw0(DB_ERROR(lmdb_error("Failed to save pruning seed: ", result).c_str()));
+    progress.next_height = 0;
+    progress.end_height = blockchain_height;
+    MINFO("Pruning blockchain up to height " << blockchain_height << ", seed " << epee::string_tools::to_string_hex(pruning_seed));
+  }
+  else if (result == 0)
+  {
+    if (v.mv_size != sizeof(uint32_t))
+      throw0(DB_ERROR("Failed to retrieve or create pruning seed: unexpected value size"));
+    const uint32_t data = *(const uint32_t*)v.mv_data;
+    if (pruning_seed == 0)
+      pruning_seed = tools::get_pruning_stripe(data);
+    if (tools::get_pruning_stripe(data) != pruning_seed)
+      throw0(DB_ERROR("Blockchain already pruned with different seed"));
+    if (tools::get_pruning_log_stripes(data) != CRYPTONOTE_PRUNING_LOG_STRIPES)
+      throw0(DB_ERROR("Blockchain already pruned with different base"));
+    pruning_seed = tools::make_pruning_seed(pruning_seed, CRYPTONOTE_PRUNING_LOG_STRIPES);
+
+    result = mdb_get(txn, m_properties, &pk, &v);
+    if (result == MDB_NOTFOUND)
+    {
+      txn.abort();
+      MDEBUG("Blockchain already pruned, nothing to do");
+      return true;
+    }
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to retrieve pruning progress: ", result).c_str()));
+    if (v.mv_size != sizeof(progress))
+      throw0(DB_ERROR("Failed to retrieve pruning progress: unexpected value size"));
+    memcpy(&progress, v.mv_data, sizeof(progress));
+    // blocks popped since the run started took their data with them
+    progress.end_height = std::min(progress.end_height, blockchain_height);
+  }
+  else
+  {
+    throw0(DB_ERROR(lmdb_error("Failed to retrieve or create pruning seed: ", result).c_str()));
+  }
+
+  MDB_cursor *c_txs_pruned, *c_txs_prunable, *c_txs_prunable_tip;
+  result = mdb_cursor_open(txn, m_txs_pruned, &c_txs_pruned);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to open a cursor for txs_pruned: ", result).c_str()));
+  result = mdb_cursor_open(txn, m_txs_prunable, &c_txs_prunable);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to open a cursor for txs_prunable: ", result).c_str()));
+  result = mdb_cursor_open(txn, m_txs_prunable_tip, &c_txs_prunable_tip);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to open a cursor for txs_prunable_tip: ", result).c_str()));
+
+  size_t n_records = 0;
+  std::vector<segment_store::location> freed;
+  while (progress.next_height < progress.end_height && n_records < max_records && pruned_bytes < max_bytes)
+  {
+    const uint64_t block_height = progress.next_height;
+    const bool tip = block_height + CRYPTONOTE_PRUNING_TIP_BLOCKS >= blockchain_height;
+    if (!tip && tools::has_unpruned_block(block_height, blockchain_height, pruning_seed))
+    {
+      // we keep this stripe, skip to the next one without looking at its txes
+      progress.next_height = std::min(tools::get_next_pruned_block_height(block_height, blockchain_height, pruning_seed), progress.end_height);
+      continue;
+    }
+
+    size_t n_txes;
+    const uint64_t first_tx_id = get_block_first_tx_id(txn, block_height, &n_txes);
+    for (uint64_t tx_id = first_tx_id; tx_id < first_tx_id + n_txes; ++tx_id)
+    {
+      MDB_val_set(k, tx_id);
+      if (tip)
+      {
+        // update_pruning will take it from there once it leaves the tip
+        MDB_val_set(hv, block_height);
+        result = mdb_cursor_put(c_txs_prunable_tip, &k, &hv, 0);
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to add prunable tx id to db transaction: ", result).c_str()));
+        continue;
+      }
+      if (is_v1_tx(c_txs_pruned, &k))
+        continue;
+      result = mdb_cursor_get(c_txs_prunable, &k, &v, MDB_SET);
+      if (result == 0)
       {
-        result = mdb_cursor_get(c_txs_prunable, &kp, &v, MDB_SET);
-        if (result && result != MDB_NOTFOUND)
-          throw0(DB_ERROR(lmdb_error("Error looking for transaction prunable data: ", result).c_str()));
-        if (mode == prune_mode_check)
-        {
-          if (result != MDB_NOTFOUND)
-            MERROR("Prunable data found for pruned height " << block_height << "/" << blockchain_height <<
-                ", seed " << epee::string_tools::to_string_hex(pruning_seed));
-        }
-        else
-        {
-          ++n_prunable_records;
-          if (result == MDB_NOTFOUND)
-            MDEBUG("Already pruned at height " << block_height << "/" << blockchain_height);
-          else
-          {
-            MDEBUG("Pruning at height " << block_height << "/" << blockchain_height);
-            ++n_pruned_records;
-            n_bytes += kp.mv_size + v.mv_size;
-            result = mdb_cursor_del(c_txs_prunable, 0);
-            if (result)
-              throw0(DB_ERROR(lmdb_error("Failed to delete transaction prunable data: ", result).c_str()));
-            ++commit_counter;
-          }
-        }
+        pruned_bytes += k.mv_size + v.mv_size;
+        result = mdb_cursor_del(c_txs_prunable, 0);
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to delete transaction prunable data: ", result).c_str()));
       }
-      else
+      else if (result != MDB_NOTFOUND)
+        throw0(DB_ERROR(lmdb_error("Error looking for transaction prunable data: ", result).c_str()));
+      else if (m_cold_segments)
       {
-        if (mode == prune_mode_check)
+        result = mdb_get(txn, m_txs_prunable_cold, &k, &v);
+        if (result == 0)
         {
-          MDB_val_set(kp, ti.data.tx_id);
-          result = mdb_cursor_get(c_txs_prunable, &kp, &v, MDB_SET);
-          if (result && result != MDB_NOTFOUND)
-            throw0(DB_ERROR(lmdb_error("Error looking for transaction prunable data: ", result).c_str()));
-          if (result == MDB_NOTFOUND)
-            MERROR("Prunable data not found for unpruned height " << block_height << "/" << blockchain_height <<
-                ", seed " << epee::string_tools::to_string_hex(pruning_seed));
+          if (v.mv_size != sizeof(segment_store::location))
+            throw0(DB_ERROR("Unexpected cold prunable tx data location size"));
+          segment_store::location loc;
+          memcpy(&loc, v.mv_data, sizeof(loc));
+          freed.push_back(loc);
+          pruned_bytes += k.mv_size + loc.size;
+          if ((result = mdb_del(txn, m_txs_prunable_cold, &k, NULL)))
+            throw0(DB_ERROR(lmdb_error("Failed to delete cold transaction prunable data: ", result).c_str()));
         }
-      }
-
-      if (mode != prune_mode_check && commit_counter >= 4096)
-      {
-        MDEBUG("Committing txn at checkpoint...");
-        txn.commit();
-        result = mdb_txn_begin(m_env, NULL, 0, txn);
-        if (result)
-          throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
-        result = mdb_cursor_open(txn, m_txs_pruned, &c_txs_pruned);
-        if (result)
-          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for txs_pruned: ", result).c_str()));
-        result = mdb_cursor_open(txn, m_txs_prunable, &c_txs_prunable);
-        if (result)
-          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for txs_prunable: ", result).c_str()));
-        result = mdb_cursor_open(txn, m_txs_prunable_tip, &c_txs_prunable_tip);
-        if (result)
-          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for txs_prunable_tip: ", result).c_str()));
-        result = mdb_cursor_open(txn, m_tx_indices, &c_tx_indices);
-        if (result)
-          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for tx_indices: ", result).c_str()));
-        MDB_val val;
-        val.mv_size = sizeof(ti);
-        val.mv_data = (void *)&ti;
-        result = mdb_cursor_get(c_tx_indices, (MDB_val*)&zerokval, &val, MDB_GET_BOTH);
-        if (result)
-          throw0(DB_ERROR(lmdb_error("Failed to restore cursor for tx_indices: ", result).c_str()));
-        commit_counter = 0;
+        else if (result != MDB_NOTFOUND)
+          throw0(DB_ERROR(lmdb_error("Error looking for cold transaction prunable data: ", result).c_str()));
       }
     }
-    mdb_cursor_close(c_tx_indices);
+    n_records += n_txes;
+    ++progress.next_height;
   }
 
-  if ((result = mdb_stat(txn, m_txs_prunable, &db_stats)))
-    throw0(DB_ERROR(lmdb_error("Failed to query m_txs_prunable: ", result).c_str()));
-  const size_t pages1 = db_stats.ms_branch_pages + db_stats.ms_leaf_pages + db_stats.ms_overflow_pages;
-  const size_t db_bytes = (pages0 - pages1) * db_stats.ms_psize;
-
   mdb_cursor_close(c_txs_prunable_tip);
   mdb_cursor_close(c_txs_prunable);
   mdb_cursor_close(c_txs_pruned);
 
-  txn.commit();
+  const bool done = progress.next_height >= progress.end_height;
+  if (done)
+  {
+    result = mdb_del(txn, m_properties, &pk, NULL);
+    if (result && result != MDB_NOTFOUND)
+      throw0(DB_ERROR(lmdb_error("Failed to remove pruning progress: ", result).c_str()));
+  }
+  else
+  {
+    MDB_val pv = {sizeof(progress), (void*)&progress};
+    result = mdb_put(txn, m_properties, &pk, &pv, 0);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to save pruning progress: ", result).c_str()));
+  }
 
-  TIME_MEASURE_FINISH(t);
+  txn.commit();
+  cold_segments_committed(freed);
 
-  MINFO((mode == prune_mode_check ? "Checked" : "Pruned") << " blockchain in " <<
-      t << " ms: " << (n_bytes/1024.0f/1024.0f) << " MB (" << db_bytes/1024.0f/1024.0f << " MB) pruned in " <<
-      n_pruned_records << " records (" << pages0 - pages1 << "/" << pages0 << " " << db_stats.ms_psize << " byte pages), " <<
-      n_prunable_records << "/" << n_total_records << " pruned records");
-  return true;
+  MDEBUG("Pruned up to height " << progress.next_height << "/" << progress.end_height << ", " << pruned_bytes << " bytes in " << n_records << " records");
+  if (done)
+    MINFO("Blockchain pruning complete");
+  return done;
 }
 
-bool BlockchainLMDB::prune_blockchain(uint32_t pruning_seed)
+bool BlockchainLMDB::get_pruning_progress(pruning_progress_t &progress) const
 {
-  return prune_worker(prune_mode_prune, pruning_seed);
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(properties)
+  MDB_val_str(k, "pruning_progress");
+  MDB_val v;
+  int result = mdb_cursor_get(m_cur_properties, &k, &v, MDB_SET);
+  if (result == MDB_NOTFOUND)
+    return false;
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to retrieve pruning progress: ", result).c_str()));
+  if (v.mv_size != sizeof(progress))
+    throw0(DB_ERROR("Failed to retrieve pruning progress: unexpected value size"));
+  memcpy(&progress, v.mv_data, sizeof(progress));
+  TXN_POSTFIX_RDONLY();
+  return true;
 }
 
 bool BlockchainLMDB::update_pruning()
@@ -2319,6 +3806,308 @@ bool BlockchainLMDB::check_pruning()
   return prune_worker(prune_mode_check, 0);
 }
 
+bool BlockchainLMDB::compact_start()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  if (is_read_only())
+  {
+    MERROR("Cannot compact a read-only database");
+    return false;
+  }
+
+  const boost::filesystem::path folder = get_compact_folder(m_folder);
+  boost::system::error_code ec;
+  boost::filesystem::remove_all(folder, ec);
+  if (!boost::filesystem::create_directories(folder, ec))
+  {
+    MERROR("Failed to create " << folder.string() << ": " << ec.message());
+    return false;
+  }
+
+  // this copies from a read snapshot, so blocks keep being added meanwhile
+  MGINFO("Writing a compacted copy of the database to " << folder.string());
+  const uint64_t t0 = epee::misc_utils::get_tick_count();
+  if (int result = mdb_env_copy2(m_env, folder.string().c_str(), MDB_CP_COMPACT))
+  {
+    MERROR(lmdb_error("Failed to copy the database: ", result));
+    boost::filesystem::remove_all(folder, ec);
+    return false;
+  }
+  MGINFO("Compacted copy written in " << (epee::misc_utils::get_tick_count() - t0) / 1000 << " seconds");
+  return true;
+}
+
+void BlockchainLMDB::catch_up_compacted(BlockchainLMDB &copy) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+
+  // the snapshot has no record of pruning, which rewrites old blocks rather than adding new ones
+  if (copy.get_blockchain_pruning_seed() != get_blockchain_pruning_seed())
+    throw0(DB_ERROR("The database was pruned while it was being compacted"));
+
+  const uint64_t live_height = height();
+  uint64_t common_height = std::min(copy.height(), live_height);
+  while (common_height > 0 && copy.get_block_hash_from_height(common_height - 1) != get_block_hash_from_height(common_height - 1))
+    --common_height;
+
+  copy.batch_start(live_height - common_height, 0);
+  try
+  {
+    while (copy.height() > common_height)
+    {
+      block b;
+      std::vector<transaction> txs;
+      copy.pop_block(b, txs);
+    }
+
+    // the same way blocks are added to the live db, but with the hard fork versions it recorded
+    for (uint64_t h = common_height; h < live_height; ++h)
+    {
+      std::pair<block, blobdata> blk;
+      blk.second = get_block_blob_from_height(h);
+      if (!parse_and_validate_block_from_blob(blk.second, blk.first))
+        throw0(DB_ERROR("Failed to parse block from the db"));
+
+      std::vector<std::pair<transaction, blobdata>> txs;
+      txs.reserve(blk.first.tx_hashes.size());
+      for (const crypto::hash &tx_hash: blk.first.tx_hashes)
+      {
+        txs.emplace_back();
+        if (!get_tx_blob(tx_hash, txs.back().second) || !parse_and_validate_tx_from_blob(txs.back().second, txs.back().first))
+          throw0(DB_ERROR(("Failed to get tx " + epee::string_tools::pod_to_hex(tx_hash) + " from the db").c_str()));
+      }
+
+      copy.add_block(blk, get_block_weight(h), get_block_long_term_weight(h), get_block_cumulative_difficulty(h),
+          get_block_already_generated_coins(h), txs);
+      copy.set_hard_fork_version(h, get_hard_fork_version(h));
+    }
+
+    // the pool and alt blocks are small, take them as they are now
+    TXN_PREFIX_RDONLY();
+    copy_table(m_txn, m_txpool_meta, *copy.m_write_txn, copy.m_txpool_meta, "txpool_meta");
+    copy_table(m_txn, m_txpool_blob, *copy.m_write_txn, copy.m_txpool_blob, "txpool_blob");
+    copy_table(m_txn, m_alt_blocks, *copy.m_write_txn, copy.m_alt_blocks, "alt_blocks");
+  }
+  catch (...)
+  {
+    copy.batch_abort();
+    throw;
+  }
+  copy.batch_stop();
+  MGINFO("Replayed " << live_height - common_height << " blocks into the compacted copy");
+}
+
+bool BlockchainLMDB::compact_finish()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  const boost::filesystem::path folder = get_compact_folder(m_folder);
+  const boost::filesystem::path compacted = folder / CRYPTONOTE_BLOCKCHAINDATA_FILENAME;
+  boost::system::error_code ec;
+  if (!boost::filesystem::exists(compacted, ec))
+  {
+    MERROR("No compacted copy of the database found");
+    return false;
+  }
+  if (m_write_txn)
+  {
+    MERROR("Cannot finish compacting the database while a write transaction is in progress");
+    boost::filesystem::remove_all(folder, ec);
+    return false;
+  }
+
+  const uint64_t old_size = get_database_size();
+  try
+  {
+    BlockchainLMDB copy;
+    // the copy points into the same segment files, and appends behind us while we are idle
+    copy.m_cold_segments_folder = (boost::filesystem::path(m_folder) / COLD_SEGMENTS_FOLDER).string();
+    copy.open(folder.string(), m_db_flags);
+    if (!copy.is_open())
+      throw0(DB_ERROR("Failed to open the compacted copy"));
+    catch_up_compacted(copy);
+    copy.close();
+  }
+  catch (const std::exception &e)
+  {
+    MERROR("Failed to bring the compacted copy up to date: " << e.what());
+    boost::filesystem::remove_all(folder, ec);
+    return false;
+  }
+
+  // every read txn is counted, on whichever thread, so once they are all done
+  // none is left to use the env after it is closed
+  CRITICAL_REGION_LOCAL(m_synchronization_lock);
+  mdb_txn_safe::prevent_new_txns();
+  epee::misc_utils::auto_scope_leave_caller gate = epee::misc_utils::create_scope_leave_handler([](){ mdb_txn_safe::allow_new_txns(); });
+  if (m_tinfo.get())
+    m_tinfo->end_rtxn();
+  mdb_txn_safe::wait_no_active_txns();
+
+  const int db_flags = m_db_flags;
+  const boost::filesystem::path live = boost::filesystem::path(m_folder) / CRYPTONOTE_BLOCKCHAINDATA_FILENAME;
+  const boost::filesystem::path backup = folder / PRE_COMPACT_FILENAME;
+  close();
+  boost::filesystem::rename(live, backup, ec);
+  if (!ec)
+  {
+    boost::filesystem::rename(compacted, live, ec);
+    if (ec)
+      boost::filesystem::rename(backup, live);
+  }
+  if (ec)
+  {
+    MERROR("Failed to swap in the compacted database: " << ec.message());
+    open(m_folder, db_flags);
+    boost::filesystem::remove_all(folder, ec);
+    return false;
+  }
+
+  try
+  {
+    open(m_folder, db_flags);
+    if (!is_open())
+      throw0(DB_ERROR("Failed to open the compacted database"));
+  }
+  catch (const std::exception &e)
+  {
+    MERROR("Failed to open the compacted database, going back to the old one: " << e.what());
+    if (is_open())
+      close();
+    boost::filesystem::rename(backup, live);
+    open(m_folder, db_flags);
+    boost::filesystem::remove_all(folder, ec);
+    return false;
+  }
+  boost::filesystem::remove_all(folder, ec);
+
+  MGINFO("Database compacted from " << old_size / (1024 * 1024) << " MiB to " << get_database_size() / (1024 * 1024) << " MiB");
+  return true;
+}
+
+bool BlockchainLMDB::bulk_load_start()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  if (is_read_only())
+  {
+    MERROR("Cannot bulk load into a read-only database");
+    return false;
+  }
+  if (m_bulk_load)
+    throw0(DB_ERROR("A bulk load is already in progress"));
+  if (m_write_txn)
+    throw0(DB_ERROR("Cannot start a bulk load while a write transaction is in progress"));
+
+  // until the indexes are built, the db is only usable by the process doing the load
+  const uint64_t start_height = height();
+  mdb_txn_safe txn;
+  if (auto result = lmdb_txn_begin(m_env, NULL, 0, txn))
+    throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+  MDB_val_str(k, "bulk_load_height");
+  MDB_val_copy<uint64_t> v(start_height);
+  if (auto result = mdb_put(txn, m_properties, &k, &v, 0))
+    throw0(DB_ERROR(lmdb_error("Failed to write bulk load height: ", result).c_str()));
+  txn.commit();
+
+  m_bulk_load.reset(new bulk_load_state((boost::filesystem::path(m_folder) / BULK_LOAD_FOLDER).string()));
+  MGINFO("Bulk load started at height " << start_height << ", block, tx and key image indexes will be built at the end");
+  return true;
+}
+
+void BlockchainLMDB::append_spooled(sorted_spool &spool, MDB_dbi dbi, size_t value_size, const char *what, uint64_t db_height, uint64_t (*get_height)(const void*))
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  MGINFO("Appending " << spool.size() << " spooled " << what << " entries");
+
+  mdb_txn_safe txn;
+  MDB_cursor *cursor = NULL;
+  auto begin = [&]() {
+    if (auto result = lmdb_txn_begin(m_env, NULL, 0, txn))
+      throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+    if (auto result = mdb_cursor_open(txn, dbi, &cursor))
+      throw0(DB_ERROR(lmdb_error(std::string("Failed to open a cursor for ") + what + ": ", result).c_str()));
+  };
+  begin();
+
+  uint64_t n_appended = 0, n_dropped = 0;
+  spool.merge([&](const void *record) {
+    if (get_height(record) >= db_height)
+    {
+      ++n_dropped;
+      return;
+    }
+    MDB_val v = {value_size, (void*)record};
+    // the table may already hold entries from before the bulk load, which the new ones interleave with
+    int result = mdb_cursor_put(cursor, (MDB_val *)&zerokval, &v, MDB_APPENDDUP);
+    if (result == MDB_KEYEXIST)
+      result = mdb_cursor_put(cursor, (MDB_val *)&zerokval, &v, MDB_NODUPDATA);
+    if (result == MDB_KEYEXIST)
+      throw0(DB_ERROR((std::string("Duplicate ") + what + " found while building indexes: " + epee::string_tools::pod_to_hex(*(const crypto::hash*)record)).c_str()));
+    if (result)
+      throw0(DB_ERROR(lmdb_error(std::string("Failed to append ") + what + " entry: ", result).c_str()));
+    if (++n_appended % BULK_LOAD_COMMIT_INTERVAL == 0)
+    {
+      mdb_cursor_close(cursor);
+      txn.commit();
+      begin();
+    }
+  });
+  mdb_cursor_close(cursor);
+  txn.commit();
+
+  if (n_dropped)
+    MINFO("Dropped " << n_dropped << " " << what << " entries of blocks which were not committed");
+}
+
+void BlockchainLMDB::bulk_load_finish()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  if (!m_bulk_load)
+    return;
+  if (m_write_txn)
+    throw0(DB_ERROR("Cannot finish a bulk load while a write transaction is in progress"));
+
+  // from here, writes go to the tables again, even if building the indexes fails
+  std::unique_ptr<bulk_load_state> state = std::move(m_bulk_load);
+  const uint64_t t0 = epee::misc_utils::get_tick_count();
+  const uint64_t db_height = height();
+
+  // appended entries fill their pages, leave room for the branch pages too
+  const uint64_t bytes = 2 * (state->block_heights.size() * sizeof(blk_height) + state->tx_indices.size() * sizeof(txindex) + state->spent_keys.size() * sizeof(crypto::key_image)
+      + state->spent_key_txs.size() * sizeof(spent_key_tx));
+  if (need_resize(bytes))
+    do_resize(std::max<uint64_t>(bytes, 512 * (1 << 20)));
+
+  append_spooled(state->block_heights, m_block_heights, sizeof(blk_height), "block height", db_height,
+      [](const void *r) { return ((const blk_height*)r)->bh_height; });
+  append_spooled(state->tx_indices, m_tx_indices, sizeof(txindex), "tx index", db_height,
+      [](const void *r) { return ((const txindex*)r)->data.block_id; });
+  append_spooled(state->spent_keys, m_spent_keys, sizeof(crypto::key_image), "spent key image", db_height,
+      [](const void *r) { return ((const bulk_load_state::spooled_key_image*)r)->height; });
+  if (m_spent_key_index)
+    append_spooled(state->spent_key_txs, m_spent_key_txs, sizeof(spent_key_tx), "spent key image tx", db_height,
+        [](const void *r) { return ((const spent_key_tx*)r)->height; });
+
+  mdb_txn_safe txn;
+  if (auto result = lmdb_txn_begin(m_env, NULL, 0, txn))
+    throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+  MDB_val_str(k, "bulk_load_height");
+  if (auto result = mdb_del(txn, m_properties, &k, NULL))
+    throw0(DB_ERROR(lmdb_error("Failed to remove bulk load height: ", result).c_str()));
+  txn.commit();
+
+  boost::system::error_code ec;
+  boost::filesystem::remove_all(state->folder, ec);
+  MGINFO("Bulk load indexes built in " << (epee::misc_utils::get_tick_count() - t0) / 1000 << " seconds");
+}
+
 bool BlockchainLMDB::for_all_txpool_txes(std::function<bool(const crypto::hash&, const txpool_tx_meta_t&, const cryptonote::blobdata_ref*)> f, bool include_blob, relay_category category) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
@@ -2475,8 +4264,29 @@ block_header BlockchainLMDB::get_block_header(const crypto::hash& h) const
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
+  // one read txn for both lookups, so a pop in between cannot hand back the
+  // block that replaced h at its height
+  TXN_PREFIX_RDONLY();
   // block_header object is automatically cast from block object
-  return get_block(h);
+  block_header ret = get_block_from_height(get_block_height(h));
+  TXN_POSTFIX_RDONLY();
+  return ret;
+}
+
+block BlockchainLMDB::get_block_from_height(const uint64_t& height) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  TXN_PREFIX_RDONLY();
+  block b;
+  if (!m_block_cache->get_block(m_txn, height, b))
+  {
+    b = BlockchainDB::get_block_from_height(height);
+    m_block_cache->put_block(m_txn, m_cursors == &m_wcursors, height, b);
+  }
+  TXN_POSTFIX_RDONLY();
+  return b;
 }
 
 cryptonote::blobdata BlockchainLMDB::get_block_blob_from_height(const uint64_t& height) const
@@ -2498,7 +4308,7 @@ cryptonote::blobdata BlockchainLMDB::get_block_blob_from_height(const uint64_t&
     throw0(DB_ERROR("Error attempting to retrieve a block from the db"));
 
   blobdata bd;
-  bd.assign(reinterpret_cast<char*>(result.mv_data), result.mv_size);
+  get_block_blob_from_value(result, bd);
 
   TXN_POSTFIX_RDONLY();
 
@@ -2511,19 +4321,24 @@ uint64_t BlockchainLMDB::get_block_timestamp(const uint64_t& height) const
   check_open();
 
   TXN_PREFIX_RDONLY();
-  RCURSOR(block_info);
-
-  MDB_val_set(result, height);
-  auto get_result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
-  if (get_result == MDB_NOTFOUND)
+  mdb_block_info bi;
+  if (!m_block_cache->get_info(m_txn, height, bi))
   {
-    throw0(BLOCK_DNE(std::string("Attempt to get timestamp from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- timestamp not in db").c_str()));
-  }
-  else if (get_result)
-    throw0(DB_ERROR("Error attempting to retrieve a timestamp from the db"));
+    RCURSOR(block_info);
+
+    MDB_val_set(result, height);
+    auto get_result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
+    if (get_result == MDB_NOTFOUND)
+    {
+      throw0(BLOCK_DNE(std::string("Attempt to get timestamp from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- timestamp not in db").c_str()));
+    }
+    else if (get_result)
+      throw0(DB_ERROR("Error attempting to retrieve a timestamp from the db"));
 
-  mdb_block_info *bi = (mdb_block_info *)result.mv_data;
-  uint64_t ret = bi->bi_timestamp;
+    memcpy(&bi, result.mv_data, sizeof(bi));
+    m_block_cache->put_info(m_txn, m_cursors == &m_wcursors, height, bi);
+  }
+  uint64_t ret = bi.bi_timestamp;
   TXN_POSTFIX_RDONLY();
   return ret;
 }
@@ -2611,19 +4426,24 @@ size_t BlockchainLMDB::get_block_weight(const uint64_t& height) const
   check_open();
 
   TXN_PREFIX_RDONLY();
-  RCURSOR(block_info);
-
-  MDB_val_set(result, height);
-  auto get_result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
-  if (get_result == MDB_NOTFOUND)
+  mdb_block_info bi;
+  if (!m_block_cache->get_info(m_txn, height, bi))
   {
-    throw0(BLOCK_DNE(std::string("Attempt to get block size from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- block size not in db").c_str()));
-  }
-  else if (get_result)
-    throw0(DB_ERROR("Error attempting to retrieve a block size from the db"));
+    RCURSOR(block_info);
+
+    MDB_val_set(result, height);
+    auto get_result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
+    if (get_result == MDB_NOTFOUND)
+    {
+      throw0(BLOCK_DNE(std::string("Attempt to get block size from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- block size not in db").c_str()));
+    }
+    else if (get_result)
+      throw0(DB_ERROR("Error attempting to retrieve a block size from the db"));
 
-  mdb_block_info *bi = (mdb_block_info *)result.mv_data;
-  size_t ret = bi->bi_weight;
+    memcpy(&bi, result.mv_data, sizeof(bi));
+    m_block_cache->put_info(m_txn, m_cursors == &m_wcursors, height, bi);
+  }
+  size_t ret = bi.bi_weight;
   TXN_POSTFIX_RDONLY();
   return ret;
 }
@@ -2750,21 +4570,26 @@ difficulty_type BlockchainLMDB::get_block_cumulative_difficulty(const uint64_t&
   check_open();
 
   TXN_PREFIX_RDONLY();
-  RCURSOR(block_info);
-
-  MDB_val_set(result, height);
-  auto get_result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
-  if (get_result == MDB_NOTFOUND)
+  mdb_block_info bi;
+  if (!m_block_cache->get_info(m_txn, height, bi))
   {
-    throw0(BLOCK_DNE(std::string("Attempt to get cumulative difficulty from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- difficulty not in db").c_str()));
-  }
-  else if (get_result)
-    throw0(DB_ERROR("Error attempting to retrieve a cumulative difficulty from the db"));
+    RCURSOR(block_info);
+
+    MDB_val_set(result, height);
+    auto get_result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
+    if (get_result == MDB_NOTFOUND)
+    {
+      throw0(BLOCK_DNE(std::string("Attempt to get cumulative difficulty from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- difficulty not in db").c_str()));
+    }
+    else if (get_result)
+      throw0(DB_ERROR("Error attempting to retrieve a cumulative difficulty from the db"));
 
-  mdb_block_info *bi = (mdb_block_info *)result.mv_data;
-  difficulty_type ret = bi->bi_diff_hi;
+    memcpy(&bi, result.mv_data, sizeof(bi));
+    m_block_cache->put_info(m_txn, m_cursors == &m_wcursors, height, bi);
+  }
+  difficulty_type ret = bi.bi_diff_hi;
   ret <<= 64;
-  ret |= bi->bi_diff_lo;
+  ret |= bi.bi_diff_lo;
   TXN_POSTFIX_RDONLY();
   return ret;
 }
@@ -2792,19 +4617,24 @@ uint64_t BlockchainLMDB::get_block_already_generated_coins(const uint64_t& heigh
   check_open();
 
   TXN_PREFIX_RDONLY();
-  RCURSOR(block_info);
-
-  MDB_val_set(result, height);
-  auto get_result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
-  if (get_result == MDB_NOTFOUND)
+  mdb_block_info bi;
+  if (!m_block_cache->get_info(m_txn, height, bi))
   {
-    throw0(BLOCK_DNE(std::string("Attempt to get generated coins from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- block size not in db").c_str()));
-  }
-  else if (get_result)
-    throw0(DB_ERROR("Error attempting to retrieve a total generated coins from the db"));
+    RCURSOR(block_info);
+
+    MDB_val_set(result, height);
+    auto get_result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
+    if (get_result == MDB_NOTFOUND)
+    {
+      throw0(BLOCK_DNE(std::string("Attempt to get generated coins from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- block size not in db").c_str()));
+    }
+    else if (get_result)
+      throw0(DB_ERROR("Error attempting to retrieve a total generated coins from the db"));
 
-  mdb_block_info *bi = (mdb_block_info *)result.mv_data;
-  uint64_t ret = bi->bi_coins;
+    memcpy(&bi, result.mv_data, sizeof(bi));
+    m_block_cache->put_info(m_txn, m_cursors == &m_wcursors, height, bi);
+  }
+  uint64_t ret = bi.bi_coins;
   TXN_POSTFIX_RDONLY();
   return ret;
 }
@@ -2815,19 +4645,24 @@ uint64_t BlockchainLMDB::get_block_long_term_weight(const uint64_t& height) cons
   check_open();
 
   TXN_PREFIX_RDONLY();
-  RCURSOR(block_info);
-
-  MDB_val_set(result, height);
-  auto get_result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
-  if (get_result == MDB_NOTFOUND)
+  mdb_block_info bi;
+  if (!m_block_cache->get_info(m_txn, height, bi))
   {
-    throw0(BLOCK_DNE(std::string("Attempt to get block long term weight from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- block info not in db").c_str()));
-  }
-  else if (get_result)
-    throw0(DB_ERROR("Error attempting to retrieve a long term block weight from the db"));
+    RCURSOR(block_info);
+
+    MDB_val_set(result, height);
+    auto get_result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
+    if (get_result == MDB_NOTFOUND)
+    {
+      throw0(BLOCK_DNE(std::string("Attempt to get block long term weight from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- block info not in db").c_str()));
+    }
+    else if (get_result)
+      throw0(DB_ERROR("Error attempting to retrieve a long term block weight from the db"));
 
-  mdb_block_info *bi = (mdb_block_info *)result.mv_data;
-  uint64_t ret = bi->bi_long_term_block_weight;
+    memcpy(&bi, result.mv_data, sizeof(bi));
+    m_block_cache->put_info(m_txn, m_cursors == &m_wcursors, height, bi);
+  }
+  uint64_t ret = bi.bi_long_term_block_weight;
   TXN_POSTFIX_RDONLY();
   return ret;
 }
@@ -2838,19 +4673,24 @@ crypto::hash BlockchainLMDB::get_block_hash_from_height(const uint64_t& height)
   check_open();
 
   TXN_PREFIX_RDONLY();
-  RCURSOR(block_info);
-
-  MDB_val_set(result, height);
-  auto get_result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
-  if (get_result == MDB_NOTFOUND)
+  mdb_block_info bi;
+  if (!m_block_cache->get_info(m_txn, height, bi))
   {
-    throw0(BLOCK_DNE(std::string("Attempt to get hash from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- hash not in db").c_str()));
-  }
-  else if (get_result)
-    throw0(DB_ERROR(lmdb_error("Error attempting to retrieve a block hash from the db: ", get_result).c_str()));
+    RCURSOR(block_info);
+
+    MDB_val_set(result, height);
+    auto get_result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
+    if (get_result == MDB_NOTFOUND)
+    {
+      throw0(BLOCK_DNE(std::string("Attempt to get hash from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- hash not in db").c_str()));
+    }
+    else if (get_result)
+      throw0(DB_ERROR(lmdb_error("Error attempting to retrieve a block hash from the db: ", get_result).c_str()));
 
-  mdb_block_info *bi = (mdb_block_info *)result.mv_data;
-  crypto::hash ret = bi->bi_hash;
+    memcpy(&bi, result.mv_data, sizeof(bi));
+    m_block_cache->put_info(m_txn, m_cursors == &m_wcursors, height, bi);
+  }
+  crypto::hash ret = bi.bi_hash;
   TXN_POSTFIX_RDONLY();
   return ret;
 }
@@ -3039,12 +4879,14 @@ uint64_t BlockchainLMDB::get_tx_unlock_time(const crypto::hash& h) const
 bool BlockchainLMDB::get_tx_blob(const crypto::hash& h, cryptonote::blobdata &bd) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  mdb_op_timer op_timer(m_op_latency[op_get_tx_blob]);
   check_open();
 
   TXN_PREFIX_RDONLY();
   RCURSOR(tx_indices);
   RCURSOR(txs_pruned);
   RCURSOR(txs_prunable);
+  RCURSOR_COLD_PRUNABLE();
 
   MDB_val_set(v, h);
   MDB_val result0, result1;
@@ -3056,7 +4898,7 @@ bool BlockchainLMDB::get_tx_blob(const crypto::hash& h, cryptonote::blobdata &bd
     get_result = mdb_cursor_get(m_cur_txs_pruned, &val_tx_id, &result0, MDB_SET);
     if (get_result == 0)
     {
-      get_result = mdb_cursor_get(m_cur_txs_prunable, &val_tx_id, &result1, MDB_SET);
+      get_result = get_prunable_value(m_cur_txs_prunable, cur_txs_prunable_cold, val_tx_id, result1);
     }
   }
   if (get_result == MDB_NOTFOUND)
@@ -3065,7 +4907,7 @@ bool BlockchainLMDB::get_tx_blob(const crypto::hash& h, cryptonote::blobdata &bd
     throw0(DB_ERROR(lmdb_error("DB error attempting to fetch tx from hash", get_result).c_str()));
 
   bd.assign(reinterpret_cast<char*>(result0.mv_data), result0.mv_size);
-  bd.append(reinterpret_cast<char*>(result1.mv_data), result1.mv_size);
+  append_prunable(result1, bd);
 
   TXN_POSTFIX_RDONLY();
 
@@ -3147,6 +4989,7 @@ bool BlockchainLMDB::get_pruned_tx_blobs_from(const crypto::hash& h, size_t coun
 bool BlockchainLMDB::get_blocks_from(uint64_t start_height, size_t min_block_count, size_t max_block_count, size_t max_tx_count, size_t max_size, std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata>>>>& blocks, bool pruned, bool skip_coinbase, bool get_miner_tx_hash) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  mdb_op_timer op_timer(m_op_latency[op_get_blocks_from]);
   check_open();
 
   TXN_PREFIX_RDONLY();
@@ -3157,6 +5000,7 @@ bool BlockchainLMDB::get_blocks_from(uint64_t start_height, size_t min_block_cou
   {
     RCURSOR(txs_prunable);
   }
+  RCURSOR_COLD_PRUNABLE();
 
   blocks.reserve(std::min<size_t>(max_block_count, 10000)); // guard against very large max count if only checking bytes
   const uint64_t blockchain_height = height();
@@ -3178,8 +5022,8 @@ bool BlockchainLMDB::get_blocks_from(uint64_t start_height, size_t min_block_cou
     blocks.resize(blocks.size() + 1);
     auto &current_block = blocks.back();
 
-    current_block.first.first.assign(reinterpret_cast<char*>(v.mv_data), v.mv_size);
-    size += v.mv_size;
+    get_block_blob_from_value(v, current_block.first.first);
+    size += current_block.first.first.size();
 
     cryptonote::block b;
     if (!parse_and_validate_block_from_blob(current_block.first.first, b))
@@ -3206,12 +5050,6 @@ bool BlockchainLMDB::get_blocks_from(uint64_t start_height, size_t min_block_cou
       result = mdb_cursor_get(m_cur_txs_pruned, &val_tx_id, &v, op);
       if (result)
         throw0(DB_ERROR(lmdb_error("Error attempting to retrieve transaction data from the db: ", result).c_str()));
-      if (!pruned)
-      {
-        result = mdb_cursor_get(m_cur_txs_prunable, &val_tx_id, &v, op);
-        if (result)
-          throw0(DB_ERROR(lmdb_error("Error attempting to retrieve transaction data from the db: ", result).c_str()));
-      }
     }
 
     op = MDB_NEXT;
@@ -3229,10 +5067,11 @@ bool BlockchainLMDB::get_blocks_from(uint64_t start_height, size_t min_block_cou
 
       if (!pruned)
       {
-        result = mdb_cursor_get(m_cur_txs_prunable, &val_tx_id, &v, op);
+        // looked up by the key the pruned cursor is on, old records may not be in txs_prunable
+        result = get_prunable_value(m_cur_txs_prunable, cur_txs_prunable_cold, val_tx_id, v);
         if (result)
           throw0(DB_ERROR(lmdb_error("Error attempting to retrieve transaction data from the db: ", result).c_str()));
-        tx_blob.append(reinterpret_cast<const char*>(v.mv_data), v.mv_size);
+        append_prunable(v, tx_blob);
       }
       current_block.second.push_back(std::make_pair(tx_hash, std::move(tx_blob)));
       size += current_block.second.back().second.size();
@@ -3255,6 +5094,7 @@ bool BlockchainLMDB::get_prunable_tx_blob(const crypto::hash& h, cryptonote::blo
   TXN_PREFIX_RDONLY();
   RCURSOR(tx_indices);
   RCURSOR(txs_prunable);
+  RCURSOR_COLD_PRUNABLE();
 
   MDB_val_set(v, h);
   MDB_val result;
@@ -3263,14 +5103,15 @@ bool BlockchainLMDB::get_prunable_tx_blob(const crypto::hash& h, cryptonote::blo
   {
     const txindex *tip = (const txindex *)v.mv_data;
     MDB_val_set(val_tx_id, tip->data.tx_id);
-    get_result = mdb_cursor_get(m_cur_txs_prunable, &val_tx_id, &result, MDB_SET);
+    get_result = get_prunable_value(m_cur_txs_prunable, cur_txs_prunable_cold, val_tx_id, result);
   }
   if (get_result == MDB_NOTFOUND)
     return false;
   else if (get_result)
     throw0(DB_ERROR(lmdb_error("DB error attempting to fetch tx from hash", get_result).c_str()));
 
-  bd.assign(reinterpret_cast<char*>(result.mv_data), result.mv_size);
+  bd.clear();
+  append_prunable(result, bd);
 
   TXN_POSTFIX_RDONLY();
 
@@ -3388,6 +5229,7 @@ uint64_t BlockchainLMDB::get_num_outputs(const uint64_t& amount) const
 output_data_t BlockchainLMDB::get_output_key(const uint64_t& amount, const uint64_t& index, bool include_commitmemt) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  mdb_op_timer op_timer(m_op_latency[op_get_output_key]);
   check_open();
 
   TXN_PREFIX_RDONLY();
@@ -3501,6 +5343,7 @@ std::vector<std::vector<uint64_t>> BlockchainLMDB::get_tx_amount_output_indices(
 bool BlockchainLMDB::has_key_image(const crypto::key_image& img) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  mdb_op_timer op_timer(m_op_latency[op_has_key_image]);
   check_open();
 
   bool ret;
@@ -3515,6 +5358,93 @@ bool BlockchainLMDB::has_key_image(const crypto::key_image& img) const
   return ret;
 }
 
+bool BlockchainLMDB::get_key_image_spender(const crypto::key_image& img, crypto::hash &tx_hash, uint64_t &height) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  if (!m_spent_key_index)
+    return false;
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(spent_key_txs);
+
+  MDB_val v = {sizeof(img), (void *)&img};
+  int result = mdb_cursor_get(m_cur_spent_key_txs, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+  if (result == MDB_NOTFOUND)
+    return false;
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to get spent key tx: ", result).c_str()));
+
+  const spent_key_tx *skt = (const spent_key_tx *)v.mv_data;
+  tx_hash = skt->tx_hash;
+  height = skt->height;
+
+  TXN_POSTFIX_RDONLY();
+  return true;
+}
+
+void BlockchainLMDB::has_key_images(const epee::span<const crypto::key_image> &images, std::vector<bool> &spent) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  spent.assign(images.size(), false);
+  if (images.empty())
+    return;
+
+  // visit the images in the order of the spent keys table, so the cursor only moves forward
+  std::vector<size_t> order(images.size());
+  for (size_t i = 0; i < order.size(); ++i)
+    order[i] = i;
+  std::sort(order.begin(), order.end(), [&images](size_t a, size_t b) {
+    MDB_val va = {sizeof(crypto::key_image), (void *)&images[a]};
+    MDB_val vb = {sizeof(crypto::key_image), (void *)&images[b]};
+    return compare_hash32(&va, &vb) < 0;
+  });
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(spent_keys);
+
+  // v is the first spent key not below the previous image, if positioned
+  MDB_val k, v;
+  bool positioned = false;
+  for (size_t i: order)
+  {
+    MDB_val img = {sizeof(crypto::key_image), (void *)&images[i]};
+    if (positioned)
+    {
+      int cmp = compare_hash32(&img, &v);
+      if (cmp > 0)
+      {
+        // try the next spent key before searching again
+        int result = mdb_cursor_get(m_cur_spent_keys, &k, &v, MDB_NEXT_DUP);
+        if (result == MDB_NOTFOUND)
+          break;
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to enumerate spent keys: ", result).c_str()));
+        cmp = compare_hash32(&img, &v);
+      }
+      if (cmp <= 0)
+      {
+        spent[i] = cmp == 0;
+        continue;
+      }
+    }
+
+    v = img;
+    int result = mdb_cursor_get(m_cur_spent_keys, (MDB_val *)&zerokval, &v, MDB_GET_BOTH_RANGE);
+    if (result == MDB_NOTFOUND)
+      break; // all remaining images sort after the last spent key
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to get spent key: ", result).c_str()));
+    positioned = true;
+    spent[i] = compare_hash32(&img, &v) == 0;
+  }
+
+  TXN_POSTFIX_RDONLY();
+}
+
 bool BlockchainLMDB::for_all_key_images(std::function<bool(const crypto::key_image&)> f) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
@@ -3579,6 +5509,12 @@ bool BlockchainLMDB::for_blocks_range(const uint64_t& h1, const uint64_t& h2, st
       throw0(DB_ERROR("Failed to enumerate blocks"));
     uint64_t height = *(const uint64_t*)k.mv_data;
     blobdata_ref bd{reinterpret_cast<char*>(v.mv_data), v.mv_size};
+    blobdata decompressed;
+    if (v.mv_size > 0 && *(const uint8_t*)v.mv_data == COMPRESSED_BLOCK_MARKER)
+    {
+      get_block_blob_from_value(v, decompressed);
+      bd = blobdata_ref{decompressed.data(), decompressed.size()};
+    }
     block b;
     if (!parse_and_validate_block_from_blob(bd, b))
       throw0(DB_ERROR("Failed to parse block from blob retrieved from the db"));
@@ -3607,6 +5543,7 @@ bool BlockchainLMDB::for_all_transactions(std::function<bool(const crypto::hash&
   RCURSOR(txs_pruned);
   RCURSOR(txs_prunable);
   RCURSOR(tx_indices);
+  RCURSOR_COLD_PRUNABLE();
 
   MDB_val k;
   MDB_val v;
@@ -3643,10 +5580,10 @@ bool BlockchainLMDB::for_all_transactions(std::function<bool(const crypto::hash&
     {
       blobdata bd;
       bd.assign(reinterpret_cast<char*>(v.mv_data), v.mv_size);
-      ret = mdb_cursor_get(m_cur_txs_prunable, &k, &v, MDB_SET);
+      ret = get_prunable_value(m_cur_txs_prunable, cur_txs_prunable_cold, k, v);
       if (ret)
         throw0(DB_ERROR(lmdb_error("Failed to get prunable tx data the db: ", ret).c_str()));
-      bd.append(reinterpret_cast<char*>(v.mv_data), v.mv_size);
+      append_prunable(v, bd);
       if (!parse_and_validate_tx_from_blob(bd, tx))
         throw0(DB_ERROR("Failed to parse tx from blob retrieved from the db"));
     }
@@ -3751,6 +5688,8 @@ bool BlockchainLMDB::batch_start(uint64_t batch_num_blocks, uint64_t batch_bytes
   check_open();
 
   m_writer = boost::this_thread::get_id();
+  if (m_tinfo.get())
+    m_tinfo->end_rtxn();
   check_and_resize_for_batch(batch_num_blocks, batch_bytes);
 
   m_write_batch_txn = new mdb_txn_safe();
@@ -3769,12 +5708,6 @@ bool BlockchainLMDB::batch_start(uint64_t batch_num_blocks, uint64_t batch_bytes
 
   m_batch_active = true;
   memset(&m_wcursors, 0, sizeof(m_wcursors));
-  if (m_tinfo.get())
-  {
-    if (m_tinfo->m_ti_rflags.m_rf_txn)
-      mdb_txn_reset(m_tinfo->m_ti_rtxn);
-    memset(&m_tinfo->m_ti_rflags, 0, sizeof(m_tinfo->m_ti_rflags));
-  }
 
   LOG_PRINT_L3("batch transaction: begin");
   return true;
@@ -3795,6 +5728,7 @@ void BlockchainLMDB::batch_commit()
   check_open();
 
   LOG_PRINT_L3("batch transaction: committing...");
+  sync_cold_segments();
   TIME_MEASURE_START(time1);
   m_write_txn->commit();
   TIME_MEASURE_FINISH(time1);
@@ -3805,6 +5739,7 @@ void BlockchainLMDB::batch_commit()
   delete m_write_batch_txn;
   m_write_batch_txn = nullptr;
   memset(&m_wcursors, 0, sizeof(m_wcursors));
+  cold_segments_committed(m_cold_freed);
 }
 
 void BlockchainLMDB::cleanup_batch()
@@ -3820,6 +5755,7 @@ void BlockchainLMDB::cleanup_batch()
 void BlockchainLMDB::batch_stop()
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  mdb_op_timer op_timer(m_op_latency[op_batch_stop]);
   if (! m_batch_transactions)
     throw0(DB_ERROR("batch transactions not enabled"));
   if (! m_batch_active)
@@ -3833,6 +5769,7 @@ void BlockchainLMDB::batch_stop()
   TIME_MEASURE_START(time1);
   try
   {
+    sync_cold_segments();
     m_write_txn->commit();
     TIME_MEASURE_FINISH(time1);
     time_commit1 += time1;
@@ -3841,8 +5778,11 @@ void BlockchainLMDB::batch_stop()
   catch (const std::exception &e)
   {
     cleanup_batch();
+    m_cold_freed.clear();
+    m_tip_first_tx_ids.clear();
     throw;
   }
+  cold_segments_committed(m_cold_freed);
   LOG_PRINT_L3("batch transaction: end");
 }
 
@@ -3866,6 +5806,10 @@ void BlockchainLMDB::batch_abort()
   m_write_batch_txn = nullptr;
   m_batch_active = false;
   memset(&m_wcursors, 0, sizeof(m_wcursors));
+  m_cold_freed.clear();
+  m_tip_first_tx_ids.clear();
+  if (m_bulk_load)
+    m_bulk_load->drop_from(height());
   LOG_PRINT_L3("batch transaction: aborted");
 }
 
@@ -3890,26 +5834,43 @@ bool BlockchainLMDB::block_rtxn_start(MDB_txn **mtxn, mdb_txn_cursors **mcur) co
     *mcur = (mdb_txn_cursors *)&m_wcursors;
     return ret;
   }
-  /* Check for existing info and force reset if env doesn't match -
-   * only happens if env was opened/closed multiple times in same process
-   */
-  if (!(tinfo = m_tinfo.get()) || mdb_txn_env(tinfo->m_ti_rtxn) != m_env)
-  {
-    tinfo = new mdb_threadinfo;
-    m_tinfo.reset(tinfo);
-    memset(&tinfo->m_ti_rcursors, 0, sizeof(tinfo->m_ti_rcursors));
-    memset(&tinfo->m_ti_rflags, 0, sizeof(tinfo->m_ti_rflags));
-    if (auto mdb_res = lmdb_txn_begin(m_env, NULL, MDB_RDONLY, &tinfo->m_ti_rtxn))
-      throw0(DB_ERROR_TXN_START(lmdb_error("Failed to create a read transaction for the db: ", mdb_res).c_str()));
-    ret = true;
-  } else if (!tinfo->m_ti_rflags.m_rf_txn)
+  tinfo = m_tinfo.get();
+  if (!tinfo || !tinfo->m_ti_rflags.m_rf_txn || tinfo->m_ti_generation != *m_env_generation)
   {
-    if (auto mdb_res = lmdb_txn_renew(tinfo->m_ti_rtxn))
+    // counted like any other txn, so a resize or compaction waits for it to end
+    mdb_txn_safe::add_active_txn();
+    /* Check for existing info and force reset if env was closed since -
+     * happens if env was opened/closed multiple times in same process,
+     * or swapped for a compacted copy
+     */
+    if (!tinfo || tinfo->m_ti_generation != *m_env_generation)
+    {
+      tinfo = new mdb_threadinfo;
+      m_tinfo.reset(tinfo);
+      memset(&tinfo->m_ti_rcursors, 0, sizeof(tinfo->m_ti_rcursors));
+      memset(&tinfo->m_ti_rflags, 0, sizeof(tinfo->m_ti_rflags));
+      tinfo->m_ti_rtxn = NULL;
+      tinfo->m_ti_env_generation = m_env_generation;
+      tinfo->m_ti_generation = *m_env_generation;
+      tinfo->m_ti_set = m_thread_infos;
+      {
+        boost::lock_guard<boost::mutex> lock(m_thread_infos->lock);
+        m_thread_infos->infos.insert(tinfo);
+      }
+      if (auto mdb_res = lmdb_txn_begin(m_env, NULL, MDB_RDONLY, &tinfo->m_ti_rtxn))
+      {
+        mdb_txn_safe::remove_active_txn();
+        throw0(DB_ERROR_TXN_START(lmdb_error("Failed to create a read transaction for the db: ", mdb_res).c_str()));
+      }
+    }
+    else if (auto mdb_res = lmdb_txn_renew(tinfo->m_ti_rtxn))
+    {
+      mdb_txn_safe::remove_active_txn();
       throw0(DB_ERROR_TXN_START(lmdb_error("Failed to renew a read transaction for the db: ", mdb_res).c_str()));
+    }
+    tinfo->m_ti_rflags.m_rf_txn = true;
     ret = true;
   }
-  if (ret)
-    tinfo->m_ti_rflags.m_rf_txn = true;
   *mtxn = tinfo->m_ti_rtxn;
   *mcur = &tinfo->m_ti_rcursors;
 
@@ -3921,8 +5882,7 @@ bool BlockchainLMDB::block_rtxn_start(MDB_txn **mtxn, mdb_txn_cursors **mcur) co
 void BlockchainLMDB::block_rtxn_stop() const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
-  mdb_txn_reset(m_tinfo->m_ti_rtxn);
-  memset(&m_tinfo->m_ti_rflags, 0, sizeof(m_tinfo->m_ti_rflags));
+  m_tinfo->end_rtxn();
 }
 
 bool BlockchainLMDB::block_rtxn_start() const
@@ -3956,11 +5916,7 @@ void BlockchainLMDB::block_wtxn_start()
     }
     memset(&m_wcursors, 0, sizeof(m_wcursors));
     if (m_tinfo.get())
-    {
-      if (m_tinfo->m_ti_rflags.m_rf_txn)
-        mdb_txn_reset(m_tinfo->m_ti_rtxn);
-      memset(&m_tinfo->m_ti_rflags, 0, sizeof(m_tinfo->m_ti_rflags));
-    }
+      m_tinfo->end_rtxn();
   } else if (m_writer != boost::this_thread::get_id())
     throw0(DB_ERROR_TXN_START((std::string("Attempted to start new write txn when batch txn already exists in ")+__FUNCTION__).c_str()));
 }
@@ -3975,6 +5931,7 @@ void BlockchainLMDB::block_wtxn_stop()
   {
     if (! m_batch_active)
 	{
+      sync_cold_segments();
       TIME_MEASURE_START(time1);
       m_write_txn->commit();
       TIME_MEASURE_FINISH(time1);
@@ -3983,6 +5940,7 @@ void BlockchainLMDB::block_wtxn_stop()
       delete m_write_txn;
       m_write_txn = nullptr;
       memset(&m_wcursors, 0, sizeof(m_wcursors));
+      cold_segments_committed(m_cold_freed);
 	}
   }
 }
@@ -4000,20 +5958,24 @@ void BlockchainLMDB::block_wtxn_abort()
     delete m_write_txn;
     m_write_txn = nullptr;
     memset(&m_wcursors, 0, sizeof(m_wcursors));
+    m_cold_freed.clear();
+    m_tip_first_tx_ids.clear();
+    if (m_bulk_load)
+      m_bulk_load->drop_from(height());
   }
 }
 
 void BlockchainLMDB::block_rtxn_abort() const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
-  mdb_txn_reset(m_tinfo->m_ti_rtxn);
-  memset(&m_tinfo->m_ti_rflags, 0, sizeof(m_tinfo->m_ti_rflags));
+  m_tinfo->end_rtxn();
 }
 
 uint64_t BlockchainLMDB::add_block(const std::pair<block, blobdata>& blk, size_t block_weight, uint64_t long_term_block_weight, const difficulty_type& cumulative_difficulty, const uint64_t& coins_generated,
     const std::vector<std::pair<transaction, blobdata>>& txs)
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  mdb_op_timer op_timer(m_op_latency[op_add_block]);
   check_open();
   uint64_t m_height = height();
 
@@ -4043,6 +6005,8 @@ void BlockchainLMDB::pop_block(block& blk, std::vector<transaction>& txs)
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
+  if (m_bulk_load)
+    throw0(DB_ERROR("Cannot pop blocks during a bulk load"));
 
   block_wtxn_start();
 
@@ -4088,6 +6052,7 @@ void BlockchainLMDB::get_output_tx_and_index_from_global(const std::vector<uint6
 
 void BlockchainLMDB::get_output_key(const epee::span<const uint64_t> &amounts, const std::vector<uint64_t> &offsets, std::vector<output_data_t> &outputs, bool allow_partial) const
 {
+  mdb_op_timer op_timer(m_op_latency[op_get_output_keys]);
   if (amounts.size() != 1 && amounts.size() != offsets.size())
     throw0(DB_ERROR("Invalid sizes of amounts and offets"));
 
@@ -4503,6 +6468,72 @@ uint64_t BlockchainLMDB::get_database_size() const
   return size;
 }
 
+bool BlockchainLMDB::get_db_stats(std::vector<db_table_stats> &tables, std::vector<db_operation_stats> &operations) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  std::vector<std::pair<const char*, MDB_dbi>> dbis = {
+    {LMDB_BLOCKS, m_blocks},
+    {LMDB_BLOCK_HEIGHTS, m_block_heights},
+    {LMDB_BLOCK_INFO, m_block_info},
+    {LMDB_TXS_PRUNED, m_txs_pruned},
+    {LMDB_TXS_PRUNABLE, m_txs_prunable},
+    {LMDB_TXS_PRUNABLE_HASH, m_txs_prunable_hash},
+    {LMDB_TX_INDICES, m_tx_indices},
+    {LMDB_TX_OUTPUTS, m_tx_outputs},
+    {LMDB_OUTPUT_TXS, m_output_txs},
+    {LMDB_OUTPUT_AMOUNTS, m_output_amounts},
+    {LMDB_SPENT_KEYS, m_spent_keys},
+    {LMDB_TXPOOL_META, m_txpool_meta},
+    {LMDB_TXPOOL_BLOB, m_txpool_blob},
+    {LMDB_ALT_BLOCKS, m_alt_blocks},
+    {LMDB_HF_VERSIONS, m_hf_versions},
+    {LMDB_PROPERTIES, m_properties},
+  };
+  // those are only opened in some modes
+  if (!is_read_only())
+    dbis.push_back({LMDB_TXS_PRUNABLE_TIP, m_txs_prunable_tip});
+  if (m_cold_segments)
+    dbis.push_back({LMDB_TXS_PRUNABLE_COLD, m_txs_prunable_cold});
+  if (m_spent_key_index)
+    dbis.push_back({LMDB_SPENT_KEY_TXS, m_spent_key_txs});
+
+  TXN_PREFIX_RDONLY();
+  tables.clear();
+  tables.reserve(dbis.size());
+  for (const auto &e: dbis)
+  {
+    MDB_stat st;
+    if (int result = mdb_stat(m_txn, e.second, &st))
+      throw0(DB_ERROR(lmdb_error(std::string("Failed to query ") + e.first + ": ", result).c_str()));
+    tables.push_back({e.first, st.ms_entries, st.ms_depth, st.ms_branch_pages, st.ms_leaf_pages, st.ms_overflow_pages, st.ms_psize});
+  }
+  TXN_POSTFIX_RDONLY();
+
+  static const char * const op_names[op_count] = {
+    "add_block", "get_output_key", "get_output_keys", "has_key_image", "get_blocks_from", "get_tx_blob", "batch_stop"
+  };
+  operations.clear();
+  operations.reserve(op_count);
+  for (size_t i = 0; i < op_count; ++i)
+  {
+    const mdb_op_latency &op = m_op_latency[i];
+    operations.push_back({op_names[i], op.count, op.total_us, op.max_us, {}});
+    operations.back().histogram.reserve(mdb_op_latency::BUCKETS);
+    for (const auto &b: op.buckets)
+      operations.back().histogram.push_back(b);
+  }
+  return true;
+}
+
+void BlockchainLMDB::reset_db_stats()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  for (auto &op: m_op_latency)
+    op.reset();
+}
+
 void BlockchainLMDB::fixup()
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
@@ -5640,6 +7671,185 @@ void BlockchainLMDB::migrate_4_5()
   txn.commit();
 }
 
+void BlockchainLMDB::migrate_compression()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  uint64_t i;
+  int result;
+  mdb_txn_safe txn(false);
+  MDB_val k, v;
+
+  MGINFO_YELLOW("Compressing prunable tx data - this may take a while:");
+
+  result = mdb_txn_begin(m_env, NULL, 0, txn);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+
+  MDB_stat db_stats;
+  if ((result = mdb_stat(txn, m_txs_prunable, &db_stats)))
+    throw0(DB_ERROR(lmdb_error("Failed to query m_txs_prunable: ", result).c_str()));
+  const uint64_t n_records = db_stats.ms_entries;
+
+  // records below next_tx_id were compressed by an earlier, interrupted run, with the stored dictionary if any
+  uint64_t next_tx_id = 0;
+  MDB_val_str(pk, "compression_next_tx_id");
+  result = mdb_get(txn, m_properties, &pk, &v);
+  const bool resuming = result == 0;
+  if (resuming)
+  {
+    memcpy(&next_tx_id, v.mv_data, sizeof(next_tx_id));
+    load_compression_dictionary(txn);
+    MGINFO("Resuming from tx id " << next_tx_id);
+  }
+  else if (result != MDB_NOTFOUND)
+    throw0(DB_ERROR(lmdb_error("Failed to retrieve compression progress: ", result).c_str()));
+  txn.commit();
+
+  if (!resuming)
+    train_compression_dictionary();
+
+  MDB_cursor *c_prunable;
+  MDB_cursor_op op = MDB_SET_RANGE;
+  i = 0;
+  while (1)
+  {
+    if (!(i % 1000))
+    {
+      if (i)
+      {
+        LOGIF(el::Level::Info) {
+          std::cout << i << " / " << n_records << "  \r" << std::flush;
+        }
+        MDB_val_copy<uint64_t> pv(next_tx_id);
+        result = mdb_put(txn, m_properties, &pk, &pv, 0);
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to update compression progress: ", result).c_str()));
+        txn.commit();
+        // rewritten records land on new pages until the old ones are freed, so keep ahead of the map size
+        if (need_resize())
+          do_resize();
+      }
+      result = mdb_txn_begin(m_env, NULL, 0, txn);
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+      result = mdb_cursor_open(txn, m_txs_prunable, &c_prunable);
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to open a cursor for txs_prunable: ", result).c_str()));
+      op = MDB_SET_RANGE;
+    }
+
+    MDB_val_set(key, next_tx_id);
+    if (op == MDB_SET_RANGE)
+      k = key;
+    result = mdb_cursor_get(c_prunable, &k, &v, op);
+    op = MDB_NEXT;
+    if (result == MDB_NOTFOUND)
+      break;
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to enumerate prunable tx data: ", result).c_str()));
+
+    std::string compressed;
+    compress_prunable({(const uint8_t*)v.mv_data, v.mv_size}, compressed);
+    const uint64_t tx_id = *(const uint64_t*)k.mv_data;
+    next_tx_id = tx_id + 1;
+    MDB_val_set(put_key, tx_id);
+    MDB_val nv = {compressed.size(), (void*)compressed.data()};
+    result = mdb_cursor_put(c_prunable, &put_key, &nv, MDB_CURRENT);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to update prunable tx data: ", result).c_str()));
+    ++i;
+  }
+
+  result = mdb_del(txn, m_properties, &pk, NULL);
+  if (result && result != MDB_NOTFOUND)
+    throw0(DB_ERROR(lmdb_error("Failed to delete compression progress: ", result).c_str()));
+  MDB_val_str(ck, "compression");
+  MDB_val_copy<uint32_t> cv(COMPRESSION_ZSTD);
+  result = mdb_put(txn, m_properties, &ck, &cv, 0);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to write compression mode to database: ", result).c_str()));
+  txn.commit();
+  MGINFO_YELLOW("Compressed " << i << " prunable tx records");
+}
+
+void BlockchainLMDB::migrate_cold_prunable()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  int result;
+  mdb_txn_safe txn(false);
+  uint64_t n_records = 0;
+  bool announced = false;
+
+  while (1)
+  {
+    // rewritten tables land on new pages until the old ones are freed, so keep ahead of the map size
+    if (need_resize())
+      do_resize();
+
+    result = mdb_txn_begin(m_env, NULL, 0, txn);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+    MDB_stat db_stats;
+    if ((result = mdb_stat(txn, m_blocks, &db_stats)))
+      throw0(DB_ERROR(lmdb_error("Failed to query m_blocks: ", result).c_str()));
+    const size_t n = move_cold_prunable(txn, db_stats.ms_entries, COLD_PRUNABLE_BATCH_SIZE);
+    sync_cold_segments();
+    txn.commit();
+    n_records += n;
+
+    if (n < COLD_PRUNABLE_BATCH_SIZE)
+      break;
+    if (!announced)
+    {
+      MGINFO_YELLOW("Moving old prunable tx data to segment files - this may take a while:");
+      announced = true;
+    }
+    LOGIF(el::Level::Info) {
+      std::cout << n_records << " records moved  \r" << std::flush;
+    }
+  }
+  if (announced)
+    MGINFO_YELLOW("Moved " << n_records << " prunable tx records to segment files");
+}
+
+void BlockchainLMDB::migrate_spent_key_index()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  int result;
+  mdb_txn_safe txn(false);
+  uint64_t n_blocks = 0;
+  bool announced = false;
+
+  while (1)
+  {
+    if (need_resize())
+      do_resize();
+
+    result = mdb_txn_begin(m_env, NULL, 0, txn);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+    MDB_stat db_stats;
+    if ((result = mdb_stat(txn, m_blocks, &db_stats)))
+      throw0(DB_ERROR(lmdb_error("Failed to query m_blocks: ", result).c_str()));
+    const size_t n = index_spent_keys(txn, db_stats.ms_entries, SPENT_KEY_INDEX_BATCH_SIZE);
+    txn.commit();
+    n_blocks += n;
+
+    if (n < SPENT_KEY_INDEX_BATCH_SIZE)
+      break;
+    if (!announced)
+    {
+      MGINFO_YELLOW("Indexing spent key images by spending transaction - this may take a while:");
+      announced = true;
+    }
+    LOGIF(el::Level::Info) {
+      std::cout << n_blocks << " / " << db_stats.ms_entries << " blocks indexed  \r" << std::flush;
+    }
+  }
+  if (announced)
+    MGINFO_YELLOW("Indexed the spent key images of " << n_blocks << " blocks");
+}
+
 void BlockchainLMDB::migrate(const uint32_t oldversion)
 {
   if (oldversion < 1)
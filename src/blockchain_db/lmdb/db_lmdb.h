@@ -27,10 +27,16 @@
 #pragma once
 
 #include <atomic>
+#include <deque>
+#include <memory>
+#include <unordered_set>
 
 #include "blockchain_db/blockchain_db.h"
+#include "blockchain_db/segment_store.h"
+#include "blockchain_db/sorted_spool.h"
 #include "cryptonote_basic/blobdatatype.h" // for type blobdata
 #include "ringct/rctTypes.h"
+#include <boost/thread/mutex.hpp>
 #include <boost/thread/tss.hpp>
 
 #include "lmdb/db_drivers/liblmdb/lmdb.h"
@@ -45,6 +51,12 @@ typedef struct txindex {
     tx_data_t data;
 } txindex;
 
+typedef struct spent_key_tx {
+    crypto::key_image key;
+    crypto::hash tx_hash;
+    uint64_t height;
+} spent_key_tx;
+
 typedef struct mdb_txn_cursors
 {
   MDB_cursor *m_txc_blocks;
@@ -59,10 +71,12 @@ typedef struct mdb_txn_cursors
   MDB_cursor *m_txc_txs_prunable;
   MDB_cursor *m_txc_txs_prunable_hash;
   MDB_cursor *m_txc_txs_prunable_tip;
+  MDB_cursor *m_txc_txs_prunable_cold;
   MDB_cursor *m_txc_tx_indices;
   MDB_cursor *m_txc_tx_outputs;
 
   MDB_cursor *m_txc_spent_keys;
+  MDB_cursor *m_txc_spent_key_txs;
 
   MDB_cursor *m_txc_txpool_meta;
   MDB_cursor *m_txc_txpool_blob;
@@ -84,9 +98,11 @@ typedef struct mdb_txn_cursors
 #define m_cur_txs_prunable	m_cursors->m_txc_txs_prunable
 #define m_cur_txs_prunable_hash	m_cursors->m_txc_txs_prunable_hash
 #define m_cur_txs_prunable_tip	m_cursors->m_txc_txs_prunable_tip
+#define m_cur_txs_prunable_cold	m_cursors->m_txc_txs_prunable_cold
 #define m_cur_tx_indices	m_cursors->m_txc_tx_indices
 #define m_cur_tx_outputs	m_cursors->m_txc_tx_outputs
 #define m_cur_spent_keys	m_cursors->m_txc_spent_keys
+#define m_cur_spent_key_txs	m_cursors->m_txc_spent_key_txs
 #define m_cur_txpool_meta	m_cursors->m_txc_txpool_meta
 #define m_cur_txpool_blob	m_cursors->m_txc_txpool_blob
 #define m_cur_alt_blocks	m_cursors->m_txc_alt_blocks
@@ -106,9 +122,11 @@ typedef struct mdb_rflags
   bool m_rf_txs_prunable;
   bool m_rf_txs_prunable_hash;
   bool m_rf_txs_prunable_tip;
+  bool m_rf_txs_prunable_cold;
   bool m_rf_tx_indices;
   bool m_rf_tx_outputs;
   bool m_rf_spent_keys;
+  bool m_rf_spent_key_txs;
   bool m_rf_txpool_meta;
   bool m_rf_txpool_blob;
   bool m_rf_alt_blocks;
@@ -116,15 +134,32 @@ typedef struct mdb_rflags
   bool m_rf_properties;
 } mdb_rflags;
 
+struct mdb_threadinfo_set;
+
 typedef struct mdb_threadinfo
 {
   MDB_txn *m_ti_rtxn;	// per-thread read txn
   mdb_txn_cursors m_ti_rcursors;	// per-thread read cursors
   mdb_rflags m_ti_rflags;	// per-thread read state
+  std::shared_ptr<const std::atomic<uint64_t>> m_ti_env_generation;	// bumped each time the env is closed
+  uint64_t m_ti_generation;	// env generation the read txn belongs to
+  std::shared_ptr<mdb_threadinfo_set> m_ti_set;	// all the thread infos of the env
 
   ~mdb_threadinfo();
+
+  // ends the read txn if it is active, it stays around to be renewed
+  void end_rtxn();
+  // closes the cursors and frees the read txn, which must not be active
+  void free_rtxn();
 } mdb_threadinfo;
 
+// the read txn info of every thread using an env, so their txns can be freed before it is closed
+struct mdb_threadinfo_set
+{
+  boost::mutex lock;
+  std::unordered_set<mdb_threadinfo*> infos;
+};
+
 struct mdb_txn_safe
 {
   mdb_txn_safe(const bool check=true);
@@ -151,6 +186,11 @@ struct mdb_txn_safe
 
   uint64_t num_active_tx() const;
 
+  // counts a txn not owned by a mdb_txn_safe, like a thread's read txn, waiting at the gate if closed
+  static void add_active_txn();
+  static void remove_active_txn();
+
+  // the thread which closed the gate may keep creating txns, and may close it again
   static void prevent_new_txns();
   static void wait_no_active_txns();
   static void allow_new_txns();
@@ -163,6 +203,34 @@ struct mdb_txn_safe
 
   // could use a mutex here, but this should be sufficient.
   static std::atomic_flag creation_gate;
+  static thread_local unsigned int creation_gate_holds;
+};
+
+// call count and latency histogram of one kind of operation, updated without locking
+struct mdb_op_latency
+{
+  static constexpr size_t BUCKETS = 24; // powers of two microseconds, the last one open ended
+
+  mdb_op_latency() { reset(); }
+  void add(uint64_t us);
+  void reset();
+
+  std::atomic<uint64_t> count;
+  std::atomic<uint64_t> total_us;
+  std::atomic<uint64_t> max_us;
+  std::atomic<uint64_t> buckets[BUCKETS];
+};
+
+// times the enclosing scope into an mdb_op_latency, exceptions included
+class mdb_op_timer
+{
+public:
+  mdb_op_timer(mdb_op_latency &op);
+  ~mdb_op_timer();
+
+private:
+  mdb_op_latency &m_op;
+  uint64_t m_start_ns;
 };
 
 
@@ -215,6 +283,8 @@ public:
 
   virtual cryptonote::blobdata get_block_blob_from_height(const uint64_t& height) const;
 
+  virtual block get_block_from_height(const uint64_t& height) const;
+
   virtual std::vector<uint64_t> get_block_cumulative_rct_outputs(const std::vector<uint64_t> &heights) const;
 
   virtual uint64_t get_block_timestamp(const uint64_t& height) const;
@@ -280,6 +350,8 @@ public:
   virtual std::vector<std::vector<uint64_t>> get_tx_amount_output_indices(const uint64_t tx_id, size_t n_txes) const;
 
   virtual bool has_key_image(const crypto::key_image& img) const;
+  virtual void has_key_images(const epee::span<const crypto::key_image> &images, std::vector<bool> &spent) const;
+  virtual bool get_key_image_spender(const crypto::key_image& img, crypto::hash &tx_hash, uint64_t &height) const;
 
   virtual void add_txpool_tx(const crypto::hash &txid, const cryptonote::blobdata_ref &blob, const txpool_tx_meta_t& meta);
   virtual void update_txpool_tx(const crypto::hash &txid, const txpool_tx_meta_t& meta);
@@ -291,9 +363,19 @@ public:
   virtual cryptonote::blobdata get_txpool_tx_blob(const crypto::hash& txid, relay_category tx_category) const;
   virtual uint32_t get_blockchain_pruning_seed() const;
   virtual bool prune_blockchain(uint32_t pruning_seed = 0);
+  virtual bool prune_blockchain_step(uint32_t pruning_seed, size_t max_records, uint64_t max_bytes, uint64_t &pruned_bytes);
+  virtual bool get_pruning_progress(pruning_progress_t &progress) const;
   virtual bool update_pruning();
   virtual bool check_pruning();
 
+  virtual bool compact_start();
+  virtual bool compact_finish();
+  virtual bool bulk_load_start();
+  virtual void bulk_load_finish();
+
+  virtual bool get_db_stats(std::vector<db_table_stats> &tables, std::vector<db_operation_stats> &operations) const;
+  virtual void reset_db_stats();
+
   virtual void add_alt_block(const crypto::hash &blkid, const cryptonote::alt_block_data_t &data, const cryptonote::blobdata_ref &blob);
   virtual bool get_alt_block(const crypto::hash &blkid, alt_block_data_t *data, cryptonote::blobdata *blob);
   virtual void remove_alt_block(const crypto::hash &blkid);
@@ -355,6 +437,17 @@ public:
   static int compare_hash32(const MDB_val *a, const MDB_val *b);
   static int compare_string(const MDB_val *a, const MDB_val *b);
 
+  /**
+   * @brief get a block blob from a raw "blocks" table value
+   *
+   * Large blocks may be stored compressed; this undoes it, for tools
+   * which read the table directly.
+   *
+   * @param v the value as stored in the blocks table
+   * @param bd the block blob
+   */
+  static void get_block_blob_from_value(const MDB_val &v, cryptonote::blobdata &bd);
+
 private:
   void check_mmap_support();
   void do_resize(uint64_t size_increase=0);
@@ -395,7 +488,7 @@ private:
 
   virtual void prune_outputs(uint64_t amount);
 
-  virtual void add_spent_key(const crypto::key_image& k_image);
+  virtual void add_spent_key(const crypto::key_image& k_image, const crypto::hash& tx_hash);
 
   virtual void remove_spent_key(const crypto::key_image& k_image);
 
@@ -441,10 +534,60 @@ private:
   // migrate from DB version 4 to 5
   void migrate_4_5();
 
+  // load, enable, or finish enabling zstd compression of prunable data and large blocks
+  void init_compression(bool requested);
+
+  // compress existing txs_prunable records, resuming from where a previous run stopped
+  void migrate_compression();
+
+  // train a zstd dictionary from a sample of txs_prunable records
+  void train_compression_dictionary();
+  bool load_compression_dictionary(MDB_txn *txn);
+
+  void compress_prunable(const epee::span<const uint8_t> &data, std::string &out) const;
+  void append_prunable(const MDB_val &v, cryptonote::blobdata &bd) const;
+  bool compress_block(const cryptonote::blobdata &blob, std::string &out) const;
+
+  // open the segment files holding prunable data older than the pruning tip, if enabled
+  void init_cold_storage(bool requested);
+
+  // id of the first tx (the miner tx) of the block at the given height, and optionally the block's number of txes
+  uint64_t get_block_first_tx_id(MDB_txn *txn, uint64_t height, size_t *n_txes = NULL) const;
+
+  // move txs_prunable records of blocks which left the pruning tip to the segment files,
+  // unless fewer than min_txes txes left it since the last move
+  size_t move_cold_prunable(MDB_txn *txn, uint64_t blockchain_height, size_t max_records, uint64_t min_txes = 0);
+  void migrate_cold_prunable();
+
+  // make appended segment data durable before committing the locations pointing to it
+  void sync_cold_segments();
+  // take over the segment space freed by a txn which was just committed
+  void cold_segments_committed(std::vector<segment_store::location> &freed);
+  // release the freed segment space no read txn can still see, once it is durably unreferenced
+  void reclaim_cold_segments();
+
+  // open the key image to spending tx index if enabled, and build it for blocks added before it was
+  void init_spent_key_index(bool requested);
+  size_t index_spent_keys(MDB_txn *txn, uint64_t blockchain_height, size_t max_blocks);
+  void migrate_spent_key_index();
+
+  // look up prunable data for a tx id in txs_prunable, then in the segment files
+  int get_prunable_value(MDB_cursor *c_prunable, MDB_cursor *c_cold, const MDB_val &k, MDB_val &v) const;
+
+  // bring a compacted copy of this db up to date with it, while writers are held off
+  void catch_up_compacted(BlockchainLMDB &copy) const;
+
+  // append the sorted entries a bulk load spooled for a hash keyed table, skipping those of uncommitted blocks
+  void append_spooled(sorted_spool &spool, MDB_dbi dbi, size_t value_size, const char *what, uint64_t db_height, uint64_t (*get_height)(const void*));
+
   void cleanup_batch();
 
 private:
   MDB_env* m_env;
+  std::shared_ptr<std::atomic<uint64_t>> m_env_generation;
+  std::shared_ptr<mdb_threadinfo_set> m_thread_infos;
+  int m_db_flags;
+  bool m_sparse_map; // the map was reserved for the whole disk, and is grown geometrically if that ever falls short
 
   MDB_dbi m_blocks;
   MDB_dbi m_block_heights;
@@ -455,6 +598,7 @@ private:
   MDB_dbi m_txs_prunable;
   MDB_dbi m_txs_prunable_hash;
   MDB_dbi m_txs_prunable_tip;
+  MDB_dbi m_txs_prunable_cold;
   MDB_dbi m_tx_indices;
   MDB_dbi m_tx_outputs;
 
@@ -462,6 +606,7 @@ private:
   MDB_dbi m_output_amounts;
 
   MDB_dbi m_spent_keys;
+  MDB_dbi m_spent_key_txs;
 
   MDB_dbi m_txpool_meta;
   MDB_dbi m_txpool_blob;
@@ -486,6 +631,28 @@ private:
   mdb_txn_cursors m_wcursors;
   mutable boost::thread_specific_ptr<mdb_threadinfo> m_tinfo;
 
+  struct compression_context;
+  std::unique_ptr<compression_context> m_compression; // non null when storage compression is active
+  bool m_prunable_compressed; // whether txs_prunable records carry a compression header
+  std::unique_ptr<segment_store> m_cold_segments; // non null when old prunable data lives in segment files
+  std::vector<segment_store::location> m_cold_freed; // segment space freed by the write txn in progress
+  std::vector<segment_store::location> m_cold_freed_unsynced; // freed by commits which are not on disk yet
+  std::vector<segment_store::location> m_cold_reclaimable; // freed by commits on disk, waiting for older readers
+  std::deque<uint64_t> m_tip_first_tx_ids; // first tx id of the latest blocks added, so move_cold_prunable need not parse them
+  uint64_t m_tip_first_tx_ids_height; // height of the first block in m_tip_first_tx_ids
+  bool m_spent_key_index; // whether spent key images are also indexed to the tx spending them
+
+  // operations whose latency is recorded, see get_db_stats
+  enum { op_add_block, op_get_output_key, op_get_output_keys, op_has_key_image, op_get_blocks_from, op_get_tx_blob, op_batch_stop, op_count };
+  mutable mdb_op_latency m_op_latency[op_count];
+  std::string m_cold_segments_folder; // overrides the default segment folder, for a compacted copy
+
+  struct block_cache;
+  std::unique_ptr<block_cache> m_block_cache; // recently read parsed blocks and block_info records
+
+  struct bulk_load_state;
+  std::unique_ptr<bulk_load_state> m_bulk_load; // non null while hash keyed index entries are spooled rather than written
+
 #if defined(__arm__)
   // force a value so it can compile with 32-bit ARM
   constexpr static uint64_t DEFAULT_MAPSIZE = 1LL << 31;
@@ -0,0 +1,2065 @@
+// Copyright (c) 2014-2021, The Monero Project
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "db_memory.h"
+
+#include <algorithm>
+#include <fstream>
+#include <boost/filesystem.hpp>
+
+#include "string_tools.h"
+#include "file_io_utils.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "serialization/binary_utils.h"
+#include "utilities/blockchain_utilities/bootstrap_serialization.h"
+#include "ringct/rctOps.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "blockchain.db.memory"
+
+using epee::string_tools::pod_to_hex;
+
+namespace
+{
+
+// must match what blockchain_export writes, so the snapshot can be imported into an lmdb db
+const uint32_t blockchain_raw_magic = 0x28721586;
+const uint32_t header_size = 1024;
+// same limit blockchain_import applies
+const uint32_t max_chunk_size = 2 * 1024 * 1024;
+
+const char SNAPSHOT_FILENAME[] = "blockchain.raw";
+// long term weight and hard fork version for each block in the snapshot, in the same order
+const char SNAPSHOT_EXTRA_FILENAME[] = "blockchain.raw.extra";
+
+template <typename T>
+[[noreturn]] inline void throw0(const T &e)
+{
+  LOG_PRINT_L0(e.what());
+  throw e;
+}
+
+template <typename T>
+[[noreturn]] inline void throw1(const T &e)
+{
+  LOG_PRINT_L1(e.what());
+  throw e;
+}
+
+template <typename T>
+void write_binary(std::ofstream &f, T v)
+{
+  std::string blob;
+  if (!::serialization::dump_binary(v, blob))
+    throw0(cryptonote::DB_ERROR("Failed to serialize snapshot data"));
+  f.write(blob.data(), blob.size());
+}
+
+template <typename T>
+bool read_binary(std::ifstream &f, T &v)
+{
+  std::string blob(sizeof(T), '\0');
+  if (!f.read(&blob[0], blob.size()))
+    return false;
+  return ::serialization::parse_binary(blob, v);
+}
+
+// the first bytes of the snapshot, as blockchain_export writes them
+void write_snapshot_header(std::ofstream &f, uint64_t block_last)
+{
+  write_binary(f, blockchain_raw_magic);
+
+  cryptonote::bootstrap::file_info bfi;
+  bfi.major_version = 1;
+  bfi.minor_version = 0;
+  bfi.header_size = header_size;
+
+  cryptonote::bootstrap::blocks_info bbi;
+  bbi.block_first = 0;
+  bbi.block_last = block_last;
+  bbi.block_last_pos = 0;
+
+  std::string header;
+  for (const cryptonote::blobdata &bd: {cryptonote::t_serializable_object_to_blob(bfi), cryptonote::t_serializable_object_to_blob(bbi)})
+  {
+    std::string size_blob;
+    uint32_t bd_size = bd.size();
+    if (!::serialization::dump_binary(bd_size, size_blob))
+      throw0(cryptonote::DB_ERROR("Failed to serialize snapshot header"));
+    header += size_blob;
+    header += bd;
+  }
+  header.resize(header_size, '\0');
+  f.write(header.data(), header.size());
+}
+
+}  // anonymous namespace
+
+namespace cryptonote
+{
+
+BlockchainMemory::BlockchainMemory(bool batch_transactions): BlockchainDB()
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  m_folder = "thishsouldnotexistbecauseitisgibberish";
+  m_db_flags = 0;
+  m_max_block_size = std::numeric_limits<uint64_t>::max();
+  m_data_size = 0;
+  m_write_depth = 0;
+  m_batch_active = false;
+  m_batch_transactions = batch_transactions;
+  m_snapshot_height = 0;
+  m_snapshot_stale = false;
+  m_hardfork = nullptr;
+}
+
+BlockchainMemory::~BlockchainMemory()
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+
+  // batch transaction shouldn't be active at this point. If it is, consider it aborted.
+  if (m_batch_active)
+  {
+    try { batch_abort(); }
+    catch (...) { /* ignore */ }
+  }
+  if (m_open)
+  {
+    try { close(); }
+    catch (const std::exception &e) { MERROR("Failed to close the memory db: " << e.what()); }
+  }
+}
+
+inline void BlockchainMemory::check_open() const
+{
+  if (!m_open)
+    throw0(DB_ERROR("DB operation attempted on a not-open DB instance"));
+}
+
+void BlockchainMemory::open(const std::string& filename, const int db_flags)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+
+  if (m_open)
+    throw0(DB_OPEN_FAILURE("Attempted to open db, but it's already open"));
+
+  boost::filesystem::path direc(filename);
+  if (boost::filesystem::exists(direc))
+  {
+    if (!boost::filesystem::is_directory(direc))
+      throw0(DB_OPEN_FAILURE("The memory db needs a directory path for its snapshot, but a file was passed"));
+  }
+  else if (!(db_flags & DBF_RDONLY))
+  {
+    if (!boost::filesystem::create_directories(direc))
+      throw0(DB_OPEN_FAILURE(std::string("Failed to create directory ").append(filename).c_str()));
+  }
+
+  if (db_flags & (DBF_COMPRESS | DBF_COLD_SEGMENTS | DBF_SPARSE_MAP))
+    MWARNING("Compression, cold segments and sparse maps do not apply to the memory db, ignored");
+
+  m_folder = filename;
+  m_db_flags = db_flags;
+
+  CRITICAL_REGION_LOCAL(m_lock);
+  clear();
+  // the snapshot is replayed through the regular write path, which needs the db open
+  m_open = true;
+  try
+  {
+    load_snapshot();
+  }
+  catch (...)
+  {
+    clear();
+    m_open = false;
+    throw;
+  }
+}
+
+void BlockchainMemory::close()
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  if (m_batch_active)
+  {
+    LOG_PRINT_L3("close() first calling batch_abort() due to active batch transaction");
+    batch_abort();
+  }
+  this->sync();
+
+  CRITICAL_REGION_LOCAL(m_lock);
+  clear();
+  m_open = false;
+}
+
+void BlockchainMemory::sync()
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+
+  if (is_read_only())
+    return;
+
+  boost::lock_guard<boost::recursive_mutex> write_lock(m_write_lock);
+  CRITICAL_REGION_LOCAL(m_lock);
+  save_snapshot();
+}
+
+void BlockchainMemory::safesyncmode(const bool onoff)
+{
+  MINFO("the memory db has no sync mode, only its snapshot is written to disk");
+}
+
+void BlockchainMemory::reset()
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+
+  CRITICAL_REGION_LOCAL(m_lock);
+  clear();
+  m_snapshot_stale = true;
+}
+
+void BlockchainMemory::clear()
+{
+  m_blocks.clear();
+  m_block_heights.clear();
+  m_hf_versions.clear();
+  m_txs.clear();
+  m_tx_ids.clear();
+  m_outputs.clear();
+  m_amount_outputs.clear();
+  m_spent_keys.clear();
+  m_txpool.clear();
+  m_alt_blocks.clear();
+  m_max_block_size = std::numeric_limits<uint64_t>::max();
+  m_data_size = 0;
+  m_undo.clear();
+  m_snapshot_height = 0;
+  m_snapshot_stale = false;
+}
+
+std::vector<std::string> BlockchainMemory::get_filenames() const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  std::vector<std::string> filenames;
+
+  boost::filesystem::path snapshot(m_folder);
+  snapshot /= SNAPSHOT_FILENAME;
+  boost::filesystem::path extra(m_folder);
+  extra /= SNAPSHOT_EXTRA_FILENAME;
+
+  filenames.push_back(snapshot.string());
+  filenames.push_back(extra.string());
+
+  return filenames;
+}
+
+bool BlockchainMemory::remove_data_file(const std::string& folder) const
+{
+  for (const char *name: {SNAPSHOT_FILENAME, SNAPSHOT_EXTRA_FILENAME})
+  {
+    const std::string filename = folder + "/" + name;
+    try
+    {
+      boost::filesystem::remove(filename);
+    }
+    catch (const std::exception &e)
+    {
+      MERROR("Failed to remove " << filename << ": " << e.what());
+      return false;
+    }
+  }
+  return true;
+}
+
+std::string BlockchainMemory::get_db_name() const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+
+  return std::string("memory");
+}
+
+bool BlockchainMemory::lock()
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  return false;
+}
+
+void BlockchainMemory::unlock()
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+}
+
+bool BlockchainMemory::is_read_only() const
+{
+  return m_db_flags & DBF_RDONLY;
+}
+
+uint64_t BlockchainMemory::get_database_size() const
+{
+  CRITICAL_REGION_LOCAL(m_lock);
+  return m_data_size;
+}
+
+void BlockchainMemory::on_abort(std::function<void()> undo)
+{
+  if (m_write_depth > 0 || m_batch_active)
+    m_undo.push_back(std::move(undo));
+}
+
+void BlockchainMemory::roll_back()
+{
+  CRITICAL_REGION_LOCAL(m_lock);
+  for (auto i = m_undo.rbegin(); i != m_undo.rend(); ++i)
+    (*i)();
+  m_undo.clear();
+}
+
+void BlockchainMemory::load_snapshot()
+{
+  const boost::filesystem::path snapshot = boost::filesystem::path(m_folder) / SNAPSHOT_FILENAME;
+  if (!boost::filesystem::exists(snapshot))
+  {
+    MINFO("No snapshot in " << m_folder << ", starting from an empty chain");
+    return;
+  }
+
+  std::ifstream f(snapshot.string(), std::ios_base::binary | std::ios_base::in);
+  uint32_t magic = 0, bfi_size = 0;
+  if (!read_binary(f, magic) || magic != blockchain_raw_magic)
+    throw0(DB_OPEN_FAILURE(("Snapshot " + snapshot.string() + " is not a bootstrap file").c_str()));
+  if (!read_binary(f, bfi_size) || bfi_size > header_size)
+    throw0(DB_OPEN_FAILURE("Invalid bootstrap file header"));
+  std::string blob(bfi_size, '\0');
+  bootstrap::file_info bfi;
+  if (!f.read(&blob[0], blob.size()) || !::serialization::parse_binary(blob, bfi) || bfi.major_version != 1)
+    throw0(DB_OPEN_FAILURE("Unsupported bootstrap file version"));
+  uint32_t bbi_size = 0;
+  if (!read_binary(f, bbi_size) || bbi_size > header_size)
+    throw0(DB_OPEN_FAILURE("Invalid bootstrap file header"));
+  blob.resize(bbi_size);
+  bootstrap::blocks_info bbi;
+  if (!f.read(&blob[0], blob.size()) || !::serialization::parse_binary(blob, bbi))
+    throw0(DB_OPEN_FAILURE("Invalid bootstrap file header"));
+  if (bbi.block_first != 0)
+    throw0(DB_OPEN_FAILURE("The memory db can only load a bootstrap file starting at the genesis block"));
+  f.seekg(sizeof(magic) + bfi.header_size);
+
+  std::ifstream extra((boost::filesystem::path(m_folder) / SNAPSHOT_EXTRA_FILENAME).string(), std::ios_base::binary | std::ios_base::in);
+  bool have_extra = extra.good();
+  if (!have_extra)
+    MWARNING("No long term weights next to the snapshot, using block weights in their place");
+
+  MGINFO("Loading blockchain snapshot from " << snapshot.string() << "...");
+  // block_last is only raised once appended blocks are fully written, anything past it is
+  // what a save interrupted by a crash left behind
+  while (m_blocks.size() <= bbi.block_last)
+  {
+    uint32_t chunk_size;
+    if (!read_binary(f, chunk_size))
+      break;
+    if (chunk_size > max_chunk_size)
+      throw0(DB_OPEN_FAILURE("Bootstrap file chunk size is too large"));
+    blob.resize(chunk_size);
+    bootstrap::block_package bp;
+    if (!f.read(&blob[0], blob.size()) || !::serialization::parse_binary(blob, bp))
+      throw0(DB_OPEN_FAILURE(("Failed to read block " + std::to_string(m_blocks.size()) + " from the snapshot").c_str()));
+    if (bp.txs.size() != bp.block.tx_hashes.size())
+      throw0(DB_OPEN_FAILURE("Inconsistent tx/hashes sizes in the snapshot"));
+
+    uint64_t long_term_block_weight = bp.block_weight;
+    uint8_t hf_version = bp.block.major_version;
+    if (have_extra && !(read_binary(extra, long_term_block_weight) && read_binary(extra, hf_version)))
+    {
+      MWARNING("Long term weights end at height " << m_blocks.size() << ", using block weights from there");
+      long_term_block_weight = bp.block_weight;
+      hf_version = bp.block.major_version;
+      have_extra = false;
+    }
+
+    const crypto::hash blk_hash = get_block_hash(bp.block);
+    uint64_t num_rct_outs = 0;
+    const blobdata miner_bd = tx_to_blob(bp.block.miner_tx);
+    add_transaction(blk_hash, std::make_pair(bp.block.miner_tx, blobdata_ref(miner_bd)));
+    if (bp.block.miner_tx.version == 2)
+      num_rct_outs += bp.block.miner_tx.vout.size();
+    for (size_t i = 0; i < bp.txs.size(); ++i)
+    {
+      const blobdata bd = tx_to_blob(bp.txs[i]);
+      add_transaction(blk_hash, std::make_pair(bp.txs[i], blobdata_ref(bd)), &bp.block.tx_hashes[i]);
+      for (const auto &vout: bp.txs[i].vout)
+        if (vout.amount == 0)
+          ++num_rct_outs;
+    }
+    const uint64_t height = m_blocks.size();
+    add_block(bp.block, bp.block_weight, long_term_block_weight, bp.cumulative_difficulty, bp.coins_generated, num_rct_outs, blk_hash);
+    set_hard_fork_version(height, hf_version);
+  }
+
+  if (f.peek() != std::ifstream::traits_type::eof())
+  {
+    MWARNING("Ignoring data after block " << bbi.block_last << " in the snapshot, it will be rewritten on the next save");
+    m_snapshot_stale = true;
+  }
+  m_snapshot_height = m_blocks.size();
+  MGINFO("Loaded " << m_blocks.size() << " blocks from the snapshot");
+}
+
+void BlockchainMemory::save_snapshot()
+{
+  if (!m_snapshot_stale && m_snapshot_height == m_blocks.size())
+    return;
+
+  const boost::filesystem::path snapshot = boost::filesystem::path(m_folder) / SNAPSHOT_FILENAME;
+  const boost::filesystem::path extra_path = boost::filesystem::path(m_folder) / SNAPSHOT_EXTRA_FILENAME;
+
+  // blocks are only ever appended, unless one already saved was popped, which needs a rewrite
+  const bool rewrite = m_snapshot_stale || !boost::filesystem::exists(snapshot) || !boost::filesystem::exists(extra_path);
+  const uint64_t start_height = rewrite ? 0 : m_snapshot_height;
+  const boost::filesystem::path tmp_snapshot = snapshot.string() + ".tmp";
+  const boost::filesystem::path tmp_extra = extra_path.string() + ".tmp";
+
+  std::ofstream f, extra;
+  if (rewrite)
+  {
+    f.open(tmp_snapshot.string(), std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+    extra.open(tmp_extra.string(), std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+  }
+  else
+  {
+    f.open(snapshot.string(), std::ios_base::binary | std::ios_base::out | std::ios_base::app);
+    extra.open(extra_path.string(), std::ios_base::binary | std::ios_base::out | std::ios_base::app);
+  }
+  if (!f || !extra)
+    throw0(DB_ERROR(("Failed to open the snapshot in " + m_folder + " for writing").c_str()));
+
+  if (rewrite)
+    write_snapshot_header(f, m_blocks.empty() ? 0 : m_blocks.size() - 1);
+
+  for (uint64_t height = start_height; height < m_blocks.size(); ++height)
+  {
+    const block_record &br = m_blocks[height];
+    bootstrap::block_package bp;
+    if (!parse_and_validate_block_from_blob(br.blob, bp.block))
+      throw0(DB_ERROR("Failed to parse block from blob retrieved from the db"));
+    bp.txs.reserve(bp.block.tx_hashes.size());
+    for (size_t i = 0; i < bp.block.tx_hashes.size(); ++i)
+    {
+      const tx_record &tr = m_txs[br.first_tx_id + 1 + i];
+      bp.txs.resize(bp.txs.size() + 1);
+      if (!parse_and_validate_tx_from_blob(tr.pruned + tr.prunable, bp.txs.back()))
+        throw0(DB_ERROR("Failed to parse tx from blob retrieved from the db"));
+    }
+    bp.block_weight = br.weight;
+    bp.cumulative_difficulty = br.cumulative_difficulty;
+    bp.coins_generated = br.coins;
+
+    const blobdata bd = t_serializable_object_to_blob(bp);
+    write_binary(f, (uint32_t)bd.size());
+    f.write(bd.data(), bd.size());
+    write_binary(extra, br.long_term_weight);
+    write_binary(extra, height < m_hf_versions.size() ? m_hf_versions[height] : bp.block.major_version);
+  }
+
+  f.close();
+  extra.close();
+  if (!f || !extra)
+    throw0(DB_ERROR(("Failed to write the snapshot in " + m_folder).c_str()));
+
+  // appended blocks only count once the header says so, a crash before this loads the old height
+  if (!rewrite)
+  {
+    f.open(snapshot.string(), std::ios_base::binary | std::ios_base::in | std::ios_base::out);
+    if (f)
+      write_snapshot_header(f, m_blocks.size() - 1);
+    f.close();
+    if (!f)
+      throw0(DB_ERROR(("Failed to update the snapshot header in " + m_folder).c_str()));
+  }
+
+  if (rewrite)
+  {
+    boost::filesystem::rename(tmp_snapshot, snapshot);
+    boost::filesystem::rename(tmp_extra, extra_path);
+  }
+  MDEBUG("Saved blocks " << start_height << " to " << m_blocks.size() << " to the snapshot");
+  m_snapshot_height = m_blocks.size();
+  m_snapshot_stale = false;
+}
+
+const BlockchainMemory::block_record &BlockchainMemory::get_block_record(uint64_t height) const
+{
+  if (height >= m_blocks.size())
+    throw0(BLOCK_DNE(std::string("Attempt to get block from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- block not in db").c_str()));
+  return m_blocks[height];
+}
+
+const BlockchainMemory::tx_record *BlockchainMemory::find_tx(const crypto::hash& h) const
+{
+  const auto i = m_tx_ids.find(h);
+  return i == m_tx_ids.end() ? nullptr : &m_txs[i->second];
+}
+
+void BlockchainMemory::add_block(const block& blk, size_t block_weight, uint64_t long_term_block_weight, const difficulty_type& cumulative_difficulty, const uint64_t& coins_generated,
+    uint64_t num_rct_outs, const crypto::hash& blk_hash)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+  const uint64_t m_height = m_blocks.size();
+
+  if (m_block_heights.find(blk_hash) != m_block_heights.end())
+    throw1(BLOCK_EXISTS("Attempting to add block that's already in the db"));
+
+  if (m_height > 0)
+  {
+    const auto parent = m_block_heights.find(blk.prev_id);
+    if (parent == m_block_heights.end() || parent->second != m_height - 1)
+      throw0(BLOCK_PARENT_DNE("Top block is not new block's parent"));
+  }
+
+  block_record br;
+  br.blob = block_to_blob(blk);
+  br.hash = blk_hash;
+  br.timestamp = blk.timestamp;
+  br.coins = coins_generated;
+  br.weight = block_weight;
+  br.long_term_weight = long_term_block_weight;
+  br.cumulative_difficulty = cumulative_difficulty;
+  br.cum_rct = num_rct_outs;
+  if (blk.major_version >= 4 && m_height > 0)
+    br.cum_rct += m_blocks.back().cum_rct;
+  // the block's txs were added just before it, the miner tx first
+  br.first_tx_id = m_txs.size() - blk.tx_hashes.size() - 1;
+
+  m_data_size += br.blob.size();
+  m_blocks.push_back(std::move(br));
+  m_block_heights.emplace(blk_hash, m_height);
+  on_abort([this, blk_hash]() {
+    m_data_size -= m_blocks.back().blob.size();
+    m_blocks.pop_back();
+    m_block_heights.erase(blk_hash);
+  });
+}
+
+void BlockchainMemory::remove_block()
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  if (m_blocks.empty())
+    throw0(BLOCK_DNE ("Attempting to remove block from an empty blockchain"));
+
+  block_record br = std::move(m_blocks.back());
+  m_blocks.pop_back();
+  m_block_heights.erase(br.hash);
+  m_data_size -= br.blob.size();
+  if (m_blocks.size() < m_snapshot_height)
+    m_snapshot_stale = true;
+
+  auto saved = std::make_shared<block_record>(std::move(br));
+  on_abort([this, saved]() {
+    m_data_size += saved->blob.size();
+    m_block_heights.emplace(saved->hash, m_blocks.size());
+    m_blocks.push_back(std::move(*saved));
+  });
+}
+
+void BlockchainMemory::pop_block(block& blk, std::vector<transaction>& txs)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+
+  block_wtxn_start();
+
+  try
+  {
+    BlockchainDB::pop_block(blk, txs);
+    block_wtxn_stop();
+  }
+  catch (...)
+  {
+    block_wtxn_abort();
+    throw;
+  }
+}
+
+uint64_t BlockchainMemory::add_transaction_data(const crypto::hash& blk_hash, const std::pair<transaction, blobdata_ref>& txp, const crypto::hash& tx_hash, const crypto::hash& tx_prunable_hash)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  const uint64_t tx_id = m_txs.size();
+  const auto existing = m_tx_ids.find(tx_hash);
+  if (existing != m_tx_ids.end())
+    throw1(TX_EXISTS(std::string("Attempting to add transaction that's already in the db (tx id ").append(boost::lexical_cast<std::string>(existing->second)).append(")").c_str()));
+
+  const cryptonote::transaction &tx = txp.first;
+  const cryptonote::blobdata_ref &blob = txp.second;
+
+  unsigned int unprunable_size = tx.unprunable_size;
+  if (unprunable_size == 0)
+  {
+    std::stringstream ss;
+    binary_archive<true> ba(ss);
+    bool r = const_cast<cryptonote::transaction&>(tx).serialize_base(ba);
+    if (!r)
+      throw0(DB_ERROR("Failed to serialize pruned tx"));
+    unprunable_size = ss.str().size();
+  }
+
+  if (unprunable_size > blob.size())
+    throw0(DB_ERROR("pruned tx size is larger than tx size"));
+
+  tx_record tr;
+  tr.hash = tx_hash;
+  tr.prunable_hash = tx.version > 1 ? tx_prunable_hash : crypto::null_hash;
+  tr.unlock_time = tx.unlock_time;
+  tr.block_height = m_blocks.size();  // we don't need blk_hash since we know the height
+  tr.pruned.assign(blob.data(), unprunable_size);
+  tr.prunable.assign(blob.data() + unprunable_size, blob.size() - unprunable_size);
+
+  m_data_size += blob.size();
+  m_txs.push_back(std::move(tr));
+  m_tx_ids.emplace(tx_hash, tx_id);
+  on_abort([this, tx_hash]() {
+    m_data_size -= m_txs.back().pruned.size() + m_txs.back().prunable.size();
+    m_txs.pop_back();
+    m_tx_ids.erase(tx_hash);
+  });
+
+  return tx_id;
+}
+
+// tx ids are handed out in order, and blocks are popped from the top, so txs are removed in the reverse order they were added
+void BlockchainMemory::remove_transaction_data(const crypto::hash& tx_hash, const transaction& tx)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  const auto i = m_tx_ids.find(tx_hash);
+  if (i == m_tx_ids.end())
+    throw1(TX_DNE("Attempting to remove transaction that isn't in the db"));
+  const uint64_t tx_id = i->second;
+  if (tx_id + 1 != m_txs.size())
+    throw0(DB_ERROR("Attempting to remove a transaction which is not the latest one"));
+
+  const std::vector<uint64_t> &amount_output_indices = m_txs.back().amount_output_indices;
+  if (amount_output_indices.empty())
+  {
+    if (tx.vout.empty())
+      LOG_PRINT_L2("tx has no outputs, so no output indices");
+    else
+      throw0(DB_ERROR("tx has outputs, but no output indices found"));
+  }
+
+  bool is_pseudo_rct = tx.version >= 2 && tx.vin.size() == 1 && tx.vin[0].type() == typeid(txin_gen);
+  for (size_t i = tx.vout.size(); i-- > 0;)
+  {
+    uint64_t amount = is_pseudo_rct ? 0 : tx.vout[i].amount;
+    remove_output(amount, amount_output_indices[i]);
+  }
+
+  auto saved = std::make_shared<tx_record>(std::move(m_txs.back()));
+  m_txs.pop_back();
+  m_tx_ids.erase(tx_hash);
+  m_data_size -= saved->pruned.size() + saved->prunable.size();
+  on_abort([this, saved]() {
+    m_data_size += saved->pruned.size() + saved->prunable.size();
+    m_tx_ids.emplace(saved->hash, m_txs.size());
+    m_txs.push_back(std::move(*saved));
+  });
+}
+
+uint64_t BlockchainMemory::add_output(const crypto::hash& tx_hash,
+    const tx_out& tx_output,
+    const uint64_t& local_index,
+    const uint64_t unlock_time,
+    const rct::key *commitment)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  if (tx_output.target.type() != typeid(txout_to_key))
+    throw0(DB_ERROR("Wrong output type: expected txout_to_key"));
+  if (tx_output.amount == 0 && !commitment)
+    throw0(DB_ERROR("RCT output without commitment"));
+
+  const uint64_t output_id = m_outputs.size();
+  m_outputs.push_back({tx_hash, local_index, false});
+
+  std::vector<amount_output> &outputs = m_amount_outputs[tx_output.amount];
+  const uint64_t amount_index = outputs.size();
+  amount_output ao;
+  ao.output_id = output_id;
+  ao.data.pubkey = boost::get < txout_to_key >(tx_output.target).key;
+  ao.data.unlock_time = unlock_time;
+  ao.data.height = m_blocks.size();
+  ao.data.commitment = tx_output.amount == 0 ? *commitment : rct::key();
+  outputs.push_back(ao);
+
+  const uint64_t amount = tx_output.amount;
+  on_abort([this, amount]() {
+    m_outputs.pop_back();
+    m_amount_outputs[amount].pop_back();
+  });
+
+  return amount_index;
+}
+
+void BlockchainMemory::remove_output(const uint64_t amount, const uint64_t& out_index)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  auto i = m_amount_outputs.find(amount);
+  if (i == m_amount_outputs.end() || out_index >= i->second.size())
+    throw1(OUTPUT_DNE("Attempting to get an output index by amount and amount index, but amount not found"));
+  if (out_index + 1 != i->second.size())
+    throw0(DB_ERROR("Attempting to remove an output which is not the latest one for its amount"));
+  const amount_output ao = i->second.back();
+  if (ao.output_id + 1 != m_outputs.size())
+    throw0(DB_ERROR("Unexpected: global output index not found in m_output_txs"));
+
+  const global_output go = m_outputs.back();
+  m_outputs.pop_back();
+  i->second.pop_back();
+  on_abort([this, amount, ao, go]() {
+    m_outputs.push_back(go);
+    m_amount_outputs[amount].push_back(ao);
+  });
+}
+
+void BlockchainMemory::add_tx_amount_output_indices(const uint64_t tx_id,
+    const std::vector<uint64_t>& amount_output_indices)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  if (tx_id >= m_txs.size())
+    throw0(DB_ERROR("Failed to add tx output index to db transaction: tx not found"));
+  m_txs[tx_id].amount_output_indices = amount_output_indices;
+  on_abort([this, tx_id]() {
+    if (tx_id < m_txs.size())
+      m_txs[tx_id].amount_output_indices.clear();
+  });
+}
+
+void BlockchainMemory::prune_outputs(uint64_t amount)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  MINFO("Pruning outputs for amount " << amount);
+
+  auto i = m_amount_outputs.find(amount);
+  if (i == m_amount_outputs.end())
+    return;
+  MINFO(i->second.size() << " outputs found");
+
+  auto saved = std::make_shared<std::vector<amount_output>>(std::move(i->second));
+  m_amount_outputs.erase(i);
+  for (const amount_output &ao: *saved)
+    m_outputs[ao.output_id].pruned = true;
+  on_abort([this, amount, saved]() {
+    for (const amount_output &ao: *saved)
+      m_outputs[ao.output_id].pruned = false;
+    m_amount_outputs[amount] = std::move(*saved);
+  });
+}
+
+void BlockchainMemory::add_spent_key(const crypto::key_image& k_image, const crypto::hash& tx_hash)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  if (!m_spent_keys.emplace(k_image, std::make_pair(tx_hash, (uint64_t)m_blocks.size())).second)
+    throw1(KEY_IMAGE_EXISTS("Attempting to add spent key image that's already in the db"));
+  on_abort([this, k_image]() { m_spent_keys.erase(k_image); });
+}
+
+void BlockchainMemory::remove_spent_key(const crypto::key_image& k_image)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  const auto i = m_spent_keys.find(k_image);
+  if (i == m_spent_keys.end())
+    return;
+  const std::pair<crypto::hash, uint64_t> spender = i->second;
+  m_spent_keys.erase(i);
+  on_abort([this, k_image, spender]() { m_spent_keys.emplace(k_image, spender); });
+}
+
+void BlockchainMemory::add_txpool_tx(const crypto::hash &txid, const cryptonote::blobdata_ref &blob, const txpool_tx_meta_t &meta)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  if (!m_txpool.emplace(txid, std::make_pair(meta, cryptonote::blobdata(blob.data(), blob.size()))).second)
+    throw1(DB_ERROR("Attempting to add txpool tx metadata that's already in the db"));
+  on_abort([this, txid]() { m_txpool.erase(txid); });
+}
+
+void BlockchainMemory::update_txpool_tx(const crypto::hash &txid, const txpool_tx_meta_t &meta)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  auto i = m_txpool.find(txid);
+  if (i == m_txpool.end())
+    throw1(DB_ERROR("Error finding txpool tx meta to update"));
+  const txpool_tx_meta_t old_meta = i->second.first;
+  i->second.first = meta;
+  on_abort([this, txid, old_meta]() { m_txpool[txid].first = old_meta; });
+}
+
+uint64_t BlockchainMemory::get_txpool_tx_count(relay_category category) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  if (category == relay_category::all)
+    return m_txpool.size();
+
+  uint64_t num_entries = 0;
+  for (const auto &e: m_txpool)
+    if (e.second.first.matches(category))
+      ++num_entries;
+  return num_entries;
+}
+
+bool BlockchainMemory::txpool_has_tx(const crypto::hash& txid, relay_category tx_category) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  const auto i = m_txpool.find(txid);
+  if (i == m_txpool.end())
+    return false;
+  return tx_category == relay_category::all || i->second.first.matches(tx_category);
+}
+
+void BlockchainMemory::remove_txpool_tx(const crypto::hash& txid)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  auto i = m_txpool.find(txid);
+  if (i == m_txpool.end())
+    return;
+  auto saved = std::make_shared<std::pair<txpool_tx_meta_t, cryptonote::blobdata>>(std::move(i->second));
+  m_txpool.erase(i);
+  on_abort([this, txid, saved]() { m_txpool.emplace(txid, std::move(*saved)); });
+}
+
+bool BlockchainMemory::get_txpool_tx_meta(const crypto::hash& txid, txpool_tx_meta_t &meta) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  const auto i = m_txpool.find(txid);
+  if (i == m_txpool.end())
+    return false;
+  meta = i->second.first;
+  return true;
+}
+
+bool BlockchainMemory::get_txpool_tx_blob(const crypto::hash& txid, cryptonote::blobdata &bd, relay_category tx_category) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  const auto i = m_txpool.find(txid);
+  if (i == m_txpool.end())
+    return false;
+  if (!i->second.first.matches(tx_category))
+    return false;
+  bd = i->second.second;
+  return true;
+}
+
+cryptonote::blobdata BlockchainMemory::get_txpool_tx_blob(const crypto::hash& txid, relay_category tx_category) const
+{
+  cryptonote::blobdata bd;
+  if (!get_txpool_tx_blob(txid, bd, tx_category))
+    throw1(DB_ERROR("Tx not found in txpool: "));
+  return bd;
+}
+
+bool BlockchainMemory::for_all_txpool_txes(std::function<bool(const crypto::hash&, const txpool_tx_meta_t&, const cryptonote::blobdata_ref*)> f, bool include_blob, relay_category category) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  for (const auto &e: m_txpool)
+  {
+    if (!e.second.first.matches(category))
+      continue;
+    cryptonote::blobdata_ref bd;
+    if (include_blob)
+      bd = cryptonote::blobdata_ref{e.second.second.data(), e.second.second.size()};
+    if (!f(e.first, e.second.first, &bd))
+      return false;
+  }
+  return true;
+}
+
+uint32_t BlockchainMemory::get_blockchain_pruning_seed() const
+{
+  return 0;
+}
+
+bool BlockchainMemory::prune_blockchain(uint32_t pruning_seed)
+{
+  MERROR("The memory db does not support pruning");
+  return false;
+}
+
+bool BlockchainMemory::prune_blockchain_step(uint32_t pruning_seed, size_t max_records, uint64_t max_bytes, uint64_t &pruned_bytes)
+{
+  throw0(DB_ERROR("The memory db does not support pruning"));
+}
+
+bool BlockchainMemory::get_pruning_progress(pruning_progress_t &progress) const
+{
+  return false;
+}
+
+bool BlockchainMemory::update_pruning()
+{
+  return true;
+}
+
+bool BlockchainMemory::check_pruning()
+{
+  return true;
+}
+
+bool BlockchainMemory::compact_start()
+{
+  MINFO("The memory db has nothing to compact");
+  return true;
+}
+
+bool BlockchainMemory::compact_finish()
+{
+  return true;
+}
+
+// the indexes are hash tables already, there is nothing to gain from deferring them
+bool BlockchainMemory::bulk_load_start()
+{
+  return false;
+}
+
+void BlockchainMemory::bulk_load_finish()
+{
+}
+
+bool BlockchainMemory::get_db_stats(std::vector<db_table_stats> &tables, std::vector<db_operation_stats> &operations) const
+{
+  // there are no pages to count, and operations are too short to be worth timing
+  return false;
+}
+
+void BlockchainMemory::reset_db_stats()
+{
+}
+
+void BlockchainMemory::add_alt_block(const crypto::hash &blkid, const cryptonote::alt_block_data_t &data, const cryptonote::blobdata_ref &blob)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  if (!m_alt_blocks.emplace(blkid, std::make_pair(data, cryptonote::blobdata(blob.data(), blob.size()))).second)
+    throw1(DB_ERROR("Attempting to add alternate block that's already in the db"));
+  on_abort([this, blkid]() { m_alt_blocks.erase(blkid); });
+}
+
+bool BlockchainMemory::get_alt_block(const crypto::hash &blkid, alt_block_data_t *data, cryptonote::blobdata *blob)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  const auto i = m_alt_blocks.find(blkid);
+  if (i == m_alt_blocks.end())
+    return false;
+  if (data)
+    *data = i->second.first;
+  if (blob)
+    *blob = i->second.second;
+  return true;
+}
+
+void BlockchainMemory::remove_alt_block(const crypto::hash &blkid)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  auto i = m_alt_blocks.find(blkid);
+  if (i == m_alt_blocks.end())
+    throw0(DB_ERROR(("Error locating alternate block " + epee::string_tools::pod_to_hex(blkid) + " in the db").c_str()));
+  auto saved = std::make_shared<std::pair<alt_block_data_t, cryptonote::blobdata>>(std::move(i->second));
+  m_alt_blocks.erase(i);
+  on_abort([this, blkid, saved]() { m_alt_blocks.emplace(blkid, std::move(*saved)); });
+}
+
+uint64_t BlockchainMemory::get_alt_block_count()
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+  return m_alt_blocks.size();
+}
+
+void BlockchainMemory::drop_alt_blocks()
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  auto saved = std::make_shared<decltype(m_alt_blocks)>(std::move(m_alt_blocks));
+  m_alt_blocks.clear();
+  on_abort([this, saved]() { m_alt_blocks = std::move(*saved); });
+}
+
+bool BlockchainMemory::for_all_alt_blocks(std::function<bool(const crypto::hash&, const cryptonote::alt_block_data_t&, const cryptonote::blobdata_ref*)> f, bool include_blob) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  for (const auto &e: m_alt_blocks)
+  {
+    cryptonote::blobdata_ref bd;
+    if (include_blob)
+      bd = cryptonote::blobdata_ref{e.second.second.data(), e.second.second.size()};
+    if (!f(e.first, e.second.first, include_blob ? &bd : NULL))
+      return false;
+  }
+  return true;
+}
+
+bool BlockchainMemory::block_exists(const crypto::hash& h, uint64_t *height) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  const auto i = m_block_heights.find(h);
+  if (i == m_block_heights.end())
+  {
+    LOG_PRINT_L3("Block with hash " << epee::string_tools::pod_to_hex(h) << " not found in db");
+    return false;
+  }
+  if (height)
+    *height = i->second;
+  return true;
+}
+
+cryptonote::blobdata BlockchainMemory::get_block_blob(const crypto::hash& h) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+
+  return get_block_blob_from_height(get_block_height(h));
+}
+
+uint64_t BlockchainMemory::get_block_height(const crypto::hash& h) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  const auto i = m_block_heights.find(h);
+  if (i == m_block_heights.end())
+    throw1(BLOCK_DNE("Attempted to retrieve non-existent block height"));
+  return i->second;
+}
+
+block_header BlockchainMemory::get_block_header(const crypto::hash& h) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+
+  // block_header object is automatically cast from block object
+  return get_block(h);
+}
+
+cryptonote::blobdata BlockchainMemory::get_block_blob_from_height(const uint64_t& height) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  return get_block_record(height).blob;
+}
+
+uint64_t BlockchainMemory::get_block_timestamp(const uint64_t& height) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  return get_block_record(height).timestamp;
+}
+
+std::vector<uint64_t> BlockchainMemory::get_block_cumulative_rct_outputs(const std::vector<uint64_t> &heights) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  std::vector<uint64_t> res;
+  res.reserve(heights.size());
+  for (uint64_t height: heights)
+  {
+    if (height >= m_blocks.size())
+      throw0(BLOCK_DNE(std::string("Attempt to get rct distribution from height " + std::to_string(height) + " failed -- block size not in db").c_str()));
+    res.push_back(m_blocks[height].cum_rct);
+  }
+  return res;
+}
+
+uint64_t BlockchainMemory::get_top_block_timestamp() const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  // if no blocks, return 0
+  if (m_blocks.empty())
+    return 0;
+  return m_blocks.back().timestamp;
+}
+
+size_t BlockchainMemory::get_block_weight(const uint64_t& height) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  return get_block_record(height).weight;
+}
+
+std::vector<uint64_t> BlockchainMemory::get_block_weights(uint64_t start_height, size_t count) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  std::vector<uint64_t> res;
+  if (count == 0)
+    return res;
+  if (start_height >= m_blocks.size() || count > m_blocks.size() - start_height)
+    throw0(BLOCK_DNE("Attempt to get block weights past the top of the chain"));
+  res.reserve(count);
+  for (uint64_t height = start_height; height < start_height + count; ++height)
+    res.push_back(m_blocks[height].weight);
+  return res;
+}
+
+std::vector<uint64_t> BlockchainMemory::get_long_term_block_weights(uint64_t start_height, size_t count) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  std::vector<uint64_t> res;
+  if (count == 0)
+    return res;
+  if (start_height >= m_blocks.size() || count > m_blocks.size() - start_height)
+    throw0(BLOCK_DNE("Attempt to get long term block weights past the top of the chain"));
+  res.reserve(count);
+  for (uint64_t height = start_height; height < start_height + count; ++height)
+    res.push_back(m_blocks[height].long_term_weight);
+  return res;
+}
+
+difficulty_type BlockchainMemory::get_block_cumulative_difficulty(const uint64_t& height) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__ << "  height: " << height);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  return get_block_record(height).cumulative_difficulty;
+}
+
+difficulty_type BlockchainMemory::get_block_difficulty(const uint64_t& height) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+
+  difficulty_type diff1 = 0;
+  difficulty_type diff2 = 0;
+
+  diff1 = get_block_cumulative_difficulty(height);
+  if (height != 0)
+  {
+    diff2 = get_block_cumulative_difficulty(height - 1);
+  }
+
+  return diff1 - diff2;
+}
+
+uint64_t BlockchainMemory::get_block_already_generated_coins(const uint64_t& height) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  return get_block_record(height).coins;
+}
+
+uint64_t BlockchainMemory::get_block_long_term_weight(const uint64_t& height) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  return get_block_record(height).long_term_weight;
+}
+
+crypto::hash BlockchainMemory::get_block_hash_from_height(const uint64_t& height) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  if (height >= m_blocks.size())
+    throw0(BLOCK_DNE(std::string("Attempt to get hash from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- hash not in db").c_str()));
+  return m_blocks[height].hash;
+}
+
+std::vector<block> BlockchainMemory::get_blocks_range(const uint64_t& h1, const uint64_t& h2) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  std::vector<block> v;
+
+  for (uint64_t height = h1; height <= h2; ++height)
+  {
+    v.push_back(get_block_from_height(height));
+  }
+
+  return v;
+}
+
+std::vector<crypto::hash> BlockchainMemory::get_hashes_range(const uint64_t& h1, const uint64_t& h2) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  std::vector<crypto::hash> v;
+
+  for (uint64_t height = h1; height <= h2; ++height)
+  {
+    v.push_back(get_block_hash_from_height(height));
+  }
+
+  return v;
+}
+
+crypto::hash BlockchainMemory::top_block_hash(uint64_t *block_height) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  uint64_t m_height = m_blocks.size();
+  if (block_height)
+    *block_height = m_height - 1;
+  if (m_height != 0)
+    return m_blocks.back().hash;
+
+  return crypto::null_hash;
+}
+
+block BlockchainMemory::get_top_block() const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  if (!m_blocks.empty())
+  {
+    return get_block_from_height(m_blocks.size() - 1);
+  }
+
+  block b;
+  return b;
+}
+
+uint64_t BlockchainMemory::height() const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  return m_blocks.size();
+}
+
+bool BlockchainMemory::tx_exists(const crypto::hash& h) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  if (!find_tx(h))
+  {
+    LOG_PRINT_L1("transaction with hash " << epee::string_tools::pod_to_hex(h) << " not found in db");
+    return false;
+  }
+  return true;
+}
+
+bool BlockchainMemory::tx_exists(const crypto::hash& h, uint64_t& tx_id) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  const auto i = m_tx_ids.find(h);
+  if (i == m_tx_ids.end())
+  {
+    LOG_PRINT_L1("transaction with hash " << epee::string_tools::pod_to_hex(h) << " not found in db");
+    return false;
+  }
+  tx_id = i->second;
+  return true;
+}
+
+uint64_t BlockchainMemory::get_tx_unlock_time(const crypto::hash& h) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  const tx_record *tr = find_tx(h);
+  if (!tr)
+    throw1(TX_DNE((std::string("tx data with hash ") + epee::string_tools::pod_to_hex(h) + " not found in db").c_str()));
+  return tr->unlock_time;
+}
+
+bool BlockchainMemory::get_tx_blob(const crypto::hash& h, cryptonote::blobdata &bd) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  const tx_record *tr = find_tx(h);
+  if (!tr)
+    return false;
+  bd = tr->pruned;
+  bd.append(tr->prunable);
+  return true;
+}
+
+bool BlockchainMemory::get_pruned_tx_blob(const crypto::hash& h, cryptonote::blobdata &bd) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  const tx_record *tr = find_tx(h);
+  if (!tr)
+    return false;
+  bd = tr->pruned;
+  return true;
+}
+
+bool BlockchainMemory::get_pruned_tx_blobs_from(const crypto::hash& h, size_t count, std::vector<cryptonote::blobdata> &bd) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+
+  if (!count)
+    return true;
+
+  CRITICAL_REGION_LOCAL(m_lock);
+  const auto i = m_tx_ids.find(h);
+  if (i == m_tx_ids.end())
+    return false;
+  if (count > m_txs.size() - i->second)
+    return false;
+
+  bd.reserve(bd.size() + count);
+  for (uint64_t tx_id = i->second; tx_id < i->second + count; ++tx_id)
+    bd.push_back(m_txs[tx_id].pruned);
+  return true;
+}
+
+bool BlockchainMemory::get_blocks_from(uint64_t start_height, size_t min_block_count, size_t max_block_count, size_t max_tx_count, size_t max_size, std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata>>>>& blocks, bool pruned, bool skip_coinbase, bool get_miner_tx_hash) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  blocks.reserve(std::min<size_t>(max_block_count, 10000)); // guard against very large max count if only checking bytes
+  const uint64_t blockchain_height = m_blocks.size();
+  uint64_t size = 0;
+  size_t num_txes = 0;
+  for (uint64_t h = start_height; h < blockchain_height && blocks.size() < max_block_count && (size < max_size || blocks.size() < min_block_count); ++h)
+  {
+    const block_record &br = m_blocks[h];
+    blocks.resize(blocks.size() + 1);
+    auto &current_block = blocks.back();
+    current_block.first.first = br.blob;
+    size += br.blob.size();
+    current_block.first.second = get_miner_tx_hash ? m_txs[br.first_tx_id].hash : crypto::null_hash;
+
+    const uint64_t next_first_tx_id = h + 1 < blockchain_height ? m_blocks[h + 1].first_tx_id : m_txs.size();
+    current_block.second.reserve(next_first_tx_id - br.first_tx_id - 1);
+    num_txes += next_first_tx_id - br.first_tx_id - (skip_coinbase ? 1 : 0);
+    for (uint64_t tx_id = br.first_tx_id + 1; tx_id < next_first_tx_id; ++tx_id)
+    {
+      const tx_record &tr = m_txs[tx_id];
+      cryptonote::blobdata tx_blob = tr.pruned;
+      if (!pruned)
+        tx_blob.append(tr.prunable);
+      current_block.second.push_back(std::make_pair(tr.hash, std::move(tx_blob)));
+      size += current_block.second.back().second.size();
+    }
+
+    if (blocks.size() >= min_block_count && num_txes >= max_tx_count)
+      break;
+  }
+
+  return true;
+}
+
+bool BlockchainMemory::get_prunable_tx_blob(const crypto::hash& h, cryptonote::blobdata &bd) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  const tx_record *tr = find_tx(h);
+  if (!tr)
+    return false;
+  bd = tr->prunable;
+  return true;
+}
+
+bool BlockchainMemory::get_prunable_tx_hash(const crypto::hash& tx_hash, crypto::hash &prunable_hash) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  const tx_record *tr = find_tx(tx_hash);
+  if (!tr || tr->prunable_hash == crypto::null_hash)
+    return false;
+  prunable_hash = tr->prunable_hash;
+  return true;
+}
+
+uint64_t BlockchainMemory::get_tx_count() const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  return m_txs.size();
+}
+
+std::vector<transaction> BlockchainMemory::get_tx_list(const std::vector<crypto::hash>& hlist) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  std::vector<transaction> v;
+
+  for (auto& h : hlist)
+  {
+    v.push_back(get_tx(h));
+  }
+
+  return v;
+}
+
+uint64_t BlockchainMemory::get_tx_block_height(const crypto::hash& h) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  const tx_record *tr = find_tx(h);
+  if (!tr)
+    throw1(TX_DNE(std::string("tx_data_t with hash ").append(epee::string_tools::pod_to_hex(h)).append(" not found in db").c_str()));
+  return tr->block_height;
+}
+
+uint64_t BlockchainMemory::get_num_outputs(const uint64_t& amount) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  const auto i = m_amount_outputs.find(amount);
+  return i == m_amount_outputs.end() ? 0 : i->second.size();
+}
+
+output_data_t BlockchainMemory::get_output_key(const uint64_t& amount, const uint64_t& index, bool include_commitmemt) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  const auto i = m_amount_outputs.find(amount);
+  if (i == m_amount_outputs.end() || index >= i->second.size())
+    throw1(OUTPUT_DNE(std::string("Attempting to get output pubkey by index, but key does not exist: amount " +
+        std::to_string(amount) + ", index " + std::to_string(index)).c_str()));
+
+  output_data_t ret = i->second[index].data;
+  if (amount != 0 && include_commitmemt)
+    ret.commitment = rct::zeroCommit(amount);
+  return ret;
+}
+
+void BlockchainMemory::get_output_key(const epee::span<const uint64_t> &amounts, const std::vector<uint64_t> &offsets, std::vector<output_data_t> &outputs, bool allow_partial) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  if (amounts.size() != 1 && amounts.size() != offsets.size())
+    throw0(DB_ERROR("Invalid sizes of amounts and offets"));
+
+  CRITICAL_REGION_LOCAL(m_lock);
+  outputs.clear();
+  outputs.reserve(offsets.size());
+
+  for (size_t i = 0; i < offsets.size(); ++i)
+  {
+    const uint64_t amount = amounts.size() == 1 ? amounts[0] : amounts[i];
+    const auto o = m_amount_outputs.find(amount);
+    if (o == m_amount_outputs.end() || offsets[i] >= o->second.size())
+    {
+      if (allow_partial)
+      {
+        MDEBUG("Partial result: " << outputs.size() << "/" << offsets.size());
+        break;
+      }
+      throw1(OUTPUT_DNE((std::string("Attempting to get output pubkey by global index (amount ") + boost::lexical_cast<std::string>(amount) + ", index " + boost::lexical_cast<std::string>(offsets[i]) + ", count " + boost::lexical_cast<std::string>(o == m_amount_outputs.end() ? 0 : o->second.size()) + "), but key does not exist (current height " + boost::lexical_cast<std::string>(m_blocks.size()) + ")").c_str()));
+    }
+
+    outputs.push_back(o->second[offsets[i]].data);
+    if (amount != 0)
+      outputs.back().commitment = rct::zeroCommit(amount);
+  }
+}
+
+tx_out_index BlockchainMemory::get_output_tx_and_index_from_global(const uint64_t& output_id) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  if (output_id >= m_outputs.size() || m_outputs[output_id].pruned)
+    throw1(OUTPUT_DNE("output with given index not in db"));
+  const global_output &go = m_outputs[output_id];
+  return tx_out_index(go.tx_hash, go.local_index);
+}
+
+tx_out_index BlockchainMemory::get_output_tx_and_index(const uint64_t& amount, const uint64_t& index) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  std::vector < uint64_t > offsets;
+  std::vector<tx_out_index> indices;
+  offsets.push_back(index);
+  get_output_tx_and_index(amount, offsets, indices);
+  if (!indices.size())
+    throw1(OUTPUT_DNE("Attempting to get an output index by amount and amount index, but amount not found"));
+
+  return indices[0];
+}
+
+void BlockchainMemory::get_output_tx_and_index(const uint64_t& amount, const std::vector<uint64_t> &offsets, std::vector<tx_out_index> &indices) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+  indices.clear();
+
+  const auto o = m_amount_outputs.find(amount);
+  for (const uint64_t &index : offsets)
+  {
+    if (o == m_amount_outputs.end() || index >= o->second.size())
+      throw1(OUTPUT_DNE("Attempting to get output by index, but key does not exist"));
+    const global_output &go = m_outputs[o->second[index].output_id];
+    indices.push_back(tx_out_index(go.tx_hash, go.local_index));
+  }
+}
+
+std::vector<std::vector<uint64_t>> BlockchainMemory::get_tx_amount_output_indices(uint64_t tx_id, size_t n_txes) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  std::vector<std::vector<uint64_t>> amount_output_indices_set;
+  amount_output_indices_set.reserve(n_txes);
+  for (; n_txes > 0; --n_txes, ++tx_id)
+  {
+    if (tx_id >= m_txs.size())
+      throw0(DB_ERROR("DB error attempting to get data for tx_outputs[tx_index]"));
+    amount_output_indices_set.push_back(m_txs[tx_id].amount_output_indices);
+  }
+  return amount_output_indices_set;
+}
+
+bool BlockchainMemory::has_key_image(const crypto::key_image& img) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  return m_spent_keys.find(img) != m_spent_keys.end();
+}
+
+void BlockchainMemory::has_key_images(const epee::span<const crypto::key_image> &images, std::vector<bool> &spent) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  spent.clear();
+  spent.reserve(images.size());
+  for (const crypto::key_image &img: images)
+    spent.push_back(m_spent_keys.find(img) != m_spent_keys.end());
+}
+
+bool BlockchainMemory::get_key_image_spender(const crypto::key_image& img, crypto::hash &tx_hash, uint64_t &height) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  const auto i = m_spent_keys.find(img);
+  if (i == m_spent_keys.end() || i->second.first == crypto::null_hash)
+    return false;
+  tx_hash = i->second.first;
+  height = i->second.second;
+  return true;
+}
+
+bool BlockchainMemory::for_all_key_images(std::function<bool(const crypto::key_image&)> f) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  for (const auto &e: m_spent_keys)
+    if (!f(e.first))
+      return false;
+  return true;
+}
+
+bool BlockchainMemory::for_blocks_range(const uint64_t& h1, const uint64_t& h2, std::function<bool(uint64_t, const crypto::hash&, const cryptonote::block&)> f) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  for (uint64_t height = h1; height < m_blocks.size(); ++height)
+  {
+    block b;
+    if (!parse_and_validate_block_from_blob(m_blocks[height].blob, b))
+      throw0(DB_ERROR("Failed to parse block from blob retrieved from the db"));
+    if (!f(height, m_blocks[height].hash, b))
+      return false;
+    if (height >= h2)
+      break;
+  }
+  return true;
+}
+
+bool BlockchainMemory::for_all_transactions(std::function<bool(const crypto::hash&, const cryptonote::transaction&)> f, bool pruned) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  for (const tx_record &tr: m_txs)
+  {
+    transaction tx;
+    if (pruned)
+    {
+      if (!parse_and_validate_tx_base_from_blob(tr.pruned, tx))
+        throw0(DB_ERROR("Failed to parse tx from blob retrieved from the db"));
+    }
+    else
+    {
+      if (!parse_and_validate_tx_from_blob(tr.pruned + tr.prunable, tx))
+        throw0(DB_ERROR("Failed to parse tx from blob retrieved from the db"));
+    }
+    if (!f(tr.hash, tx))
+      return false;
+  }
+  return true;
+}
+
+bool BlockchainMemory::for_all_outputs(std::function<bool(uint64_t amount, const crypto::hash &tx_hash, uint64_t height, size_t tx_idx)> f) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  // walk amounts in order, like the lmdb backend does
+  std::vector<uint64_t> amounts;
+  amounts.reserve(m_amount_outputs.size());
+  for (const auto &e: m_amount_outputs)
+    amounts.push_back(e.first);
+  std::sort(amounts.begin(), amounts.end());
+
+  for (uint64_t amount: amounts)
+  {
+    for (const amount_output &ao: m_amount_outputs.find(amount)->second)
+    {
+      const global_output &go = m_outputs[ao.output_id];
+      if (!f(amount, go.tx_hash, ao.data.height, go.local_index))
+        return false;
+    }
+  }
+  return true;
+}
+
+bool BlockchainMemory::for_all_outputs(uint64_t amount, const std::function<bool(uint64_t height)> &f) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  const auto i = m_amount_outputs.find(amount);
+  if (i == m_amount_outputs.end())
+    return true;
+  for (const amount_output &ao: i->second)
+    if (!f(ao.data.height))
+      return false;
+  return true;
+}
+
+std::map<uint64_t, std::tuple<uint64_t, uint64_t, uint64_t>> BlockchainMemory::get_output_histogram(const std::vector<uint64_t> &amounts, bool unlocked, uint64_t recent_cutoff, uint64_t min_count) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  std::map<uint64_t, std::tuple<uint64_t, uint64_t, uint64_t>> histogram;
+
+  if (amounts.empty())
+  {
+    for (const auto &e: m_amount_outputs)
+      if (e.second.size() >= min_count)
+        histogram[e.first] = std::make_tuple(e.second.size(), 0, 0);
+  }
+  else
+  {
+    for (const auto &amount: amounts)
+    {
+      const uint64_t num_elems = get_num_outputs(amount);
+      if (num_elems >= min_count)
+        histogram[amount] = std::make_tuple(num_elems, 0, 0);
+    }
+  }
+
+  if (unlocked || recent_cutoff > 0) {
+    const uint64_t blockchain_height = m_blocks.size();
+    for (auto i = histogram.begin(); i != histogram.end(); ++i) {
+      uint64_t amount = i->first;
+      uint64_t num_elems = std::get<0>(i->second);
+      const auto o = m_amount_outputs.find(amount);
+      while (num_elems > 0) {
+        const uint64_t height = o->second[num_elems - 1].data.height;
+        if (height + CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE <= blockchain_height)
+          break;
+        --num_elems;
+      }
+      std::get<1>(i->second) = num_elems;
+
+      if (recent_cutoff > 0)
+      {
+        uint64_t recent = 0;
+        while (num_elems > 0) {
+          const uint64_t height = o->second[num_elems - 1].data.height;
+          if (m_blocks[height].timestamp < recent_cutoff)
+            break;
+          --num_elems;
+          ++recent;
+        }
+        std::get<2>(i->second) = recent;
+      }
+    }
+  }
+
+  return histogram;
+}
+
+bool BlockchainMemory::get_output_distribution(uint64_t amount, uint64_t from_height, uint64_t to_height, std::vector<uint64_t> &distribution, uint64_t &base) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  distribution.clear();
+  const uint64_t db_height = m_blocks.size();
+  if (from_height >= db_height)
+    return false;
+  distribution.resize(db_height - from_height, 0);
+
+  base = 0;
+  const auto i = m_amount_outputs.find(amount);
+  if (i != m_amount_outputs.end())
+  {
+    for (const amount_output &ao: i->second)
+    {
+      const uint64_t height = ao.data.height;
+      if (height >= from_height)
+        distribution[height - from_height]++;
+      else
+        base++;
+      if (to_height > 0 && height > to_height)
+        break;
+    }
+  }
+
+  distribution[0] += base;
+  for (size_t n = 1; n < distribution.size(); ++n)
+    distribution[n] += distribution[n - 1];
+  base = 0;
+
+  return true;
+}
+
+uint64_t BlockchainMemory::get_max_block_size()
+{
+  CRITICAL_REGION_LOCAL(m_lock);
+  return m_max_block_size;
+}
+
+void BlockchainMemory::add_max_block_size(uint64_t sz)
+{
+  CRITICAL_REGION_LOCAL(m_lock);
+  const uint64_t old_max_block_size = m_max_block_size;
+  if (m_max_block_size == std::numeric_limits<uint64_t>::max() || sz > m_max_block_size)
+    m_max_block_size = sz;
+  on_abort([this, old_max_block_size]() { m_max_block_size = old_max_block_size; });
+}
+
+void BlockchainMemory::set_hard_fork_version(uint64_t height, uint8_t version)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  if (height >= m_hf_versions.size())
+    m_hf_versions.resize(height + 1, 0);
+  const uint8_t old_version = m_hf_versions[height];
+  m_hf_versions[height] = version;
+  on_abort([this, height, old_version]() { m_hf_versions[height] = old_version; });
+}
+
+uint8_t BlockchainMemory::get_hard_fork_version(uint64_t height) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  if (height >= m_hf_versions.size() || m_hf_versions[height] == 0)
+    throw0(DB_ERROR(("Error attempting to retrieve a hard fork version at height " + boost::lexical_cast<std::string>(height) + " from the db").c_str()));
+  return m_hf_versions[height];
+}
+
+void BlockchainMemory::check_hard_fork_info()
+{
+}
+
+void BlockchainMemory::drop_hard_fork_info()
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  auto saved = std::make_shared<std::vector<uint8_t>>(std::move(m_hf_versions));
+  m_hf_versions.clear();
+  on_abort([this, saved]() { m_hf_versions = std::move(*saved); });
+}
+
+void BlockchainMemory::set_batch_transactions(bool batch_transactions)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  if ((batch_transactions) && (m_batch_transactions))
+  {
+    MINFO("batch transaction mode already enabled, but asked to enable batch mode");
+  }
+  m_batch_transactions = batch_transactions;
+  MINFO("batch transactions " << (m_batch_transactions ? "enabled" : "disabled"));
+}
+
+bool BlockchainMemory::batch_start(uint64_t batch_num_blocks, uint64_t batch_bytes)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  if (! m_batch_transactions)
+    throw0(DB_ERROR("batch transactions not enabled"));
+  check_open();
+
+  m_write_lock.lock();
+  if (m_batch_active)
+  {
+    m_write_lock.unlock();
+    return false;
+  }
+  if (m_write_depth)
+  {
+    m_write_lock.unlock();
+    throw0(DB_ERROR("batch transaction attempted, but m_write_txn already in use"));
+  }
+
+  m_writer = boost::this_thread::get_id();
+  m_batch_active = true;
+  LOG_PRINT_L3("batch transaction: begin");
+  return true;
+}
+
+void BlockchainMemory::batch_stop()
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  if (! m_batch_transactions)
+    throw0(DB_ERROR("batch transactions not enabled"));
+  if (! m_batch_active)
+    throw1(DB_ERROR("batch transaction not in progress"));
+  if (m_writer != boost::this_thread::get_id())
+    throw1(DB_ERROR("batch transaction owned by other thread"));
+  check_open();
+
+  {
+    CRITICAL_REGION_LOCAL(m_lock);
+    m_undo.clear();
+  }
+  m_batch_active = false;
+  m_write_lock.unlock();
+  LOG_PRINT_L3("batch transaction: end");
+}
+
+void BlockchainMemory::batch_abort()
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  if (! m_batch_transactions)
+    throw0(DB_ERROR("batch transactions not enabled"));
+  if (! m_batch_active)
+    throw1(DB_ERROR("batch transaction not in progress"));
+  if (m_writer != boost::this_thread::get_id())
+    throw1(DB_ERROR("batch transaction owned by other thread"));
+  check_open();
+
+  roll_back();
+  m_batch_active = false;
+  m_write_lock.unlock();
+}
+
+void BlockchainMemory::block_wtxn_start()
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  m_write_lock.lock();
+  if (! m_batch_active && m_write_depth)
+  {
+    m_write_lock.unlock();
+    throw0(DB_ERROR_TXN_START((std::string("Attempted to start new write txn when write txn already exists in ")+__FUNCTION__).c_str()));
+  }
+  if (! m_batch_active)
+    m_writer = boost::this_thread::get_id();
+  ++m_write_depth;
+}
+
+void BlockchainMemory::block_wtxn_stop()
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  if (!m_write_depth)
+    throw0(DB_ERROR_TXN_START((std::string("Attempted to stop write txn when no such txn exists in ")+__FUNCTION__).c_str()));
+  if (m_writer != boost::this_thread::get_id())
+    throw0(DB_ERROR_TXN_START((std::string("Attempted to stop write txn from the wrong thread in ")+__FUNCTION__).c_str()));
+
+  --m_write_depth;
+  if (! m_batch_active)
+  {
+    CRITICAL_REGION_LOCAL(m_lock);
+    m_undo.clear();
+  }
+  m_write_lock.unlock();
+}
+
+void BlockchainMemory::block_wtxn_abort()
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  if (!m_write_depth)
+    throw0(DB_ERROR_TXN_START((std::string("Attempted to abort write txn when no such txn exists in ")+__FUNCTION__).c_str()));
+  if (m_writer != boost::this_thread::get_id())
+    throw0(DB_ERROR_TXN_START((std::string("Attempted to abort write txn from the wrong thread in ")+__FUNCTION__).c_str()));
+
+  --m_write_depth;
+  // like the lmdb backend, a block txn inside a batch is only undone with the batch
+  if (! m_batch_active)
+    roll_back();
+  m_write_lock.unlock();
+}
+
+// reads always see the latest data, there is no snapshot to hold
+bool BlockchainMemory::block_rtxn_start() const
+{
+  return false;
+}
+
+void BlockchainMemory::block_rtxn_stop() const
+{
+}
+
+void BlockchainMemory::block_rtxn_abort() const
+{
+}
+
+}  // namespace cryptonote
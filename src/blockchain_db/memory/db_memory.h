@@ -0,0 +1,356 @@
+// Copyright (c) 2014-2021, The Monero Project
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <boost/thread/recursive_mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "syncobj.h"
+#include "blockchain_db/blockchain_db.h"
+#include "cryptonote_basic/blobdatatype.h" // for type blobdata
+#include "ringct/rctTypes.h"
+
+namespace cryptonote
+{
+
+// A BlockchainDB kept entirely in memory, for benchmarks and ephemeral nodes.
+//
+// Blocks, transactions and global outputs are indexed by their position in
+// flat vectors, and hashes, amounts and key images map to those positions
+// through hash tables, so there is no tree to walk on lookups.
+//
+// Writes are not isolated from readers: a write txn only serializes writers,
+// and keeps an undo log so that aborting it restores what was there before.
+//
+// The chain is loaded from, and saved to, a bootstrap file in the db folder,
+// in the format blockchain_export writes and blockchain_import reads. Long
+// term block weights and hard fork versions are not part of that format, and
+// are kept in a small file next to it. The txpool and alternative blocks are
+// not saved.
+class BlockchainMemory : public BlockchainDB
+{
+public:
+  BlockchainMemory(bool batch_transactions=true);
+  ~BlockchainMemory();
+
+  virtual void open(const std::string& filename, const int db_flags=0);
+
+  virtual void close();
+
+  virtual void sync();
+
+  virtual void safesyncmode(const bool onoff);
+
+  virtual void reset();
+
+  virtual std::vector<std::string> get_filenames() const;
+
+  virtual bool remove_data_file(const std::string& folder) const;
+
+  virtual std::string get_db_name() const;
+
+  virtual bool lock();
+
+  virtual void unlock();
+
+  virtual bool block_exists(const crypto::hash& h, uint64_t *height = NULL) const;
+
+  virtual uint64_t get_block_height(const crypto::hash& h) const;
+
+  virtual block_header get_block_header(const crypto::hash& h) const;
+
+  virtual cryptonote::blobdata get_block_blob(const crypto::hash& h) const;
+
+  virtual cryptonote::blobdata get_block_blob_from_height(const uint64_t& height) const;
+
+  virtual std::vector<uint64_t> get_block_cumulative_rct_outputs(const std::vector<uint64_t> &heights) const;
+
+  virtual uint64_t get_block_timestamp(const uint64_t& height) const;
+
+  virtual uint64_t get_top_block_timestamp() const;
+
+  virtual size_t get_block_weight(const uint64_t& height) const;
+
+  virtual std::vector<uint64_t> get_block_weights(uint64_t start_height, size_t count) const;
+
+  virtual difficulty_type get_block_cumulative_difficulty(const uint64_t& height) const;
+
+  virtual difficulty_type get_block_difficulty(const uint64_t& height) const;
+
+  virtual uint64_t get_block_already_generated_coins(const uint64_t& height) const;
+
+  virtual uint64_t get_block_long_term_weight(const uint64_t& height) const;
+
+  virtual std::vector<uint64_t> get_long_term_block_weights(uint64_t start_height, size_t count) const;
+
+  virtual crypto::hash get_block_hash_from_height(const uint64_t& height) const;
+
+  virtual std::vector<block> get_blocks_range(const uint64_t& h1, const uint64_t& h2) const;
+
+  virtual std::vector<crypto::hash> get_hashes_range(const uint64_t& h1, const uint64_t& h2) const;
+
+  virtual crypto::hash top_block_hash(uint64_t *block_height = NULL) const;
+
+  virtual block get_top_block() const;
+
+  virtual uint64_t height() const;
+
+  virtual bool tx_exists(const crypto::hash& h) const;
+  virtual bool tx_exists(const crypto::hash& h, uint64_t& tx_index) const;
+
+  virtual uint64_t get_tx_unlock_time(const crypto::hash& h) const;
+
+  virtual bool get_tx_blob(const crypto::hash& h, cryptonote::blobdata &tx) const;
+
+  virtual bool get_pruned_tx_blob(const crypto::hash& h, cryptonote::blobdata &tx) const;
+
+  virtual bool get_pruned_tx_blobs_from(const crypto::hash& h, size_t count, std::vector<cryptonote::blobdata> &bd) const;
+
+  virtual bool get_blocks_from(uint64_t start_height, size_t min_block_count, size_t max_block_count, size_t max_tx_count, size_t max_size, std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata>>>>& blocks, bool pruned, bool skip_coinbase, bool get_miner_tx_hash) const;
+
+  virtual bool get_prunable_tx_blob(const crypto::hash& h, cryptonote::blobdata &tx) const;
+
+  virtual bool get_prunable_tx_hash(const crypto::hash& tx_hash, crypto::hash &prunable_hash) const;
+
+  virtual uint64_t get_tx_count() const;
+
+  virtual std::vector<transaction> get_tx_list(const std::vector<crypto::hash>& hlist) const;
+
+  virtual uint64_t get_tx_block_height(const crypto::hash& h) const;
+
+  virtual uint64_t get_num_outputs(const uint64_t& amount) const;
+
+  virtual output_data_t get_output_key(const uint64_t& amount, const uint64_t& index, bool include_commitmemt) const;
+  virtual void get_output_key(const epee::span<const uint64_t> &amounts, const std::vector<uint64_t> &offsets, std::vector<output_data_t> &outputs, bool allow_partial = false) const;
+
+  virtual tx_out_index get_output_tx_and_index_from_global(const uint64_t& index) const;
+
+  virtual tx_out_index get_output_tx_and_index(const uint64_t& amount, const uint64_t& index) const;
+  virtual void get_output_tx_and_index(const uint64_t& amount, const std::vector<uint64_t> &offsets, std::vector<tx_out_index> &indices) const;
+
+  virtual std::vector<std::vector<uint64_t>> get_tx_amount_output_indices(const uint64_t tx_id, size_t n_txes) const;
+
+  virtual bool has_key_image(const crypto::key_image& img) const;
+  virtual void has_key_images(const epee::span<const crypto::key_image> &images, std::vector<bool> &spent) const;
+  virtual bool get_key_image_spender(const crypto::key_image& img, crypto::hash &tx_hash, uint64_t &height) const;
+
+  virtual void add_txpool_tx(const crypto::hash &txid, const cryptonote::blobdata_ref &blob, const txpool_tx_meta_t& meta);
+  virtual void update_txpool_tx(const crypto::hash &txid, const txpool_tx_meta_t& meta);
+  virtual uint64_t get_txpool_tx_count(relay_category category = relay_category::broadcasted) const;
+  virtual bool txpool_has_tx(const crypto::hash &txid, relay_category tx_category) const;
+  virtual void remove_txpool_tx(const crypto::hash& txid);
+  virtual bool get_txpool_tx_meta(const crypto::hash& txid, txpool_tx_meta_t &meta) const;
+  virtual bool get_txpool_tx_blob(const crypto::hash& txid, cryptonote::blobdata &bd, relay_category tx_category) const;
+  virtual cryptonote::blobdata get_txpool_tx_blob(const crypto::hash& txid, relay_category tx_category) const;
+  virtual uint32_t get_blockchain_pruning_seed() const;
+  virtual bool prune_blockchain(uint32_t pruning_seed = 0);
+  virtual bool prune_blockchain_step(uint32_t pruning_seed, size_t max_records, uint64_t max_bytes, uint64_t &pruned_bytes);
+  virtual bool get_pruning_progress(pruning_progress_t &progress) const;
+  virtual bool update_pruning();
+  virtual bool check_pruning();
+  virtual bool compact_start();
+  virtual bool compact_finish();
+  virtual bool bulk_load_start();
+  virtual void bulk_load_finish();
+  virtual bool get_db_stats(std::vector<db_table_stats> &tables, std::vector<db_operation_stats> &operations) const;
+  virtual void reset_db_stats();
+
+  virtual void add_alt_block(const crypto::hash &blkid, const cryptonote::alt_block_data_t &data, const cryptonote::blobdata_ref &blob);
+  virtual bool get_alt_block(const crypto::hash &blkid, alt_block_data_t *data, cryptonote::blobdata *blob);
+  virtual void remove_alt_block(const crypto::hash &blkid);
+  virtual uint64_t get_alt_block_count();
+  virtual void drop_alt_blocks();
+
+  virtual bool for_all_txpool_txes(std::function<bool(const crypto::hash&, const txpool_tx_meta_t&, const cryptonote::blobdata_ref*)> f, bool include_blob = false, relay_category category = relay_category::broadcasted) const;
+
+  virtual bool for_all_key_images(std::function<bool(const crypto::key_image&)>) const;
+  virtual bool for_blocks_range(const uint64_t& h1, const uint64_t& h2, std::function<bool(uint64_t, const crypto::hash&, const cryptonote::block&)>) const;
+  virtual bool for_all_transactions(std::function<bool(const crypto::hash&, const cryptonote::transaction&)>, bool pruned) const;
+  virtual bool for_all_outputs(std::function<bool(uint64_t amount, const crypto::hash &tx_hash, uint64_t height, size_t tx_idx)> f) const;
+  virtual bool for_all_outputs(uint64_t amount, const std::function<bool(uint64_t height)> &f) const;
+  virtual bool for_all_alt_blocks(std::function<bool(const crypto::hash &blkid, const alt_block_data_t &data, const cryptonote::blobdata_ref *blob)> f, bool include_blob = false) const;
+
+  virtual void set_batch_transactions(bool batch_transactions);
+  virtual bool batch_start(uint64_t batch_num_blocks=0, uint64_t batch_bytes=0);
+  virtual void batch_stop();
+  virtual void batch_abort();
+
+  virtual void block_wtxn_start();
+  virtual void block_wtxn_stop();
+  virtual void block_wtxn_abort();
+  virtual bool block_rtxn_start() const;
+  virtual void block_rtxn_stop() const;
+  virtual void block_rtxn_abort() const;
+
+  virtual void pop_block(block& blk, std::vector<transaction>& txs);
+
+  virtual bool can_thread_bulk_indices() const { return false; }
+
+  virtual std::map<uint64_t, std::tuple<uint64_t, uint64_t, uint64_t>> get_output_histogram(const std::vector<uint64_t> &amounts, bool unlocked, uint64_t recent_cutoff, uint64_t min_count) const;
+
+  virtual bool get_output_distribution(uint64_t amount, uint64_t from_height, uint64_t to_height, std::vector<uint64_t> &distribution, uint64_t &base) const;
+
+private:
+  struct block_record
+  {
+    cryptonote::blobdata blob;
+    crypto::hash hash;
+    uint64_t timestamp;
+    uint64_t coins;
+    uint64_t weight;
+    uint64_t long_term_weight;
+    difficulty_type cumulative_difficulty;
+    uint64_t cum_rct;
+    uint64_t first_tx_id; // the miner tx, followed by the block's other txs
+  };
+
+  struct tx_record
+  {
+    crypto::hash hash;
+    crypto::hash prunable_hash;
+    uint64_t unlock_time;
+    uint64_t block_height;
+    cryptonote::blobdata pruned;
+    cryptonote::blobdata prunable;
+    std::vector<uint64_t> amount_output_indices;
+  };
+
+  struct amount_output
+  {
+    uint64_t output_id;
+    output_data_t data; // the commitment is only stored for rct outputs
+  };
+
+  struct global_output
+  {
+    crypto::hash tx_hash;
+    uint64_t local_index;
+    bool pruned;
+  };
+
+  virtual void add_block( const block& blk
+                , size_t block_weight
+                , uint64_t long_term_block_weight
+                , const difficulty_type& cumulative_difficulty
+                , const uint64_t& coins_generated
+                , uint64_t num_rct_outs
+                , const crypto::hash& block_hash
+                );
+
+  virtual void remove_block();
+
+  virtual uint64_t add_transaction_data(const crypto::hash& blk_hash, const std::pair<transaction, blobdata_ref>& tx, const crypto::hash& tx_hash, const crypto::hash& tx_prunable_hash);
+
+  virtual void remove_transaction_data(const crypto::hash& tx_hash, const transaction& tx);
+
+  virtual uint64_t add_output(const crypto::hash& tx_hash,
+      const tx_out& tx_output,
+      const uint64_t& local_index,
+      const uint64_t unlock_time,
+      const rct::key *commitment
+      );
+
+  virtual void add_tx_amount_output_indices(const uint64_t tx_id,
+      const std::vector<uint64_t>& amount_output_indices
+      );
+
+  void remove_output(const uint64_t amount, const uint64_t& out_index);
+
+  virtual void prune_outputs(uint64_t amount);
+
+  virtual void add_spent_key(const crypto::key_image& k_image, const crypto::hash& tx_hash);
+
+  virtual void remove_spent_key(const crypto::key_image& k_image);
+
+  // Hard fork
+  virtual void set_hard_fork_version(uint64_t height, uint8_t version);
+  virtual uint8_t get_hard_fork_version(uint64_t height) const;
+  virtual void check_hard_fork_info();
+  virtual void drop_hard_fork_info();
+
+  inline void check_open() const;
+
+  virtual bool is_read_only() const;
+
+  virtual uint64_t get_database_size() const;
+
+  uint64_t get_max_block_size();
+  void add_max_block_size(uint64_t sz);
+
+  const block_record &get_block_record(uint64_t height) const;
+  const tx_record *find_tx(const crypto::hash& h) const;
+
+  // remember how to put back what a write is about to change, if it is part of a write txn
+  void on_abort(std::function<void()> undo);
+  void roll_back();
+
+  void clear();
+
+  // load the chain from the snapshot files, and save blocks added since the last save
+  void load_snapshot();
+  void save_snapshot();
+
+  std::string m_folder;
+  int m_db_flags;
+
+  mutable epee::critical_section m_lock;
+
+  std::vector<block_record> m_blocks;
+  std::unordered_map<crypto::hash, uint64_t> m_block_heights;
+  std::vector<uint8_t> m_hf_versions;
+
+  std::vector<tx_record> m_txs;
+  std::unordered_map<crypto::hash, uint64_t> m_tx_ids;
+
+  std::vector<global_output> m_outputs;
+  std::unordered_map<uint64_t, std::vector<amount_output>> m_amount_outputs;
+
+  std::unordered_map<crypto::key_image, std::pair<crypto::hash, uint64_t>> m_spent_keys; // spending tx hash and height, null hash when unknown
+
+  std::unordered_map<crypto::hash, std::pair<txpool_tx_meta_t, cryptonote::blobdata>> m_txpool;
+  std::unordered_map<crypto::hash, std::pair<alt_block_data_t, cryptonote::blobdata>> m_alt_blocks;
+
+  uint64_t m_max_block_size;
+  uint64_t m_data_size; // block and tx blobs held
+
+  // writers are serialized by m_write_lock, held from txn start to commit or abort
+  boost::recursive_mutex m_write_lock;
+  boost::thread::id m_writer;
+  unsigned int m_write_depth;
+  bool m_batch_active;
+  bool m_batch_transactions;
+  std::vector<std::function<void()>> m_undo;
+
+  uint64_t m_snapshot_height; // blocks already in the snapshot file
+  bool m_snapshot_stale; // a block in the snapshot file was popped, so it must be rewritten
+};
+
+}  // namespace cryptonote
@@ -0,0 +1,331 @@
+// Copyright (c) 2014-2021, The Monero Project
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <string.h>
+#include <errno.h>
+#include <boost/filesystem.hpp>
+
+#include "segment_store.h"
+#include "blockchain_db.h"
+#include "misc_log_ex.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "blockchain.db.segments"
+
+namespace cryptonote
+{
+
+segment_store::segment_store(): m_read_only(true), m_fd(-1), m_dirty(false)
+{
+}
+
+segment_store::~segment_store()
+{
+  try { close(); }
+  catch (...) { /* ignore */ }
+}
+
+std::string segment_store::get_segment_filename(uint32_t index) const
+{
+  char name[32];
+  snprintf(name, sizeof(name), "segment-%06u.dat", index);
+  return (boost::filesystem::path(m_folder) / name).string();
+}
+
+void segment_store::open(const std::string &folder, bool read_only)
+{
+#ifdef _WIN32
+  throw DB_ERROR("Segment storage is not supported on this platform");
+#else
+  if (is_open())
+    throw DB_ERROR("Segment store is already open");
+
+  if (!read_only)
+  {
+    boost::system::error_code ec;
+    boost::filesystem::create_directories(folder, ec);
+    if (ec)
+      throw DB_ERROR(("Failed to create segment folder " + folder + ": " + ec.message()).c_str());
+  }
+
+  m_folder = folder;
+  m_read_only = read_only;
+  try
+  {
+    uint32_t n_segments = 0;
+    while (boost::filesystem::exists(get_segment_filename(n_segments)))
+      ++n_segments;
+    for (uint32_t i = 0; i < n_segments; ++i)
+      add_segment(i, false);
+    if (n_segments == 0 && !read_only)
+      add_segment(0, true);
+  }
+  catch (...)
+  {
+    close();
+    throw;
+  }
+  MDEBUG("Opened " << m_segments.size() << " segments in " << folder);
+#endif
+}
+
+void segment_store::add_segment(uint32_t index, bool create)
+{
+#ifndef _WIN32
+  const std::string filename = get_segment_filename(index);
+  const int fd = ::open(filename.c_str(), (m_read_only ? O_RDONLY : O_RDWR) | (create ? O_CREAT | O_EXCL : 0), 0600);
+  if (fd < 0)
+    throw DB_ERROR(("Failed to open segment " + filename + ": " + strerror(errno)).c_str());
+
+  struct stat st;
+  if (fstat(fd, &st) < 0 || (uint64_t)st.st_size > SEGMENT_SIZE)
+  {
+    ::close(fd);
+    throw DB_ERROR(("Failed to get the size of segment " + filename).c_str());
+  }
+
+  // reserve the whole segment up front, so blobs never move as the file behind it grows
+  void *map = mmap(NULL, SEGMENT_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (map == MAP_FAILED)
+  {
+    ::close(fd);
+    throw DB_ERROR(("Failed to reserve space for segment " + filename + ": " + strerror(errno)).c_str());
+  }
+
+  std::unique_ptr<segment> seg(new segment());
+  seg->map = (const uint8_t*)map;
+  seg->size = st.st_size;
+  try
+  {
+    map_file(*seg, fd, st.st_size);
+  }
+  catch (...)
+  {
+    munmap(map, SEGMENT_SIZE);
+    ::close(fd);
+    throw;
+  }
+  {
+    boost::unique_lock<boost::shared_mutex> lock(m_segments_lock);
+    m_segments.push_back(std::move(seg));
+  }
+
+  // the previous segment is now sealed, make sure it is on disk before we forget its fd
+  if (m_fd >= 0)
+  {
+    if (!m_read_only && fsync(m_fd) < 0)
+      MERROR("Failed to sync segment: " << strerror(errno));
+    ::close(m_fd);
+  }
+  m_fd = fd;
+#endif
+}
+
+void segment_store::map_file(segment &seg, int fd, uint64_t size)
+{
+#ifndef _WIN32
+  // only map pages the file reaches into, touching a page wholly past its end raises SIGBUS
+  static const uint64_t page_size = sysconf(_SC_PAGESIZE);
+  const uint64_t mapped = (size + page_size - 1) / page_size * page_size;
+  uint8_t *base = (uint8_t*)seg.map;
+  if (mapped > seg.mapped)
+  {
+    if (mmap(base + seg.mapped, mapped - seg.mapped, PROT_READ, MAP_SHARED | MAP_FIXED, fd, seg.mapped) == MAP_FAILED)
+      throw DB_ERROR((std::string("Failed to map segment: ") + strerror(errno)).c_str());
+  }
+  else if (mapped < seg.mapped)
+  {
+    if (mmap(base + mapped, seg.mapped - mapped, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0) == MAP_FAILED)
+      throw DB_ERROR((std::string("Failed to unmap segment: ") + strerror(errno)).c_str());
+  }
+  seg.mapped = mapped;
+#endif
+}
+
+void segment_store::unmap_segments()
+{
+#ifndef _WIN32
+  boost::unique_lock<boost::shared_mutex> lock(m_segments_lock);
+  for (const auto &seg: m_segments)
+    munmap((void*)seg->map, SEGMENT_SIZE);
+  m_segments.clear();
+#endif
+}
+
+void segment_store::close()
+{
+#ifndef _WIN32
+  if (m_fd >= 0)
+  {
+    if (!m_read_only && fsync(m_fd) < 0)
+      MERROR("Failed to sync segment: " << strerror(errno));
+    ::close(m_fd);
+    m_fd = -1;
+  }
+#endif
+  m_dirty = false;
+  unmap_segments();
+  m_folder.clear();
+}
+
+segment_store::location segment_store::append(const epee::span<const uint8_t> &data)
+{
+#ifdef _WIN32
+  throw DB_ERROR("Segment storage is not supported on this platform");
+#else
+  if (m_read_only || m_segments.empty())
+    throw DB_ERROR("Segment store is not writable");
+  if (data.size() > SEGMENT_SIZE)
+    throw DB_ERROR("Blob is too large for a segment");
+
+  // only the writer changes m_segments, so it can read it without the lock
+  uint32_t index = m_segments.size() - 1;
+  uint64_t offset = m_segments[index]->size.load(std::memory_order_relaxed);
+  if (offset + data.size() > SEGMENT_SIZE)
+  {
+    add_segment(++index, true);
+    offset = 0;
+  }
+
+  size_t written = 0;
+  while (written < data.size())
+  {
+    const ssize_t res = pwrite(m_fd, data.data() + written, data.size() - written, offset + written);
+    if (res < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      throw DB_ERROR((std::string("Failed to write to segment: ") + strerror(errno)).c_str());
+    }
+    written += res;
+  }
+  m_dirty = true;
+  segment &seg = *m_segments[index];
+  if (offset + data.size() > seg.mapped)
+    map_file(seg, m_fd, offset + data.size());
+  seg.size.store(offset + data.size(), std::memory_order_release);
+
+  location loc;
+  loc.segment = index;
+  loc.size = data.size();
+  loc.offset = offset;
+  return loc;
+#endif
+}
+
+epee::span<const uint8_t> segment_store::get(const location &loc) const
+{
+  boost::shared_lock<boost::shared_mutex> lock(m_segments_lock);
+  if (loc.segment >= m_segments.size())
+    throw DB_ERROR("Blob location refers to a missing segment");
+  const segment &seg = *m_segments[loc.segment];
+  if (loc.offset + loc.size > seg.size.load(std::memory_order_acquire))
+    throw DB_ERROR("Blob location is past the end of its segment");
+  return {seg.map + loc.offset, loc.size};
+}
+
+void segment_store::release(const location &loc)
+{
+#ifndef _WIN32
+  if (m_read_only)
+    throw DB_ERROR("Segment store is not writable");
+  if (loc.segment >= m_segments.size())
+    throw DB_ERROR("Blob location refers to a missing segment");
+  segment &seg = *m_segments[loc.segment];
+  const uint64_t size = seg.size.load(std::memory_order_relaxed);
+  if (loc.offset + loc.size > size)
+    throw DB_ERROR("Blob location is past the end of its segment");
+
+  if (loc.segment == m_segments.size() - 1 && loc.offset + loc.size == size)
+  {
+    // shrink the mapping before the file, so no mapped page is ever past its end
+    seg.size.store(loc.offset, std::memory_order_release);
+    map_file(seg, m_fd, loc.offset);
+    if (ftruncate(m_fd, loc.offset) < 0)
+      throw DB_ERROR((std::string("Failed to truncate segment: ") + strerror(errno)).c_str());
+    m_dirty = true;
+    return;
+  }
+
+#ifdef FALLOC_FL_PUNCH_HOLE
+  const bool last = loc.segment == m_segments.size() - 1;
+  const int fd = last ? m_fd : ::open(get_segment_filename(loc.segment).c_str(), O_WRONLY);
+  if (fd < 0)
+  {
+    MWARNING("Failed to open segment " << loc.segment << " to release space: " << strerror(errno));
+    return;
+  }
+  if (fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, loc.offset, loc.size) < 0 && errno != EOPNOTSUPP)
+    MWARNING("Failed to release space in segment " << loc.segment << ": " << strerror(errno));
+  if (!last)
+    ::close(fd);
+#endif
+#endif
+}
+
+void segment_store::sync()
+{
+#ifndef _WIN32
+  if (!m_dirty || m_fd < 0 || m_read_only)
+    return;
+  if (fsync(m_fd) < 0)
+    throw DB_ERROR((std::string("Failed to sync segment: ") + strerror(errno)).c_str());
+  m_dirty = false;
+#endif
+}
+
+void segment_store::clear()
+{
+  if (m_read_only)
+    throw DB_ERROR("Segment store is not writable");
+  const std::string folder = m_folder;
+  const uint32_t n_segments = m_segments.size();
+  close();
+  m_folder = folder;
+  for (uint32_t i = 0; i < n_segments; ++i)
+    boost::filesystem::remove(get_segment_filename(i));
+  m_folder.clear();
+  open(folder, false);
+}
+
+uint64_t segment_store::get_size() const
+{
+  boost::shared_lock<boost::shared_mutex> lock(m_segments_lock);
+  uint64_t size = 0;
+  for (const auto &seg: m_segments)
+    size += seg->size.load(std::memory_order_relaxed);
+  return size;
+}
+
+}  // namespace cryptonote
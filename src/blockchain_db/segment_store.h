@@ -0,0 +1,138 @@
+// Copyright (c) 2014-2021, The Monero Project
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/thread/shared_mutex.hpp>
+
+#include "span.h"
+
+namespace cryptonote
+{
+
+/**
+ * @brief append-only store for blobs which are written once and rarely read
+ *
+ * Blobs are appended to fixed size segment files which are memory mapped
+ * for reading. Nothing is ever moved, the caller keeps the location of each
+ * blob (in the database) and gives its space back with release() once it is
+ * no longer referenced. There is a single writer, reads may run concurrently
+ * with it.
+ */
+class segment_store
+{
+public:
+#pragma pack(push, 1)
+  struct location
+  {
+    uint32_t segment;
+    uint32_t size;
+    uint64_t offset;
+  };
+#pragma pack(pop)
+
+  constexpr static uint64_t SEGMENT_SIZE = 256 * 1024 * 1024;
+
+  segment_store();
+  ~segment_store();
+
+  /**
+   * @brief open the segments in the given folder, creating it if needed
+   *
+   * @param folder the folder holding the segment files
+   * @param read_only whether appending is allowed
+   *
+   * If any of the segments fail to open, throw DB_ERROR
+   */
+  void open(const std::string &folder, bool read_only);
+
+  void close();
+
+  bool is_open() const { return !m_folder.empty(); }
+
+  /**
+   * @brief append a blob, starting a new segment when the current one is full
+   *
+   * The data reaches the OS before this returns, but is only durable after sync().
+   *
+   * @return where the blob was written
+   */
+  location append(const epee::span<const uint8_t> &data);
+
+  /**
+   * @brief get a blob previously appended
+   *
+   * The data points into the mapping and stays valid until close() or clear().
+   * If the location is not valid, throw DB_ERROR
+   */
+  epee::span<const uint8_t> get(const location &loc) const;
+
+  /**
+   * @brief give back the space of a blob which will not be read again
+   *
+   * A blob at the end of the last segment is truncated away, so the next
+   * append reuses its space. Elsewhere, a hole is punched where the
+   * filesystem supports it. No get() may be in progress for the location.
+   */
+  void release(const location &loc);
+
+  // flush appended data to disk, if any was appended since the last sync
+  void sync();
+
+  // delete all segments
+  void clear();
+
+  // total bytes stored, over all segments
+  uint64_t get_size() const;
+
+private:
+  struct segment
+  {
+    segment(): map(NULL), size(0), mapped(0) {}
+    const uint8_t *map;
+    std::atomic<uint64_t> size;
+    uint64_t mapped; // bytes of the file mapped, the rest of the segment is reserved but inaccessible
+  };
+
+  std::string get_segment_filename(uint32_t index) const;
+  void add_segment(uint32_t index, bool create);
+  void map_file(segment &seg, int fd, uint64_t size);
+  void unmap_segments();
+
+  std::string m_folder;
+  bool m_read_only;
+  int m_fd; // the last segment, which appends go to
+  bool m_dirty; // whether appends were made since the last sync
+  std::vector<std::unique_ptr<segment>> m_segments;
+  mutable boost::shared_mutex m_segments_lock;
+};
+
+}  // namespace cryptonote
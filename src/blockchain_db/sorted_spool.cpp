@@ -0,0 +1,209 @@
+// Copyright (c) 2014-2021, The Monero Project
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <queue>
+#include <boost/filesystem.hpp>
+
+#include "sorted_spool.h"
+#include "blockchain_db.h"
+#include "misc_log_ex.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "blockchain.db.spool"
+
+namespace cryptonote
+{
+
+sorted_spool::sorted_spool(const std::string &folder, const std::string &name, size_t record_size, compare_t compare, size_t memory_budget):
+  m_folder(folder), m_name(name), m_record_size(record_size), m_compare(std::move(compare)), m_runs(0), m_count(0)
+{
+  m_max_buffered = std::max<size_t>(memory_budget / record_size, 1) * record_size;
+}
+
+sorted_spool::~sorted_spool()
+{
+  try { clear(); }
+  catch (...) { /* ignore */ }
+}
+
+std::string sorted_spool::get_run_filename(size_t index) const
+{
+  return (boost::filesystem::path(m_folder) / (m_name + "-" + std::to_string(index) + ".run")).string();
+}
+
+void sorted_spool::add(const void *record)
+{
+  const uint8_t *ptr = (const uint8_t*)record;
+  m_buffer.insert(m_buffer.end(), ptr, ptr + m_record_size);
+  ++m_count;
+  if (m_buffer.size() >= m_max_buffered)
+    write_run();
+}
+
+void sorted_spool::write_run()
+{
+  if (m_buffer.empty())
+    return;
+
+  boost::system::error_code ec;
+  boost::filesystem::create_directories(m_folder, ec);
+  if (ec)
+    throw DB_ERROR(("Failed to create spool folder " + m_folder + ": " + ec.message()).c_str());
+
+  const size_t n_records = m_buffer.size() / m_record_size;
+  std::vector<uint32_t> order(n_records);
+  for (size_t i = 0; i < n_records; ++i)
+    order[i] = i;
+  std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+    return m_compare(m_buffer.data() + a * m_record_size, m_buffer.data() + b * m_record_size) < 0;
+  });
+
+  const std::string filename = get_run_filename(m_runs);
+  std::ofstream f(filename, std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+  for (uint32_t i: order)
+    f.write((const char*)m_buffer.data() + i * m_record_size, m_record_size);
+  f.close();
+  if (!f)
+    throw DB_ERROR(("Failed to write spool run " + filename).c_str());
+
+  MDEBUG("Wrote " << n_records << " records to " << filename);
+  ++m_runs;
+  m_buffer.clear();
+}
+
+void sorted_spool::merge(const std::function<void(const void*)> &f)
+{
+  // everything fits in memory, no need to go through a file
+  if (m_runs == 0)
+  {
+    const size_t n_records = m_buffer.size() / m_record_size;
+    std::vector<uint32_t> order(n_records);
+    for (size_t i = 0; i < n_records; ++i)
+      order[i] = i;
+    std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+      return m_compare(m_buffer.data() + a * m_record_size, m_buffer.data() + b * m_record_size) < 0;
+    });
+    for (uint32_t i: order)
+      f(m_buffer.data() + i * m_record_size);
+    clear();
+    return;
+  }
+
+  write_run();
+
+  std::vector<std::unique_ptr<std::ifstream>> runs;
+  std::vector<std::string> heads(m_runs, std::string(m_record_size, '\0'));
+  auto greater = [this, &heads](size_t a, size_t b) { return m_compare(heads[a].data(), heads[b].data()) > 0; };
+  std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> queue(greater);
+  for (size_t i = 0; i < m_runs; ++i)
+  {
+    runs.emplace_back(new std::ifstream(get_run_filename(i), std::ios_base::binary | std::ios_base::in));
+    if (!*runs.back())
+      throw DB_ERROR(("Failed to open spool run " + get_run_filename(i)).c_str());
+    if (runs.back()->read(&heads[i][0], m_record_size))
+      queue.push(i);
+  }
+
+  uint64_t merged = 0;
+  while (!queue.empty())
+  {
+    const size_t i = queue.top();
+    queue.pop();
+    f(heads[i].data());
+    ++merged;
+    if (runs[i]->read(&heads[i][0], m_record_size))
+      queue.push(i);
+    else if (!runs[i]->eof())
+      throw DB_ERROR(("Failed to read spool run " + get_run_filename(i)).c_str());
+  }
+  runs.clear();
+
+  if (merged != m_count)
+    throw DB_ERROR(("Spool " + m_name + " lost records: " + std::to_string(merged) + " read back out of " + std::to_string(m_count)).c_str());
+  clear();
+}
+
+void sorted_spool::retain(const std::function<bool(const void*)> &keep)
+{
+  size_t kept = 0;
+  for (size_t offset = 0; offset < m_buffer.size(); offset += m_record_size)
+  {
+    if (!keep(m_buffer.data() + offset))
+      continue;
+    if (kept != offset)
+      memmove(m_buffer.data() + kept, m_buffer.data() + offset, m_record_size);
+    kept += m_record_size;
+  }
+  m_buffer.resize(kept);
+  uint64_t count = kept / m_record_size;
+
+  // a run stays sorted with some of its records left out
+  std::string record(m_record_size, '\0');
+  for (size_t i = 0; i < m_runs; ++i)
+  {
+    const std::string filename = get_run_filename(i);
+    const std::string tmp_filename = filename + ".tmp";
+    std::ifstream in(filename, std::ios_base::binary | std::ios_base::in);
+    if (!in)
+      throw DB_ERROR(("Failed to open spool run " + filename).c_str());
+    std::ofstream out(tmp_filename, std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+    while (in.read(&record[0], m_record_size))
+    {
+      if (!keep(record.data()))
+        continue;
+      out.write(record.data(), m_record_size);
+      ++count;
+    }
+    if (!in.eof())
+      throw DB_ERROR(("Failed to read spool run " + filename).c_str());
+    in.close();
+    out.close();
+    if (!out)
+      throw DB_ERROR(("Failed to write spool run " + tmp_filename).c_str());
+    boost::system::error_code ec;
+    boost::filesystem::rename(tmp_filename, filename, ec);
+    if (ec)
+      throw DB_ERROR(("Failed to replace spool run " + filename + ": " + ec.message()).c_str());
+  }
+
+  MDEBUG("Kept " << count << " of " << m_count << " records in spool " << m_name);
+  m_count = count;
+}
+
+void sorted_spool::clear()
+{
+  for (size_t i = 0; i < m_runs; ++i)
+    boost::filesystem::remove(get_run_filename(i));
+  m_runs = 0;
+  m_count = 0;
+  m_buffer.clear();
+  m_buffer.shrink_to_fit();
+}
+
+}  // namespace cryptonote
@@ -0,0 +1,97 @@
+// Copyright (c) 2014-2021, The Monero Project
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace cryptonote
+{
+
+/**
+ * @brief external sort for fixed size records
+ *
+ * Records are buffered in memory, and written out as sorted runs whenever
+ * the buffer fills up. merge() then streams all the records back in order,
+ * reading each run sequentially, so the records can be appended to a table
+ * in a single pass whatever their number.
+ */
+class sorted_spool
+{
+public:
+  typedef std::function<int(const void*, const void*)> compare_t;
+
+  /**
+   * @param folder where the run files go, created if needed
+   * @param name prefix for the run file names
+   * @param record_size the size of every record
+   * @param compare orders two records, returning <0, 0 or >0 like memcmp
+   * @param memory_budget bytes to buffer before writing a run
+   */
+  sorted_spool(const std::string &folder, const std::string &name, size_t record_size, compare_t compare, size_t memory_budget = 64 * 1024 * 1024);
+  ~sorted_spool();
+
+  void add(const void *record);
+
+  uint64_t size() const { return m_count; }
+
+  /**
+   * @brief call f with every record added so far, in order
+   *
+   * Equal records are all passed. The spool is empty afterwards.
+   * If a run cannot be read back, throw DB_ERROR
+   */
+  void merge(const std::function<void(const void*)> &f);
+
+  /**
+   * @brief drop the records for which keep returns false
+   *
+   * The runs are rewritten in place, so this is as costly as a merge.
+   * If a run cannot be rewritten, throw DB_ERROR
+   */
+  void retain(const std::function<bool(const void*)> &keep);
+
+  // drop all records and delete the runs
+  void clear();
+
+private:
+  std::string get_run_filename(size_t index) const;
+  void write_run();
+
+  std::string m_folder;
+  std::string m_name;
+  size_t m_record_size;
+  compare_t m_compare;
+  size_t m_max_buffered;
+  std::vector<uint8_t> m_buffer;
+  size_t m_runs;
+  uint64_t m_count;
+};
+
+}  // namespace cryptonote
@@ -109,12 +109,14 @@ public:
   virtual bool can_thread_bulk_indices() const override { return false; }
   virtual std::vector<std::vector<uint64_t>> get_tx_amount_output_indices(const uint64_t tx_index, size_t n_txes) const override { return std::vector<std::vector<uint64_t>>(); }
   virtual bool has_key_image(const crypto::key_image& img) const override { return false; }
+  virtual void has_key_images(const epee::span<const crypto::key_image> &images, std::vector<bool> &spent) const override { spent.assign(images.size(), false); }
+  virtual bool get_key_image_spender(const crypto::key_image& img, crypto::hash &tx_hash, uint64_t &height) const override { return false; }
   virtual void remove_block() override { }
   virtual uint64_t add_transaction_data(const crypto::hash& blk_hash, const std::pair<cryptonote::transaction, cryptonote::blobdata_ref>& tx, const crypto::hash& tx_hash, const crypto::hash& tx_prunable_hash) override {return 0;}
   virtual void remove_transaction_data(const crypto::hash& tx_hash, const cryptonote::transaction& tx) override {}
   virtual uint64_t add_output(const crypto::hash& tx_hash, const cryptonote::tx_out& tx_output, const uint64_t& local_index, const uint64_t unlock_time, const rct::key *commitment) override {return 0;}
   virtual void add_tx_amount_output_indices(const uint64_t tx_index, const std::vector<uint64_t>& amount_output_indices) override {}
-  virtual void add_spent_key(const crypto::key_image& k_image) override {}
+  virtual void add_spent_key(const crypto::key_image& k_image, const crypto::hash& tx_hash) override {}
   virtual void remove_spent_key(const crypto::key_image& k_image) override {}
 
   virtual bool for_all_key_images(std::function<bool(const crypto::key_image&)>) const override { return true; }
@@ -134,6 +136,8 @@ public:
   virtual bool get_txpool_tx_meta(const crypto::hash& txid, cryptonote::txpool_tx_meta_t &meta) const override { return false; }
   virtual bool get_txpool_tx_blob(const crypto::hash& txid, cryptonote::blobdata &bd, relay_category tx_category) const override { return false; }
   virtual uint64_t get_database_size() const override { return 0; }
+  virtual bool get_db_stats(std::vector<cryptonote::db_table_stats> &tables, std::vector<cryptonote::db_operation_stats> &operations) const override { return false; }
+  virtual void reset_db_stats() override {}
   virtual cryptonote::blobdata get_txpool_tx_blob(const crypto::hash& txid, relay_category tx_category) const override { return ""; }
   virtual bool for_all_txpool_txes(std::function<bool(const crypto::hash&, const cryptonote::txpool_tx_meta_t&, const cryptonote::blobdata_ref*)>, bool include_blob = false, relay_category category = relay_category::broadcasted) const override { return false; }
 
@@ -152,8 +156,14 @@ public:
 
   virtual uint32_t get_blockchain_pruning_seed() const override { return 0; }
   virtual bool prune_blockchain(uint32_t pruning_seed = 0) override { return true; }
+  virtual bool prune_blockchain_step(uint32_t pruning_seed, size_t max_records, uint64_t max_bytes, uint64_t &pruned_bytes) override { pruned_bytes = 0; return true; }
+  virtual bool get_pruning_progress(cryptonote::pruning_progress_t &progress) const override { return false; }
   virtual bool update_pruning() override { return true; }
   virtual bool check_pruning() override { return true; }
+  virtual bool compact_start() override { return true; }
+  virtual bool compact_finish() override { return true; }
+  virtual bool bulk_load_start() override { return false; }
+  virtual void bulk_load_finish() override {}
   virtual void prune_outputs(uint64_t amount) override {}
 
   virtual uint64_t get_max_block_size() override { return 100000000; }
@@ -44,7 +44,8 @@ namespace cryptonote
     cryptonote_connection_context(): m_state(state_before_handshake), m_remote_blockchain_height(0), m_last_response_height(0),
         m_last_request_time(boost::date_time::not_a_date_time), m_callback_request_count(0),
         m_last_known_hash(crypto::null_hash), m_pruning_seed(0), m_rpc_port(0), m_rpc_credits_per_hash(0), m_anchor(false), m_score(0),
-        m_expect_response(0), m_expect_height(0), m_num_requested(0) {}
+        m_expect_response(0), m_expect_height(0), m_num_requested(0), m_span_rate(0.0f), m_span_block_size(0.0f), m_rtt(0.0f),
+        m_recon_salt(0), m_recon_round_start(boost::date_time::not_a_date_time) {}
 
     enum state
     {
@@ -61,6 +62,12 @@ namespace cryptonote
     //! \return Maximum number of bytes permissible for `command`.
     static size_t get_max_bytes(int command) noexcept;
 
+    //! \return Send priority of `command`, new blocks first and peer exchange last.
+    static epee::net_utils::traffic_class get_traffic_class(int command) noexcept;
+
+    //! \return True for the block download responses, the only bodies large enough to pay for compression.
+    static bool compress_command(int command) noexcept;
+
     state m_state;
     std::vector<std::pair<crypto::hash, uint64_t>> m_needed_objects;
     std::unordered_set<crypto::hash> m_requested_objects;
@@ -77,6 +84,13 @@ namespace cryptonote
     int m_expect_response;
     uint64_t m_expect_height;
     size_t m_num_requested;
+    float m_span_rate; // smoothed, bytes per second, excluding round trip time
+    float m_span_block_size; // smoothed, bytes per block
+    float m_rtt; // smoothed, seconds
+    std::vector<crypto::hash> m_recon_txs; // queued for the next reconciliation round
+    std::vector<crypto::hash> m_recon_round_txs; // in the reconciliation round in flight
+    uint64_t m_recon_salt;
+    boost::posix_time::ptime m_recon_round_start;
     epee::copyable_atomic m_new_stripe_notification{0};
     epee::copyable_atomic m_idle_peer_notification{0};    
   };
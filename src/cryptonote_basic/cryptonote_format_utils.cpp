@@ -1181,6 +1181,65 @@ namespace cryptonote
     return blob;
   }
   //---------------------------------------------------------------
+  bool get_block_hashing_blob(const blobdata_ref& block_blob, blobdata& hashing_blob)
+  {
+    // same as parsing the whole block, but the header and miner tx are hashed from the blob's own bytes
+    binary_archive<false> ba{epee::strspan<std::uint8_t>(block_blob)};
+    block_header header;
+    bool r = ::serialization::serialize_noeof(ba, header);
+    CHECK_AND_ASSERT_MES(r, false, "Failed to parse block header from blob");
+    const size_t header_size = ba.getpos();
+    transaction miner_tx;
+    r = ::serialization::serialize_noeof(ba, miner_tx);
+    CHECK_AND_ASSERT_MES(r, false, "Failed to parse miner tx from block blob");
+    const blobdata_ref miner_tx_blob(block_blob.data() + header_size, ba.getpos() - header_size);
+    std::vector<crypto::hash> tx_hashes;
+    r = ::serialization::serialize(ba, tx_hashes);
+    CHECK_AND_ASSERT_MES(r, false, "Failed to parse tx hashes from block blob");
+    CHECK_AND_ASSERT_MES(tx_hashes.size() <= CRYPTONOTE_MAX_TX_PER_BLOCK, false, "Too many txes in block blob");
+
+    crypto::hash miner_tx_hash;
+    if (miner_tx.version == 1)
+    {
+      get_blob_hash(miner_tx_blob, miner_tx_hash);
+    }
+    else if (miner_tx.rct_signatures.type == rct::RCTTypeNull)
+    {
+      const unsigned int prefix_size = miner_tx.prefix_size, unprunable_size = miner_tx.unprunable_size;
+      CHECK_AND_ASSERT_MES(prefix_size <= unprunable_size && unprunable_size <= miner_tx_blob.size(), false, "Inconsistent miner tx sizes");
+      crypto::hash hashes[3];
+      get_blob_hash(blobdata_ref(miner_tx_blob.data(), prefix_size), hashes[0]);
+      get_blob_hash(blobdata_ref(miner_tx_blob.data() + prefix_size, unprunable_size - prefix_size), hashes[1]);
+      hashes[2] = crypto::null_hash;
+      miner_tx_hash = cn_fast_hash(hashes, sizeof(hashes));
+    }
+    else
+    {
+      CHECK_AND_ASSERT_MES(get_transaction_hash(miner_tx, miner_tx_hash), false, "Failed to hash miner tx");
+    }
+    tx_hashes.insert(tx_hashes.begin(), miner_tx_hash);
+    const crypto::hash tree_root_hash = get_tx_tree_hash(tx_hashes);
+
+    hashing_blob.assign(block_blob.data(), header_size);
+    hashing_blob.append(reinterpret_cast<const char*>(&tree_root_hash), sizeof(tree_root_hash));
+    hashing_blob.append(tools::get_varint_data(tx_hashes.size()));
+    return true;
+  }
+  //---------------------------------------------------------------
+  bool parse_block_hashing_blob(const blobdata_ref& hashing_blob, block_header& header)
+  {
+    binary_archive<false> ba{epee::strspan<std::uint8_t>(hashing_blob)};
+    bool r = ::serialization::serialize_noeof(ba, header);
+    CHECK_AND_ASSERT_MES(r, false, "Failed to parse block header from hashing blob");
+    // then the tx tree root and the varint tx count, at least one for the miner tx
+    const size_t tail = ba.remaining_bytes();
+    CHECK_AND_ASSERT_MES(tail > sizeof(crypto::hash) && tail <= sizeof(crypto::hash) + (sizeof(uint64_t) * 8 + 6) / 7, false, "Invalid block hashing blob size");
+    uint64_t n_txes = 0;
+    const int read = tools::read_varint(hashing_blob.end() - (tail - sizeof(crypto::hash)), hashing_blob.end(), n_txes);
+    CHECK_AND_ASSERT_MES(read == (int)(tail - sizeof(crypto::hash)) && n_txes > 0, false, "Invalid tx count in block hashing blob");
+    return true;
+  }
+  //---------------------------------------------------------------
   bool calculate_block_hash(const block& b, crypto::hash& res, const blobdata_ref *blob)
   {
     blobdata bd;
@@ -1254,19 +1313,23 @@ namespace cryptonote
   //---------------------------------------------------------------
   bool get_block_longhash(const block& b, crypto::hash& res, uint64_t height)
   {
-    block b_local = b; //workaround to avoid const errors with do_serialize
-    blobdata bd = get_block_hashing_blob(b);
+    const blobdata bd = get_block_hashing_blob(b);
+    return get_block_longhash(blobdata_ref{bd.data(), bd.size()}, b.major_version, res, height);
+  }
+  //---------------------------------------------------------------
+  bool get_block_longhash(const blobdata_ref& hashing_blob, uint8_t major_version, crypto::hash& res, uint64_t height)
+  {
     crypto::cn_slow_hash_type cn_type = cn_slow_hash_type::cn_original;
-    if (b_local.major_version == CRYPTONOTE_HEAVY_BLOCK_VERSION)
+    if (major_version == CRYPTONOTE_HEAVY_BLOCK_VERSION)
     {
       cn_type = cn_slow_hash_type::cn_heavy;
     }
-    else if (b_local.major_version >= HF_VERSION_BP){
+    else if (major_version >= HF_VERSION_BP){
       cn_type = cn_slow_hash_type::cn_r;
     }
 
-    const int cn_variant = b_local.major_version >= HF_VERSION_BP ? b_local.major_version - 3 : 0;
-    crypto::cn_slow_hash(bd.data(), bd.size(), res, cn_variant, height, cn_type);
+    const int cn_variant = major_version >= HF_VERSION_BP ? major_version - 3 : 0;
+    crypto::cn_slow_hash(hashing_blob.data(), hashing_blob.size(), res, cn_variant, height, cn_type);
     return true;
   }
   //---------------------------------------------------------------
@@ -30,6 +30,7 @@
 // Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
 
 #include <algorithm>
+#include <chrono>
 #include <boost/filesystem.hpp>
 #include <boost/range/adaptor/reversed.hpp>
 #include <boost/system/error_code.hpp>
@@ -60,6 +61,8 @@
 
 #define FIND_BLOCKCHAIN_SUPPLEMENT_MAX_SIZE (100*1024*1024) // 100 MB
 
+#define VERIFIED_HEADERS_MAX_COUNT 100000 // how far ahead of the chain we keep verified headers
+
 using namespace crypto;
 
 //#include "serialization/json_archive.h"
@@ -320,8 +323,8 @@ bool checkpoints::load_new_checkpoints(const std::string &json_hashfile_fullpath
 
 //------------------------------------------------------------------
 Blockchain::Blockchain(tx_memory_pool& tx_pool) :
-  m_db(), m_tx_pool(tx_pool), m_hardfork(NULL), m_timestamps_and_difficulties_height(0), m_reset_timestamps_and_difficulties_height(true), m_current_block_cumul_weight_limit(0), m_current_block_cumul_weight_median(0),
-  m_enforce_dns_checkpoints(false), m_max_prepare_blocks_threads(4), m_db_sync_on_blocks(true), m_db_sync_threshold(1), m_db_sync_mode(db_async), m_db_default_sync(false), m_fast_sync(true), m_show_time_stats(false), m_sync_counter(0), m_bytes_to_sync(0), m_cancel(false),
+  m_db(), m_tx_pool(tx_pool), m_hardfork(NULL), m_timestamps_and_difficulties_height(0), m_reset_timestamps_and_difficulties_height(true), m_current_block_cumul_weight_limit(0), m_current_block_cumul_weight_median(0), m_verified_headers_start(0),
+  m_enforce_dns_checkpoints(false), m_max_prepare_blocks_threads(4), m_db_sync_on_blocks(true), m_db_sync_threshold(1), m_db_sync_mode(db_async), m_db_default_sync(false), m_fast_sync(true), m_show_time_stats(false), m_sync_counter(0), m_bytes_to_sync(0), m_pruning_active(false), m_pruning_rate(0), m_cancel(false),
   m_long_term_block_weights_window(CRYPTONOTE_LONG_TERM_BLOCK_WEIGHT_WINDOW_SIZE),
   m_long_term_effective_median_block_weight(0),
   m_long_term_block_weights_cache_tip_hash(crypto::null_hash),
@@ -360,11 +363,25 @@ bool Blockchain::have_tx_keyimg_as_spent(const crypto::key_image &key_im) const
   return  m_db->has_key_image(key_im);
 }
 //------------------------------------------------------------------
+void Blockchain::have_key_images_as_spent(const epee::span<const crypto::key_image> &key_images, std::vector<bool> &spent) const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  // same caveat as have_tx_keyimg_as_spent, this does not take m_blockchain_lock
+  m_db->has_key_images(key_images, spent);
+}
+//------------------------------------------------------------------
+bool Blockchain::get_key_image_spender(const crypto::key_image &key_im, crypto::hash &tx_hash, uint64_t &height) const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  // same caveat as have_tx_keyimg_as_spent, this does not take m_blockchain_lock
+  return m_db->get_key_image_spender(key_im, tx_hash, height);
+}
+//------------------------------------------------------------------
 // This function makes sure that each "input" in an input (mixins) exists
 // and collects the public key for each from the transaction it was included in
 // via the visitor passed to it.
 template <class visitor_t>
-bool Blockchain::scan_outputkeys_for_indexes(size_t tx_version, const txin_to_key& tx_in_to_key, visitor_t &vis, const crypto::hash &tx_prefix_hash, uint64_t* pmax_related_block_height) const
+bool Blockchain::scan_outputkeys_for_indexes(size_t tx_version, const txin_to_key& tx_in_to_key, visitor_t &vis, const crypto::hash &tx_prefix_hash, uint64_t* pmax_related_block_height, const scan_table_t *scan_table) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
 
@@ -383,8 +400,10 @@ bool Blockchain::scan_outputkeys_for_indexes(size_t tx_version, const txin_to_ke
   std::vector<output_data_t> outputs;
 
   bool found = false;
-  auto it = m_scan_table.find(tx_prefix_hash);
-  if (it != m_scan_table.end())
+  if (!scan_table)
+    scan_table = &m_scan_table;
+  auto it = scan_table->find(tx_prefix_hash);
+  if (it != scan_table->end())
   {
     auto its = it->second.find(tx_in_to_key.k_image);
     if (its != it->second.end())
@@ -752,6 +771,14 @@ bool Blockchain::deinit()
   m_async_thread.join();
   m_async_service.stop();
 
+  // a pruning run stopped here resumes from its last chunk on restart
+  {
+    CRITICAL_REGION_LOCAL(m_pruning_lock);
+    m_pruning_thread.interrupt();
+    if (m_pruning_thread.joinable())
+      m_pruning_thread.join();
+  }
+
   // as this should be called if handling a SIGSEGV, need to check
   // if m_db is a NULL pointer (and thus may have caused the illegal
   // memory operation), otherwise we may cause a loop.
@@ -1055,6 +1082,52 @@ bool Blockchain::get_block_by_hash(const crypto::hash &h, block &blk, bool *orph
   return false;
 }
 //------------------------------------------------------------------
+static size_t get_difficulty_blocks_count(uint8_t version)
+{
+  if (version == 1)
+    return DIFFICULTY_BLOCKS_COUNT;
+  else if (version < 5)
+    return DIFFICULTY_BLOCKS_COUNT_V2;
+  else
+    return DIFFICULTY_BLOCKS_COUNT_V3;
+}
+//------------------------------------------------------------------
+static difficulty_type next_difficulty_for_version(uint8_t version, std::vector<uint64_t> timestamps, std::vector<difficulty_type> cumulative_difficulties)
+{
+  size_t target = DIFFICULTY_TARGET;
+  if (version == 1)
+    return next_difficulty(std::move(timestamps), std::move(cumulative_difficulties), target);
+  else if (version < 5)
+    return next_difficulty_v2(std::move(timestamps), std::move(cumulative_difficulties), target);
+  else
+    return next_difficulty_v3(std::move(timestamps), std::move(cumulative_difficulties), target);
+}
+//------------------------------------------------------------------
+// Returns the difficulty the network hashrate is reset to right after
+// some hard forks, or 0 if the given blockchain height is not in such a window
+static difficulty_type get_difficulty_reset(network_type nettype, uint64_t height)
+{
+  if (nettype != MAINNET)
+    return 0;
+
+  // Reset network hashrate to 2.0 MHz when hardfork v3 comes
+  if (height >= MAINNET_HARDFORK_V3_HEIGHT && height <= MAINNET_HARDFORK_V3_HEIGHT + (uint64_t)DIFFICULTY_BLOCKS_COUNT_V2){
+    return (difficulty_type)480000000;
+  }
+
+  // Reset network hashrate to 200 MHz when hardfork v6 comes
+  if (height >= MAINNET_HARDFORK_V6_HEIGHT && height <= MAINNET_HARDFORK_V6_HEIGHT + (uint64_t)DIFFICULTY_BLOCKS_COUNT_V3){
+    return (difficulty_type)48000000000;
+  }
+
+  // Reset network hashrate to 1.0 MHz when hardfork v7 comes
+  if (height >= MAINNET_HARDFORK_V7_HEIGHT && height <= MAINNET_HARDFORK_V7_HEIGHT + (uint64_t)DIFFICULTY_BLOCKS_COUNT_V3){
+    return (difficulty_type)240000000;
+  }
+
+  return 0;
+}
+//------------------------------------------------------------------
 // This function aggregates the cumulative difficulties and timestamps of the
 // last DIFFICULTY_BLOCKS_COUNT blocks and passes them to next_difficulty,
 // returning the result of that call.  Ignores the genesis block, and can use
@@ -1085,32 +1158,12 @@ difficulty_type Blockchain::get_difficulty_for_next_block()
   uint64_t height;
   top_hash = get_tail_id(height); // get it again now that we have the lock
   ++height; // top block height to blockchain height
-  // Reset network hashrate to 2.0 MHz when hardfork v3 comes
-  if (m_nettype == MAINNET && (uint64_t)height >= MAINNET_HARDFORK_V3_HEIGHT && (uint64_t)height <= MAINNET_HARDFORK_V3_HEIGHT + (uint64_t)DIFFICULTY_BLOCKS_COUNT_V2){
-    return (difficulty_type)480000000;
-  }
+  const difficulty_type reset_difficulty = get_difficulty_reset(m_nettype, height);
+  if (reset_difficulty)
+    return reset_difficulty;
 
-  // Reset network hashrate to 200 MHz when hardfork v6 comes
-  if (m_nettype == MAINNET && (uint64_t)height >= MAINNET_HARDFORK_V6_HEIGHT && (uint64_t)height <= MAINNET_HARDFORK_V6_HEIGHT + (uint64_t)DIFFICULTY_BLOCKS_COUNT_V3){
-    return (difficulty_type)48000000000;
-  }
-
-  // Reset network hashrate to 1.0 MHz when hardfork v7 comes
-  if (m_nettype == MAINNET && (uint64_t)height >= MAINNET_HARDFORK_V7_HEIGHT && (uint64_t)height <= MAINNET_HARDFORK_V7_HEIGHT + (uint64_t)DIFFICULTY_BLOCKS_COUNT_V3){
-    return (difficulty_type)240000000;
-  }
-
-  size_t difficulty_blocks_count;
   uint8_t hf_version = get_current_hard_fork_version();
-  if (hf_version == 1) {
-    difficulty_blocks_count = DIFFICULTY_BLOCKS_COUNT;
-  }
-  else if (hf_version < 5) {
-    difficulty_blocks_count = DIFFICULTY_BLOCKS_COUNT_V2;
-  }
-  else {
-    difficulty_blocks_count = DIFFICULTY_BLOCKS_COUNT_V3;
-  }
+  const size_t difficulty_blocks_count = get_difficulty_blocks_count(hf_version);
 
   // ND: Speedup
   // 1. Keep a list of the last 735 (or less) blocks that is used to compute difficulty,
@@ -1157,16 +1210,7 @@ difficulty_type Blockchain::get_difficulty_for_next_block()
     m_timestamps = timestamps;
     m_difficulties = difficulties;
   }
-  size_t target = DIFFICULTY_TARGET;
-  if (hf_version == 1) {
-    return next_difficulty(timestamps, difficulties, target);
-  }
-  else if (hf_version < 5) {
-    return next_difficulty_v2(timestamps, difficulties, target);
-  }
-  else {
-    return next_difficulty_v3(timestamps, difficulties, target);
-  }
+  return next_difficulty_for_version(hf_version, std::move(timestamps), std::move(difficulties));
 }
 //------------------------------------------------------------------
 std::vector<time_t> Blockchain::get_last_block_timestamps(unsigned int blocks) const
@@ -1353,17 +1397,8 @@ difficulty_type Blockchain::get_next_difficulty_for_alternative_chain(const std:
   LOG_PRINT_L3("Blockchain::" << __func__);
   std::vector<uint64_t> timestamps;
   std::vector<difficulty_type> cumulative_difficulties;
-  size_t difficulty_blocks_count;
   uint8_t version = get_current_hard_fork_version();
-  if (version == 1) {
-    difficulty_blocks_count = DIFFICULTY_BLOCKS_COUNT;
-  }
-  else if (version < 5) {
-    difficulty_blocks_count = DIFFICULTY_BLOCKS_COUNT_V2;
-  }
-  else{
-    difficulty_blocks_count = DIFFICULTY_BLOCKS_COUNT_V3;
-  }
+  const size_t difficulty_blocks_count = get_difficulty_blocks_count(version);
 
   // if the alt chain isn't long enough to calculate the difficulty target
   // based on its blocks alone, need to get more blocks from the main chain
@@ -1416,18 +1451,8 @@ difficulty_type Blockchain::get_next_difficulty_for_alternative_chain(const std:
   }
 
   // FIXME: This will fail if fork activation heights are subject to voting
-  size_t target = DIFFICULTY_TARGET;
-
   // calculate the difficulty target for the block and return it
-  if (version == 1) {
-    return next_difficulty(timestamps, cumulative_difficulties, target);
-  }
-  else if (version < 5) {
-    return next_difficulty_v2(timestamps, cumulative_difficulties, target);
-  }
-  else{
-    return next_difficulty_v3(timestamps, cumulative_difficulties, target);
-  }
+  return next_difficulty_for_version(version, std::move(timestamps), std::move(cumulative_difficulties));
 }
 //------------------------------------------------------------------
 // This function does a sanity check on basic things that all miner
@@ -2977,7 +3002,13 @@ void Blockchain::on_new_tx_from_block(const cryptonote::transaction &tx)
 bool Blockchain::check_tx_inputs(transaction& tx, uint64_t& max_used_block_height, crypto::hash& max_used_block_id, tx_verification_context &tvc, bool kept_by_block) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+
+  // The database part of the checks (key images, ring members, unlock times)
+  // needs the blockchain lock, but the ring signatures themselves only depend
+  // on the expanded transaction, so they are verified after the lock is
+  // released, letting several transactions be verified concurrently.
+  TIME_MEASURE_START(a);
+  CRITICAL_REGION_BEGIN(m_blockchain_lock);
 
 #if defined(PER_BLOCK_CHECKPOINT)
   // check if we're doing per-block checkpointing
@@ -2989,20 +3020,99 @@ bool Blockchain::check_tx_inputs(transaction& tx, uint64_t& max_used_block_heigh
   }
 #endif
 
-  TIME_MEASURE_START(a);
-  bool res = check_tx_inputs(tx, tvc, &max_used_block_height);
+  if (!check_tx_inputs(tx, tvc, &max_used_block_height, true))
+    return false;
+
+  CHECK_AND_ASSERT_MES(max_used_block_height < m_db->height(), false,  "internal error: max used block index=" << max_used_block_height << " is not less then blockchain size = " << m_db->height());
+  max_used_block_id = m_db->get_block_hash_from_height(max_used_block_height);
+  CRITICAL_REGION_END();
+
+  bool res = check_tx_ring_signatures(tx);
   TIME_MEASURE_FINISH(a);
   if(m_show_time_stats)
   {
     size_t ring_size = !tx.vin.empty() && tx.vin[0].type() == typeid(txin_to_key) ? boost::get<txin_to_key>(tx.vin[0]).key_offsets.size() : 0;
     MINFO("HASH: " <<  get_transaction_hash(tx) << " I/M/O: " << tx.vin.size() << "/" << ring_size << "/" << tx.vout.size() << " H: " << max_used_block_height << " ms: " << a + m_fake_scan_time << " B: " << get_object_blobsize(tx) << " W: " << get_transaction_weight(tx));
   }
-  if (!res)
-    return false;
+  return res;
+}
+//------------------------------------------------------------------
+void Blockchain::check_tx_inputs_batch(std::vector<tx_input_check> &txs) const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  PERF_TIMER(check_tx_inputs_batch);
 
-  CHECK_AND_ASSERT_MES(max_used_block_height < m_db->height(), false,  "internal error: max used block index=" << max_used_block_height << " is not less then blockchain size = " << m_db->height());
-  max_used_block_id = m_db->get_block_hash_from_height(max_used_block_height);
-  return true;
+  CRITICAL_REGION_BEGIN(m_blockchain_lock);
+
+  std::vector<std::pair<const transaction*, crypto::hash>> txes;
+  txes.reserve(txs.size());
+  for (const tx_input_check &check: txs)
+    txes.emplace_back(check.tx, get_transaction_prefix_hash(*check.tx));
+
+  // identical txes share their entry, their rings are the same
+  scan_table_t scan_table;
+  prefetch_ring_members(txes, scan_table);
+
+  for (tx_input_check &check: txs)
+  {
+    check.max_used_block_height = 0;
+    check.max_used_block_id = null_hash;
+    check.result = check_tx_inputs(*check.tx, *check.tvc, &check.max_used_block_height, true, &scan_table);
+    if (!check.result)
+      continue;
+    if (check.max_used_block_height >= m_db->height())
+    {
+      MERROR("internal error: max used block index=" << check.max_used_block_height << " is not less then blockchain size = " << m_db->height());
+      check.result = false;
+      continue;
+    }
+    check.max_used_block_id = m_db->get_block_hash_from_height(check.max_used_block_height);
+  }
+  CRITICAL_REGION_END();
+
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  tools::threadpool::waiter waiter(tpool);
+  for (tx_input_check &check: txs)
+  {
+    if (!check.result)
+      continue;
+    tpool.submit(&waiter, [&check] { check.result = check_tx_ring_signatures(*check.tx); });
+  }
+  if (!waiter.wait())
+  {
+    for (tx_input_check &check: txs)
+      check.result = false;
+  }
+}
+//------------------------------------------------------------------
+bool Blockchain::check_tx_ring_signatures(const transaction &tx)
+{
+  PERF_TIMER(check_tx_ring_signatures);
+
+  // pruned txes are skipped, see check_tx_inputs
+  if (tx.pruned || tx.version < 2)
+    return true;
+
+  const rct::rctSig &rv = tx.rct_signatures;
+  bool r = false;
+  switch (rv.type)
+  {
+  case rct::RCTTypeSimple:
+  case rct::RCTTypeBulletproof:
+  case rct::RCTTypeBulletproof2:
+  case rct::RCTTypeCLSAG:
+    r = rct::verRctNonSemanticsSimple(rv);
+    break;
+  case rct::RCTTypeFull:
+    r = rct::verRct(rv, false);
+    break;
+  default:
+    MERROR_VER("Unsupported rct type: " << rv.type);
+    return false;
+  }
+  if (!r)
+    MERROR_VER("Failed to check ringct signatures!");
+  return r;
 }
 //------------------------------------------------------------------
 bool Blockchain::check_tx_outputs(const transaction& tx, tx_verification_context &tvc) const
@@ -3109,13 +3219,16 @@ bool Blockchain::check_tx_outputs(const transaction& tx, tx_verification_context
 bool Blockchain::have_tx_keyimges_as_spent(const transaction &tx) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
+  std::vector<crypto::key_image> key_images;
+  key_images.reserve(tx.vin.size());
   for (const txin_v& in: tx.vin)
   {
     CHECKED_GET_SPECIFIC_VARIANT(in, const txin_to_key, in_to_key, true);
-    if(have_tx_keyimg_as_spent(in_to_key.k_image))
-      return true;
+    key_images.push_back(in_to_key.k_image);
   }
-  return false;
+  std::vector<bool> spent;
+  have_key_images_as_spent(epee::to_span(key_images), spent);
+  return std::find(spent.begin(), spent.end(), true) != spent.end();
 }
 bool Blockchain::expand_transaction_2(transaction &tx, const crypto::hash &tx_prefix_hash, const std::vector<std::vector<rct::ctkey>> &pubkeys) const
 {
@@ -3210,7 +3323,7 @@ bool Blockchain::expand_transaction_2(transaction &tx, const crypto::hash &tx_pr
 //        check_tx_input() rather than here, and use this function simply
 //        to iterate the inputs as necessary (splitting the task
 //        using threads, etc.)
-bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc, uint64_t* pmax_used_block_height) const
+bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc, uint64_t* pmax_used_block_height, bool defer_signatures, const scan_table_t *scan_table) const
 {
   PERF_TIMER(check_tx_inputs);
   LOG_PRINT_L3("Blockchain::" << __func__);
@@ -3341,6 +3454,15 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
   uint64_t max_used_block_height = 0;
   if (!pmax_used_block_height)
     pmax_used_block_height = &max_used_block_height;
+
+  // look up all the key images at once, inputs of another type are rejected below
+  std::vector<crypto::key_image> key_images;
+  key_images.reserve(tx.vin.size());
+  for (const auto& txin : tx.vin)
+    key_images.push_back(txin.type() == typeid(txin_to_key) ? boost::get<txin_to_key>(txin).k_image : crypto::key_image{});
+  std::vector<bool> spent_key_images;
+  have_key_images_as_spent(epee::to_span(key_images), spent_key_images);
+
   for (const auto& txin : tx.vin)
   {
     // make sure output being spent is of type txin_to_key, rather than
@@ -3351,7 +3473,7 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
     // make sure tx output has key offset(s) (is signed to be used)
     CHECK_AND_ASSERT_MES(in_to_key.key_offsets.size(), false, "empty in_to_key.key_offsets in transaction with id " << get_transaction_hash(tx));
 
-    if(have_tx_keyimg_as_spent(in_to_key.k_image))
+    if(spent_key_images[sig_index])
     {
       MERROR_VER("Key image already spent in blockchain: " << epee::string_tools::pod_to_hex(in_to_key.k_image));
       tvc.m_double_spend = true;
@@ -3361,7 +3483,7 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
 
     // make sure that output being spent matches up correctly with the
     // signature spending it.
-    if (!check_tx_input(tx.version, in_to_key, tx_prefix_hash, std::vector<crypto::signature>(), tx.rct_signatures, pubkeys[sig_index], pmax_used_block_height, hf_version))
+    if (!check_tx_input(tx.version, in_to_key, tx_prefix_hash, std::vector<crypto::signature>(), tx.rct_signatures, pubkeys[sig_index], pmax_used_block_height, hf_version, scan_table))
     {
       MERROR_VER("Failed to check ring signature for tx " << get_transaction_hash(tx) << "  vin key with k_image: " << in_to_key.k_image << "  sig_index: " << sig_index);
       if (pmax_used_block_height) // a default value of NULL is used when called from Blockchain::handle_block_to_main_chain()
@@ -3460,11 +3582,8 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
         }
       }
 
-      if (!rct::verRctNonSemanticsSimple(rv))
-      {
-        MERROR_VER("Failed to check ringct signatures!");
+      if (!defer_signatures && !check_tx_ring_signatures(tx))
         return false;
-      }
       break;
     }
     case rct::RCTTypeFull:
@@ -3519,11 +3638,8 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
         }
       }
 
-      if (!rct::verRct(rv, false))
-      {
-        MERROR_VER("Failed to check ringct signatures!");
+      if (!defer_signatures && !check_tx_ring_signatures(tx))
         return false;
-      }
       break;
     }
     default:
@@ -3709,7 +3825,7 @@ bool Blockchain::is_tx_spendtime_unlocked(uint64_t unlock_time, uint8_t hf_versi
 // This function locates all outputs associated with a given input (mixins)
 // and validates that they exist and are usable.  It also checks the ring
 // signature for each input.
-bool Blockchain::check_tx_input(size_t tx_version, const txin_to_key& txin, const crypto::hash& tx_prefix_hash, const std::vector<crypto::signature>& sig, const rct::rctSig &rct_signatures, std::vector<rct::ctkey> &output_keys, uint64_t* pmax_related_block_height, uint8_t hf_version) const
+bool Blockchain::check_tx_input(size_t tx_version, const txin_to_key& txin, const crypto::hash& tx_prefix_hash, const std::vector<crypto::signature>& sig, const rct::rctSig &rct_signatures, std::vector<rct::ctkey> &output_keys, uint64_t* pmax_related_block_height, uint8_t hf_version, const scan_table_t *scan_table) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
 
@@ -3749,7 +3865,7 @@ bool Blockchain::check_tx_input(size_t tx_version, const txin_to_key& txin, cons
 
   // collect output keys
   outputs_visitor vi(output_keys, *this, hf_version);
-  if (!scan_outputkeys_for_indexes(tx_version, txin, vi, tx_prefix_hash, pmax_related_block_height))
+  if (!scan_outputkeys_for_indexes(tx_version, txin, vi, tx_prefix_hash, pmax_related_block_height, scan_table))
   {
     MERROR_VER("Failed to get output keys for tx with amount = " << print_money(txin.amount) << " and count indexes " << txin.key_offsets.size());
     return false;
@@ -4043,6 +4159,8 @@ leave:
       precomputed = true;
       proof_of_work = it->second;
     }
+    else if (get_verified_header_pow(id, blockchain_height, proof_of_work))
+      precomputed = true;
     else
       proof_of_work = get_block_longhash(bl, blockchain_height);
 
@@ -4324,11 +4442,73 @@ leave:
 //------------------------------------------------------------------
 bool Blockchain::prune_blockchain(uint32_t pruning_seed)
 {
+  CRITICAL_REGION_LOCAL(m_pruning_lock);
+  if (m_pruning_active)
+    return true;
+  if (m_pruning_thread.joinable())
+    m_pruning_thread.join();
+
+  uint64_t pruned_bytes;
+  if (prune_blockchain_step(pruning_seed, pruned_bytes))
+    return true;
+
+  m_pruning_active = true;
+  m_pruning_thread = boost::thread(&Blockchain::prune_blockchain_worker, this);
+  return true;
+}
+//------------------------------------------------------------------
+bool Blockchain::prune_blockchain_step(uint32_t pruning_seed, uint64_t &pruned_bytes)
+{
+  // big enough to amortize the commit, small enough not to hold up block processing
+  static constexpr size_t max_records = 1000;
+  static constexpr uint64_t max_bytes = 4 * 1024 * 1024;
+
   m_tx_pool.lock();
   epee::misc_utils::auto_scope_leave_caller unlocker = epee::misc_utils::create_scope_leave_handler([&](){m_tx_pool.unlock();});
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
 
-  return m_db->prune_blockchain(pruning_seed);
+  const uint64_t rate = m_pruning_rate;
+  return m_db->prune_blockchain_step(pruning_seed, max_records, rate ? std::min(max_bytes, rate) : max_bytes, pruned_bytes);
+}
+//------------------------------------------------------------------
+void Blockchain::prune_blockchain_worker()
+{
+  MGINFO("Pruning blockchain in the background");
+  try
+  {
+    while (true)
+    {
+      const auto start = std::chrono::steady_clock::now();
+      uint64_t pruned_bytes;
+      if (prune_blockchain_step(0, pruned_bytes))
+      {
+        MGINFO("Blockchain pruning complete");
+        break;
+      }
+
+      // the locks are released between chunks, and we wait a bit even with no
+      // rate limit, so that blocks waiting for them get their turn
+      uint64_t wait_ms = 10;
+      const uint64_t rate = m_pruning_rate;
+      if (rate)
+      {
+        const uint64_t elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        const uint64_t budget_ms = pruned_bytes * 1000 / rate;
+        if (budget_ms > elapsed_ms)
+          wait_ms = std::max(wait_ms, budget_ms - elapsed_ms);
+      }
+      boost::this_thread::sleep_for(boost::chrono::milliseconds(wait_ms));
+    }
+  }
+  catch (const boost::thread_interrupted &)
+  {
+    MINFO("Blockchain pruning interrupted, it will resume from where it stopped");
+  }
+  catch (const std::exception &e)
+  {
+    MERROR("Blockchain pruning failed: " << e.what());
+  }
+  m_pruning_active = false;
 }
 //------------------------------------------------------------------
 bool Blockchain::update_blockchain_pruning()
@@ -4342,6 +4522,13 @@ bool Blockchain::update_blockchain_pruning()
 //------------------------------------------------------------------
 bool Blockchain::check_blockchain_pruning()
 {
+  pruning_progress_t progress;
+  if (m_db->get_pruning_progress(progress))
+  {
+    MERROR("Blockchain pruning is still in progress, at height " << progress.next_height << "/" << progress.end_height);
+    return false;
+  }
+
   m_tx_pool.lock();
   epee::misc_utils::auto_scope_leave_caller unlocker = epee::misc_utils::create_scope_leave_handler([&](){m_tx_pool.unlock();});
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
@@ -4349,6 +4536,21 @@ bool Blockchain::check_blockchain_pruning()
   return m_db->check_pruning();
 }
 //------------------------------------------------------------------
+bool Blockchain::compact_blockchain()
+{
+  CRITICAL_REGION_LOCAL(m_compact_lock);
+
+  // the bulk of the work is done from a snapshot, while blocks keep coming in
+  if (!m_db->compact_start())
+    return false;
+
+  m_tx_pool.lock();
+  epee::misc_utils::auto_scope_leave_caller unlocker = epee::misc_utils::create_scope_leave_handler([&](){m_tx_pool.unlock();});
+  CRITICAL_REGION_LOCAL1(m_blockchain_lock);
+
+  return m_db->compact_finish();
+}
+//------------------------------------------------------------------
 uint64_t Blockchain::get_next_long_term_block_weight(uint64_t block_weight) const
 {
   PERF_TIMER(get_next_long_term_block_weight);
@@ -4576,7 +4778,10 @@ void Blockchain::block_longhash_worker(uint64_t height, const epee::span<const b
     if (m_cancel)
        break;
     crypto::hash id = get_block_hash(block);
-    crypto::hash pow = get_block_longhash(block, height++);
+    crypto::hash pow;
+    if (!get_verified_header_pow(id, height, pow))
+      pow = get_block_longhash(block, height);
+    ++height;
     map.emplace(id, pow);
   }
 
@@ -4679,6 +4884,96 @@ void Blockchain::output_scan_worker(const uint64_t amount, const std::vector<uin
   }
 }
 
+bool Blockchain::prefetch_ring_members(const std::vector<std::pair<const transaction*, crypto::hash>> &txes, scan_table_t &scan_table) const
+{
+  // collect the ring members of all inputs, sorted by amount and global index
+  std::vector<std::pair<uint64_t, uint64_t>> keys;
+  for (const auto &e: txes)
+  {
+    for (const txin_v &txin: e.first->vin)
+    {
+      if (txin.type() != typeid(txin_to_key))
+        continue;
+      const txin_to_key &in_to_key = boost::get<txin_to_key>(txin);
+      for (const uint64_t offset: relative_output_offsets_to_absolute(in_to_key.key_offsets))
+        keys.emplace_back(in_to_key.amount, offset);
+    }
+  }
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+  // read each amount in one cursor pass over output_amounts. Partial results
+  // stop at the first missing output (eg, created earlier in the same span),
+  // the rest is looked up later by scan_outputkeys_for_indexes
+  struct amount_range
+  {
+    size_t begin;
+    std::vector<uint64_t> offsets;
+    std::vector<output_data_t> outputs;
+  };
+  std::vector<amount_range> ranges;
+  for (size_t i = 0; i < keys.size(); )
+  {
+    ranges.push_back({i, {}, {}});
+    amount_range &range = ranges.back();
+    for (; i < keys.size() && keys[i].first == keys[range.begin].first; ++i)
+      range.offsets.push_back(keys[i].second);
+  }
+
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  if (ranges.size() > 1 && tpool.get_max_concurrency() > 1 && m_db->can_thread_bulk_indices())
+  {
+    tools::threadpool::waiter waiter(tpool);
+    for (amount_range &range: ranges)
+      tpool.submit(&waiter, [this, &keys, &range] { output_scan_worker(keys[range.begin].first, range.offsets, range.outputs); }, true);
+    if (!waiter.wait())
+    {
+      for (amount_range &range: ranges)
+        range.outputs.clear();
+    }
+  }
+  else
+  {
+    for (amount_range &range: ranges)
+      output_scan_worker(keys[range.begin].first, range.offsets, range.outputs);
+  }
+
+  std::vector<const output_data_t*> found(keys.size(), nullptr);
+  for (const amount_range &range: ranges)
+    for (size_t i = 0; i < range.outputs.size(); ++i)
+      found[range.begin + i] = &range.outputs[i];
+
+  // and build the table for each tx prefix and key image
+  bool duplicates = false;
+  for (const auto &e: txes)
+  {
+    auto ins = scan_table.emplace(e.second, std::unordered_map<crypto::key_image, std::vector<output_data_t>>());
+    if (!ins.second)
+    {
+      duplicates = true;
+      continue;
+    }
+    for (const txin_v &txin: e.first->vin)
+    {
+      if (txin.type() != typeid(txin_to_key))
+        continue;
+      const txin_to_key &in_to_key = boost::get<txin_to_key>(txin);
+      std::vector<output_data_t> ring;
+      for (const uint64_t offset: relative_output_offsets_to_absolute(in_to_key.key_offsets))
+      {
+        const std::pair<uint64_t, uint64_t> key{in_to_key.amount, offset};
+        const auto it = std::lower_bound(keys.begin(), keys.end(), key);
+        if (it == keys.end() || *it != key || !found[it - keys.begin()])
+          break;
+        ring.push_back(*found[it - keys.begin()]);
+      }
+      if (!ins.first->second.emplace(in_to_key.k_image, std::move(ring)).second)
+        duplicates = true;
+    }
+  }
+  return !duplicates;
+}
+
 uint64_t Blockchain::prevalidate_block_hashes(uint64_t height, const std::vector<crypto::hash> &hashes, const std::vector<uint64_t> &weights)
 {
   // new: . . . . . X X X X X . . . . . .
@@ -4798,6 +5093,256 @@ uint64_t Blockchain::prevalidate_block_hashes(uint64_t height, const std::vector
   CHECK_AND_ASSERT_MES(usable < std::numeric_limits<uint64_t>::max() / 2, 0, "usable is negative");
   return usable;
 }
+//------------------------------------------------------------------
+void Blockchain::trim_verified_headers()
+{
+  const uint64_t db_height = m_db->height();
+  CRITICAL_REGION_LOCAL(m_verified_headers_lock);
+  if (m_verified_headers.empty())
+  {
+    m_verified_headers_start = db_height;
+    return;
+  }
+  if (m_verified_headers_start > db_height)
+  {
+    MDEBUG("Verified headers do not connect to the chain anymore, dropping them");
+    m_verified_headers.clear();
+    m_verified_headers_start = db_height;
+    return;
+  }
+  while (!m_verified_headers.empty() && m_verified_headers_start < db_height)
+  {
+    if (m_verified_headers.front().id != m_db->get_block_hash_from_height(m_verified_headers_start))
+    {
+      MDEBUG("Verified header at height " << m_verified_headers_start << " is not in the chain, dropping verified headers");
+      m_verified_headers.clear();
+      m_verified_headers_start = db_height;
+      return;
+    }
+    m_verified_headers.pop_front();
+    ++m_verified_headers_start;
+  }
+  if (m_verified_headers.empty())
+    m_verified_headers_start = db_height;
+}
+//------------------------------------------------------------------
+bool Blockchain::get_verified_header_pow(const crypto::hash &id, uint64_t height, crypto::hash &pow) const
+{
+  CRITICAL_REGION_LOCAL(m_verified_headers_lock);
+  if (height < m_verified_headers_start || height - m_verified_headers_start >= m_verified_headers.size())
+    return false;
+  const verified_header &vh = m_verified_headers[height - m_verified_headers_start];
+  if (vh.id != id)
+    return false;
+  pow = vh.pow;
+  return true;
+}
+//------------------------------------------------------------------
+uint64_t Blockchain::get_verified_headers_height() const
+{
+  const uint64_t db_height = m_db->height();
+  CRITICAL_REGION_LOCAL(m_verified_headers_lock);
+  return std::max(db_height, m_verified_headers_start + m_verified_headers.size());
+}
+//------------------------------------------------------------------
+bool Blockchain::get_block_hashing_blobs(const std::vector<crypto::hash> &hashes, std::vector<blobdata> &blobs) const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  // no need for the blockchain lock, the read txn gives a consistent view of the db
+  db_rtxn_guard rtxn_guard(m_db);
+  blobs.clear();
+  blobs.reserve(hashes.size());
+  for (const crypto::hash &id: hashes)
+  {
+    blobdata blob;
+    try
+    {
+      if (!get_block_hashing_blob(m_db->get_block_blob(id), blob))
+      {
+        MERROR("Failed to get hashing blob for block " << id << " from db");
+        return false;
+      }
+    }
+    catch (const BLOCK_DNE &)
+    {
+      return false;
+    }
+    blobs.push_back(std::move(blob));
+  }
+  return true;
+}
+//------------------------------------------------------------------
+bool Blockchain::prevalidate_block_headers(uint64_t height, const std::vector<crypto::hash> &hashes, const std::vector<blobdata> &headers)
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  CHECK_AND_ASSERT_MES(headers.size() <= hashes.size(), false, "More headers than hashes");
+
+  // only one verification at a time, so the verified headers only grow from here
+  CRITICAL_REGION_LOCAL(m_header_verification_lock);
+
+  struct pending_header
+  {
+    verified_header vh;
+    uint8_t major_version;
+    difficulty_type difficulty;
+  };
+  std::vector<pending_header> pending;
+  uint64_t first_height;
+  {
+    CRITICAL_REGION_LOCAL1(m_blockchain_lock);
+    trim_verified_headers();
+
+    const uint64_t db_height = m_db->height();
+    const uint64_t verified_end = get_verified_headers_height();
+    if (height > verified_end || height + headers.size() <= verified_end)
+      return true;
+    // PoW is not checked where we have precompiled block hashes
+    if (verified_end < m_blocks_hash_check.size())
+      return true;
+
+    first_height = verified_end;
+    size_t n_headers = height + headers.size() - first_height;
+    if (verified_end - db_height + n_headers > VERIFIED_HEADERS_MAX_COUNT)
+      n_headers = VERIFIED_HEADERS_MAX_COUNT - std::min<uint64_t>(VERIFIED_HEADERS_MAX_COUNT, verified_end - db_height);
+    if (n_headers == 0)
+      return true;
+
+    // seed the difficulty window from the chain and the headers we already verified
+    const size_t max_difficulty_blocks_count = std::max({(size_t)DIFFICULTY_BLOCKS_COUNT, (size_t)DIFFICULTY_BLOCKS_COUNT_V2, (size_t)DIFFICULTY_BLOCKS_COUNT_V3});
+    uint64_t window_start = first_height - std::min<uint64_t>(first_height, max_difficulty_blocks_count);
+    if (window_start == 0)
+      ++window_start; // skip genesis block
+    std::vector<uint64_t> timestamps;
+    std::vector<difficulty_type> cumulative_difficulties;
+    timestamps.reserve(first_height - window_start + n_headers);
+    cumulative_difficulties.reserve(first_height - window_start + n_headers);
+    for (uint64_t h = window_start; h < db_height; ++h)
+    {
+      timestamps.push_back(m_db->get_block_timestamp(h));
+      cumulative_difficulties.push_back(m_db->get_block_cumulative_difficulty(h));
+    }
+    crypto::hash prev_id;
+    difficulty_type cumulative_difficulty = db_height ? m_db->get_block_cumulative_difficulty(db_height - 1) : 0;
+    CRITICAL_REGION_BEGIN(m_verified_headers_lock);
+      for (uint64_t h = std::max(window_start, db_height); h < first_height; ++h)
+      {
+        timestamps.push_back(m_verified_headers[h - m_verified_headers_start].timestamp);
+        cumulative_difficulties.push_back(m_verified_headers[h - m_verified_headers_start].cumulative_difficulty);
+      }
+      if (m_verified_headers.empty())
+      {
+        prev_id = db_height ? m_db->top_block_hash() : crypto::null_hash;
+      }
+      else
+      {
+        prev_id = m_verified_headers.back().id;
+        cumulative_difficulty = m_verified_headers.back().cumulative_difficulty;
+      }
+    CRITICAL_REGION_END();
+
+    pending.reserve(n_headers);
+    for (size_t i = first_height - height; i < first_height - height + n_headers; ++i)
+    {
+      const uint64_t block_height = height + i;
+      block b;
+      if (!parse_block_hashing_blob(headers[i], b))
+      {
+        MERROR_VER("Invalid block header at height " << block_height);
+        return false;
+      }
+      pending_header ph;
+      get_object_hash(headers[i], ph.vh.id);
+      if (ph.vh.id != hashes[i])
+      {
+        MERROR_VER("Block header at height " << block_height << " hashes to " << ph.vh.id << ", expected " << hashes[i]);
+        return false;
+      }
+      if (b.prev_id != prev_id)
+      {
+        MERROR_VER("Block header at height " << block_height << " does not link to the previous block " << prev_id);
+        return false;
+      }
+      if (!m_hardfork->check_for_height(b, block_height))
+      {
+        MERROR_VER("Block header at height " << block_height << " has old version: " << (unsigned)b.major_version);
+        return false;
+      }
+      if (m_checkpoints.is_in_checkpoint_zone(block_height) && !m_checkpoints.check_block(block_height, ph.vh.id))
+      {
+        MERROR_VER("Block header at height " << block_height << " does not match the checkpoint");
+        return false;
+      }
+
+      if (m_fixed_difficulty)
+      {
+        ph.difficulty = block_height ? m_fixed_difficulty : 1;
+      }
+      else
+      {
+        ph.difficulty = get_difficulty_reset(m_nettype, block_height);
+        if (!ph.difficulty)
+        {
+          // check_for_height pinned the version to the fork at this height, which is what
+          // get_difficulty_for_next_block uses too, so the first block of a fork already
+          // gets the difficulty of the new version
+          const size_t window = std::min<size_t>(timestamps.size(), get_difficulty_blocks_count(b.major_version));
+          ph.difficulty = next_difficulty_for_version(b.major_version,
+              std::vector<uint64_t>(timestamps.end() - window, timestamps.end()),
+              std::vector<difficulty_type>(cumulative_difficulties.end() - window, cumulative_difficulties.end()));
+        }
+      }
+      CHECK_AND_ASSERT_MES(ph.difficulty, false, "!!!!!!!!! difficulty overhead !!!!!!!!!");
+
+      cumulative_difficulty += ph.difficulty;
+      ph.vh.timestamp = b.timestamp;
+      ph.vh.cumulative_difficulty = cumulative_difficulty;
+      ph.major_version = b.major_version;
+      timestamps.push_back(b.timestamp);
+      cumulative_difficulties.push_back(cumulative_difficulty);
+      prev_id = ph.vh.id;
+      pending.push_back(std::move(ph));
+    }
+  }
+
+  // check proof of work on the thread pool, outside of the blockchain lock
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  unsigned threads = std::min<unsigned>(tpool.get_max_concurrency(), m_max_prepare_blocks_threads);
+  threads = std::max(1u, std::min<unsigned>(threads, pending.size()));
+  const size_t offset = first_height - height;
+  std::vector<char> valid(pending.size(), 0);
+  tools::threadpool::waiter waiter(tpool);
+  for (unsigned t = 0; t < threads; ++t)
+  {
+    tpool.submit(&waiter, [&, t]() {
+      slow_hash_allocate_state();
+      for (size_t i = t; i < pending.size() && !m_cancel; i += threads)
+      {
+        const blobdata &blob = headers[offset + i];
+        get_block_longhash(blobdata_ref{blob.data(), blob.size()}, pending[i].major_version, pending[i].vh.pow, first_height + i);
+        valid[i] = check_hash(pending[i].vh.pow, pending[i].difficulty);
+      }
+      slow_hash_free_state();
+    }, true);
+  }
+  if (!waiter.wait() || m_cancel)
+    return true;
+
+  for (size_t i = 0; i < pending.size(); ++i)
+  {
+    if (!valid[i])
+    {
+      MERROR_VER("Block header with id: " << pending[i].vh.id << " does not have enough proof of work: " << pending[i].vh.pow << " at height " << first_height + i << ", unexpected difficulty: " << pending[i].difficulty);
+      return false;
+    }
+  }
+
+  // verified headers only change under m_header_verification_lock, so these still extend them
+  CRITICAL_REGION_LOCAL1(m_verified_headers_lock);
+  for (const pending_header &ph: pending)
+    m_verified_headers.push_back(ph.vh);
+  MDEBUG("Verified block headers up to height " << m_verified_headers_start + m_verified_headers.size() - 1);
+  return true;
+}
 
 bool Blockchain::has_block_weights(uint64_t height, uint64_t nblocks) const
 {
@@ -4979,12 +5524,6 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
 
   TIME_MEASURE_START(scantable);
 
-  // [input] stores all unique amounts found
-  std::vector < uint64_t > amounts;
-  // [input] stores all absolute_offsets for each amount
-  std::map<uint64_t, std::vector<uint64_t>> offset_map;
-  // [output] stores all output_data_t for each absolute_offset
-  std::map<uint64_t, std::vector<output_data_t>> tx_map;
   std::vector<std::pair<cryptonote::transaction, crypto::hash>> txes(total_txs);
 
 #define SCAN_TABLE_QUIT(m) \
@@ -4994,8 +5533,8 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
             return false; \
         } while(0); \
 
-  // generate sorted tables for all amounts and absolute offsets
-  size_t tx_index = 0, block_index = 0;
+  // parse all txes in the span, their ring members are then prefetched at once
+  size_t tx_index = 0;
   for (const auto &entry : blocks_entry)
   {
     if (m_cancel)
@@ -5012,142 +5551,15 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
       if (!parse_and_validate_tx_base_from_blob(tx_blob.blob, tx))
         SCAN_TABLE_QUIT("Could not parse tx from incoming blocks.");
       cryptonote::get_transaction_prefix_hash(tx, tx_prefix_hash);
-
-      auto its = m_scan_table.find(tx_prefix_hash);
-      if (its != m_scan_table.end())
-        SCAN_TABLE_QUIT("Duplicate tx found from incoming blocks.");
-
-      m_scan_table.emplace(tx_prefix_hash, std::unordered_map<crypto::key_image, std::vector<output_data_t>>());
-      its = m_scan_table.find(tx_prefix_hash);
-      assert(its != m_scan_table.end());
-
-      // get all amounts from tx.vin(s)
-      for (const auto &txin : tx.vin)
-      {
-        const txin_to_key &in_to_key = boost::get < txin_to_key > (txin);
-
-        // check for duplicate
-        auto it = its->second.find(in_to_key.k_image);
-        if (it != its->second.end())
-          SCAN_TABLE_QUIT("Duplicate key_image found from incoming blocks.");
-
-        amounts.push_back(in_to_key.amount);
-      }
-
-      // sort and remove duplicate amounts from amounts list
-      std::sort(amounts.begin(), amounts.end());
-      auto last = std::unique(amounts.begin(), amounts.end());
-      amounts.erase(last, amounts.end());
-
-      // add amount to the offset_map and tx_map
-      for (const uint64_t &amount : amounts)
-      {
-        if (offset_map.find(amount) == offset_map.end())
-          offset_map.emplace(amount, std::vector<uint64_t>());
-
-        if (tx_map.find(amount) == tx_map.end())
-          tx_map.emplace(amount, std::vector<output_data_t>());
-      }
-
-      // add new absolute_offsets to offset_map
-      for (const auto &txin : tx.vin)
-      {
-        const txin_to_key &in_to_key = boost::get < txin_to_key > (txin);
-        // no need to check for duplicate here.
-        auto absolute_offsets = relative_output_offsets_to_absolute(in_to_key.key_offsets);
-        for (const auto & offset : absolute_offsets)
-          offset_map[in_to_key.amount].push_back(offset);
-
-      }
     }
-    ++block_index;
-  }
-
-  // sort and remove duplicate absolute_offsets in offset_map
-  for (auto &offsets : offset_map)
-  {
-    std::sort(offsets.second.begin(), offsets.second.end());
-    auto last = std::unique(offsets.second.begin(), offsets.second.end());
-    offsets.second.erase(last, offsets.second.end());
   }
 
-  // gather all the output keys
-  threads = tpool.get_max_concurrency();
-  if (!m_db->can_thread_bulk_indices())
-    threads = 1;
-
-  if (threads > 1 && amounts.size() > 1)
-  {
-    tools::threadpool::waiter waiter(tpool);
-
-    for (size_t i = 0; i < amounts.size(); i++)
-    {
-      uint64_t amount = amounts[i];
-      tpool.submit(&waiter, std::bind(&Blockchain::output_scan_worker, this, amount, std::cref(offset_map[amount]), std::ref(tx_map[amount])), true);
-    }
-    if (!waiter.wait())
-      return false;
-  }
-  else
-  {
-    for (size_t i = 0; i < amounts.size(); i++)
-    {
-      uint64_t amount = amounts[i];
-      output_scan_worker(amount, offset_map[amount], tx_map[amount]);
-    }
-  }
-
-  // now generate a table for each tx_prefix and k_image hashes
-  tx_index = 0;
-  for (const auto &entry : blocks_entry)
-  {
-    if (m_cancel)
-      return false;
-
-    for (size_t i = 0; i < entry.txs.size(); ++i)
-    {
-      if (tx_index >= txes.size())
-        SCAN_TABLE_QUIT("tx_index is out of sync");
-      const transaction &tx = txes[tx_index].first;
-      const crypto::hash &tx_prefix_hash = txes[tx_index].second;
-      ++tx_index;
-
-      auto its = m_scan_table.find(tx_prefix_hash);
-      if (its == m_scan_table.end())
-        SCAN_TABLE_QUIT("Tx not found on scan table from incoming blocks.");
-
-      for (const auto &txin : tx.vin)
-      {
-        const txin_to_key &in_to_key = boost::get < txin_to_key > (txin);
-        auto needed_offsets = relative_output_offsets_to_absolute(in_to_key.key_offsets);
-
-        std::vector<output_data_t> outputs;
-        for (const uint64_t & offset_needed : needed_offsets)
-        {
-          size_t pos = 0;
-          bool found = false;
-
-          for (const uint64_t &offset_found : offset_map[in_to_key.amount])
-          {
-            if (offset_needed == offset_found)
-            {
-              found = true;
-              break;
-            }
-
-            ++pos;
-          }
-
-          if (found && pos < tx_map[in_to_key.amount].size())
-            outputs.push_back(tx_map[in_to_key.amount].at(pos));
-          else
-            break;
-        }
-
-        its->second.emplace(in_to_key.k_image, outputs);
-      }
-    }
-  }
+  std::vector<std::pair<const transaction*, crypto::hash>> tx_refs;
+  tx_refs.reserve(txes.size());
+  for (const auto &e: txes)
+    tx_refs.emplace_back(&e.first, e.second);
+  if (!prefetch_ring_members(tx_refs, m_scan_table))
+    SCAN_TABLE_QUIT("Duplicate tx or key_image found from incoming blocks.");
 
   TIME_MEASURE_FINISH(scantable);
   if (total_txs > 0)
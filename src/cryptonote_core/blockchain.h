@@ -43,6 +43,7 @@
 #include <boost/multi_index/hashed_index.hpp>
 #include <boost/multi_index/member.hpp>
 #include <atomic>
+#include <deque>
 #include <functional>
 #include <unordered_map>
 #include <unordered_set>
@@ -430,6 +431,29 @@ namespace cryptonote
      */
     bool have_tx_keyimg_as_spent(const crypto::key_image &key_im) const;
 
+    /**
+     * @brief check which of a set of key images are already spent on the blockchain
+     *
+     * plural version of have_tx_keyimg_as_spent(), looked up in a single pass
+     *
+     * @param key_images the key images to search for
+     * @param spent return-by-reference, true for each key image already spent
+     */
+    void have_key_images_as_spent(const epee::span<const crypto::key_image> &key_images, std::vector<bool> &spent) const;
+
+    /**
+     * @brief get the transaction which spent a key image on the blockchain
+     *
+     * This needs the database's spent key index (see --db-spent-key-index).
+     *
+     * @param key_im the key image to look up
+     * @param tx_hash return-by-reference the hash of the spending transaction
+     * @param height return-by-reference the height of the block containing it
+     *
+     * @return true if the spender is known, else false
+     */
+    bool get_key_image_spender(const crypto::key_image &key_im, crypto::hash &tx_hash, uint64_t &height) const;
+
     /**
      * @brief get the current height of the blockchain
      *
@@ -716,6 +740,43 @@ namespace cryptonote
      */
     bool check_tx_inputs(transaction& tx, uint64_t& pmax_used_block_height, crypto::hash& max_used_block_id, tx_verification_context &tvc, bool kept_by_block = false) const;
 
+    /**
+     * @brief verifies the ringct signatures of an expanded transaction
+     *
+     * This does not access the database, so it may be called without
+     * holding the blockchain lock, once the transaction's inputs have
+     * been checked and its ring members expanded.
+     *
+     * @param tx the transaction to verify
+     *
+     * @return false if the signatures are invalid, otherwise true
+     */
+    static bool check_tx_ring_signatures(const transaction &tx);
+
+    /**
+     * @brief a transaction to be checked by check_tx_inputs_batch, and the results
+     */
+    struct tx_input_check
+    {
+      transaction *tx;  //!< the transaction to check
+      tx_verification_context *tvc;  //!< returned information about tx verification
+      uint64_t max_used_block_height;  //!< height of the most recent block with a ring member
+      crypto::hash max_used_block_id;  //!< hash of the most recent block with a ring member
+      bool result;  //!< true if the inputs are valid
+    };
+
+    /**
+     * @brief validates the inputs of several relayed transactions at once
+     *
+     * Equivalent to calling check_tx_inputs on each transaction, but the
+     * ring members of all the inputs are fetched from the database in a
+     * single sorted pass, and the ringct signatures are then verified in
+     * parallel on the threadpool, without holding the blockchain lock.
+     *
+     * @param txs the transactions to check, results are set in place
+     */
+    void check_tx_inputs_batch(std::vector<tx_input_check> &txs) const;
+
     /**
      * @brief get fee quantization mask
      *
@@ -1128,10 +1189,60 @@ namespace cryptonote
 
     bool is_within_compiled_block_hash_area() const { return is_within_compiled_block_hash_area(m_db->height()); }
     uint64_t prevalidate_block_hashes(uint64_t height, const std::vector<crypto::hash> &hashes, const std::vector<uint64_t> &weights);
+
+    /**
+     * @brief verifies block headers ahead of their bodies
+     *
+     * Headers extending the verified header chain are checked for linkage,
+     * hard fork version, checkpoints and proof of work, the latter on all
+     * cores. Their proof of work hashes are kept so they need not be computed
+     * again when the blocks themselves arrive. Headers which do not connect
+     * to what we have are ignored.
+     *
+     * @param height the height of the first header
+     * @param hashes the block ids the headers are claimed to hash to
+     * @param headers the block hashing blobs, may be shorter than hashes
+     *
+     * @return false if any header is invalid, true otherwise
+     */
+    bool prevalidate_block_headers(uint64_t height, const std::vector<crypto::hash> &hashes, const std::vector<blobdata> &headers);
+
+    /**
+     * @brief gets the height up to which block headers have been verified
+     *
+     * @return the height of the first block without a verified header
+     */
+    uint64_t get_verified_headers_height() const;
+
+    /**
+     * @brief gets the hashing blobs of the given blocks
+     *
+     * Stops at the first block we do not have in the main chain.
+     *
+     * @param hashes the block ids
+     * @param blobs return-by-reference the hashing blobs
+     *
+     * @return true if all blocks were found, false otherwise
+     */
+    bool get_block_hashing_blobs(const std::vector<crypto::hash> &hashes, std::vector<blobdata> &blobs) const;
     uint32_t get_blockchain_pruning_seed() const { return m_db->get_blockchain_pruning_seed(); }
+    /**
+     * @brief starts or resumes pruning the blockchain in the background
+     *
+     * The first chunk is pruned before returning, so that the pruning seed
+     * is recorded and a mismatching one reported to the caller.
+     *
+     * @param pruning_seed the seed to use, 0 for default (highly recommended)
+     *
+     * @return false if pruning could not be started, true otherwise
+     */
     bool prune_blockchain(uint32_t pruning_seed = 0);
+    bool get_pruning_progress(pruning_progress_t &progress) const { return m_db->get_pruning_progress(progress); }
+    bool is_pruning() const { return m_pruning_active; }
+    void set_pruning_rate(uint64_t bytes_per_second) { m_pruning_rate = bytes_per_second; }
     bool update_blockchain_pruning();
     bool check_blockchain_pruning();
+    bool compact_blockchain();
 
     void lock();
     void unlock();
@@ -1164,6 +1275,24 @@ namespace cryptonote
      */
     bool is_within_compiled_block_hash_area(uint64_t height) const;
 
+    /**
+     * @brief drops verified headers which are now in the chain
+     *
+     * All verified headers are dropped if they disagree with the chain.
+     */
+    void trim_verified_headers();
+
+    /**
+     * @brief looks up the proof of work hash of a verified header
+     *
+     * @param id the block id
+     * @param height the block height
+     * @param pow return-by-reference the proof of work hash
+     *
+     * @return true if found, false otherwise
+     */
+    bool get_verified_header_pow(const crypto::hash &id, uint64_t height, crypto::hash &pow) const;
+
     /**
      * @brief checks whether we have known weights for the given block heights
      *
@@ -1203,21 +1332,42 @@ namespace cryptonote
 
     typedef std::unordered_map<crypto::hash, block_extended_info> blocks_ext_by_hash;
 
+    //! ring members of each input, by tx prefix hash and key image
+    typedef std::unordered_map<crypto::hash, std::unordered_map<crypto::key_image, std::vector<output_data_t>>> scan_table_t;
+
 
     BlockchainDB* m_db;
 
     tx_memory_pool& m_tx_pool;
 
     mutable epee::critical_section m_blockchain_lock; // TODO: add here reader/writer lock
+    epee::critical_section m_compact_lock; // one compaction at a time, without holding up the chain meanwhile
+    epee::critical_section m_pruning_lock; // guards starting and stopping m_pruning_thread
+    boost::thread m_pruning_thread;
+    std::atomic<bool> m_pruning_active;
+    std::atomic<uint64_t> m_pruning_rate; // prunable bytes deleted per second, 0 for no limit
 
     // main chain
     size_t m_current_block_cumul_weight_limit;
     size_t m_current_block_cumul_weight_median;
 
     // metadata containers
-    std::unordered_map<crypto::hash, std::unordered_map<crypto::key_image, std::vector<output_data_t>>> m_scan_table;
+    scan_table_t m_scan_table;
     std::unordered_map<crypto::hash, crypto::hash> m_blocks_longhash_table;
 
+    // headers verified ahead of the chain, from m_verified_headers_start
+    struct verified_header
+    {
+      crypto::hash id;
+      crypto::hash pow;
+      uint64_t timestamp;
+      difficulty_type cumulative_difficulty;
+    };
+    std::deque<verified_header> m_verified_headers;
+    uint64_t m_verified_headers_start;
+    mutable epee::critical_section m_verified_headers_lock;
+    epee::critical_section m_header_verification_lock;
+
     // SHA-3 hashes for each block and for fast pow checking
     std::vector<std::pair<crypto::hash, crypto::hash>> m_blocks_hash_of_hashes;
     std::vector<std::pair<crypto::hash, uint64_t>> m_blocks_hash_check;
@@ -1305,11 +1455,12 @@ namespace cryptonote
      * @param tx_prefix_hash the hash of the associated transaction_prefix
      * @param pmax_related_block_height return-by-pointer the height of the most recent block in the input set
      * @param tx_version version of the tx, if > 1 we also get commitments
+     * @param scan_table prefetched ring members to use instead of m_scan_table, if not NULL
      *
      * @return false if any keys are not found or any inputs are not unlocked, otherwise true
      */
     template<class visitor_t>
-    inline bool scan_outputkeys_for_indexes(size_t tx_version, const txin_to_key& tx_in_to_key, visitor_t &vis, const crypto::hash &tx_prefix_hash, uint64_t* pmax_related_block_height = NULL) const;
+    inline bool scan_outputkeys_for_indexes(size_t tx_version, const txin_to_key& tx_in_to_key, visitor_t &vis, const crypto::hash &tx_prefix_hash, uint64_t* pmax_related_block_height = NULL, const scan_table_t *scan_table = NULL) const;
 
     /**
      * @brief collect output public keys of a transaction input set
@@ -1329,10 +1480,11 @@ namespace cryptonote
      * @param rct_signatures the ringCT signatures, which are only valid if tx version > 1
      * @param pmax_related_block_height return-by-pointer the height of the most recent block in the input set
      * @param hf_version the consensus rules version to use
+     * @param scan_table prefetched ring members, see scan_outputkeys_for_indexes
      *
      * @return false if any output is not yet unlocked, or is missing, otherwise true
      */
-    bool check_tx_input(size_t tx_version,const txin_to_key& txin, const crypto::hash& tx_prefix_hash, const std::vector<crypto::signature>& sig, const rct::rctSig &rct_signatures, std::vector<rct::ctkey> &output_keys, uint64_t* pmax_related_block_height, uint8_t hf_version) const;
+    bool check_tx_input(size_t tx_version,const txin_to_key& txin, const crypto::hash& tx_prefix_hash, const std::vector<crypto::signature>& sig, const rct::rctSig &rct_signatures, std::vector<rct::ctkey> &output_keys, uint64_t* pmax_related_block_height, uint8_t hf_version, const scan_table_t *scan_table = NULL) const;
 
     /**
      * @brief validate a transaction's inputs and their keys
@@ -1351,10 +1503,26 @@ namespace cryptonote
      * @param tx the transaction to validate
      * @param tvc returned information about tx verification
      * @param pmax_related_block_height return-by-pointer the height of the most recent block in the input set
+     * @param defer_signatures if true, skip the ringct signature verification, see check_tx_ring_signatures
+     * @param scan_table prefetched ring members, see scan_outputkeys_for_indexes
      *
      * @return false if any validation step fails, otherwise true
      */
-    bool check_tx_inputs(transaction& tx, tx_verification_context &tvc, uint64_t* pmax_used_block_height = NULL) const;
+    bool check_tx_inputs(transaction& tx, tx_verification_context &tvc, uint64_t* pmax_used_block_height = NULL, bool defer_signatures = false, const scan_table_t *scan_table = NULL) const;
+
+    /**
+     * @brief fetches the ring members of all inputs of a set of transactions
+     *
+     * The (amount, global index) pairs are sorted and deduplicated first, so
+     * each amount is read in a single forward pass over the output table.
+     * Rings may be partial if some outputs are not in the db yet.
+     *
+     * @param txes the transactions and their prefix hashes
+     * @param scan_table return-by-reference the ring members of each input
+     *
+     * @return false if a prefix hash or a key image within a tx was seen twice, otherwise true
+     */
+    bool prefetch_ring_members(const std::vector<std::pair<const transaction*, crypto::hash>> &txes, scan_table_t &scan_table) const;
 
     /**
      * @brief performs a blockchain reorganization according to the longest chain rule
@@ -1649,6 +1817,21 @@ namespace cryptonote
      */
     bool expand_transaction_2(transaction &tx, const crypto::hash &tx_prefix_hash, const std::vector<std::vector<rct::ctkey>> &pubkeys) const;
 
+    /**
+     * @brief prunes one chunk of the blockchain, with the blockchain and pool locked
+     *
+     * @param pruning_seed the seed to use, 0 for the one already recorded
+     * @param pruned_bytes return-by-reference the number of prunable bytes deleted
+     *
+     * @return true iff pruning is complete
+     */
+    bool prune_blockchain_step(uint32_t pruning_seed, uint64_t &pruned_bytes);
+
+    /**
+     * @brief prunes the blockchain chunk by chunk until done or interrupted, at the configured rate
+     */
+    void prune_blockchain_worker();
+
     /**
      * @brief invalidates any cached block template
      */
@@ -54,6 +54,7 @@ DISABLE_VS_WARNINGS(4355)
 #define MERROR_VER(x) MCERROR("verify", x)
 
 #define BAD_SEMANTICS_TXES_MAX_SIZE 100
+#define TXPOOL_ADMISSION_MIN_BATCH_SIZE 16
 
 // basically at least how many bytes the block itself serializes to without the miner tx
 #define BLOCK_SIZE_SANITY_LEEWAY 100
@@ -115,6 +116,10 @@ namespace cryptonote
     "sync-pruned-blocks"
   , "Allow syncing from nodes with only pruned blocks"
   };
+  const command_line::arg_descriptor<bool> arg_tx_reconciliation  = {
+    "tx-reconciliation"
+  , "Relay transactions to supporting peers by periodic set reconciliation instead of flooding"
+  };
 
   static const command_line::arg_descriptor<bool> arg_test_drop_download = {
     "test-drop-download"
@@ -155,6 +160,11 @@ namespace cryptonote
   , "How many blocks to sync at once during chain synchronization (0 = adaptive)."
   , 0
   };
+  static const command_line::arg_descriptor<bool> arg_adaptive_block_sync  = {
+    "adaptive-block-sync"
+  , "Size block downloads per peer from its measured speed and round trip time, when --block-sync-size is 0"
+  , false
+  };
   static const command_line::arg_descriptor<std::string> arg_check_updates = {
     "check-updates"
   , "Check for new versions of sumokoin: [disabled|notify|download|update]"
@@ -170,11 +180,26 @@ namespace cryptonote
   , "Relay blocks as normal blocks"
   , false
   };
+  static const command_line::arg_descriptor<bool> arg_headers_first_sync  = {
+    "headers-first-sync"
+  , "Verify block headers and their proof of work ahead of downloading blocks"
+  , false
+  };
   static const command_line::arg_descriptor<size_t> arg_max_txpool_weight  = {
     "max-txpool-weight"
   , "Set maximum txpool weight in bytes."
   , DEFAULT_TXPOOL_MAX_WEIGHT
   };
+  static const command_line::arg_descriptor<size_t> arg_max_txpool_memory  = {
+    "max-txpool-memory"
+  , "Set maximum memory used by the txpool indices and caches in bytes, lowest fee txes are pruned above it (0 = no limit)."
+  , 0
+  };
+  static const command_line::arg_descriptor<size_t> arg_txpool_admission_threads  = {
+    "txpool-admission-threads"
+  , "Max number of batches of relayed transactions verified concurrently when adding them to the txpool (0 = number of threads in the pool)."
+  , 0
+  };
   static const command_line::arg_descriptor<std::string> arg_block_notify = {
     "block-notify"
   , "Run a program for each new block, '%s' will be replaced by the block hash"
@@ -185,6 +210,11 @@ namespace cryptonote
   , "Prune blockchain"
   , false
   };
+  static const command_line::arg_descriptor<uint64_t> arg_prune_blockchain_rate  = {
+    "prune-blockchain-rate"
+  , "Max rate at which prunable data is deleted when pruning in the background, in kB/s (0 = unlimited)"
+  , 16384
+  };
   static const command_line::arg_descriptor<std::string> arg_reorg_notify = {
     "reorg-notify"
   , "Run a program for each reorg, '%s' will be replaced by the split height, "
@@ -226,7 +256,9 @@ namespace cryptonote
               m_disable_dns_checkpoints(false),
               m_update_download(0),
               m_nettype(UNDEFINED),
-              m_update_available(false)
+              m_update_available(false),
+              m_adaptive_block_sync(false),
+              m_txpool_admission_threads(0)
   {
     m_checkpoints_updating.clear();
     set_cryptonote_protocol(pprotocol);
@@ -322,17 +354,23 @@ namespace cryptonote
     command_line::add_arg(desc, arg_fast_block_sync);
     command_line::add_arg(desc, arg_show_time_stats);
     command_line::add_arg(desc, arg_block_sync_size);
+    command_line::add_arg(desc, arg_adaptive_block_sync);
     command_line::add_arg(desc, arg_check_updates);
     command_line::add_arg(desc, arg_fluffy_blocks);
     command_line::add_arg(desc, arg_no_fluffy_blocks);
+    command_line::add_arg(desc, arg_headers_first_sync);
     command_line::add_arg(desc, arg_test_dbg_lock_sleep);
     command_line::add_arg(desc, arg_offline);
     command_line::add_arg(desc, arg_disable_dns_checkpoints);
     command_line::add_arg(desc, arg_block_download_max_size);
     command_line::add_arg(desc, arg_sync_pruned_blocks);
+    command_line::add_arg(desc, arg_tx_reconciliation);
     command_line::add_arg(desc, arg_max_txpool_weight);
+    command_line::add_arg(desc, arg_max_txpool_memory);
+    command_line::add_arg(desc, arg_txpool_admission_threads);
     command_line::add_arg(desc, arg_block_notify);
     command_line::add_arg(desc, arg_prune_blockchain);
+    command_line::add_arg(desc, arg_prune_blockchain_rate);
     command_line::add_arg(desc, arg_reorg_notify);
     command_line::add_arg(desc, arg_block_rate_notify);
     command_line::add_arg(desc, arg_keep_alt_blocks);
@@ -373,6 +411,7 @@ namespace cryptonote
     set_enforce_dns_checkpoints(command_line::get_arg(vm, arg_dns_checkpoints));
     test_drop_download_height(command_line::get_arg(vm, arg_test_drop_download_height));
     m_fluffy_blocks_enabled = !get_arg(vm, arg_no_fluffy_blocks);
+    m_headers_first_sync_enabled = get_arg(vm, arg_headers_first_sync);
     m_offline = get_arg(vm, arg_offline);
     m_disable_dns_checkpoints = get_arg(vm, arg_disable_dns_checkpoints);
     if (!command_line::is_arg_defaulted(vm, arg_fluffy_blocks))
@@ -461,10 +500,15 @@ namespace cryptonote
 
     std::string db_sync_mode = command_line::get_arg(vm, cryptonote::arg_db_sync_mode);
     bool db_salvage = command_line::get_arg(vm, cryptonote::arg_db_salvage) != 0;
+    bool db_compression = command_line::get_arg(vm, cryptonote::arg_db_compression);
+    bool db_cold_segments = command_line::get_arg(vm, cryptonote::arg_db_cold_segments);
+    bool db_sparse_map = command_line::get_arg(vm, cryptonote::arg_db_sparse_map);
+    bool db_spent_key_index = command_line::get_arg(vm, cryptonote::arg_db_spent_key_index);
     bool fast_sync = command_line::get_arg(vm, arg_fast_block_sync) != 0;
     uint64_t blocks_threads = command_line::get_arg(vm, arg_prep_blocks_threads);
     std::string check_updates_string = command_line::get_arg(vm, arg_check_updates);
     size_t max_txpool_weight = command_line::get_arg(vm, arg_max_txpool_weight);
+    size_t max_txpool_memory = command_line::get_arg(vm, arg_max_txpool_memory);
     bool prune_blockchain = command_line::get_arg(vm, arg_prune_blockchain);
     bool keep_alt_blocks = command_line::get_arg(vm, arg_keep_alt_blocks);
     bool keep_fakechain = command_line::get_arg(vm, arg_keep_fakechain);
@@ -477,10 +521,11 @@ namespace cryptonote
     CHECK_AND_ASSERT_MES (boost::filesystem::exists(folder) || boost::filesystem::create_directories(folder), false,
       std::string("Failed to create directory ").append(folder.string()).c_str());
 
-    std::unique_ptr<BlockchainDB> db(new_db());
+    const std::string db_type = command_line::get_arg(vm, cryptonote::arg_db_type);
+    std::unique_ptr<BlockchainDB> db(new_db(db_type));
     if (db == NULL)
     {
-      LOG_ERROR("Failed to initialize a database");
+      LOG_ERROR("Attempted to use non-existent database type: " << db_type);
       return false;
     }
 
@@ -579,6 +624,14 @@ namespace cryptonote
 
       if (db_salvage)
         db_flags |= DBF_SALVAGE;
+      if (db_compression)
+        db_flags |= DBF_COMPRESS;
+      if (db_cold_segments)
+        db_flags |= DBF_COLD_SEGMENTS;
+      if (db_sparse_map)
+        db_flags |= DBF_SPARSE_MAP;
+      if (db_spent_key_index)
+        db_flags |= DBF_SPENT_KEY_INDEX;
 
       db->open(filename, db_flags);
       if(!db->m_open)
@@ -645,7 +698,7 @@ namespace cryptonote
     r = m_blockchain_storage.init(db.release(), m_nettype, m_offline, regtest ? &regtest_test_options : test_options, fixed_difficulty, get_checkpoints);
     CHECK_AND_ASSERT_MES(r, false, "Failed to initialize blockchain storage");
 
-    r = m_mempool.init(max_txpool_weight, m_nettype == FAKECHAIN);
+    r = m_mempool.init(max_txpool_weight, m_nettype == FAKECHAIN, max_txpool_memory);
     CHECK_AND_ASSERT_MES(r, false, "Failed to initialize memory pool");
 
     // now that we have a valid m_blockchain_storage, we can clean out any
@@ -657,6 +710,8 @@ namespace cryptonote
     CHECK_AND_ASSERT_MES(r, false, "Failed to initialize blockchain storage");
 
     block_sync_size = command_line::get_arg(vm, arg_block_sync_size);
+    m_adaptive_block_sync = command_line::get_arg(vm, arg_adaptive_block_sync);
+    m_txpool_admission_threads = command_line::get_arg(vm, arg_txpool_admission_threads);
 
     MGINFO("Loading checkpoints");
 
@@ -685,6 +740,7 @@ namespace cryptonote
     if (!keep_alt_blocks && !m_blockchain_storage.get_db().is_read_only())
       m_blockchain_storage.get_db().drop_alt_blocks();
 
+    m_blockchain_storage.set_pruning_rate(command_line::get_arg(vm, arg_prune_blockchain_rate) * 1024);
     if (prune_blockchain)
     {
       // display a message if the blockchain is not pruned yet
@@ -699,6 +755,14 @@ namespace cryptonote
       }
     }
 
+    // pick up a pruning run from where it was stopped
+    pruning_progress_t pruning_progress;
+    if (!m_blockchain_storage.is_pruning() && !m_blockchain_storage.get_db().is_read_only() && m_blockchain_storage.get_pruning_progress(pruning_progress))
+    {
+      MGINFO("Resuming blockchain pruning at height " << pruning_progress.next_height << "/" << pruning_progress.end_height);
+      CHECK_AND_ASSERT_MES(m_blockchain_storage.prune_blockchain(), false, "Failed to resume blockchain pruning");
+    }
+
     return true;
   }
   //-----------------------------------------------------------------------------------------------
@@ -946,7 +1010,15 @@ namespace cryptonote
 
     std::vector<txpool_event> results(tx_blobs.size());
 
-    CRITICAL_REGION_LOCAL(m_incoming_tx_lock);
+    // Txes from blocks are handled within the prepare/cleanup incoming blocks
+    // sequence, which holds this lock already. Relayed txes only need it to
+    // publish to the listener: parsing and verification are stateless, and
+    // the pool locks itself for the short time it takes to add a tx, so txes
+    // received from different peers can be admitted concurrently.
+    const bool from_block = tx_relay == relay_method::block;
+    boost::unique_lock<epee::critical_section> incoming_tx_lock(m_incoming_tx_lock, boost::defer_lock);
+    if (from_block)
+      incoming_tx_lock.lock();
 
     tools::threadpool& tpool = tools::threadpool::getInstance();
     tools::threadpool::waiter waiter(tpool);
@@ -1009,24 +1081,94 @@ namespace cryptonote
       tx_info.push_back({&results[i].tx, results[i].hash, tvc[i], results[i].res});
     }
     if (!tx_info.empty())
-      handle_incoming_tx_accumulated_batch(tx_info, tx_relay == relay_method::block);
+      handle_incoming_tx_accumulated_batch(tx_info, from_block);
+
+    std::vector<uint8_t> added(tx_blobs.size(), true);
+    std::vector<size_t> to_admit;
+    to_admit.reserve(tx_blobs.size());
+    for (size_t i = 0; i < tx_blobs.size(); i++) {
+      if (!results[i].res)
+        continue;
+      if (from_block)
+        get_blockchain_storage().on_new_tx_from_block(results[i].tx);
+      if (!already_have[i])
+        to_admit.push_back(i);
+    }
+
+    const auto get_weight = [&](size_t i) -> uint64_t
+    {
+      return results[i].tx.pruned ? get_pruned_transaction_weight(results[i].tx) : get_transaction_weight(results[i].tx, tx_blobs[i].blob.size());
+    };
+
+    if (from_block)
+    {
+      // txes from blocks are added one at a time and in order, as later
+      // ones may depend on the pool state left by earlier ones during a reorg
+      for (size_t i: to_admit)
+        added[i] = add_new_tx(results[i].tx, results[i].hash, tx_blobs[i].blob, get_weight(i), tvc[i], tx_relay, relayed);
+    }
+    else if (!to_admit.empty())
+    {
+      // relayed txes are added in batches, the ring members of each batch
+      // being read at once and its signatures verified in parallel by the
+      // pool. Large sets are split so that several batches are admitted
+      // concurrently.
+      const size_t max_batches = m_txpool_admission_threads ? m_txpool_admission_threads : tpool.get_max_concurrency();
+      const size_t n_batches = std::max<size_t>(1, std::min<size_t>(max_batches, to_admit.size() / TXPOOL_ADMISSION_MIN_BATCH_SIZE));
+      const uint8_t version = m_blockchain_storage.get_current_hard_fork_version();
+      std::vector<std::vector<tx_memory_pool::tx_to_add>> batches(n_batches);
+      std::vector<std::vector<size_t>> batch_indices(n_batches);
+      for (size_t n = 0; n < to_admit.size(); ++n)
+      {
+        const size_t i = to_admit[n];
+        const size_t b = n * n_batches / to_admit.size();
+        batches[b].push_back({&results[i].tx, results[i].hash, &tx_blobs[i].blob, get_weight(i), &tvc[i], false});
+        batch_indices[b].push_back(i);
+      }
+      const auto admit = [&](size_t b)
+      {
+        try
+        {
+          m_mempool.add_txs(batches[b], tx_relay, relayed, version);
+        }
+        catch (const std::exception &e)
+        {
+          MERROR_VER("Exception in add_txs: " << e.what());
+          for (tx_memory_pool::tx_to_add &tx: batches[b])
+          {
+            tx.tvc->m_verifivation_failed = true;
+            tx.result = false;
+          }
+        }
+      };
+      if (n_batches == 1)
+      {
+        admit(0);
+      }
+      else
+      {
+        for (size_t b = 0; b < n_batches; ++b)
+          tpool.submit(&waiter, [&admit, b] { admit(b); });
+        if (!waiter.wait())
+          return false;
+      }
+      for (size_t b = 0; b < n_batches; ++b)
+        for (size_t n = 0; n < batches[b].size(); ++n)
+          added[batch_indices[b][n]] = batches[b][n].result;
+    }
 
     bool valid_events = false;
     bool ok = true;
-    it = tx_blobs.begin();
-    for (size_t i = 0; i < tx_blobs.size(); i++, ++it) {
+    for (size_t i = 0; i < tx_blobs.size(); i++) {
       if (!results[i].res)
       {
         ok = false;
         continue;
       }
-      if (tx_relay == relay_method::block)
-        get_blockchain_storage().on_new_tx_from_block(results[i].tx);
       if (already_have[i])
         continue;
 
-      const uint64_t weight = results[i].tx.pruned ? get_pruned_transaction_weight(results[i].tx) : get_transaction_weight(results[i].tx, it->blob.size());
-      ok &= add_new_tx(results[i].tx, results[i].hash, tx_blobs[i].blob, weight, tvc[i], tx_relay, relayed);
+      ok &= bool(added[i]);
 
       if(tvc[i].m_verifivation_failed)
       {MERROR_VER("Transaction verification failed: " << results[i].hash);}
@@ -1042,8 +1184,13 @@ namespace cryptonote
         results[i].res = false;
     }
 
-    if (valid_events && m_zmq_pub && matches_category(tx_relay, relay_category::legacy))
-      m_zmq_pub(std::move(results));
+    if (valid_events && matches_category(tx_relay, relay_category::legacy))
+    {
+      if (!from_block)
+        incoming_tx_lock.lock();
+      if (m_zmq_pub)
+        m_zmq_pub(std::move(results));
+    }
 
     return ok;
     CATCH_ENTRY_L0("core::handle_incoming_txs()", false);
@@ -1125,14 +1272,15 @@ namespace cryptonote
   //-----------------------------------------------------------------------------------------------
   bool core::are_key_images_spent(const std::vector<crypto::key_image>& key_im, std::vector<bool> &spent) const
   {
-    spent.clear();
-    for(auto& ki: key_im)
-    {
-      spent.push_back(m_blockchain_storage.have_tx_keyimg_as_spent(ki));
-    }
+    m_blockchain_storage.have_key_images_as_spent(epee::to_span(key_im), spent);
     return true;
   }
   //-----------------------------------------------------------------------------------------------
+  bool core::get_key_image_spender(const crypto::key_image &key_im, crypto::hash &tx_hash, uint64_t &height) const
+  {
+    return m_blockchain_storage.get_key_image_spender(key_im, tx_hash, height);
+  }
+  //-----------------------------------------------------------------------------------------------
   size_t core::get_block_sync_size(uint64_t height) const
   {
     if (block_sync_size > 0)
@@ -1955,6 +2103,11 @@ namespace cryptonote
     return m_blockchain_storage.check_blockchain_pruning();
   }
   //-----------------------------------------------------------------------------------------------
+  bool core::compact_blockchain()
+  {
+    return m_blockchain_storage.compact_blockchain();
+  }
+  //-----------------------------------------------------------------------------------------------
   void core::set_target_blockchain_height(uint64_t target_blockchain_height)
   {
     m_target_blockchain_height = target_blockchain_height;
@@ -1970,6 +2123,21 @@ namespace cryptonote
     return get_blockchain_storage().prevalidate_block_hashes(height, hashes, weights);
   }
   //-----------------------------------------------------------------------------------------------
+  bool core::prevalidate_block_headers(uint64_t height, const std::vector<crypto::hash> &hashes, const std::vector<blobdata> &headers)
+  {
+    return get_blockchain_storage().prevalidate_block_headers(height, hashes, headers);
+  }
+  //-----------------------------------------------------------------------------------------------
+  uint64_t core::get_verified_headers_height() const
+  {
+    return get_blockchain_storage().get_verified_headers_height();
+  }
+  //-----------------------------------------------------------------------------------------------
+  bool core::get_block_hashing_blobs(const std::vector<crypto::hash> &hashes, std::vector<blobdata> &blobs) const
+  {
+    return get_blockchain_storage().get_block_hashing_blobs(hashes, blobs);
+  }
+  //-----------------------------------------------------------------------------------------------
   uint64_t core::get_free_space() const
   {
     boost::filesystem::path path(m_config_folder);
@@ -71,6 +71,7 @@ namespace cryptonote
   extern const command_line::arg_descriptor<bool> arg_offline;
   extern const command_line::arg_descriptor<size_t> arg_block_download_max_size;
   extern const command_line::arg_descriptor<bool> arg_sync_pruned_blocks;
+  extern const command_line::arg_descriptor<bool> arg_tx_reconciliation;
 
   /************************************************************************/
   /*                                                                      */
@@ -753,6 +754,13 @@ namespace cryptonote
       */
      bool are_key_images_spent(const std::vector<crypto::key_image>& key_im, std::vector<bool> &spent) const;
 
+     /**
+      * @copydoc Blockchain::get_key_image_spender
+      *
+      * @note see Blockchain::get_key_image_spender
+      */
+     bool get_key_image_spender(const crypto::key_image& key_im, crypto::hash &tx_hash, uint64_t &height) const;
+
      /**
       * @brief check if multiple key images are spent in the transaction pool
       *
@@ -770,6 +778,13 @@ namespace cryptonote
       */
      size_t get_block_sync_size(uint64_t height) const;
 
+     /**
+      * @brief get whether the number of blocks to sync in one go is sized per peer
+      *
+      * @return true if --adaptive-block-sync was given and no block sync size was set
+      */
+     bool is_block_sync_size_adaptive() const { return m_adaptive_block_sync && block_sync_size == 0; }
+
      /**
       * @brief get the sum of coinbase tx amounts between blocks
       *
@@ -801,6 +816,13 @@ namespace cryptonote
       */
      bool fluffy_blocks_enabled() const { return m_fluffy_blocks_enabled; }
 
+     /**
+      * @brief get whether block headers are verified ahead of blocks when syncing
+      *
+      * @return whether headers-first sync is enabled
+      */
+     bool headers_first_sync_enabled() const { return m_headers_first_sync_enabled; }
+
      /**
       * @brief check a set of hashes against the precompiled hash set
       *
@@ -808,6 +830,27 @@ namespace cryptonote
       */
      uint64_t prevalidate_block_hashes(uint64_t height, const std::vector<crypto::hash> &hashes, const std::vector<uint64_t> &weights);
 
+     /**
+      * @copydoc Blockchain::prevalidate_block_headers
+      *
+      * @note see Blockchain::prevalidate_block_headers
+      */
+     bool prevalidate_block_headers(uint64_t height, const std::vector<crypto::hash> &hashes, const std::vector<blobdata> &headers);
+
+     /**
+      * @copydoc Blockchain::get_verified_headers_height
+      *
+      * @note see Blockchain::get_verified_headers_height
+      */
+     uint64_t get_verified_headers_height() const;
+
+     /**
+      * @copydoc Blockchain::get_block_hashing_blobs
+      *
+      * @note see Blockchain::get_block_hashing_blobs
+      */
+     bool get_block_hashing_blobs(const std::vector<crypto::hash> &hashes, std::vector<blobdata> &blobs) const;
+
      /**
       * @brief get free disk space on the blockchain partition
       *
@@ -830,7 +873,9 @@ namespace cryptonote
      uint32_t get_blockchain_pruning_seed() const;
 
      /**
-      * @brief prune the blockchain
+      * @brief prune the blockchain, in the background
+      *
+      * If a pruning run is already going, this does nothing.
       *
       * @param pruning_seed the seed to use to prune the chain (0 for default, highly recommended)
       *
@@ -852,6 +897,13 @@ namespace cryptonote
       */
      bool check_blockchain_pruning();
 
+     /**
+      * @brief rewrites the database without its free pages, while the daemon keeps running
+      *
+      * @return true on success, false otherwise
+      */
+     bool compact_blockchain();
+
      /**
       * @brief checks whether a given block height is included in the precompiled block hash area
       *
@@ -1093,6 +1145,9 @@ namespace cryptonote
      bool m_disable_dns_checkpoints;
 
      size_t block_sync_size;
+     bool m_adaptive_block_sync; //!< size spans per peer when block_sync_size is 0
+
+     size_t m_txpool_admission_threads; //!< max number of batches of relayed txes added to the pool concurrently, 0 for the threadpool size
 
      time_t start_time;
 
@@ -1111,6 +1166,7 @@ namespace cryptonote
      boost::mutex m_update_mutex;
 
      bool m_fluffy_blocks_enabled;
+     bool m_headers_first_sync_enabled;
      bool m_offline;
 
      /* `boost::function` is used because the implementation never allocates if
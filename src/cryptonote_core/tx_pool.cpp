@@ -117,9 +117,69 @@ namespace cryptonote
       if (candidate < next_check.load(std::memory_order_relaxed))
         next_check = candidate;
     }
+
+    // Rounding tx fee/blob_size ratio so that txs with the same priority would be sorted by receive_time
+    tx_by_fee_and_receive_time_entry get_sorted_tx_entry(const crypto::hash &id, uint64_t fee, size_t weight, std::time_t receive_time)
+    {
+      const uint32_t fee_per_size_ratio = (uint32_t)(fee / (double)(weight ? weight : 1));
+      return tx_by_fee_and_receive_time_entry(std::pair<uint32_t, std::time_t>(fee_per_size_ratio, receive_time), id);
+    }
+
+    // node sizes for the standard library containers: hash nodes hold a next
+    // pointer and the cached hash code, tree nodes hold three links and a colour
+    template<typename T>
+    constexpr uint64_t hash_node_memory() { return sizeof(void*) + sizeof(T) + sizeof(size_t); }
+    template<typename T>
+    constexpr uint64_t tree_node_memory() { return 4 * sizeof(void*) + sizeof(T); }
+
+    template<typename C>
+    uint64_t hash_container_memory(const C &c)
+    {
+      return c.bucket_count() * sizeof(void*) + c.size() * hash_node_memory<typename C::value_type>();
+    }
+
+    // an empty set uses a single bucket inside the container itself
+    uint64_t txid_set_memory(const std::unordered_set<crypto::hash> &txids)
+    {
+      return (txids.bucket_count() > 1 ? txids.bucket_count() * sizeof(void*) : 0) + txids.size() * hash_node_memory<crypto::hash>();
+    }
+
+    template<typename T>
+    uint64_t vector_memory(const std::vector<T> &v)
+    {
+      return v.capacity() * sizeof(T);
+    }
+
+    // heap usage of a parsed transaction, not counting sizeof(transaction)
+    uint64_t get_transaction_heap_memory(const transaction &tx)
+    {
+      uint64_t bytes = vector_memory(tx.vin) + vector_memory(tx.vout) + vector_memory(tx.extra) + vector_memory(tx.signatures);
+      for (const txin_v &in: tx.vin)
+        if (in.type() == typeid(txin_to_key))
+          bytes += vector_memory(boost::get<txin_to_key>(in).key_offsets);
+      for (const std::vector<crypto::signature> &signatures: tx.signatures)
+        bytes += vector_memory(signatures);
+
+      const rct::rctSig &rv = tx.rct_signatures;
+      bytes += vector_memory(rv.mixRing) + vector_memory(rv.pseudoOuts) + vector_memory(rv.ecdhInfo) + vector_memory(rv.outPk);
+      for (const rct::ctkeyV &ring: rv.mixRing)
+        bytes += vector_memory(ring);
+      bytes += vector_memory(rv.p.rangeSigs) + vector_memory(rv.p.bulletproofs) + vector_memory(rv.p.MGs) + vector_memory(rv.p.CLSAGs) + vector_memory(rv.p.pseudoOuts);
+      for (const rct::Bulletproof &proof: rv.p.bulletproofs)
+        bytes += vector_memory(proof.V) + vector_memory(proof.L) + vector_memory(proof.R);
+      for (const rct::mgSig &mg: rv.p.MGs)
+      {
+        bytes += vector_memory(mg.ss) + vector_memory(mg.II);
+        for (const rct::keyV &ss: mg.ss)
+          bytes += vector_memory(ss);
+      }
+      for (const rct::clsag &sig: rv.p.CLSAGs)
+        bytes += vector_memory(sig.s);
+      return bytes;
+    }
   }
   //---------------------------------------------------------------------------------
-  tx_memory_pool::tx_memory_pool(Blockchain& bchs): m_blockchain(bchs), m_cookie(0), m_txpool_max_weight(DEFAULT_TXPOOL_MAX_WEIGHT), m_txpool_weight(0), m_mine_stem_txes(false), m_next_check(std::time(nullptr))
+  tx_memory_pool::tx_memory_pool(Blockchain& bchs): m_blockchain(bchs), m_cookie(0), m_txpool_max_weight(DEFAULT_TXPOOL_MAX_WEIGHT), m_txpool_weight(0), m_txpool_max_memory(0), m_num_pruned(0), m_mine_stem_txes(false), m_input_cache_generation(0), m_parsed_tx_cache_memory(0), m_spent_key_images_memory(0), m_next_check(std::time(nullptr))
   {
     // class code expects unsigned values throughout
     if (m_next_check < time_t(0))
@@ -130,10 +190,119 @@ namespace cryptonote
   {
     const bool kept_by_block = (tx_relay == relay_method::block);
 
-    // this should already be called with that lock, but let's make it explicit for clarity
+    // Admission runs in two phases. The checks up to and including the input
+    // verification only need the transaction and the chain, so they run
+    // without the pool lock, and several transactions may be verified at
+    // once. The pool lock is then taken for a short critical section which
+    // re-checks key image conflicts and inserts the transaction.
+    PERF_TIMER(add_tx);
+    if (!check_tx_for_pool(tx, id, tx_weight, tvc, kept_by_block, version))
+      return false;
+
+    // assume failure during verification steps until success is certain
+    tvc.m_verifivation_failed = true;
+
+    crypto::hash max_used_block_id = null_hash;
+    uint64_t max_used_block_height = 0;
+    const crypto::hash verified_top_id = m_blockchain.get_tail_id();
+    bool ch_inp_res = check_tx_inputs([&tx]()->cryptonote::transaction&{ return tx; }, id, max_used_block_height, max_used_block_id, tvc, kept_by_block);
+
+    // end of the lock free verification phase
     CRITICAL_REGION_LOCAL(m_transactions_lock);
+    if (!add_verified_tx(tx, id, blob, tx_weight, tvc, tx_relay, relayed, ch_inp_res, max_used_block_height, max_used_block_id, verified_top_id))
+      return false;
 
-    PERF_TIMER(add_tx);
+    prune(m_txpool_max_weight);
+
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::add_txs(std::vector<tx_to_add> &txs, relay_method tx_relay, bool relayed, uint8_t version)
+  {
+    PERF_TIMER(add_txs);
+
+    // txes kept by block skip most checks, and are added one by one in order
+    if (tx_relay == relay_method::block)
+    {
+      for (tx_to_add &e: txs)
+        e.result = add_tx(*e.tx, e.id, *e.blob, e.weight, *e.tvc, tx_relay, relayed, version);
+      return;
+    }
+
+    std::vector<Blockchain::tx_input_check> checks;
+    std::vector<std::tuple<bool, uint64_t, crypto::hash>> inputs(txs.size(), std::make_tuple(false, 0, null_hash));
+    std::vector<size_t> to_check;
+    checks.reserve(txs.size());
+    uint64_t generation;
+    {
+      CRITICAL_REGION_LOCAL(m_input_cache_lock);
+      generation = m_input_cache_generation;
+    }
+    for (size_t n = 0; n < txs.size(); ++n)
+    {
+      tx_to_add &e = txs[n];
+      e.result = check_tx_for_pool(*e.tx, e.id, e.weight, *e.tvc, false, version);
+      if (!e.result)
+        continue;
+
+      // assume failure during verification steps until success is certain
+      e.tvc->m_verifivation_failed = true;
+
+      CRITICAL_REGION_LOCAL(m_input_cache_lock);
+      const auto i = m_input_cache.find(e.id);
+      if (i != m_input_cache.end())
+      {
+        inputs[n] = std::make_tuple(std::get<0>(i->second), std::get<2>(i->second), std::get<3>(i->second));
+        *e.tvc = std::get<1>(i->second);
+        continue;
+      }
+      to_check.push_back(n);
+      checks.push_back({e.tx, e.tvc, 0, null_hash, false});
+    }
+
+    // the ring members of all txes are read at once, and their signatures
+    // verified in parallel, all without the pool lock
+    const crypto::hash verified_top_id = m_blockchain.get_tail_id();
+    if (!checks.empty())
+    {
+      try
+      {
+        m_blockchain.check_tx_inputs_batch(checks);
+      }
+      catch (const std::exception &e)
+      {
+        MERROR("Failed to check inputs of " << checks.size() << " txes: " << e.what());
+        for (Blockchain::tx_input_check &check: checks)
+          check.result = false;
+      }
+      CRITICAL_REGION_LOCAL(m_input_cache_lock);
+      for (size_t n = 0; n < checks.size(); ++n)
+      {
+        const Blockchain::tx_input_check &check = checks[n];
+        inputs[to_check[n]] = std::make_tuple(check.result, check.max_used_block_height, check.max_used_block_id);
+        if (generation == m_input_cache_generation)
+          m_input_cache.insert(std::make_pair(txs[to_check[n]].id, std::make_tuple(check.result, *check.tvc, check.max_used_block_height, check.max_used_block_id)));
+      }
+    }
+
+    // survivors are added in a single db transaction
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    CRITICAL_REGION_LOCAL1(m_blockchain);
+    LockedTXN lock(m_blockchain.get_db());
+    for (size_t n = 0; n < txs.size(); ++n)
+    {
+      tx_to_add &e = txs[n];
+      if (!e.result)
+        continue;
+      e.result = add_verified_tx(*e.tx, e.id, *e.blob, e.weight, *e.tvc, tx_relay, relayed, std::get<0>(inputs[n]), std::get<1>(inputs[n]), std::get<2>(inputs[n]), verified_top_id);
+    }
+    lock.commit();
+
+    prune(m_txpool_max_weight);
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::check_tx_for_pool(transaction &tx, const crypto::hash &id, size_t tx_weight, tx_verification_context& tvc, bool kept_by_block, uint8_t version)
+  {
     if (tx.version < 2)
     {
       // v0, v1 never accepted
@@ -145,12 +314,16 @@ namespace cryptonote
 
     // we do not accept transactions that timed out before, unless they're
     // kept_by_block
-    if (!kept_by_block && m_timed_out_transactions.find(id) != m_timed_out_transactions.end())
+    if (!kept_by_block)
     {
-      // not clear if we should set that, since verifivation (sic) did not fail before, since
-      // the tx was accepted before timing out.
-      tvc.m_verifivation_failed = true;
-      return false;
+      CRITICAL_REGION_LOCAL(m_transactions_lock);
+      if (m_timed_out_transactions.find(id) != m_timed_out_transactions.end())
+      {
+        // not clear if we should set that, since verifivation (sic) did not fail before, since
+        // the tx was accepted before timing out.
+        tvc.m_verifivation_failed = true;
+        return false;
+      }
     }
 
     if(!check_inputs_types_supported(tx))
@@ -213,6 +386,8 @@ namespace cryptonote
     // if the transaction came from a block popped from the chain,
     // don't check if we have its key images as spent.
     // TODO: Investigate why not?
+    // This is only an early rejection, the check is repeated once the
+    // pool lock is taken below.
     if(!kept_by_block)
     {
       if(have_tx_keyimges_as_spent(tx, id))
@@ -233,15 +408,45 @@ namespace cryptonote
       return false;
     }
 
-    // assume failure during verification steps until success is certain
-    tvc.m_verifivation_failed = true;
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::add_verified_tx(transaction &tx, const crypto::hash &id, const cryptonote::blobdata &blob, size_t tx_weight, tx_verification_context& tvc, relay_method tx_relay, bool relayed, bool ch_inp_res, uint64_t max_used_block_height, const crypto::hash &max_used_block_id, const crypto::hash &verified_top_id)
+  {
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    const bool kept_by_block = (tx_relay == relay_method::block);
+    const uint64_t fee = tx.rct_signatures.txnFee;
+    cryptonote::txpool_tx_meta_t meta{};
 
     time_t receive_time = time(nullptr);
 
-    crypto::hash max_used_block_id = null_hash;
-    uint64_t max_used_block_height = 0;
-    cryptonote::txpool_tx_meta_t meta{};
-    bool ch_inp_res = check_tx_inputs([&tx]()->cryptonote::transaction&{ return tx; }, id, max_used_block_height, max_used_block_id, tvc, kept_by_block);
+    if (!kept_by_block && ch_inp_res)
+    {
+      // another peer may have sent us the same tx while we were verifying it
+      if (have_tx(id, relay_category::legacy))
+      {
+        LOG_PRINT_L2("tx " << id << " was added to the pool while being verified");
+        tvc.m_verifivation_failed = false;
+        return true;
+      }
+      if(have_tx_keyimges_as_spent(tx, id))
+      {
+        mark_double_spend(tx);
+        LOG_PRINT_L1("Transaction with id= "<< id << " used already spent key images");
+        tvc.m_verifivation_failed = true;
+        tvc.m_double_spend = true;
+        return false;
+      }
+      // a block may have been added since the inputs were checked
+      if (m_blockchain.get_tail_id() != verified_top_id && m_blockchain.have_tx_keyimges_as_spent(tx))
+      {
+        LOG_PRINT_L1("Transaction with id= "<< id << " had its key images spent in a block while being verified");
+        tvc.m_verifivation_failed = true;
+        tvc.m_double_spend = true;
+        return false;
+      }
+    }
+
     if(!ch_inp_res)
     {
       // if the transaction was valid before (kept_by_block), then it
@@ -265,16 +470,14 @@ namespace cryptonote
         try
         {
           if (kept_by_block)
-            m_parsed_tx_cache.insert(std::make_pair(id, tx));
+            cache_parsed_tx(id, tx);
           CRITICAL_REGION_LOCAL1(m_blockchain);
           LockedTXN lock(m_blockchain.get_db());
           if (!insert_key_images(tx, id, tx_relay))
             return false;
 
           m_blockchain.add_txpool_tx(id, blob, meta);
-          // Rounding tx fee/blob_size ratio so that txs with the same priority would be sorted by receive_time
-          uint32_t fee_per_size_ratio = (uint32_t)(fee / (double)(tx_weight ? tx_weight : 1));
-          m_txs_by_fee_and_receive_time.emplace(std::pair<uint32_t, std::time_t>(fee_per_size_ratio, receive_time), id);
+          m_txs_by_fee_and_receive_time.emplace(get_sorted_tx_entry(id, fee, tx_weight, receive_time));
           lock.commit();
         }
         catch (const std::exception &e)
@@ -296,7 +499,7 @@ namespace cryptonote
       try
       {
         if (kept_by_block)
-          m_parsed_tx_cache.insert(std::make_pair(id, tx));
+          cache_parsed_tx(id, tx);
         CRITICAL_REGION_LOCAL1(m_blockchain);
         LockedTXN lock(m_blockchain.get_db());
 
@@ -325,6 +528,14 @@ namespace cryptonote
           }
           // else the `set_relayed` function will adjust the time accordingly later
 
+          // the sort key changes with the receive time, drop the old entry
+          if (existing_tx)
+          {
+            const auto sorted_it = find_tx_in_sorted_container(id, meta);
+            if (sorted_it != m_txs_by_fee_and_receive_time.end())
+              m_txs_by_fee_and_receive_time.erase(sorted_it);
+          }
+
           //update transactions container
           meta.last_relayed_time = last_relayed_time;
           meta.receive_time = receive_time;
@@ -345,9 +556,7 @@ namespace cryptonote
 
           m_blockchain.remove_txpool_tx(id);
           m_blockchain.add_txpool_tx(id, blob, meta);
-          // Rounding tx fee/blob_size ratio so that txs with the same priority would be sorted by receive_time
-          uint32_t fee_per_size_ratio = (uint32_t)(fee / (double)(tx_weight ? tx_weight : 1));
-          m_txs_by_fee_and_receive_time.emplace(std::pair<uint32_t, std::time_t>(fee_per_size_ratio, receive_time), id);
+          m_txs_by_fee_and_receive_time.emplace(get_sorted_tx_entry(id, fee, tx_weight, receive_time));
         }
         lock.commit();
       }
@@ -370,8 +579,6 @@ namespace cryptonote
 
     MINFO("Transaction added to pool: txid " << id << " weight: " << tx_weight << " fee/byte: " << (fee / (double)(tx_weight ? tx_weight : 1)));
 
-    prune(m_txpool_max_weight);
-
     return true;
   }
   //---------------------------------------------------------------------------------
@@ -398,63 +605,147 @@ namespace cryptonote
     m_txpool_max_weight = bytes;
   }
   //---------------------------------------------------------------------------------
+  txpool_memory_usage tx_memory_pool::get_txpool_memory_usage() const
+  {
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    return get_memory_usage_locked();
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::set_txpool_max_memory(size_t bytes)
+  {
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    m_txpool_max_memory = bytes;
+  }
+  //---------------------------------------------------------------------------------
+  txpool_memory_usage tx_memory_pool::get_memory_usage_locked() const
+  {
+    txpool_memory_usage usage;
+    usage.sorted_txes = m_txs_by_fee_and_receive_time.size() * tree_node_memory<sorted_tx_container::value_type>();
+    usage.key_images = hash_container_memory(m_spent_key_images) + m_spent_key_images_memory;
+    {
+      CRITICAL_REGION_LOCAL(m_input_cache_lock);
+      usage.input_cache = hash_container_memory(m_input_cache);
+    }
+    usage.parsed_tx_cache = hash_container_memory(m_parsed_tx_cache) + m_parsed_tx_cache_memory;
+    usage.timed_out = hash_container_memory(m_timed_out_transactions);
+    return usage;
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::cache_parsed_tx(const crypto::hash &id, const transaction &tx)
+  {
+    if (m_parsed_tx_cache.insert(std::make_pair(id, tx)).second)
+      m_parsed_tx_cache_memory += get_transaction_heap_memory(tx);
+  }
+  //---------------------------------------------------------------------------------
   void tx_memory_pool::prune(size_t bytes)
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     if (bytes == 0)
       bytes = m_txpool_max_weight;
+    const auto over_memory_limit = [this]() { return m_txpool_max_memory && get_memory_usage_locked().total() > m_txpool_max_memory; };
+    if (m_txpool_weight <= bytes && !over_memory_limit())
+      return;
+
+    if (over_memory_limit())
+    {
+      // failed verifications are only cached to cheaply reject resubmissions, drop them before any tx
+      CRITICAL_REGION_LOCAL1(m_input_cache_lock);
+      for (auto i = m_input_cache.begin(); i != m_input_cache.end(); )
+      {
+        if (std::get<0>(i->second))
+          ++i;
+        else
+          i = m_input_cache.erase(i);
+      }
+    }
+    if (m_txs_by_fee_and_receive_time.empty())
+      return;
+
+    // a tx is assumed to free the pool's average memory per tx, so the cut point is found
+    // in one walk from the lowest fee end and everything past it is erased at once
+    uint64_t memory_excess = 0, tx_memory = 0;
+    if (m_txpool_max_memory)
+    {
+      const uint64_t total = get_memory_usage_locked().total();
+      memory_excess = total > m_txpool_max_memory ? total - m_txpool_max_memory : 0;
+      tx_memory = total / m_txs_by_fee_and_receive_time.size() + 1;
+    }
+
     CRITICAL_REGION_LOCAL1(m_blockchain);
     LockedTXN lock(m_blockchain.get_db());
-    bool changed = false;
 
+    std::vector<std::pair<sorted_tx_container::const_iterator, size_t>> victims;
+    std::vector<sorted_tx_container::value_type> kept;
+    size_t weight_freed = 0;
+    uint64_t memory_freed = 0;
     // this will never remove the first one, but we don't care
-    auto it = --m_txs_by_fee_and_receive_time.end();
-    while (it != m_txs_by_fee_and_receive_time.begin())
+    auto cut = m_txs_by_fee_and_receive_time.end();
+    while (std::prev(cut) != m_txs_by_fee_and_receive_time.begin() && (m_txpool_weight - weight_freed > bytes || memory_freed < memory_excess))
     {
-      if (m_txpool_weight <= bytes)
-        break;
+      --cut;
+      txpool_tx_meta_t meta;
+      if (!m_blockchain.get_txpool_tx_meta(cut->second, meta))
+      {
+        MERROR("Failed to find tx_meta in txpool");
+        return;
+      }
+      // don't prune the kept_by_block ones, they're likely added because we're adding a block with those
+      if (meta.kept_by_block)
+      {
+        kept.push_back(*cut);
+        continue;
+      }
+      victims.emplace_back(cut, meta.weight);
+      weight_freed += meta.weight;
+      memory_freed += tx_memory;
+    }
+
+    size_t removed = 0;
+    for (; removed < victims.size(); ++removed)
+    {
+      const sorted_tx_container::const_iterator it = victims[removed].first;
+      const crypto::hash &txid = it->second;
+      const size_t weight = victims[removed].second;
       try
       {
-        const crypto::hash &txid = it->second;
-        txpool_tx_meta_t meta;
-        if (!m_blockchain.get_txpool_tx_meta(txid, meta))
-        {
-          MERROR("Failed to find tx_meta in txpool");
-          return;
-        }
-        // don't prune the kept_by_block ones, they're likely added because we're adding a block with those
-        if (meta.kept_by_block)
-        {
-          --it;
-          continue;
-        }
         cryptonote::blobdata txblob = m_blockchain.get_txpool_tx_blob(txid, relay_category::all);
         cryptonote::transaction_prefix tx;
         if (!parse_and_validate_tx_prefix_from_blob(txblob, tx))
         {
           MERROR("Failed to parse tx from txpool");
-          return;
+          break;
         }
         // remove first, in case this throws, so key images aren't removed
-        MINFO("Pruning tx " << txid << " from txpool: weight: " << meta.weight << ", fee/byte: " << it->first.first);
+        MINFO("Pruning tx " << txid << " from txpool: weight: " << weight << ", fee/byte: " << it->first.first);
         m_blockchain.remove_txpool_tx(txid);
-        m_txpool_weight -= meta.weight;
+        m_txpool_weight -= weight;
         remove_transaction_keyimages(tx, txid);
-        MINFO("Pruned tx " << txid << " from txpool: weight: " << meta.weight << ", fee/byte: " << it->first.first);
-        m_txs_by_fee_and_receive_time.erase(it--);
-        changed = true;
+        {
+          CRITICAL_REGION_LOCAL1(m_input_cache_lock);
+          m_input_cache.erase(txid);
+        }
+        MINFO("Pruned tx " << txid << " from txpool: weight: " << weight << ", fee/byte: " << it->first.first);
       }
       catch (const std::exception &e)
       {
         MERROR("Error while pruning txpool: " << e.what());
-        return;
+        break;
       }
     }
+    // txes past the cut that stay are put back after the range is erased
+    for (size_t i = removed; i < victims.size(); ++i)
+      kept.push_back(*victims[i].first);
+    m_txs_by_fee_and_receive_time.erase(cut, m_txs_by_fee_and_receive_time.end());
+    m_txs_by_fee_and_receive_time.insert(kept.begin(), kept.end());
+    m_num_pruned += removed;
+
     lock.commit();
-    if (changed)
+    if (removed)
       ++m_cookie;
     if (m_txpool_weight > bytes)
       MINFO("Pool weight after pruning is larger than limit: " << m_txpool_weight << "/" << bytes);
+    if (over_memory_limit())
+      MINFO("Pool memory after pruning is larger than limit: " << get_memory_usage_locked().total() << "/" << m_txpool_max_memory);
   }
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::insert_key_images(const transaction_prefix &tx, const crypto::hash &id, relay_method tx_relay)
@@ -475,8 +766,11 @@ namespace cryptonote
                                            << ", kei_image_set.size()=" << kei_image_set.size() << ENDL << "txin.k_image=" << txin.k_image << ENDL
                                            << "tx_id=" << id);
       }
+      const uint64_t set_memory = txid_set_memory(kei_image_set);
+      const bool inserted = kei_image_set.insert(id).second;
+      m_spent_key_images_memory = m_spent_key_images_memory - set_memory + txid_set_memory(kei_image_set);
       const bool new_or_previously_private =
-        kei_image_set.insert(id).second ||
+        inserted ||
         !m_blockchain.txpool_tx_matches_category(id, relay_category::legacy);
       CHECK_AND_ASSERT_MES(new_or_previously_private, false, "internal error: try to insert duplicate iterator in key_image set");
     }
@@ -505,12 +799,17 @@ namespace cryptonote
       auto it_in_set = key_image_set.find(actual_hash);
       CHECK_AND_ASSERT_MES(it_in_set != key_image_set.end(), false, "transaction id not found in key_image set, img=" << txin.k_image << ENDL
         << "transaction id = " << actual_hash);
+      m_spent_key_images_memory -= txid_set_memory(key_image_set);
       key_image_set.erase(it_in_set);
       if(!key_image_set.size())
       {
         //it is now empty hash container for this key_image
         m_spent_key_images.erase(it);
       }
+      else
+      {
+        m_spent_key_images_memory += txid_set_memory(key_image_set);
+      }
 
     }
     ++m_cookie;
@@ -522,7 +821,7 @@ namespace cryptonote
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
 
-    auto sorted_it = find_tx_in_sorted_container(id);
+    auto sorted_it = m_txs_by_fee_and_receive_time.end();
 
     try
     {
@@ -533,6 +832,7 @@ namespace cryptonote
         MERROR("Failed to find tx_meta in txpool");
         return false;
       }
+      sorted_it = find_tx_in_sorted_container(id, meta);
       txblob = m_blockchain.get_txpool_tx_blob(id, relay_category::all);
       auto ci = m_parsed_tx_cache.find(id);
       if (ci != m_parsed_tx_cache.end())
@@ -664,13 +964,9 @@ namespace cryptonote
     m_remove_stuck_tx_interval.do_call([this](){return remove_stuck_transactions();});
   }
   //---------------------------------------------------------------------------------
-  sorted_tx_container::iterator tx_memory_pool::find_tx_in_sorted_container(const crypto::hash& id) const
+  sorted_tx_container::iterator tx_memory_pool::find_tx_in_sorted_container(const crypto::hash& id, const txpool_tx_meta_t &meta) const
   {
-    return std::find_if( m_txs_by_fee_and_receive_time.begin(), m_txs_by_fee_and_receive_time.end()
-                       , [&](const sorted_tx_container::value_type& a){
-                         return a.second == id;
-                       }
-    );
+    return m_txs_by_fee_and_receive_time.find(get_sorted_tx_entry(id, meta.fee, meta.weight, meta.receive_time));
   }
   //---------------------------------------------------------------------------------
   //TODO: investigate whether boolean return is appropriate
@@ -686,7 +982,7 @@ namespace cryptonote
          (tx_age > CRYPTONOTE_MEMPOOL_TX_FROM_ALT_BLOCK_LIVETIME && meta.kept_by_block) )
       {
         LOG_PRINT_L1("Tx " << txid << " removed from tx pool due to outdated, age: " << tx_age );
-        auto sorted_it = find_tx_in_sorted_container(txid);
+        auto sorted_it = find_tx_in_sorted_container(txid, meta);
         if (sorted_it == m_txs_by_fee_and_receive_time.end())
         {
           LOG_PRINT_L1("Removing tx " << txid << " from tx pool, but it was not found in the sorted txs container!");
@@ -943,6 +1239,17 @@ namespace cryptonote
     }, false, category);
 
     stats.bytes_med = epee::misc_utils::median(weights);
+
+    const txpool_memory_usage usage = get_memory_usage_locked();
+    stats.memory_sorted_txes = usage.sorted_txes;
+    stats.memory_key_images = usage.key_images;
+    stats.memory_input_cache = usage.input_cache;
+    stats.memory_parsed_tx_cache = usage.parsed_tx_cache;
+    stats.memory_timed_out = usage.timed_out;
+    stats.memory_total = usage.total();
+    stats.memory_limit = m_txpool_max_memory;
+    stats.weight_limit = m_txpool_max_weight;
+    stats.num_pruned = m_num_pruned;
     if (stats.txs_total > 1)
     {
       /* looking for 98th percentile */
@@ -1142,16 +1449,22 @@ namespace cryptonote
   bool tx_memory_pool::on_blockchain_inc(uint64_t new_block_height, const crypto::hash& top_block_id)
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
+    CRITICAL_REGION_LOCAL1(m_input_cache_lock);
     m_input_cache.clear();
+    ++m_input_cache_generation;
     m_parsed_tx_cache.clear();
+    m_parsed_tx_cache_memory = 0;
     return true;
   }
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::on_blockchain_dec(uint64_t new_block_height, const crypto::hash& top_block_id)
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
+    CRITICAL_REGION_LOCAL1(m_input_cache_lock);
     m_input_cache.clear();
+    ++m_input_cache_generation;
     m_parsed_tx_cache.clear();
+    m_parsed_tx_cache_memory = 0;
     return true;
   }
   //---------------------------------------------------------------------------------
@@ -1202,8 +1515,11 @@ namespace cryptonote
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::check_tx_inputs(const std::function<cryptonote::transaction&(void)> &get_tx, const crypto::hash &txid, uint64_t &max_used_block_height, crypto::hash &max_used_block_id, tx_verification_context &tvc, bool kept_by_block) const
   {
+    uint64_t generation = 0;
     if (!kept_by_block)
     {
+      CRITICAL_REGION_LOCAL(m_input_cache_lock);
+      generation = m_input_cache_generation;
       const std::unordered_map<crypto::hash, std::tuple<bool, tx_verification_context, uint64_t, crypto::hash>>::const_iterator i = m_input_cache.find(txid);
       if (i != m_input_cache.end())
       {
@@ -1213,9 +1529,15 @@ namespace cryptonote
         return std::get<0>(i->second);
       }
     }
+    // the cache lock is not held while verifying, so the result is dropped
+    // if the chain changed (and the cache was cleared) in the meantime
     bool ret = m_blockchain.check_tx_inputs(get_tx(), max_used_block_height, max_used_block_id, tvc, kept_by_block);
     if (!kept_by_block)
-      m_input_cache.insert(std::make_pair(txid, std::make_tuple(ret, tvc, max_used_block_height, max_used_block_id)));
+    {
+      CRITICAL_REGION_LOCAL(m_input_cache_lock);
+      if (generation == m_input_cache_generation)
+        m_input_cache.insert(std::make_pair(txid, std::make_tuple(ret, tvc, max_used_block_height, max_used_block_id)));
+    }
     return ret;
   }
   //---------------------------------------------------------------------------------
@@ -1552,18 +1874,18 @@ namespace cryptonote
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
     size_t tx_weight_limit = get_transaction_weight_limit(version);
-    std::unordered_set<crypto::hash> remove;
+    std::unordered_map<crypto::hash, txpool_tx_meta_t> remove;
 
     m_txpool_weight = 0;
     m_blockchain.for_all_txpool_txes([this, &remove, tx_weight_limit](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata_ref*) {
       m_txpool_weight += meta.weight;
       if (meta.weight > tx_weight_limit) {
         LOG_PRINT_L1("Transaction " << txid << " is too big (" << meta.weight << " bytes), removing it from pool");
-        remove.insert(txid);
+        remove.insert(std::make_pair(txid, meta));
       }
       else if (m_blockchain.have_tx(txid)) {
         LOG_PRINT_L1("Transaction " << txid << " is in the blockchain, removing it from pool");
-        remove.insert(txid);
+        remove.insert(std::make_pair(txid, meta));
       }
       return true;
     }, false, relay_category::all);
@@ -1572,8 +1894,9 @@ namespace cryptonote
     if (!remove.empty())
     {
       LockedTXN lock(m_blockchain.get_db());
-      for (const crypto::hash &txid: remove)
+      for (const auto &entry: remove)
       {
+        const crypto::hash &txid = entry.first;
         try
         {
           cryptonote::blobdata txblob = m_blockchain.get_txpool_tx_blob(txid, relay_category::all);
@@ -1587,7 +1910,7 @@ namespace cryptonote
           m_blockchain.remove_txpool_tx(txid);
           m_txpool_weight -= get_transaction_weight(tx, txblob.size());
           remove_transaction_keyimages(tx, txid);
-          auto sorted_it = find_tx_in_sorted_container(txid);
+          auto sorted_it = find_tx_in_sorted_container(txid, entry.second);
           if (sorted_it == m_txs_by_fee_and_receive_time.end())
           {
             LOG_PRINT_L1("Removing tx " << txid << " from tx pool, but it was not found in the sorted txs container!");
@@ -1611,14 +1934,16 @@ namespace cryptonote
     return n_removed;
   }
   //---------------------------------------------------------------------------------
-  bool tx_memory_pool::init(size_t max_txpool_weight, bool mine_stem_txes)
+  bool tx_memory_pool::init(size_t max_txpool_weight, bool mine_stem_txes, size_t max_txpool_memory)
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
 
     m_txpool_max_weight = max_txpool_weight ? max_txpool_weight : DEFAULT_TXPOOL_MAX_WEIGHT;
+    m_txpool_max_memory = max_txpool_memory;
     m_txs_by_fee_and_receive_time.clear();
     m_spent_key_images.clear();
+    m_spent_key_images_memory = 0;
     m_txpool_weight = 0;
     std::vector<crypto::hash> remove;
 
@@ -1642,9 +1967,7 @@ namespace cryptonote
           MFATAL("Failed to insert key images from txpool tx");
           return false;
         }
-        // Rounding tx fee/blob_size ratio so that txs with the same priority would be sorted by receive_time
-        uint32_t fee_per_size_ratio = (uint32_t)(meta.fee / (double)(meta.weight ? meta.weight : 1));
-        m_txs_by_fee_and_receive_time.emplace(std::pair<uint32_t, std::time_t>(fee_per_size_ratio, meta.receive_time), txid);
+        m_txs_by_fee_and_receive_time.emplace(get_sorted_tx_entry(txid, meta.fee, meta.weight, meta.receive_time));
         m_txpool_weight += meta.weight;
         return true;
       }, true, relay_category::all);
@@ -73,14 +73,26 @@ namespace cryptonote
       else if (a.first.first < b.first.first) return false;
       else if (a.first.second < b.first.second) return true;
       else if (a.first.second > b.first.second) return false;
-      else if (a.second != b.second) return true;
-      else return false;
+      // strict ordering on the id so entries can be looked up in O(log n)
+      else return memcmp(a.second.data, b.second.data, sizeof(a.second.data)) < 0;
     }
   };
 
   //! container for sorting transactions by fee per unit size
   typedef std::set<tx_by_fee_and_receive_time_entry, txCompare> sorted_tx_container;
 
+  //! estimated heap usage of the pool side containers, in bytes
+  struct txpool_memory_usage
+  {
+    uint64_t sorted_txes; //!< m_txs_by_fee_and_receive_time
+    uint64_t key_images; //!< m_spent_key_images and their txid sets
+    uint64_t input_cache; //!< m_input_cache
+    uint64_t parsed_tx_cache; //!< m_parsed_tx_cache, including the parsed transactions
+    uint64_t timed_out; //!< m_timed_out_transactions
+
+    uint64_t total() const { return sorted_txes + key_images + input_cache + parsed_tx_cache + timed_out; }
+  };
+
   /**
    * @brief Transaction pool, handles transactions which are not part of a block
    *
@@ -129,10 +141,42 @@ namespace cryptonote
      * @param relayed was this transaction from the network or a local client?
      * @param version the version used to create the transaction
      *
+     * The transaction is verified without holding the pool lock, which is
+     * only taken to check for conflicting key images and to insert it, so
+     * this may be called from several threads at once.
+     *
      * @return true if the transaction passes validations, otherwise false
      */
     bool add_tx(transaction &tx, tx_verification_context& tvc, relay_method tx_relay, bool relayed, uint8_t version);
 
+    /**
+     * @brief a transaction to be added to the pool by add_txs
+     */
+    struct tx_to_add
+    {
+      transaction *tx;  //!< the transaction to be added
+      crypto::hash id;  //!< the transaction's hash
+      const cryptonote::blobdata *blob;  //!< the transaction as a blob
+      size_t weight;  //!< the transaction's weight
+      tx_verification_context *tvc;  //!< return-by-pointer status about the transaction verification
+      bool result;  //!< set to what add_tx would have returned for this transaction
+    };
+
+    /**
+     * @brief add a set of transactions received together to the pool
+     *
+     * This gives the same results as calling add_tx on each transaction,
+     * but the ring members of all the transactions are read from the
+     * database at once, their signatures are verified in parallel, and
+     * those that pass are added to the pool in a single db transaction.
+     *
+     * @param txs the transactions to add, results are set in place
+     * @param tx_relay how the transactions were received
+     * @param relayed were these transactions from the network or a local client?
+     * @param version the version used to create the transactions
+     */
+    void add_txs(std::vector<tx_to_add> &txs, relay_method tx_relay, bool relayed, uint8_t version);
+
     /**
      * @brief takes a transaction with the given hash from the pool
      *
@@ -208,10 +252,11 @@ namespace cryptonote
      *
      * @param max_txpool_weight the max weight in bytes
      * @param mine_stem_txes whether to mine txes in stem relay mode
+     * @param max_txpool_memory the max memory used by the pool containers in bytes, 0 for no limit
      *
      * @return true
      */
-    bool init(size_t max_txpool_weight = 0, bool mine_stem_txes = false);
+    bool init(size_t max_txpool_weight = 0, bool mine_stem_txes = false, size_t max_txpool_memory = 0);
 
     /**
      * @brief attempts to save the transaction pool state to disk
@@ -398,6 +443,20 @@ namespace cryptonote
      */
     void set_txpool_max_weight(size_t bytes);
 
+    /**
+     * @brief get the estimated memory used by the pool containers
+     *
+     * @return the memory usage, per container
+     */
+    txpool_memory_usage get_txpool_memory_usage() const;
+
+    /**
+     * @brief set the max memory used by the pool containers in bytes
+     *
+     * @param bytes the max memory in bytes, 0 for no limit
+     */
+    void set_txpool_max_memory(size_t bytes);
+
 #define CURRENT_MEMPOOL_ARCHIVE_VER    11
 #define CURRENT_MEMPOOL_TX_DETAILS_ARCHIVE_VER    13
 
@@ -454,6 +513,28 @@ namespace cryptonote
 
   private:
 
+    /**
+     * @brief checks which do not depend on the transaction's inputs
+     *
+     * These are cheap, and are done before verifying the inputs.
+     *
+     * @return true if the transaction may be added to the pool, otherwise false
+     */
+    bool check_tx_for_pool(transaction &tx, const crypto::hash &id, size_t tx_weight, tx_verification_context& tvc, bool kept_by_block, uint8_t version);
+
+    /**
+     * @brief adds a transaction whose inputs have been checked to the pool
+     *
+     * Key images are checked again against the pool, and against the chain
+     * if its top changed since the inputs were checked.
+     *
+     * @param ch_inp_res the result of checking the transaction's inputs
+     * @param verified_top_id the top block hash when the inputs were checked
+     *
+     * @return true if the transaction was added or was already in the pool, otherwise false
+     */
+    bool add_verified_tx(transaction &tx, const crypto::hash &id, const cryptonote::blobdata &blob, size_t tx_weight, tx_verification_context& tvc, relay_method tx_relay, bool relayed, bool ch_inp_res, uint64_t max_used_block_height, const crypto::hash &max_used_block_id, const crypto::hash &verified_top_id);
+
     /**
      * @brief insert key images into m_spent_key_images
      *
@@ -552,9 +633,19 @@ namespace cryptonote
      * @brief prune lowest fee/byte txes till we're not above bytes
      *
      * if bytes is 0, use m_txpool_max_weight
+     * Txes are also pruned till the pool containers fit in m_txpool_max_memory,
+     * after dropping cached results of failed verifications. The memory a tx
+     * frees is estimated as the average per tx, so the txes to prune are picked
+     * once and erased together.
      */
     void prune(size_t bytes = 0);
 
+    //! get the memory usage, the pool lock must be held
+    txpool_memory_usage get_memory_usage_locked() const;
+
+    //! add a parsed tx to m_parsed_tx_cache and account for it
+    void cache_parsed_tx(const crypto::hash &id, const transaction &tx);
+
     //TODO: confirm the below comments and investigate whether or not this
     //      is the desired behavior
     //! map key images to transactions which spent them
@@ -591,10 +682,11 @@ private:
      * @brief get an iterator to a transaction in the sorted container
      *
      * @param id the hash of the transaction to look for
+     * @param meta the txpool metadata of the transaction, used to build its sort key
      *
      * @return an iterator, possibly to the end of the container if not found
      */
-    sorted_tx_container::iterator find_tx_in_sorted_container(const crypto::hash& id) const;
+    sorted_tx_container::iterator find_tx_in_sorted_container(const crypto::hash& id, const txpool_tx_meta_t &meta) const;
 
     //! cache/call Blockchain::check_tx_inputs results
     bool check_tx_inputs(const std::function<cryptonote::transaction&(void)> &get_tx, const crypto::hash &txid, uint64_t &max_used_block_height, crypto::hash &max_used_block_id, tx_verification_context &tvc, bool kept_by_block = false) const;
@@ -609,11 +701,17 @@ private:
 
     size_t m_txpool_max_weight;
     size_t m_txpool_weight;
+    size_t m_txpool_max_memory;  //!< max memory of the pool containers, 0 for no limit
+    uint64_t m_num_pruned;  //!< number of txes pruned to honor the weight and memory limits
     bool m_mine_stem_txes;
 
     mutable std::unordered_map<crypto::hash, std::tuple<bool, tx_verification_context, uint64_t, crypto::hash>> m_input_cache;
+    mutable epee::critical_section m_input_cache_lock;  //!< lock for m_input_cache, which is used outside of m_transactions_lock
+    uint64_t m_input_cache_generation;  //!< incremented each time m_input_cache is cleared
 
     std::unordered_map<crypto::hash, transaction> m_parsed_tx_cache;
+    uint64_t m_parsed_tx_cache_memory;  //!< heap usage of the transactions in m_parsed_tx_cache
+    uint64_t m_spent_key_images_memory;  //!< heap usage of the txid sets in m_spent_key_images
 
     //! Next timestamp that a DB check for relayable txes is allowed
     std::atomic<time_t> m_next_check;
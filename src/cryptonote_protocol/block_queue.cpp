@@ -295,6 +295,12 @@ std::pair<uint64_t, uint64_t> block_queue::reserve_span(uint64_t first_block_hei
       MDEBUG("Stopping at " << span_start_height + span_length << " for peer on stripe " << tools::get_pruning_stripe(pruning_seed) << " as we need full data for " << tools::get_pruning_stripe(local_pruning_seed));
       break;
     }
+    // if we need full data, only give the peer what it actually has unpruned
+    if (sync_pruned_blocks && !first_is_pruned && !tools::has_unpruned_block(span_start_height + span_length, blockchain_height, pruning_seed))
+    {
+      MDEBUG("Stopping at " << span_start_height + span_length << " as peer on stripe " << tools::get_pruning_stripe(pruning_seed) << " does not have full data for it");
+      break;
+    }
     hashes.push_back((*i).first);
     ++i;
     ++span_length;
@@ -0,0 +1,216 @@
+// Copyright (c) 2014-2021, The Monero Project
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "block_response_cache.h"
+
+#include <boost/thread/lock_guard.hpp>
+#include <cstring>
+
+#include "cryptonote_protocol_defs.h"
+#include "int-util.h"
+#include "storages/portable_storage_template_helper.h"
+#include "storages/portable_storage_to_bin.h"
+
+namespace cryptonote
+{
+namespace
+{
+  // sizeof(portable_storage::storage_block_header), which is private
+  constexpr const std::size_t storage_header_size = sizeof(std::uint32_t) * 2 + sizeof(std::uint8_t);
+
+  template<typename T>
+  void write_pod(epee::byte_stream& out, const T value)
+  {
+    out.write(reinterpret_cast<const char*>(std::addressof(value)), sizeof(value));
+  }
+
+  void write_field(epee::byte_stream& out, const char* name, const std::uint8_t type)
+  {
+    const std::uint8_t length = std::strlen(name);
+    write_pod(out, length);
+    out.write(name, length);
+    write_pod(out, type);
+  }
+
+  std::uint64_t blob_bytes(const blobdata& block, const std::vector<blobdata>& txs) noexcept
+  {
+    std::uint64_t bytes = block.size();
+    for (const blobdata& tx : txs)
+      bytes += tx.size();
+    return bytes;
+  }
+}
+
+  block_response_cache::block_response_cache()
+    : m_lock(), m_blocks(), m_top(crypto::null_hash), m_bytes(0)
+  {}
+
+  crypto::hash block_response_cache::top() const
+  {
+    boost::lock_guard<boost::mutex> lock{m_lock};
+    return m_top;
+  }
+
+  void block_response_cache::set_chain(const crypto::hash& top, const std::vector<crypto::hash>& ids)
+  {
+    std::unordered_map<crypto::hash, entry> blocks;
+    blocks.reserve(ids.size());
+
+    boost::lock_guard<boost::mutex> lock{m_lock};
+    m_bytes = 0;
+    for (const crypto::hash& id : ids)
+    {
+      entry& next = blocks[id];
+      const auto old = m_blocks.find(id);
+      if (old != m_blocks.end())
+      {
+        next = std::move(old->second);
+        m_bytes += next.pruned.size() + next.full.size() + blob_bytes(next.block, next.txs);
+      }
+    }
+    m_blocks.swap(blocks);
+    m_top = top;
+  }
+
+  bool block_response_cache::get_sections(const std::vector<crypto::hash>& ids, const bool pruned, std::vector<epee::byte_slice>& out) const
+  {
+    out.clear();
+    out.reserve(ids.size());
+
+    boost::lock_guard<boost::mutex> lock{m_lock};
+    for (const crypto::hash& id : ids)
+    {
+      const auto cached = m_blocks.find(id);
+      if (cached == m_blocks.end())
+        return false;
+      const epee::byte_slice& section = pruned ? cached->second.pruned : cached->second.full;
+      if (section.empty())
+        return false;
+      out.push_back(section.clone());
+    }
+    return true;
+  }
+
+  bool block_response_cache::get_blobs(const crypto::hash& id, blobdata& block, std::vector<blobdata>& txs) const
+  {
+    boost::lock_guard<boost::mutex> lock{m_lock};
+    const auto cached = m_blocks.find(id);
+    if (cached == m_blocks.end() || cached->second.full.empty())
+      return false;
+    block = cached->second.block;
+    txs = cached->second.txs;
+    return true;
+  }
+
+  epee::byte_slice block_response_cache::add(const crypto::hash& id, const block_complete_entry& bce)
+  {
+    {
+      boost::lock_guard<boost::mutex> lock{m_lock};
+      const auto cached = m_blocks.find(id);
+      if (cached != m_blocks.end())
+      {
+        const epee::byte_slice& section = bce.pruned ? cached->second.pruned : cached->second.full;
+        if (!section.empty())
+          return section.clone();
+      }
+    }
+
+    // serialize without the lock, the window may move meanwhile
+    epee::byte_slice section = serialize_section(bce);
+    if (section.empty())
+      return section;
+
+    boost::lock_guard<boost::mutex> lock{m_lock};
+    const auto cached = m_blocks.find(id);
+    if (cached == m_blocks.end())
+      return section;
+
+    entry& e = cached->second;
+    epee::byte_slice& slot = bce.pruned ? e.pruned : e.full;
+    if (!slot.empty())
+      return section;
+
+    slot = section.clone();
+    m_bytes += section.size();
+    if (!bce.pruned)
+    {
+      e.block = bce.block;
+      e.txs.clear();
+      e.txs.reserve(bce.txs.size());
+      for (const tx_blob_entry& tx : bce.txs)
+        e.txs.push_back(tx.blob);
+      m_bytes += blob_bytes(e.block, e.txs);
+    }
+    return section;
+  }
+
+  std::uint64_t block_response_cache::size() const
+  {
+    boost::lock_guard<boost::mutex> lock{m_lock};
+    return m_bytes;
+  }
+
+  epee::byte_slice block_response_cache::serialize_section(const block_complete_entry& bce)
+  {
+    std::size_t reserve = storage_header_size + bce.block.size() + 256;
+    for (const tx_blob_entry& tx : bce.txs)
+      reserve += tx.blob.size() + 64;
+
+    epee::byte_slice section;
+    if (!epee::serialization::store_t_to_binary(bce, section, reserve))
+      return nullptr;
+    section.remove_prefix(storage_header_size);
+    return section;
+  }
+
+  void block_response_cache::write_get_objects(epee::byte_stream& out, const epee::span<const epee::byte_slice> blocks, const std::vector<crypto::hash>& missed_ids, const std::uint64_t current_blockchain_height)
+  {
+    write_pod(out, std::uint32_t(SWAP32LE(PORTABLE_STORAGE_SIGNATUREA)));
+    write_pod(out, std::uint32_t(SWAP32LE(PORTABLE_STORAGE_SIGNATUREB)));
+    write_pod(out, std::uint8_t(PORTABLE_STORAGE_FORMAT_VER));
+
+    // fields in the sorted order of a portable storage section, empty containers are not stored
+    epee::serialization::pack_varint(out, 1 + !blocks.empty() + !missed_ids.empty());
+    if (!blocks.empty())
+    {
+      write_field(out, "blocks", SERIALIZE_TYPE_OBJECT | SERIALIZE_FLAG_ARRAY);
+      epee::serialization::pack_varint(out, blocks.size());
+      for (const epee::byte_slice& section : blocks)
+        out.write(epee::to_span(section));
+    }
+
+    write_field(out, "current_blockchain_height", SERIALIZE_TYPE_UINT64);
+    write_pod(out, std::uint64_t(SWAP64LE(current_blockchain_height)));
+
+    if (!missed_ids.empty())
+    {
+      write_field(out, "missed_ids", SERIALIZE_TYPE_STRING);
+      epee::serialization::pack_varint(out, missed_ids.size() * sizeof(crypto::hash));
+      out.write(reinterpret_cast<const char*>(missed_ids.data()), missed_ids.size() * sizeof(crypto::hash));
+    }
+  }
+}
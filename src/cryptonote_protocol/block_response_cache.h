@@ -0,0 +1,97 @@
+// Copyright (c) 2014-2021, The Monero Project
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <boost/thread/mutex.hpp>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "byte_slice.h"
+#include "byte_stream.h"
+#include "crypto/hash.h"
+#include "cryptonote_basic/blobdatatype.h"
+#include "span.h"
+
+namespace cryptonote
+{
+  struct block_complete_entry;
+
+  /*! Serialized `block_complete_entry` sections of the blocks at the top of
+      the main chain, shared by every peer asking for them with
+      `NOTIFY_REQUEST_GET_OBJECTS`. The window is moved with `set_chain` when
+      the top changes, which also drops blocks that were reorganized away. */
+  class block_response_cache
+  {
+    struct entry
+    {
+      epee::byte_slice pruned;
+      epee::byte_slice full;
+      blobdata block;              //!< only set with `full`
+      std::vector<blobdata> txs;   //!< unpruned, only set with `full`
+    };
+
+    mutable boost::mutex m_lock;
+    std::unordered_map<crypto::hash, entry> m_blocks;
+    crypto::hash m_top;
+    std::uint64_t m_bytes;
+
+  public:
+    block_response_cache();
+
+    //! \return Id of the block the window currently ends at.
+    crypto::hash top() const;
+
+    //! Move the window to main chain `ids` ending at `top`, dropping blocks that left it.
+    void set_chain(const crypto::hash& top, const std::vector<crypto::hash>& ids);
+
+    /*! \return True and every section of `ids` in `out` if all of them are
+        cached in the `pruned` variant. */
+    bool get_sections(const std::vector<crypto::hash>& ids, bool pruned, std::vector<epee::byte_slice>& out) const;
+
+    //! \return True if the unpruned block and tx blobs of `id` are cached.
+    bool get_blobs(const crypto::hash& id, blobdata& block, std::vector<blobdata>& txs) const;
+
+    /*! Serialize `bce`, keeping the result when `id` is in the window. An
+        already cached section is returned without serializing again.
+
+        \return Serialized section of `bce`. */
+    epee::byte_slice add(const crypto::hash& id, const block_complete_entry& bce);
+
+    //! \return Bytes held by cached sections and blobs.
+    std::uint64_t size() const;
+
+    //! \return `bce` in portable storage format without the storage header.
+    static epee::byte_slice serialize_section(const block_complete_entry& bce);
+
+    /*! Write a portable storage `NOTIFY_RESPONSE_GET_OBJECTS::request` around
+        already serialized block sections. The output is identical to
+        `store_t_to_binary` on the equivalent struct. */
+    static void write_get_objects(epee::byte_stream& out, epee::span<const epee::byte_slice> blocks, const std::vector<crypto::hash>& missed_ids, std::uint64_t current_blockchain_height);
+  };
+}
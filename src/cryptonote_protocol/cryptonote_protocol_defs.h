@@ -87,6 +87,13 @@ namespace cryptonote
 
     uint8_t address_type;
 
+    // levin bodies sent/received zstd compressed, before and after compression
+    uint64_t compressed_raw_out;
+    uint64_t compressed_wire_out;
+    uint64_t compressed_raw_in;
+    uint64_t compressed_wire_in;
+    uint64_t compression_time_us;
+
     BEGIN_KV_SERIALIZE_MAP()
       KV_SERIALIZE(incoming)
       KV_SERIALIZE(localhost)
@@ -113,6 +120,11 @@ namespace cryptonote
       KV_SERIALIZE(height)
       KV_SERIALIZE(pruning_seed)
       KV_SERIALIZE(address_type)
+      KV_SERIALIZE_OPT(compressed_raw_out, (uint64_t)0)
+      KV_SERIALIZE_OPT(compressed_wire_out, (uint64_t)0)
+      KV_SERIALIZE_OPT(compressed_raw_in, (uint64_t)0)
+      KV_SERIALIZE_OPT(compressed_wire_in, (uint64_t)0)
+      KV_SERIALIZE_OPT(compression_time_us, (uint64_t)0)
     END_KV_SERIALIZE_MAP()
   };
 
@@ -377,4 +389,104 @@ namespace cryptonote
     typedef epee::misc_utils::struct_init<request_t> request;
   };
 
+  /************************************************************************/
+  /*                                                                      */
+  /************************************************************************/
+  struct NOTIFY_REQUEST_BLOCK_HEADERS
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 11;
+
+    struct request_t
+    {
+      uint64_t start_height;
+      std::vector<crypto::hash> blocks;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(start_height)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(blocks)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<request_t> request;
+  };
+
+  /************************************************************************/
+  /*                                                                      */
+  /************************************************************************/
+  struct NOTIFY_RESPONSE_BLOCK_HEADERS
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 12;
+
+    struct request_t
+    {
+      uint64_t start_height;
+      std::vector<blobdata> headers; // block hashing blobs, in chain order
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(start_height)
+        KV_SERIALIZE(headers)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<request_t> request;
+  };
+
+  /************************************************************************/
+  /*                                                                      */
+  /************************************************************************/
+  struct NOTIFY_REQUEST_TX_RECONCILIATION
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 13;
+
+    struct request_t
+    {
+      uint64_t salt;
+      uint64_t set_size;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(salt)
+        KV_SERIALIZE(set_size)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<request_t> request;
+  };
+
+  /************************************************************************/
+  /*                                                                      */
+  /************************************************************************/
+  struct NOTIFY_RESPONSE_TX_RECONCILIATION
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 14;
+
+    struct request_t
+    {
+      std::string sketch; // empty when the sets are too far apart to reconcile
+      uint64_t set_size;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(sketch)
+        KV_SERIALIZE(set_size)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<request_t> request;
+  };
+
+  /************************************************************************/
+  /*                                                                      */
+  /************************************************************************/
+  struct NOTIFY_TX_RECONCILIATION_DIFF
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 15;
+
+    struct request_t
+    {
+      std::vector<uint64_t> short_ids; // txs the sender is missing
+      bool flood; // reconciliation failed, send every tx of the round
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(short_ids)
+        KV_SERIALIZE_OPT(flood, false)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<request_t> request;
+  };
+
 }
@@ -45,6 +45,7 @@
 #include "cryptonote_protocol_defs.h"
 #include "cryptonote_protocol_handler_common.h"
 #include "block_queue.h"
+#include "block_response_cache.h"
 #include "common/perf_timer.h"
 #include "cryptonote_basic/connection_context.h"
 #include "net/levin_base.h"
@@ -94,6 +95,11 @@ namespace cryptonote
       HANDLE_NOTIFY_T2(NOTIFY_NEW_FLUFFY_BLOCK, &cryptonote_protocol_handler::handle_notify_new_fluffy_block)
       HANDLE_NOTIFY_T2(NOTIFY_REQUEST_FLUFFY_MISSING_TX, &cryptonote_protocol_handler::handle_request_fluffy_missing_tx)
       HANDLE_NOTIFY_T2(NOTIFY_GET_TXPOOL_COMPLEMENT, &cryptonote_protocol_handler::handle_notify_get_txpool_complement)
+      HANDLE_NOTIFY_T2(NOTIFY_REQUEST_BLOCK_HEADERS, &cryptonote_protocol_handler::handle_request_block_headers)
+      HANDLE_NOTIFY_T2(NOTIFY_RESPONSE_BLOCK_HEADERS, &cryptonote_protocol_handler::handle_response_block_headers)
+      HANDLE_NOTIFY_T2(NOTIFY_REQUEST_TX_RECONCILIATION, &cryptonote_protocol_handler::handle_request_tx_reconciliation)
+      HANDLE_NOTIFY_T2(NOTIFY_RESPONSE_TX_RECONCILIATION, &cryptonote_protocol_handler::handle_response_tx_reconciliation)
+      HANDLE_NOTIFY_T2(NOTIFY_TX_RECONCILIATION_DIFF, &cryptonote_protocol_handler::handle_tx_reconciliation_diff)
     END_INVOKE_MAP2()
 
     bool on_idle();
@@ -120,6 +126,13 @@ namespace cryptonote
     bool needs_new_sync_connections() const;
     bool is_busy_syncing();
 
+    //! record the round trip time of a ping to the peer, the p2p timed syncs serve as one
+    static void update_rtt(cryptonote_connection_context& context, const boost::posix_time::time_duration &rtt);
+    //! record the time a span of nblocks blocks and size bytes took to arrive from the peer
+    static void update_span_stats(cryptonote_connection_context& context, const boost::posix_time::time_duration &dt, size_t size, size_t nblocks);
+    //! number of blocks to ask the peer for so they arrive in SPAN_TARGET_DELIVERY_TIME, default_count until it was measured
+    static size_t get_adaptive_span_size(const cryptonote_connection_context& context, size_t default_count);
+
   private:
     //----------------- commands handlers ----------------------------------------------
     int handle_notify_new_block(int command, NOTIFY_NEW_BLOCK::request& arg, cryptonote_connection_context& context);
@@ -131,6 +144,11 @@ namespace cryptonote
     int handle_notify_new_fluffy_block(int command, NOTIFY_NEW_FLUFFY_BLOCK::request& arg, cryptonote_connection_context& context);
     int handle_request_fluffy_missing_tx(int command, NOTIFY_REQUEST_FLUFFY_MISSING_TX::request& arg, cryptonote_connection_context& context);
     int handle_notify_get_txpool_complement(int command, NOTIFY_GET_TXPOOL_COMPLEMENT::request& arg, cryptonote_connection_context& context);
+    int handle_request_block_headers(int command, NOTIFY_REQUEST_BLOCK_HEADERS::request& arg, cryptonote_connection_context& context);
+    int handle_response_block_headers(int command, NOTIFY_RESPONSE_BLOCK_HEADERS::request& arg, cryptonote_connection_context& context);
+    int handle_request_tx_reconciliation(int command, NOTIFY_REQUEST_TX_RECONCILIATION::request& arg, cryptonote_connection_context& context);
+    int handle_response_tx_reconciliation(int command, NOTIFY_RESPONSE_TX_RECONCILIATION::request& arg, cryptonote_connection_context& context);
+    int handle_tx_reconciliation_diff(int command, NOTIFY_TX_RECONCILIATION_DIFF::request& arg, cryptonote_connection_context& context);
 
     //----------------- i_bc_protocol_layout ---------------------------------------
     virtual bool relay_block(NOTIFY_NEW_BLOCK::request& arg, cryptonote_connection_context& exclude_context);
@@ -139,10 +157,14 @@ namespace cryptonote
     //bool get_payload_sync_data(HANDSHAKE_DATA::request& hshd, cryptonote_connection_context& context);
     bool should_drop_connection(cryptonote_connection_context& context, uint32_t next_stripe);
     bool request_missing_objects(cryptonote_connection_context& context, bool check_having_blocks, bool force_next_span = false);
+    bool request_block_headers(cryptonote_connection_context& context);
+    bool wait_for_verified_headers(uint64_t height);
     size_t get_synchronizing_connections_count();
     bool on_connection_synchronized();
     bool should_download_next_span(cryptonote_connection_context& context, bool standby);
+    size_t get_span_size(const cryptonote_connection_context& context) const;
     bool should_ask_for_pruned_data(cryptonote_connection_context& context, uint64_t first_block_height, uint64_t nblocks, bool check_block_weights) const;
+    std::vector<unsigned int> get_stripe_peer_counts() const;
     void drop_connection(cryptonote_connection_context &context, bool add_fail, bool flush_all_spans);
     void drop_connection_with_score(cryptonote_connection_context &context, uint64_t score, bool flush_all_spans);
     void drop_connections(const epee::net_utils::network_address address);
@@ -153,6 +175,9 @@ namespace cryptonote
     void notify_new_stripe(cryptonote_connection_context &context, uint32_t stripe);
     size_t skip_unneeded_hashes(cryptonote_connection_context& context, bool check_block_queue) const;
     bool request_txpool_complement(cryptonote_connection_context &context);
+    bool reconcile_txs();
+    bool get_reconciled_txs(const std::vector<crypto::hash>& txids, NOTIFY_NEW_TRANSACTIONS::request& arg);
+    void sync_block_response_cache();
     void hit_score(cryptonote_connection_context &context, int32_t score);
 
     t_core& m_core;
@@ -166,10 +191,12 @@ namespace cryptonote
     std::atomic<bool> m_ask_for_txpool_complement;
     boost::mutex m_sync_lock;
     block_queue m_block_queue;
+    block_response_cache m_block_response_cache;
     epee::math_helper::once_a_time_seconds<8> m_idle_peer_kicker;
     epee::math_helper::once_a_time_milliseconds<100> m_standby_checker;
     epee::math_helper::once_a_time_seconds<101> m_sync_search_checker;
     epee::math_helper::once_a_time_seconds<43> m_bad_peer_checker;
+    epee::math_helper::once_a_time_seconds<CRYPTONOTE_TX_RECONCILIATION_INTERVAL> m_tx_reconciler;
     std::atomic<unsigned int> m_max_out_peers;
     tools::PerformanceTimer m_sync_timer, m_add_timer;
     uint64_t m_last_add_end_time;
@@ -177,6 +204,7 @@ namespace cryptonote
     uint64_t m_sync_download_chain_size, m_sync_download_objects_size;
     size_t m_block_download_max_size;
     bool m_sync_pruned_blocks;
+    bool m_tx_reconciliation;
 
     boost::mutex m_buffer_mutex;
     double get_avg_block_size();
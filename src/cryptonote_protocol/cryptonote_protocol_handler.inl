@@ -38,6 +38,7 @@
 
 #include <boost/interprocess/detail/atomic.hpp>
 #include <list>
+#include <numeric>
 #include <ctime>
 #include <string>
 #include <iostream>
@@ -46,6 +47,7 @@
 #include "profile_tools.h"
 #include "net/network_throttle-detail.hpp"
 #include "common/pruning.h"
+#include "cryptonote_protocol/tx_reconciliation.h"
 
 #undef MONERO_DEFAULT_LOG_CATEGORY
 #define MONERO_DEFAULT_LOG_CATEGORY "net.cn"
@@ -74,6 +76,9 @@
 #define NON_RESPONSIVE_PEER_KICK_TIME (20 * 1000000) // microseconds
 #define DROP_ON_SYNC_WEDGE_THRESHOLD (30 * 1000000000ull) // nanoseconds
 #define LAST_ACTIVITY_STALL_THRESHOLD (2.0f) // seconds
+#define SPAN_TARGET_DELIVERY_TIME (3.0f) // seconds
+#define BOTTLENECK_SPAN_SPEEDUP (2.0f) // how much sooner we must expect to get a stalled next span to ask for it too
+#define PEER_STATS_SMOOTHING (0.25f) // weight of the latest measurement
 #define DROP_PEERS_ON_SCORE -2
 
 namespace cryptonote
@@ -112,6 +117,7 @@ namespace cryptonote
 
     m_block_download_max_size = command_line::get_arg(vm, cryptonote::arg_block_download_max_size);
     m_sync_pruned_blocks = command_line::get_arg(vm, cryptonote::arg_sync_pruned_blocks);
+    m_tx_reconciliation = command_line::get_arg(vm, cryptonote::arg_tx_reconciliation);
 
     return true;
   }
@@ -325,6 +331,12 @@ namespace cryptonote
       cnx.pruning_seed = cntxt.m_pruning_seed;
       cnx.address_type = (uint8_t)cntxt.m_remote_address.get_type_id();
 
+      cnx.compressed_raw_out = cntxt.m_compression.raw_out;
+      cnx.compressed_wire_out = cntxt.m_compression.wire_out;
+      cnx.compressed_raw_in = cntxt.m_compression.raw_in;
+      cnx.compressed_wire_in = cntxt.m_compression.wire_in;
+      cnx.compression_time_us = cntxt.m_compression.compress_us + cntxt.m_compression.decompress_us;
+
       connections.push_back(cnx);
 
       return true;
@@ -847,41 +859,50 @@ namespace cryptonote
       return 1;
     }
 
-    std::vector<std::pair<cryptonote::blobdata, block>> local_blocks;
-    std::vector<cryptonote::blobdata> local_txs;
+    // the block was most likely just relayed by us, so its blobs are cached
+    sync_block_response_cache();
+    NOTIFY_NEW_FLUFFY_BLOCK::request fluffy_response;
+    fluffy_response.current_blockchain_height = arg.current_blockchain_height;
+    std::vector<cryptonote::blobdata> cached_txs;
+    const bool cached = m_block_response_cache.get_blobs(arg.block_hash, fluffy_response.b.block, cached_txs);
 
     block b;
-    if (!m_core.get_block_by_hash(arg.block_hash, b))
+    if (!cached)
     {
-      LOG_ERROR_CCONTEXT("failed to find block: " << arg.block_hash << ", dropping connection");
-      drop_connection(context, false, false);
-      return 1;
+      if (!m_core.get_block_by_hash(arg.block_hash, b))
+      {
+        LOG_ERROR_CCONTEXT("failed to find block: " << arg.block_hash << ", dropping connection");
+        drop_connection(context, false, false);
+        return 1;
+      }
+      fluffy_response.b.block = t_serializable_object_to_blob(b);
     }
 
+    const size_t tx_count = cached ? cached_txs.size() : b.tx_hashes.size();
     std::vector<crypto::hash> txids;
-    NOTIFY_NEW_FLUFFY_BLOCK::request fluffy_response;
-    fluffy_response.b.block = t_serializable_object_to_blob(b);
-    fluffy_response.current_blockchain_height = arg.current_blockchain_height;
-    std::vector<bool> seen(b.tx_hashes.size(), false);
+    std::vector<bool> seen(tx_count, false);
     for(auto& tx_idx: arg.missing_tx_indices)
     {
-      if(tx_idx < b.tx_hashes.size())
+      if(tx_idx < tx_count)
       {
-        MDEBUG("  tx " << b.tx_hashes[tx_idx]);
+        MDEBUG("  tx index " << tx_idx);
         if (seen[tx_idx])
         {
           LOG_ERROR_CCONTEXT
           (
             "Failed to handle request NOTIFY_REQUEST_FLUFFY_MISSING_TX"
             << ", request is asking for duplicate tx "
-            << ", tx index = " << tx_idx << ", block tx count " << b.tx_hashes.size()
+            << ", tx index = " << tx_idx << ", block tx count " << tx_count
             << ", block_height = " << arg.current_blockchain_height
             << ", dropping connection"
           );
           drop_connection(context, true, false);
           return 1;
         }
-        txids.push_back(b.tx_hashes[tx_idx]);
+        if (cached)
+          fluffy_response.b.txs.push_back({cached_txs[tx_idx], crypto::null_hash});
+        else
+          txids.push_back(b.tx_hashes[tx_idx]);
         seen[tx_idx] = true;
       }
       else
@@ -890,7 +911,7 @@ namespace cryptonote
         (
           "Failed to handle request NOTIFY_REQUEST_FLUFFY_MISSING_TX"
           << ", request is asking for a tx whose index is out of bounds "
-          << ", tx index = " << tx_idx << ", block tx count " << b.tx_hashes.size()
+          << ", tx index = " << tx_idx << ", block tx count " << tx_count
           << ", block_height = " << arg.current_blockchain_height
           << ", dropping connection"
         );
@@ -900,26 +921,29 @@ namespace cryptonote
       }
     }
 
-    std::vector<cryptonote::transaction> txs;
-    std::vector<crypto::hash> missed;
-    if (!m_core.get_transactions(txids, txs, missed))
-    {
-      LOG_ERROR_CCONTEXT("Failed to handle request NOTIFY_REQUEST_FLUFFY_MISSING_TX, "
-        << "failed to get requested transactions");
-      drop_connection(context, false, false);
-      return 1;
-    }
-    if (!missed.empty() || txs.size() != txids.size())
+    if (!cached)
     {
-      LOG_ERROR_CCONTEXT("Failed to handle request NOTIFY_REQUEST_FLUFFY_MISSING_TX, "
-        << missed.size() << " requested transactions not found" << ", dropping connection");
-      drop_connection(context, false, false);
-      return 1;
-    }
+      std::vector<cryptonote::transaction> txs;
+      std::vector<crypto::hash> missed;
+      if (!m_core.get_transactions(txids, txs, missed))
+      {
+        LOG_ERROR_CCONTEXT("Failed to handle request NOTIFY_REQUEST_FLUFFY_MISSING_TX, "
+          << "failed to get requested transactions");
+        drop_connection(context, false, false);
+        return 1;
+      }
+      if (!missed.empty() || txs.size() != txids.size())
+      {
+        LOG_ERROR_CCONTEXT("Failed to handle request NOTIFY_REQUEST_FLUFFY_MISSING_TX, "
+          << missed.size() << " requested transactions not found" << ", dropping connection");
+        drop_connection(context, false, false);
+        return 1;
+      }
 
-    for(auto& tx: txs)
-    {
-      fluffy_response.b.txs.push_back({t_serializable_object_to_blob(tx), crypto::null_hash});
+      for(auto& tx: txs)
+      {
+        fluffy_response.b.txs.push_back({t_serializable_object_to_blob(tx), crypto::null_hash});
+      }
     }
 
     MLOG_P2P_MESSAGE
@@ -1005,24 +1029,31 @@ namespace cryptonote
     else
       stem_txs.reserve(arg.txs.size());
 
-        for (auto& tx : arg.txs)
-        {
-          tx_verification_context tvc{};
-          if (!m_core.handle_incoming_tx({tx, crypto::null_hash}, tvc, tx_relay, true))
-      {
-        LOG_PRINT_CCONTEXT_L1("Tx verification failed, dropping connection");
-        drop_connection(context, false, false);
-        return 1;
-      }
-      switch (tvc.m_relay)
+    // the whole set is handed to the core at once, so that it can verify
+    // the txes as a batch
+    std::vector<tx_blob_entry> tx_blobs;
+    tx_blobs.reserve(arg.txs.size());
+    for (auto& tx : arg.txs)
+      tx_blobs.push_back({std::move(tx), crypto::null_hash});
+    std::vector<tx_verification_context> tvcs(tx_blobs.size());
+    if (!m_core.handle_incoming_txs(tx_blobs, tvcs, tx_relay, true))
+    {
+      LOG_PRINT_CCONTEXT_L1("Tx verification failed, dropping connection");
+      drop_connection(context, false, false);
+      return 1;
+    }
+
+    for (size_t i = 0; i < tx_blobs.size(); ++i)
+    {
+      switch (tvcs[i].m_relay)
       {
         case relay_method::local:
         case relay_method::stem:
-          stem_txs.push_back(std::move(tx));
+          stem_txs.push_back(std::move(tx_blobs[i].blob));
           break;
         case relay_method::block:
         case relay_method::fluff:
-          fluff_txs.push_back(std::move(tx));
+          fluff_txs.push_back(std::move(tx_blobs[i].blob));
           break;
         default:
         case relay_method::forward: // not supposed to happen here
@@ -1068,23 +1099,70 @@ namespace cryptonote
         return 1;
       }
 
+    // blocks at the top are asked for by every syncing peer, reuse their serialized form
+    sync_block_response_cache();
     NOTIFY_RESPONSE_GET_OBJECTS::request rsp;
-    if(!m_core.handle_get_objects(arg, rsp, context))
+    std::vector<epee::byte_slice> sections;
+    if (m_block_response_cache.get_sections(arg.blocks, arg.prune, sections))
     {
-      LOG_ERROR_CCONTEXT("failed to handle request NOTIFY_REQUEST_GET_OBJECTS, dropping connection");
-      drop_connection(context, false, false);
-      return 1;
+      rsp.current_blockchain_height = m_core.get_current_blockchain_height();
+    }
+    else
+    {
+      if(!m_core.handle_get_objects(arg, rsp, context))
+      {
+        LOG_ERROR_CCONTEXT("failed to handle request NOTIFY_REQUEST_GET_OBJECTS, dropping connection");
+        drop_connection(context, false, false);
+        return 1;
+      }
+
+      // found blocks are returned in request order, without the missed ones
+      const std::unordered_set<crypto::hash> missed(rsp.missed_ids.begin(), rsp.missed_ids.end());
+      std::vector<crypto::hash>::const_iterator id = arg.blocks.begin();
+      sections.clear();
+      sections.reserve(rsp.blocks.size());
+      for (const block_complete_entry& bce : rsp.blocks)
+      {
+        while (id != arg.blocks.end() && missed.count(*id))
+          ++id;
+        sections.push_back(m_block_response_cache.add(id == arg.blocks.end() ? crypto::null_hash : *id++, bce));
+        if (sections.back().empty())
+        {
+          LOG_ERROR_CCONTEXT("failed to serialize block for NOTIFY_RESPONSE_GET_OBJECTS, dropping connection");
+          drop_connection(context, false, false);
+          return 1;
+        }
+      }
     }
     context.m_last_request_time = boost::posix_time::microsec_clock::universal_time();
     MLOG_P2P_MESSAGE("-->>NOTIFY_RESPONSE_GET_OBJECTS: blocks.size()="
-                     << rsp.blocks.size() << ", rsp.m_current_blockchain_height=" << rsp.current_blockchain_height
+                     << sections.size() << ", rsp.m_current_blockchain_height=" << rsp.current_blockchain_height
                      << ", missed_ids.size()=" << rsp.missed_ids.size());
-    post_notify<NOTIFY_RESPONSE_GET_OBJECTS>(rsp, context);
-    //handler_response_blocks_now(sizeof(rsp)); // XXX
-    //handler_response_blocks_now(200);
+
+    epee::levin::message_writer out{256 * 1024}; // optimize for block responses
+    block_response_cache::write_get_objects(out.buffer, epee::to_span(sections), rsp.missed_ids, rsp.current_blockchain_height);
+    m_p2p->invoke_notify_to_peer(NOTIFY_RESPONSE_GET_OBJECTS::ID, std::move(out), context);
     return 1;
   }
   //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::sync_block_response_cache()
+  {
+    uint64_t top_height = 0;
+    crypto::hash top_id = crypto::null_hash;
+    m_core.get_blockchain_top(top_height, top_id);
+    if (top_id == m_block_response_cache.top())
+      return;
+
+    const uint64_t count = std::min<uint64_t>(top_height + 1, CRYPTONOTE_HOT_BLOCK_CACHE_SIZE);
+    std::vector<crypto::hash> ids;
+    ids.reserve(count);
+    for (uint64_t height = top_height + 1 - count; height <= top_height; ++height)
+      ids.push_back(m_core.get_block_id_by_height(height));
+    m_block_response_cache.set_chain(top_id, ids);
+    MDEBUG("Block response cache now ends at " << top_id << ", " << m_block_response_cache.size() << " bytes cached");
+  }
+  //------------------------------------------------------------------------------------------------------------------------
 
 
   template<class t_core>
@@ -1295,6 +1373,7 @@ namespace cryptonote
       const float rate = size * 1e6 / (dt.total_microseconds() + 1);
       MDEBUG(context << " adding span: " << arg.blocks.size() << " at height " << start_height << ", " << dt.total_microseconds()/1e6 << " seconds, " << (rate/1024) << " kB/s, size now " << (m_block_queue.get_data_size() + blocks_size) / 1048576.f << " MB");
       m_block_queue.add_blocks(start_height, arg.blocks, context.m_connection_id, context.m_remote_address, rate, blocks_size);
+      update_span_stats(context, dt, size, arg.blocks.size());
 
       const crypto::hash last_block_hash = cryptonote::get_block_hash(b);
       context.m_last_known_hash = last_block_hash;
@@ -1692,6 +1771,7 @@ skip:
     m_idle_peer_kicker.do_call(std::bind(&t_cryptonote_protocol_handler<t_core>::kick_idle_peers, this));
     m_standby_checker.do_call(std::bind(&t_cryptonote_protocol_handler<t_core>::check_standby_peers, this));
     m_sync_search_checker.do_call(std::bind(&t_cryptonote_protocol_handler<t_core>::update_sync_search, this));
+    m_tx_reconciler.do_call(std::bind(&t_cryptonote_protocol_handler<t_core>::reconcile_txs, this));
     return m_core.on_idle();
   }
   //------------------------------------------------------------------------------------------------------------------------
@@ -1840,6 +1920,32 @@ skip:
           return true;
         }
 
+        // if later spans are waiting on it, get it too when we expect to deliver it well before its current peer
+        if (context.m_span_rate > 0.0f && m_block_queue.get_num_filled_spans_prefix() == 0 && m_block_queue.get_num_filled_spans() > 0)
+        {
+          span = m_block_queue.get_next_span_if_scheduled(hashes, span_connection_id, request_time);
+          if (span.second > 0 && span_connection_id != context.m_connection_id)
+          {
+            const float span_size = span.second * context.m_span_block_size;
+            const float our_eta = context.m_rtt + span_size / context.m_span_rate;
+            bool download = false;
+            m_p2p->for_connection(span_connection_id, [&](cryptonote_connection_context& ctx, nodetool::peerid_type peer_id, uint32_t f)->bool{
+              if (ctx.m_span_rate <= 0.0f)
+                return true;
+              const float their_eta = ctx.m_rtt + span_size / ctx.m_span_rate - dt / 1e6f;
+              if (their_eta > our_eta * BOTTLENECK_SPAN_SPEEDUP)
+              {
+                MDEBUG(context << " we should download it as it is holding up the block queue, and we expect it in " << our_eta
+                    << " seconds, vs " << their_eta << " seconds from the peer downloading it");
+                download = true;
+              }
+              return true;
+            });
+            if (download)
+              return true;
+          }
+        }
+
         // in standby, be ready to double download early since we're idling anyway
         // let the fastest peer trigger first
         long threshold;
@@ -1898,6 +2004,65 @@ skip:
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::update_rtt(cryptonote_connection_context& context, const boost::posix_time::time_duration &rtt)
+  {
+    const float seconds = rtt.total_microseconds() / 1e6f;
+    context.m_rtt = context.m_rtt > 0.0f ? context.m_rtt + (seconds - context.m_rtt) * PEER_STATS_SMOOTHING : seconds;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::update_span_stats(cryptonote_connection_context& context, const boost::posix_time::time_duration &dt, size_t size, size_t nblocks)
+  {
+    // take the round trip out, so the rate reflects how fast this peer sends us data
+    const float seconds = dt.total_microseconds() / 1e6f;
+    const float transfer_time = std::max(seconds - context.m_rtt, seconds / 4);
+    const float rate = size / std::max(transfer_time, 1e-3f);
+    context.m_span_rate = context.m_span_rate > 0.0f ? context.m_span_rate + (rate - context.m_span_rate) * PEER_STATS_SMOOTHING : rate;
+    if (nblocks > 0)
+    {
+      const float block_size = size / (float)nblocks;
+      context.m_span_block_size = context.m_span_block_size > 0.0f ? context.m_span_block_size + (block_size - context.m_span_block_size) * PEER_STATS_SMOOTHING : block_size;
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  size_t t_cryptonote_protocol_handler<t_core>::get_span_size(const cryptonote_connection_context& context) const
+  {
+    const size_t default_count = m_core.get_block_sync_size(m_core.get_current_blockchain_height());
+    if (!m_core.is_block_sync_size_adaptive())
+      return default_count;
+    return get_adaptive_span_size(context, default_count);
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  size_t t_cryptonote_protocol_handler<t_core>::get_adaptive_span_size(const cryptonote_connection_context& context, size_t default_count)
+  {
+    if (context.m_span_rate <= 0.0f || context.m_span_block_size <= 0.0f)
+      return default_count;
+
+    // size the span so that, at this peer's rate, it gets here within the target time
+    const float transfer_time = std::max(SPAN_TARGET_DELIVERY_TIME - context.m_rtt, SPAN_TARGET_DELIVERY_TIME / 4);
+    const float budget = context.m_span_rate * transfer_time;
+    float size = 0.0f;
+    size_t count = 0;
+    for (const auto &o: context.m_needed_objects)
+    {
+      // block weights are close to their size, use them when the peer sent them
+      const float block_size = o.second ? o.second : context.m_span_block_size;
+      if (count > 0 && size + block_size > budget)
+        break;
+      size += block_size;
+      if (++count >= CURRENCY_PROTOCOL_MAX_OBJECT_REQUEST_COUNT)
+        break;
+    }
+    if (count == context.m_needed_objects.size() && size < budget)
+      count += (budget - size) / context.m_span_block_size;
+    count = std::max<size_t>(1, std::min<size_t>(count, CURRENCY_PROTOCOL_MAX_OBJECT_REQUEST_COUNT));
+    MDEBUG(context << " span size " << count << " at " << context.m_span_rate / 1024 << " kB/s, rtt " << context.m_rtt << " seconds");
+    return count;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
   bool t_cryptonote_protocol_handler<t_core>::should_drop_connection(cryptonote_connection_context& context, uint32_t next_stripe)
   {
     if (context.m_anchor)
@@ -2003,6 +2168,80 @@ skip:
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
+  std::vector<unsigned int> t_cryptonote_protocol_handler<t_core>::get_stripe_peer_counts() const
+  {
+    // index 0 counts unpruned peers, which have every stripe
+    std::vector<unsigned int> counts((1 << CRYPTONOTE_PRUNING_LOG_STRIPES) + 1, 0);
+    m_p2p->for_each_connection([&](const connection_context &context, nodetool::peerid_type peer_id, uint32_t support_flags) {
+      if (context.m_state >= cryptonote_connection_context::state_synchronizing)
+      {
+        const uint32_t stripe = tools::get_pruning_stripe(context.m_pruning_seed);
+        if (stripe < counts.size())
+          ++counts[stripe];
+      }
+      return true;
+    });
+    return counts;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  bool t_cryptonote_protocol_handler<t_core>::request_block_headers(cryptonote_connection_context& context)
+  {
+    if (!m_core.headers_first_sync_enabled() || context.m_needed_objects.empty())
+      return false;
+    if (context.m_last_response_height + 1 < context.m_needed_objects.size())
+      return false;
+
+    // only ask for headers which extend the verified ones
+    const uint64_t first_needed_height = context.m_last_response_height + 1 - context.m_needed_objects.size();
+    const uint64_t verified_height = m_core.get_verified_headers_height();
+    if (verified_height < first_needed_height || verified_height > context.m_last_response_height)
+      return false;
+    // no point where PoW is not checked
+    if (m_core.is_within_compiled_block_hash_area(verified_height))
+      return false;
+
+    bool supported = false;
+    m_p2p->for_connection(context.m_connection_id, [&supported](cryptonote_connection_context&, nodetool::peerid_type, uint32_t support_flags)->bool{
+      supported = support_flags & P2P_SUPPORT_FLAG_BLOCK_HEADERS;
+      return true;
+    });
+    if (!supported)
+      return false;
+
+    NOTIFY_REQUEST_BLOCK_HEADERS::request req;
+    req.start_height = verified_height;
+    const size_t offset = verified_height - first_needed_height;
+    const size_t count = std::min<size_t>(context.m_needed_objects.size() - offset, BLOCK_HEADERS_SYNCHRONIZING_MAX_COUNT);
+    req.blocks.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+      req.blocks.push_back(context.m_needed_objects[offset + i].first);
+
+    context.m_last_request_time = boost::posix_time::microsec_clock::universal_time();
+    context.m_expect_height = verified_height;
+    context.m_expect_response = NOTIFY_RESPONSE_BLOCK_HEADERS::ID;
+    MLOG_P2P_MESSAGE("-->>NOTIFY_REQUEST_BLOCK_HEADERS: blocks.size()=" << req.blocks.size() << ", start_height=" << req.start_height);
+    MLOG_PEER_STATE("requesting block headers");
+    post_notify<NOTIFY_REQUEST_BLOCK_HEADERS>(req, context);
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  bool t_cryptonote_protocol_handler<t_core>::wait_for_verified_headers(uint64_t height)
+  {
+    if (!m_core.headers_first_sync_enabled() || m_core.is_within_compiled_block_hash_area(height))
+      return false;
+
+    // if no peer can send us headers, we have to download the blocks unverified
+    bool supported = false;
+    m_p2p->for_each_connection([&supported](cryptonote_connection_context&, nodetool::peerid_type, uint32_t support_flags)->bool{
+      supported = support_flags & P2P_SUPPORT_FLAG_BLOCK_HEADERS;
+      return !supported;
+    });
+    return supported;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
   bool t_cryptonote_protocol_handler<t_core>::request_missing_objects(cryptonote_connection_context& context, bool check_having_blocks, bool force_next_span)
   {
     // flush stale spans
@@ -2143,8 +2382,9 @@ skip:
       NOTIFY_REQUEST_GET_OBJECTS::request req;
       bool is_next = false;
       size_t count = 0;
-      const size_t count_limit = m_core.get_block_sync_size(m_core.get_current_blockchain_height());
+      const size_t count_limit = get_span_size(context);
       std::pair<uint64_t, uint64_t> span = std::make_pair(0, 0);
+      bool waiting_for_headers = false;
       if (force_next_span)
       {
         if (span.second == 0)
@@ -2192,7 +2432,21 @@ skip:
         const uint64_t first_block_height = context.m_last_response_height - context.m_needed_objects.size() + 1;
         static const uint64_t bp_fork_height = m_core.get_earliest_ideal_height_for_version(7);
         bool sync_pruned_blocks = m_sync_pruned_blocks && first_block_height >= bp_fork_height && m_core.get_blockchain_pruning_seed();
-        span = m_block_queue.reserve_span(first_block_height, context.m_last_response_height, count_limit, context.m_connection_id, context.m_remote_address, sync_pruned_blocks, m_core.get_blockchain_pruning_seed(), context.m_pruning_seed, context.m_remote_blockchain_height, context.m_needed_objects);
+        // in headers-first mode, only download blocks whose headers are verified, so their PoW does not have to be checked again
+        uint64_t last_block_height = context.m_last_response_height;
+        std::vector<std::pair<crypto::hash, uint64_t>> verified_objects;
+        if (wait_for_verified_headers(first_block_height))
+        {
+          const uint64_t verified_height = m_core.get_verified_headers_height();
+          if (verified_height <= last_block_height)
+          {
+            waiting_for_headers = true;
+            last_block_height = verified_height - 1;
+            if (verified_height > first_block_height)
+              verified_objects.assign(context.m_needed_objects.begin(), context.m_needed_objects.begin() + (verified_height - first_block_height));
+          }
+        }
+        span = m_block_queue.reserve_span(first_block_height, last_block_height, count_limit, context.m_connection_id, context.m_remote_address, sync_pruned_blocks, m_core.get_blockchain_pruning_seed(), context.m_pruning_seed, context.m_remote_blockchain_height, waiting_for_headers ? verified_objects : context.m_needed_objects);
         MDEBUG(context << " span from " << first_block_height << ": " << span.first << "/" << span.second);
         if (span.second > 0)
         {
@@ -2211,8 +2465,15 @@ skip:
         boost::uuids::uuid span_connection_id;
         boost::posix_time::ptime time;
         span = m_block_queue.get_next_span_if_scheduled(hashes, span_connection_id, time);
-        if (span.second > 0 && !tools::has_unpruned_block(span.first, context.m_remote_blockchain_height, context.m_pruning_seed))
+        // only take over the span if this peer holds all of it, or pruned data will do
+        if (span.second > 0 && !should_ask_for_pruned_data(context, span.first, span.second, true) &&
+            (!tools::has_unpruned_block(span.first, context.m_remote_blockchain_height, context.m_pruning_seed) ||
+            !tools::has_unpruned_block(span.first + span.second - 1, context.m_remote_blockchain_height, context.m_pruning_seed)))
+        {
+          MDEBUG(context << " peer on stripe " << tools::get_pruning_stripe(context.m_pruning_seed) << " does not hold next span " <<
+              span.first << "/" << span.second << ", leaving it to another peer");
           span = std::make_pair(0, 0);
+        }
         if (span.second > 0)
         {
           is_next = true;
@@ -2229,6 +2490,19 @@ skip:
           }
         }
       }
+      if (span.second == 0 && waiting_for_headers)
+      {
+        // get the next headers from this peer if it can, or wait for another peer to verify them
+        if (request_block_headers(context))
+          return true;
+        if (context.m_state != cryptonote_connection_context::state_standby)
+        {
+          LOG_DEBUG_CC(context, "Waiting for block headers to be verified, pausing");
+          context.m_state = cryptonote_connection_context::state_standby;
+          MLOG_PEER_STATE("pausing");
+        }
+        return true;
+      }
       MDEBUG(context << " span: " << span.first << "/" << span.second << " (" << span.first << " - " << (span.first + span.second - 1) << ")");
       if (span.second > 0)
       {
@@ -2563,7 +2837,8 @@ skip:
     }
     context.m_last_response_height -= arg.m_block_ids.size() - n_use_blocks;
 
-    if (!request_missing_objects(context, false))
+    // in headers-first mode, blocks are requested once their headers are verified
+    if (!request_block_headers(context) && !request_missing_objects(context, false))
     {
       LOG_ERROR_CCONTEXT("Failed to request missing objects, dropping connection");
       drop_connection(context, false, false);
@@ -2578,6 +2853,89 @@ skip:
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_request_block_headers(int command, NOTIFY_REQUEST_BLOCK_HEADERS::request& arg, cryptonote_connection_context& context)
+  {
+    if (context.m_state == cryptonote_connection_context::state_before_handshake)
+    {
+      LOG_ERROR_CCONTEXT("Requested block headers before handshake, dropping connection");
+      drop_connection(context, false, false);
+      return 1;
+    }
+    MLOG_P2P_MESSAGE("Received NOTIFY_REQUEST_BLOCK_HEADERS (" << arg.blocks.size() << " blocks, start_height " << arg.start_height << ")");
+    if (arg.blocks.size() > BLOCK_HEADERS_SYNCHRONIZING_MAX_COUNT)
+    {
+      LOG_ERROR_CCONTEXT("Requested block headers count is too big (" << arg.blocks.size() << ") expected not more then " << BLOCK_HEADERS_SYNCHRONIZING_MAX_COUNT);
+      drop_connection(context, false, false);
+      return 1;
+    }
+
+    NOTIFY_RESPONSE_BLOCK_HEADERS::request rsp;
+    rsp.start_height = arg.start_height;
+    // stops at the first block we do not have, the requester knows what's missing
+    m_core.get_block_hashing_blobs(arg.blocks, rsp.headers);
+    context.m_last_request_time = boost::posix_time::microsec_clock::universal_time();
+    MLOG_P2P_MESSAGE("-->>NOTIFY_RESPONSE_BLOCK_HEADERS: headers.size()=" << rsp.headers.size() << ", start_height=" << rsp.start_height);
+    post_notify<NOTIFY_RESPONSE_BLOCK_HEADERS>(rsp, context);
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_response_block_headers(int command, NOTIFY_RESPONSE_BLOCK_HEADERS::request& arg, cryptonote_connection_context& context)
+  {
+    MLOG_P2P_MESSAGE("Received NOTIFY_RESPONSE_BLOCK_HEADERS (" << arg.headers.size() << " headers, start_height " << arg.start_height << ")");
+    MLOG_PEER_STATE("received block headers");
+
+    if (context.m_expect_response != NOTIFY_RESPONSE_BLOCK_HEADERS::ID)
+    {
+      LOG_ERROR_CCONTEXT("Got NOTIFY_RESPONSE_BLOCK_HEADERS out of the blue, dropping connection");
+      drop_connection(context, true, false);
+      return 1;
+    }
+    context.m_expect_response = 0;
+    if (arg.start_height != context.m_expect_height)
+    {
+      LOG_ERROR_CCONTEXT("Got NOTIFY_RESPONSE_BLOCK_HEADERS for unexpected height, dropping connection");
+      drop_connection(context, true, false);
+      return 1;
+    }
+    context.m_last_request_time = boost::date_time::not_a_date_time;
+
+    // the headers must match the ids we asked for, which are still the ones we need
+    const uint64_t first_needed_height = context.m_last_response_height + 1 - context.m_needed_objects.size();
+    if (context.m_last_response_height + 1 < context.m_needed_objects.size() || arg.start_height < first_needed_height
+        || arg.headers.size() > BLOCK_HEADERS_SYNCHRONIZING_MAX_COUNT
+        || arg.start_height - first_needed_height + arg.headers.size() > context.m_needed_objects.size())
+    {
+      LOG_ERROR_CCONTEXT("sent wrong NOTIFY_RESPONSE_BLOCK_HEADERS, with start_height=" << arg.start_height << " and headers=" << arg.headers.size() << ", dropping connection");
+      drop_connection(context, true, false);
+      return 1;
+    }
+    std::vector<crypto::hash> hashes;
+    hashes.reserve(arg.headers.size());
+    for (size_t i = 0; i < arg.headers.size(); ++i)
+      hashes.push_back(context.m_needed_objects[arg.start_height - first_needed_height + i].first);
+
+    const uint64_t verified_height = m_core.get_verified_headers_height();
+    if (!m_core.prevalidate_block_headers(arg.start_height, hashes, arg.headers))
+    {
+      LOG_ERROR_CCONTEXT("sent invalid block headers, dropping connection");
+      drop_connection(context, true, false);
+      return 1;
+    }
+
+    // keep going while this peer extends the verified headers, then get the blocks
+    if (m_core.get_verified_headers_height() > verified_height && request_block_headers(context))
+      return 1;
+    if (!request_missing_objects(context, false))
+    {
+      LOG_ERROR_CCONTEXT("Failed to request missing objects, dropping connection");
+      drop_connection(context, false, false);
+      return 1;
+    }
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
   bool t_cryptonote_protocol_handler<t_core>::relay_block(NOTIFY_NEW_BLOCK::request& arg, cryptonote_connection_context& exclude_context)
   {
     NOTIFY_NEW_FLUFFY_BLOCK::request fluffy_arg = AUTO_VAL_INIT(fluffy_arg);
@@ -2621,6 +2979,35 @@ skip:
       m_p2p->relay_notify_to_list(NOTIFY_NEW_BLOCK::ID, std::move(fullBlob), std::move(fullConnections));
     }
 
+    // fluffy peers ask for missing txs and syncing peers for the block right after this
+    crypto::hash block_id;
+    block b;
+    if (!arg.b.pruned && parse_and_validate_block_from_blob(arg.b.block, b, block_id))
+    {
+      // the txs come from the relaying peer and were only checked one by one, so they
+      // may be reordered or padded: only cache them as is if they match the block
+      bool txs_match = arg.b.txs.size() == b.tx_hashes.size();
+      for (size_t i = 0; txs_match && i < arg.b.txs.size(); ++i)
+      {
+        transaction tx;
+        crypto::hash tx_hash;
+        txs_match = parse_and_validate_tx_from_blob(arg.b.txs[i].blob, tx, tx_hash) && tx_hash == b.tx_hashes[i];
+      }
+      sync_block_response_cache();
+      if (txs_match)
+        m_block_response_cache.add(block_id, arg.b);
+      else
+      {
+        MDEBUG("Relayed block " << block_id << " txs do not match its tx hashes, caching it from the db");
+        NOTIFY_REQUEST_GET_OBJECTS::request req;
+        NOTIFY_RESPONSE_GET_OBJECTS::request rsp;
+        req.blocks.push_back(block_id);
+        req.prune = false;
+        if (m_core.handle_get_objects(req, rsp, exclude_context) && rsp.blocks.size() == 1 && rsp.missed_ids.empty())
+          m_block_response_cache.add(block_id, rsp.blocks.front());
+      }
+    }
+
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------
@@ -2636,6 +3023,239 @@ skip:
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
+  bool t_cryptonote_protocol_handler<t_core>::get_reconciled_txs(const std::vector<crypto::hash>& txids, NOTIFY_NEW_TRANSACTIONS::request& arg)
+  {
+    arg.txs.reserve(txids.size());
+    for (const crypto::hash& txid: txids)
+    {
+      cryptonote::blobdata txblob;
+      // txs mined or dropped since they were queued are simply skipped
+      if (m_core.get_pool_transaction(txid, txblob, relay_category::broadcasted))
+        arg.txs.push_back(std::move(txblob));
+    }
+    arg.dandelionpp_fluff = true;
+    return !arg.txs.empty();
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  bool t_cryptonote_protocol_handler<t_core>::reconcile_txs()
+  {
+    if (!m_tx_reconciliation)
+      return true;
+
+    const boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+    std::vector<std::pair<boost::uuids::uuid, std::vector<crypto::hash>>> timed_out;
+    m_p2p->for_each_connection([&](cryptonote_connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)->bool
+    {
+      // rounds are started by the outbound side only, the inbound side answers
+      if (context.m_is_income || !(support_flags & P2P_SUPPORT_FLAG_TX_RECONCILIATION) || context.m_state != cryptonote_connection_context::state_normal)
+        return true;
+
+      if (context.m_recon_round_start != boost::date_time::not_a_date_time)
+      {
+        if ((now - context.m_recon_round_start).total_seconds() < CRYPTONOTE_TX_RECONCILIATION_TIMEOUT)
+          return true;
+        MDEBUG(context << "tx reconciliation timed out, flooding " << context.m_recon_round_txs.size() << " txs");
+        timed_out.emplace_back(context.m_connection_id, std::move(context.m_recon_round_txs));
+        context.m_recon_round_txs.clear();
+      }
+
+      NOTIFY_REQUEST_TX_RECONCILIATION::request req;
+      context.m_recon_round_txs.swap(context.m_recon_txs);
+      context.m_recon_salt = crypto::rand<uint64_t>();
+      context.m_recon_round_start = now;
+      req.salt = context.m_recon_salt;
+      req.set_size = context.m_recon_round_txs.size();
+      post_notify<NOTIFY_REQUEST_TX_RECONCILIATION>(req, context);
+      return true;
+    });
+
+    for (const auto& e: timed_out)
+    {
+      NOTIFY_NEW_TRANSACTIONS::request txs;
+      if (!get_reconciled_txs(e.second, txs))
+        continue;
+      m_p2p->for_connection(e.first, [&](cryptonote_connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)->bool
+      {
+        post_notify<NOTIFY_NEW_TRANSACTIONS>(txs, context);
+        return true;
+      });
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_request_tx_reconciliation(int command, NOTIFY_REQUEST_TX_RECONCILIATION::request& arg, cryptonote_connection_context& context)
+  {
+    MLOG_P2P_MESSAGE("Received NOTIFY_REQUEST_TX_RECONCILIATION (set_size " << arg.set_size << ")");
+    if (!m_tx_reconciliation || !context.m_is_income)
+    {
+      LOG_ERROR_CCONTEXT("Got NOTIFY_REQUEST_TX_RECONCILIATION out of the blue, dropping connection");
+      drop_connection(context, false, false);
+      return 1;
+    }
+
+    // the txs of an unanswered round stay queued for this one, until there are too many to
+    // reconcile, then they are flooded so a peer that never sends a diff can't grow the set
+    std::vector<crypto::hash> txids, flood;
+    m_p2p->for_connection(context.m_connection_id, [&](cryptonote_connection_context& ctx, nodetool::peerid_type peer_id, uint32_t support_flags)->bool
+    {
+      ctx.m_recon_round_txs.insert(ctx.m_recon_round_txs.end(), ctx.m_recon_txs.begin(), ctx.m_recon_txs.end());
+      ctx.m_recon_txs.clear();
+      if (ctx.m_recon_round_txs.size() > CRYPTONOTE_TX_RECONCILIATION_MAX_SET_SIZE)
+      {
+        flood.swap(ctx.m_recon_round_txs);
+        ctx.m_recon_round_txs.clear();
+      }
+      ctx.m_recon_salt = arg.salt;
+      txids = ctx.m_recon_round_txs;
+      return true;
+    });
+    if (!flood.empty())
+    {
+      MDEBUG(context << "tx reconciliation set too large, flooding " << flood.size() << " txs");
+      NOTIFY_NEW_TRANSACTIONS::request txs;
+      if (get_reconciled_txs(flood, txs))
+        post_notify<NOTIFY_NEW_TRANSACTIONS>(txs, context);
+    }
+
+    NOTIFY_RESPONSE_TX_RECONCILIATION::request rsp;
+    rsp.set_size = txids.size();
+    const size_t cells = reconciliation::get_sketch_cells(txids.size(), arg.set_size);
+    if (cells && (!txids.empty() || arg.set_size))
+    {
+      reconciliation::sketch sketch{cells};
+      for (const crypto::hash& txid: txids)
+        sketch.add(reconciliation::get_short_id(txid, arg.salt));
+      rsp.sketch = sketch.to_blob();
+    }
+    MLOG_P2P_MESSAGE("-->>NOTIFY_RESPONSE_TX_RECONCILIATION: sketch.size()=" << rsp.sketch.size() << ", set_size=" << rsp.set_size);
+    post_notify<NOTIFY_RESPONSE_TX_RECONCILIATION>(rsp, context);
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_response_tx_reconciliation(int command, NOTIFY_RESPONSE_TX_RECONCILIATION::request& arg, cryptonote_connection_context& context)
+  {
+    MLOG_P2P_MESSAGE("Received NOTIFY_RESPONSE_TX_RECONCILIATION (sketch " << arg.sketch.size() << " bytes, set_size " << arg.set_size << ")");
+
+    bool in_round = false;
+    uint64_t salt = 0;
+    std::vector<crypto::hash> txids;
+    m_p2p->for_connection(context.m_connection_id, [&](cryptonote_connection_context& ctx, nodetool::peerid_type peer_id, uint32_t support_flags)->bool
+    {
+      in_round = ctx.m_recon_round_start != boost::date_time::not_a_date_time;
+      salt = ctx.m_recon_salt;
+      txids.swap(ctx.m_recon_round_txs);
+      ctx.m_recon_round_txs.clear();
+      ctx.m_recon_round_start = boost::date_time::not_a_date_time;
+      return true;
+    });
+    if (!in_round)
+    {
+      LOG_ERROR_CCONTEXT("Got NOTIFY_RESPONSE_TX_RECONCILIATION out of the blue, dropping connection");
+      drop_connection(context, false, false);
+      return 1;
+    }
+
+    // nothing on either side, the peer keeps no round open
+    if (arg.sketch.empty() && !arg.set_size && txids.empty())
+      return 1;
+
+    NOTIFY_TX_RECONCILIATION_DIFF::request diff{};
+    std::vector<crypto::hash> to_send;
+    std::vector<uint64_t> local_only;
+    const auto remote = reconciliation::sketch::from_blob(arg.sketch);
+    if (remote)
+    {
+      std::unordered_map<uint64_t, crypto::hash> short_ids;
+      reconciliation::sketch local{remote->size()};
+      for (const crypto::hash& txid: txids)
+      {
+        const uint64_t short_id = reconciliation::get_short_id(txid, salt);
+        short_ids.emplace(short_id, txid);
+        local.add(short_id);
+      }
+
+      if (local.decode(*remote, local_only, diff.short_ids))
+      {
+        for (const uint64_t short_id: local_only)
+        {
+          const auto it = short_ids.find(short_id);
+          if (it != short_ids.end())
+            to_send.push_back(it->second);
+        }
+      }
+      else
+      {
+        MDEBUG(context << "failed to decode tx reconciliation sketch, flooding");
+        diff.short_ids.clear();
+        diff.flood = true;
+      }
+    }
+    else
+    {
+      if (!arg.sketch.empty())
+      {
+        LOG_ERROR_CCONTEXT("Invalid tx reconciliation sketch, dropping connection");
+        drop_connection(context, false, false);
+        return 1;
+      }
+      diff.flood = true;
+    }
+    if (diff.flood)
+      to_send = std::move(txids);
+
+    NOTIFY_NEW_TRANSACTIONS::request txs;
+    if (get_reconciled_txs(to_send, txs))
+      post_notify<NOTIFY_NEW_TRANSACTIONS>(txs, context);
+
+    MLOG_P2P_MESSAGE("-->>NOTIFY_TX_RECONCILIATION_DIFF: short_ids.size()=" << diff.short_ids.size() << ", flood=" << diff.flood);
+    post_notify<NOTIFY_TX_RECONCILIATION_DIFF>(diff, context);
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_tx_reconciliation_diff(int command, NOTIFY_TX_RECONCILIATION_DIFF::request& arg, cryptonote_connection_context& context)
+  {
+    MLOG_P2P_MESSAGE("Received NOTIFY_TX_RECONCILIATION_DIFF (" << arg.short_ids.size() << " txes, flood " << arg.flood << ")");
+    if (!m_tx_reconciliation || !context.m_is_income)
+    {
+      LOG_ERROR_CCONTEXT("Got NOTIFY_TX_RECONCILIATION_DIFF out of the blue, dropping connection");
+      drop_connection(context, false, false);
+      return 1;
+    }
+
+    uint64_t salt = 0;
+    std::vector<crypto::hash> txids;
+    m_p2p->for_connection(context.m_connection_id, [&](cryptonote_connection_context& ctx, nodetool::peerid_type peer_id, uint32_t support_flags)->bool
+    {
+      salt = ctx.m_recon_salt;
+      txids.swap(ctx.m_recon_round_txs);
+      ctx.m_recon_round_txs.clear();
+      return true;
+    });
+
+    std::vector<crypto::hash> to_send;
+    if (arg.flood)
+      to_send = std::move(txids);
+    else
+    {
+      const std::unordered_set<uint64_t> requested(arg.short_ids.begin(), arg.short_ids.end());
+      for (const crypto::hash& txid: txids)
+      {
+        if (requested.count(reconciliation::get_short_id(txid, salt)))
+          to_send.push_back(txid);
+      }
+    }
+
+    NOTIFY_NEW_TRANSACTIONS::request txs;
+    if (get_reconciled_txs(to_send, txs))
+      post_notify<NOTIFY_NEW_TRANSACTIONS>(txs, context);
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
   bool t_cryptonote_protocol_handler<t_core>::request_txpool_complement(cryptonote_connection_context &context)
   {
     NOTIFY_GET_TXPOOL_COMPLEMENT::request r = {};
@@ -2694,22 +3314,32 @@ template<class t_core>
     if (next_pruning_stripe == 0)
       return std::make_pair(0, 0);
     // if we already have a few peers on this stripe, but none on next one, try next one
-    unsigned int n_next = 0, n_subsequent = 0, n_others = 0;
+    const std::vector<unsigned int> stripe_peers = get_stripe_peer_counts();
     const uint32_t subsequent_pruning_stripe = 1 + next_pruning_stripe % (1<<CRYPTONOTE_PRUNING_LOG_STRIPES);
-    m_p2p->for_each_connection([&](const connection_context &context, nodetool::peerid_type peer_id, uint32_t support_flags) {
-      if (context.m_state >= cryptonote_connection_context::state_synchronizing)
+    const unsigned int n_next = stripe_peers[0] + stripe_peers[next_pruning_stripe];
+    const unsigned int n_subsequent = stripe_peers[subsequent_pruning_stripe];
+    const unsigned int n_others = std::accumulate(stripe_peers.begin(), stripe_peers.end(), 0u) - n_next - n_subsequent;
+    const bool use_next = (n_next > m_max_out_peers / 2 && n_subsequent <= 1) || (n_next > 2 && n_subsequent == 0);
+    uint32_t ret_stripe = use_next ? subsequent_pruning_stripe: next_pruning_stripe;
+    // if the next two stripes are covered, look ahead for a stripe nobody we're connected to has,
+    // so new connections go there before the block queue gets to it
+    if (!use_next && n_next > 2 && n_subsequent > 1 && blockchain_height > CRYPTONOTE_PRUNING_TIP_BLOCKS)
+    {
+      for (uint32_t n = 2; n < (1u << CRYPTONOTE_PRUNING_LOG_STRIPES); ++n)
       {
-        if (context.m_pruning_seed == 0 || tools::get_pruning_stripe(context.m_pruning_seed) == next_pruning_stripe)
-          ++n_next;
-        else if (tools::get_pruning_stripe(context.m_pruning_seed) == subsequent_pruning_stripe)
-          ++n_subsequent;
-        else
-          ++n_others;
+        const uint64_t height = want_height + n * CRYPTONOTE_PRUNING_STRIPE_SIZE;
+        if (height >= blockchain_height - CRYPTONOTE_PRUNING_TIP_BLOCKS)
+          break;
+        const uint32_t stripe = tools::get_pruning_stripe(height, blockchain_height, CRYPTONOTE_PRUNING_LOG_STRIPES);
+        if (stripe == 0)
+          break;
+        if (stripe_peers[stripe] == 0)
+        {
+          ret_stripe = stripe;
+          break;
+        }
       }
-      return true;
-    });
-    const bool use_next = (n_next > m_max_out_peers / 2 && n_subsequent <= 1) || (n_next > 2 && n_subsequent == 0);
-    const uint32_t ret_stripe = use_next ? subsequent_pruning_stripe: next_pruning_stripe;
+    }
     MIDEBUG(const std::string po = get_peers_overview(), "get_next_needed_pruning_stripe: want height " << want_height << " (" <<
         want_height_from_blockchain << " from blockchain, " << want_height_from_block_queue << " from block queue), stripe " <<
         next_pruning_stripe << " (" << n_next << "/" << m_max_out_peers << " on it and " << n_subsequent << " on " <<
@@ -41,6 +41,7 @@
 #include "crypto/crypto.h"
 #include "crypto/duration.h"
 #include "cryptonote_basic/connection_context.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
 #include "cryptonote_core/i_core_events.h"
 #include "cryptonote_protocol/cryptonote_protocol_defs.h"
 #include "net/dandelionpp.h"
@@ -262,7 +263,7 @@ namespace levin
   {
     struct zone
     {
-      explicit zone(boost::asio::io_service& io_service, std::shared_ptr<connections> p2p, epee::byte_slice noise_in, epee::net_utils::zone zone, bool pad_txs)
+      explicit zone(boost::asio::io_service& io_service, std::shared_ptr<connections> p2p, epee::byte_slice noise_in, epee::net_utils::zone zone, bool pad_txs, bool tx_reconciliation)
         : p2p(std::move(p2p)),
           noise(std::move(noise_in)),
           next_epoch(io_service),
@@ -274,6 +275,7 @@ namespace levin
           flush_callbacks(0),
           nzone(zone),
           pad_txs(pad_txs),
+          tx_reconciliation(tx_reconciliation),
           fluffing(false)
       {
         for (std::size_t count = 0; !noise.empty() && count < CRYPTONOTE_NOISE_CHANNELS; ++count)
@@ -291,6 +293,7 @@ namespace levin
       std::uint32_t flush_callbacks;             //!< Number of active fluff flush callbacks queued
       const epee::net_utils::zone nzone;         //!< Zone is public ipv4/ipv6 connections, or i2p or tor
       const bool pad_txs;                        //!< Pad txs to the next boundary for privacy
+      const bool tx_reconciliation;              //!< Queue txs for set reconciliation with supporting peers
       bool fluffing;                             //!< Zone is in Dandelion++ fluff epoch
     };
   } // detail
@@ -426,11 +429,39 @@ namespace levin
 
         MDEBUG("Queueing " << txs.size() << " transaction(s) for Dandelion++ fluffing");
 
-        zone->p2p->foreach_connection([txs, now, &zone, &source, &in_duration, &out_duration, &next_flush] (detail::p2p_context& context)
+        // txs that cannot be identified here are always flooded
+        std::vector<crypto::hash> txids;
+        if (zone->tx_reconciliation)
+        {
+          txids.reserve(txs.size());
+          for (const blobdata& tx : txs)
+          {
+            transaction parsed;
+            crypto::hash txid;
+            if (!parse_and_validate_tx_from_blob(tx, parsed, txid))
+            {
+              txids.clear();
+              break;
+            }
+            txids.push_back(txid);
+          }
+        }
+
+        std::size_t flood_out = 0;
+        zone->p2p->foreach_connection([txs, now, &zone, &source, &in_duration, &out_duration, &next_flush, &txids, &flood_out] (detail::p2p_context& context)
         {
           // When i2p/tor, only fluff to outbound connections
           if (context.handshake_complete() && source != context.m_connection_id && (zone->nzone == epee::net_utils::zone::public_ || !context.m_is_income))
           {
+            // a few outbound peers keep flooding so txs still propagate quickly
+            const bool flood = !context.m_is_income && flood_out++ < CRYPTONOTE_TX_RECONCILIATION_FLOOD_OUT_PEERS;
+            if (!txids.empty() && !flood && (context.support_flags & P2P_SUPPORT_FLAG_TX_RECONCILIATION) &&
+              context.m_recon_txs.size() + txids.size() <= CRYPTONOTE_TX_RECONCILIATION_MAX_SET_SIZE)
+            {
+              context.m_recon_txs.insert(context.m_recon_txs.end(), txids.begin(), txids.end());
+              return true;
+            }
+
             if (context.fluff_txs.empty())
               context.flush_time = now + (context.m_is_income ? in_duration() : out_duration());
 
@@ -704,8 +735,8 @@ namespace levin
     };
   } // anonymous
 
-  notify::notify(boost::asio::io_service& service, std::shared_ptr<connections> p2p, epee::byte_slice noise, epee::net_utils::zone zone, const bool pad_txs, i_core_events& core)
-    : zone_(std::make_shared<detail::zone>(service, std::move(p2p), std::move(noise), zone, pad_txs))
+  notify::notify(boost::asio::io_service& service, std::shared_ptr<connections> p2p, epee::byte_slice noise, epee::net_utils::zone zone, const bool pad_txs, i_core_events& core, const bool tx_reconciliation)
+    : zone_(std::make_shared<detail::zone>(service, std::move(p2p), std::move(noise), zone, pad_txs, tx_reconciliation))
     , core_(std::addressof(core))
   {
     if (!zone_->p2p)
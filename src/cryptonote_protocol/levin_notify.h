@@ -84,8 +84,10 @@ namespace levin
       , core_(nullptr)
     {}
 
-    //! Construct an instance with available notification `zones`.
-    explicit notify(boost::asio::io_service& service, std::shared_ptr<connections> p2p, epee::byte_slice noise, epee::net_utils::zone zone, bool pad_txs, i_core_events& core);
+    /*! Construct an instance with available notification `zones`. When
+        `tx_reconciliation` is set, fluffed txs are queued on supporting peers
+        for set reconciliation instead of being flooded to them. */
+    explicit notify(boost::asio::io_service& service, std::shared_ptr<connections> p2p, epee::byte_slice noise, epee::net_utils::zone zone, bool pad_txs, i_core_events& core, bool tx_reconciliation = false);
 
     notify(const notify&) = delete;
     notify(notify&&) = default;
@@ -0,0 +1,195 @@
+// Copyright (c) 2014-2021, The Monero Project
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "tx_reconciliation.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "cryptonote_config.h"
+#include "int-util.h"
+
+namespace cryptonote
+{
+namespace reconciliation
+{
+  namespace
+  {
+    constexpr const std::size_t sketch_hashes = 4;
+    constexpr const std::size_t sketch_min_cells = 8 * sketch_hashes;
+    constexpr const std::size_t cell_blob_size = sizeof(std::uint32_t) + 2 * sizeof(std::uint64_t);
+
+    //! splitmix64 finalizer
+    std::uint64_t mix(std::uint64_t x) noexcept
+    {
+      x ^= x >> 30;
+      x *= 0xbf58476d1ce4e5b9;
+      x ^= x >> 27;
+      x *= 0x94d049bb133111eb;
+      x ^= x >> 31;
+      return x;
+    }
+
+    std::uint64_t get_check(const std::uint64_t id) noexcept
+    {
+      return mix(id ^ 0x5851f42d4c957f2d);
+    }
+
+    //! \return Cell of `id` in the `hash`th of the `sketch_hashes` equal partitions.
+    std::size_t get_index(const std::uint64_t id, const std::size_t hash, const std::size_t partition) noexcept
+    {
+      return hash * partition + mix(id + (hash + 1) * 0x9e3779b97f4a7c15) % partition;
+    }
+  } // anonymous
+
+  std::uint64_t get_short_id(const crypto::hash& txid, const std::uint64_t salt) noexcept
+  {
+    char data[sizeof(txid) + sizeof(salt)];
+    const std::uint64_t salt_le = SWAP64LE(salt);
+    std::memcpy(data, txid.data, sizeof(txid));
+    std::memcpy(data + sizeof(txid), &salt_le, sizeof(salt_le));
+
+    crypto::hash hash;
+    crypto::cn_fast_hash(data, sizeof(data), hash);
+    std::uint64_t out;
+    std::memcpy(&out, hash.data, sizeof(out));
+    return SWAP64LE(out);
+  }
+
+  std::size_t get_sketch_cells(const std::size_t local, const std::size_t remote) noexcept
+  {
+    // assume up to a quarter of the smaller set is also missing on the other side
+    const std::size_t difference = std::max(local, remote) - std::min(local, remote) + std::min(local, remote) / 4;
+    // four hashes at twice the difference rarely leave anything unpeeled, even for small sets
+    const std::size_t cells = 2 * difference + sketch_min_cells;
+    const std::size_t rounded = (cells + sketch_hashes - 1) / sketch_hashes * sketch_hashes;
+    return rounded <= CRYPTONOTE_TX_RECONCILIATION_MAX_CELLS ? rounded : 0;
+  }
+
+  sketch::sketch(const std::size_t cells)
+    : m_cells((std::max(cells, sketch_hashes) + sketch_hashes - 1) / sketch_hashes * sketch_hashes, cell{0, 0, 0})
+  {}
+
+  std::optional<sketch> sketch::from_blob(const std::string& blob)
+  {
+    const std::size_t cells = blob.size() / cell_blob_size;
+    if (blob.size() % cell_blob_size || cells == 0 || cells % sketch_hashes || cells > CRYPTONOTE_TX_RECONCILIATION_MAX_CELLS)
+      return std::nullopt;
+
+    sketch out{cells};
+    const char* src = blob.data();
+    for (cell& c : out.m_cells)
+    {
+      std::uint32_t count;
+      std::memcpy(&count, src, sizeof(count));
+      std::memcpy(&c.id_sum, src + sizeof(count), sizeof(c.id_sum));
+      std::memcpy(&c.check_sum, src + sizeof(count) + sizeof(c.id_sum), sizeof(c.check_sum));
+      c.count = std::int32_t(SWAP32LE(count));
+      c.id_sum = SWAP64LE(c.id_sum);
+      c.check_sum = SWAP64LE(c.check_sum);
+      src += cell_blob_size;
+    }
+    return out;
+  }
+
+  std::string sketch::to_blob() const
+  {
+    std::string out(m_cells.size() * cell_blob_size, '\0');
+    char* dest = &out[0];
+    for (const cell& c : m_cells)
+    {
+      const std::uint32_t count = SWAP32LE(std::uint32_t(c.count));
+      const std::uint64_t id_sum = SWAP64LE(c.id_sum);
+      const std::uint64_t check_sum = SWAP64LE(c.check_sum);
+      std::memcpy(dest, &count, sizeof(count));
+      std::memcpy(dest + sizeof(count), &id_sum, sizeof(id_sum));
+      std::memcpy(dest + sizeof(count) + sizeof(id_sum), &check_sum, sizeof(check_sum));
+      dest += cell_blob_size;
+    }
+    return out;
+  }
+
+  void sketch::add(const std::uint64_t short_id)
+  {
+    const std::size_t partition = m_cells.size() / sketch_hashes;
+    const std::uint64_t check = get_check(short_id);
+    for (std::size_t hash = 0; hash < sketch_hashes; ++hash)
+    {
+      cell& c = m_cells[get_index(short_id, hash, partition)];
+      ++c.count;
+      c.id_sum ^= short_id;
+      c.check_sum ^= check;
+    }
+  }
+
+  bool sketch::decode(const sketch& remote, std::vector<std::uint64_t>& local_only, std::vector<std::uint64_t>& remote_only) const
+  {
+    if (remote.size() != size())
+      return false;
+
+    std::vector<cell> diff = m_cells;
+    for (std::size_t i = 0; i < diff.size(); ++i)
+    {
+      diff[i].count -= remote.m_cells[i].count;
+      diff[i].id_sum ^= remote.m_cells[i].id_sum;
+      diff[i].check_sum ^= remote.m_cells[i].check_sum;
+    }
+
+    // a crafted sketch could keep peeling forever; an honest one never yields more ids than cells
+    const std::size_t partition = diff.size() / sketch_hashes;
+    std::size_t decoded = 0;
+    for (bool progress = true; progress;)
+    {
+      progress = false;
+      for (const cell& c : diff)
+      {
+        if ((c.count != 1 && c.count != -1) || c.check_sum != get_check(c.id_sum))
+          continue;
+        if (++decoded > diff.size())
+          return false;
+
+        const std::uint64_t id = c.id_sum;
+        const std::int64_t count = c.count;
+        (count == 1 ? local_only : remote_only).push_back(id);
+        const std::uint64_t check = get_check(id);
+        for (std::size_t hash = 0; hash < sketch_hashes; ++hash)
+        {
+          cell& other = diff[get_index(id, hash, partition)];
+          other.count -= count;
+          other.id_sum ^= id;
+          other.check_sum ^= check;
+        }
+        progress = true;
+      }
+    }
+
+    return std::all_of(diff.begin(), diff.end(), [](const cell& c) {
+      return c.count == 0 && c.id_sum == 0 && c.check_sum == 0;
+    });
+  }
+} // reconciliation
+} // cryptonote
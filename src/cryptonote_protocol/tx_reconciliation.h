@@ -0,0 +1,86 @@
+// Copyright (c) 2014-2021, The Monero Project
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "crypto/hash.h"
+
+namespace cryptonote
+{
+namespace reconciliation
+{
+  //! \return Short id of `txid` in a reconciliation round salted with `salt`.
+  std::uint64_t get_short_id(const crypto::hash& txid, std::uint64_t salt) noexcept;
+
+  /*! \return Number of sketch cells needed to reconcile sets of `local` and
+      `remote` sizes, or 0 when the expected difference is too large and the
+      peers should flood each other instead. */
+  std::size_t get_sketch_cells(std::size_t local, std::size_t remote) noexcept;
+
+  /*! Invertible Bloom lookup table of short ids. Each peer builds one over its
+      set with the same number of cells; subtracting them leaves only the
+      symmetric difference of the two sets, which `decode` peels out. The size
+      depends on the difference, not on the size of the sets. */
+  class sketch
+  {
+    struct cell
+    {
+      std::int64_t count;
+      std::uint64_t id_sum;
+      std::uint64_t check_sum;
+    };
+
+    std::vector<cell> m_cells;
+
+  public:
+    //! Empty sketch of `cells` cells, rounded up to a multiple of the hash count.
+    explicit sketch(std::size_t cells);
+
+    //! \return Sketch from `blob`, or `std::nullopt` if malformed.
+    static std::optional<sketch> from_blob(const std::string& blob);
+
+    //! \return Wire format of the sketch.
+    std::string to_blob() const;
+
+    std::size_t size() const noexcept { return m_cells.size(); }
+
+    void add(std::uint64_t short_id);
+
+    /*! Subtract `remote` from this sketch and recover the difference.
+
+        \param[out] local_only Short ids only in this sketch.
+        \param[out] remote_only Short ids only in `remote`.
+        \return False if the difference could not be fully decoded. */
+    bool decode(const sketch& remote, std::vector<std::uint64_t>& local_only, std::vector<std::uint64_t>& remote_only) const;
+  };
+} // reconciliation
+} // cryptonote
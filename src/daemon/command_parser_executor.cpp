@@ -176,6 +176,14 @@ bool t_command_parser_executor::print_net_stats(const std::vector<std::string>&
   return m_executor.print_net_stats();
 }
 
+bool t_command_parser_executor::print_db_stats(const std::vector<std::string>& args)
+{
+  if (args.size() > 1) return false;
+  if (args.size() == 1 && args[0] != "reset") return false;
+
+  return m_executor.print_db_stats(args.size() == 1);
+}
+
 bool t_command_parser_executor::print_blockchain_info(const std::vector<std::string>& args)
 {
   if(!args.size())
@@ -859,6 +867,13 @@ bool t_command_parser_executor::check_blockchain_pruning(const std::vector<std::
   return m_executor.check_blockchain_pruning();
 }
 
+bool t_command_parser_executor::compact_blockchain(const std::vector<std::string>& args)
+{
+  if (!args.empty()) return false;
+
+  return m_executor.compact_blockchain();
+}
+
 bool t_command_parser_executor::set_bootstrap_daemon(const std::vector<std::string>& args)
 {
   struct parsed_t
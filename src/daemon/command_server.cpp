@@ -100,6 +100,12 @@ t_command_server::t_command_server(
     , std::bind(&t_command_parser_executor::print_net_stats, &m_parser, p::_1)
     , "Print network statistics."
     );
+  m_command_lookup.set_handler(
+      "print_db_stats"
+    , std::bind(&t_command_parser_executor::print_db_stats, &m_parser, p::_1)
+    , "print_db_stats [reset]"
+    , "Print the page and entry counts of each database table, and the latencies of the main database operations. With reset, start counting latencies anew afterwards."
+    );
   m_command_lookup.set_handler(
       "print_bc"
     , std::bind(&t_command_parser_executor::print_blockchain_info, &m_parser, p::_1)
@@ -342,13 +348,18 @@ t_command_server::t_command_server(
     m_command_lookup.set_handler(
       "prune_blockchain"
     , std::bind(&t_command_parser_executor::prune_blockchain, &m_parser, p::_1)
-    , "Prune the blockchain."
+    , "Prune the blockchain in the background, or show how far a running prune got."
     );
     m_command_lookup.set_handler(
       "check_blockchain_pruning"
     , std::bind(&t_command_parser_executor::check_blockchain_pruning, &m_parser, p::_1)
     , "Check the blockchain pruning."
     );
+    m_command_lookup.set_handler(
+      "compact_blockchain"
+    , std::bind(&t_command_parser_executor::compact_blockchain, &m_parser, p::_1)
+    , "Rewrite the database without its free space. This needs as much free disk space as the compacted database."
+    );
     m_command_lookup.set_handler(
       "set_bootstrap_daemon"
     , std::bind(&t_command_parser_executor::set_bootstrap_daemon, &m_parser, p::_1)
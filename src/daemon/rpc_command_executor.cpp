@@ -1018,6 +1018,76 @@ bool t_rpc_command_executor::print_net_stats()
     % percent
     % tools::get_human_readable_bytes(limit);
 
+  for (const auto &stats: net_stats_res.traffic_classes_out)
+  {
+    tools::msg_writer() << boost::format("  %s: sent %u bytes (%s) in %u packets")
+      % stats.name
+      % stats.total_bytes_out
+      % tools::get_human_readable_bytes(stats.total_bytes_out)
+      % stats.total_packets_out;
+  }
+
+  return true;
+}
+
+bool t_rpc_command_executor::print_db_stats(bool reset)
+{
+  cryptonote::COMMAND_RPC_GET_DB_STATS::request req;
+  cryptonote::COMMAND_RPC_GET_DB_STATS::response res;
+  std::string fail_message = "Unsuccessful";
+  epee::json_rpc::error error_resp;
+
+  req.reset = reset;
+
+  if (m_is_rpc)
+  {
+    if (!m_rpc_client->json_rpc_request(req, res, "get_db_stats", fail_message.c_str()))
+    {
+      return true;
+    }
+  }
+  else
+  {
+    if (!m_rpc_server->on_get_db_stats(req, res, error_resp) || res.status != CORE_RPC_STATUS_OK)
+    {
+      tools::fail_msg_writer() << make_error(fail_message, res.status);
+      return true;
+    }
+  }
+
+  tools::success_msg_writer() << res.db_name << " database, " << tools::get_human_readable_bytes(res.database_size);
+  tools::msg_writer() << boost::format("%-20s %12s %5s %10s %10s %10s %10s") % "table" % "entries" % "depth" % "branch" % "leaf" % "overflow" % "size";
+  for (const auto &t: res.tables)
+  {
+    const uint64_t pages = t.branch_pages + t.leaf_pages + t.overflow_pages;
+    tools::msg_writer() << boost::format("%-20s %12u %5u %10u %10u %10u %10s") % t.name % t.entries % t.depth
+        % t.branch_pages % t.leaf_pages % t.overflow_pages % tools::get_human_readable_bytes(pages * t.page_size);
+  }
+
+  // percentiles are the upper bound of the histogram bucket they fall in
+  const auto percentile = [](const std::vector<uint64_t> &histogram, uint64_t count, double p) -> std::string {
+    const uint64_t target = std::max<uint64_t>(1, count * p);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < histogram.size(); ++i)
+    {
+      seen += histogram[i];
+      if (seen >= target)
+        return i + 1 == histogram.size() ? ">" + std::to_string(1ull << (i - 1)) : "<" + std::to_string(1ull << i);
+    }
+    return "-";
+  };
+  tools::msg_writer() << "";
+  tools::msg_writer() << boost::format("%-20s %12s %10s %10s %10s %10s (us)") % "operation" % "calls" % "mean" % "p50" % "p99" % "max";
+  for (const auto &op: res.operations)
+  {
+    if (op.count == 0)
+    {
+      tools::msg_writer() << boost::format("%-20s %12u") % op.name % 0;
+      continue;
+    }
+    tools::msg_writer() << boost::format("%-20s %12u %10u %10s %10s %10u") % op.name % op.count % (op.total_us / op.count)
+        % percentile(op.histogram, op.count, 0.5) % percentile(op.histogram, op.count, 0.99) % op.max_us;
+  }
   return true;
 }
 
@@ -1392,7 +1462,15 @@ bool t_rpc_command_executor::is_key_image_spent(const crypto::key_image &ki) {
   if (1 == res.spent_status.size())
   {
     // first as hex
-    tools::success_msg_writer() << ki << ": " << (res.spent_status.front() ? "spent" : "unspent") << (res.spent_status.front() == cryptonote::COMMAND_RPC_IS_KEY_IMAGE_SPENT::SPENT_IN_POOL ? " (in pool)" : "");
+    // older daemons, and those without the spent key index, do not report the spender
+    std::string spender;
+    if (!res.spent_tx_hashes.empty() && !res.spent_tx_hashes.front().empty())
+    {
+      spender = " by tx " + res.spent_tx_hashes.front();
+      if (!res.spent_heights.empty() && res.spent_status.front() == cryptonote::COMMAND_RPC_IS_KEY_IMAGE_SPENT::SPENT_IN_BLOCKCHAIN)
+        spender += " at height " + std::to_string(res.spent_heights.front());
+    }
+    tools::success_msg_writer() << ki << ": " << (res.spent_status.front() ? "spent" : "unspent") << (res.spent_status.front() == cryptonote::COMMAND_RPC_IS_KEY_IMAGE_SPENT::SPENT_IN_POOL ? " (in pool)" : "") << spender;
   }
   else
   {
@@ -1591,7 +1669,10 @@ bool t_rpc_command_executor::print_transaction_pool_stats() {
 
   tools::msg_writer() << n_transactions << " tx(es), " << res.pool_stats.bytes_total << " bytes total (min " << res.pool_stats.bytes_min << ", max " << res.pool_stats.bytes_max << ", avg " << avg_bytes << ", median " << res.pool_stats.bytes_med << ")" << std::endl
       << "fees " << cryptonote::print_money(res.pool_stats.fee_total) << " (avg " << cryptonote::print_money(n_transactions ? res.pool_stats.fee_total / n_transactions : 0) << " per tx" << ", " << cryptonote::print_money(res.pool_stats.bytes_total ? res.pool_stats.fee_total / res.pool_stats.bytes_total : 0) << " per byte)" << std::endl
-      << res.pool_stats.num_double_spends << " double spends, " << res.pool_stats.num_not_relayed << " not relayed, " << res.pool_stats.num_failing << " failing, " << res.pool_stats.num_10m << " older than 10 minutes (oldest " << (res.pool_stats.oldest == 0 ? "-" : get_human_time_ago(res.pool_stats.oldest, now)) << "), " << backlog_message;
+      << res.pool_stats.num_double_spends << " double spends, " << res.pool_stats.num_not_relayed << " not relayed, " << res.pool_stats.num_failing << " failing, " << res.pool_stats.num_10m << " older than 10 minutes (oldest " << (res.pool_stats.oldest == 0 ? "-" : get_human_time_ago(res.pool_stats.oldest, now)) << "), " << backlog_message << std::endl
+      << "memory " << res.pool_stats.memory_total << " bytes" << (res.pool_stats.memory_limit ? (boost::format(" (limit %u)") % res.pool_stats.memory_limit).str() : std::string()) << ": "
+      << res.pool_stats.memory_sorted_txes << " index, " << res.pool_stats.memory_key_images << " key images, " << res.pool_stats.memory_input_cache << " input cache, "
+      << res.pool_stats.memory_parsed_tx_cache << " parsed txes, " << res.pool_stats.memory_timed_out << " timed out; " << res.pool_stats.num_pruned << " tx(es) pruned";
 
   if (n_transactions > 1 && res.pool_stats.histo.size())
   {
@@ -2643,7 +2724,15 @@ bool t_rpc_command_executor::prune_blockchain()
         }
     }
 
-    tools::success_msg_writer() << "Blockchain pruned";
+    if (res.in_progress)
+    {
+      tools::success_msg_writer() << "Pruning blockchain in the background, at height " << res.pruning_height << "/" << res.pruning_target_height
+          << " (" << (res.pruning_target_height ? res.pruning_height * 100 / res.pruning_target_height : 0) << "%)";
+    }
+    else
+    {
+      tools::success_msg_writer() << "Blockchain pruned";
+    }
     return true;
 }
 
@@ -2672,7 +2761,11 @@ bool t_rpc_command_executor::check_blockchain_pruning()
         }
     }
 
-    if (res.pruning_seed)
+    if (res.in_progress)
+    {
+      tools::success_msg_writer() << "Blockchain pruning in progress, at height " << res.pruning_height << "/" << res.pruning_target_height;
+    }
+    else if (res.pruning_seed)
     {
       tools::success_msg_writer() << "Blockchain is pruned";
     }
@@ -2683,6 +2776,33 @@ bool t_rpc_command_executor::check_blockchain_pruning()
     return true;
 }
 
+bool t_rpc_command_executor::compact_blockchain()
+{
+    cryptonote::COMMAND_RPC_COMPACT_BLOCKCHAIN::request req;
+    cryptonote::COMMAND_RPC_COMPACT_BLOCKCHAIN::response res;
+    std::string fail_message = "Unsuccessful";
+    epee::json_rpc::error error_resp;
+
+    if (m_is_rpc)
+    {
+        if (!m_rpc_client->json_rpc_request(req, res, "compact_blockchain", fail_message.c_str()))
+        {
+            return true;
+        }
+    }
+    else
+    {
+        if (!m_rpc_server->on_compact_blockchain(req, res, error_resp) || res.status != CORE_RPC_STATUS_OK)
+        {
+            tools::fail_msg_writer() << make_error(fail_message, res.status);
+            return true;
+        }
+    }
+
+    tools::success_msg_writer() << "Blockchain compacted, database is now " << res.database_size / (1024 * 1024) << " MiB";
+    return true;
+}
+
 bool t_rpc_command_executor::set_bootstrap_daemon(
   const std::string &address,
   const std::string &username,
@@ -170,8 +170,12 @@ public:
 
   bool check_blockchain_pruning();
 
+  bool compact_blockchain();
+
   bool print_net_stats();
 
+  bool print_db_stats(bool reset);
+
   bool version();
 
   bool set_bootstrap_daemon(
@@ -158,6 +158,7 @@ namespace nodetool
       "pad-transactions", "Pad relayed transactions to help defend against traffic volume analysis", false
     };
     const command_line::arg_descriptor<uint32_t> arg_max_connections_per_ip = {"max-connections-per-ip", "Maximum number of connections allowed from the same IP address", 1};
+    const command_line::arg_descriptor<uint32_t> arg_p2p_io_shards = {"p2p-io-shards", "Run p2p connections on this many independent io_services, at least two threads each (0 to share a single io_service)", 0};
     
     std::optional<std::vector<proxy>> get_proxies(boost::program_options::variables_map const& vm)
     {
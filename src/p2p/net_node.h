@@ -116,14 +116,19 @@ namespace nodetool
         flush_time(std::chrono::steady_clock::time_point::max()),
         peer_id(0),
         support_flags(0),
-        m_in_timedsync(false)
+        m_in_timedsync(false),
+        m_compress_levin(false)
     {}
 
+    //! \return True if both sides advertised `P2P_SUPPORT_FLAG_COMPRESSION` in the handshake.
+    bool levin_compression() const noexcept { return m_compress_levin; }
+
     std::vector<cryptonote::blobdata> fluff_txs;
     std::chrono::steady_clock::time_point flush_time;
     peerid_type peer_id;
     uint32_t support_flags;
     bool m_in_timedsync;
+    bool m_compress_levin;
     std::set<epee::net_utils::network_address> sent_addresses;
   };
 
@@ -250,6 +255,7 @@ namespace nodetool
         m_igd(no_igd),
         m_same_version(false),
         m_offline(false),
+        m_tx_reconciliation(false),
         is_closing(false),
         m_network_id(),
         max_connections(1)
@@ -446,6 +452,7 @@ namespace nodetool
     bool m_offline;
     bool m_use_ipv6;
     bool m_require_ipv4;
+    bool m_tx_reconciliation;
     std::atomic<bool> is_closing;
     std::unique_ptr<boost::thread> mPeersLoggerThread;
     //critical_section m_connections_lock;
@@ -453,6 +460,7 @@ namespace nodetool
 
     t_payload_net_handler& m_payload_handler;
     peerlist_storage m_peerlist_storage;
+    std::unique_ptr<peerlist_db> m_peerlist_db;
 
     epee::math_helper::once_a_time_seconds<P2P_DEFAULT_HANDSHAKE_INTERVAL> m_peer_handshake_idle_maker_interval;
     epee::math_helper::once_a_time_seconds<1> m_connections_maker_interval;
@@ -534,6 +542,7 @@ namespace nodetool
     extern const command_line::arg_descriptor<int64_t> arg_limit_rate;
     extern const command_line::arg_descriptor<bool> arg_pad_transactions;
     extern const command_line::arg_descriptor<uint32_t> arg_max_connections_per_ip;
+    extern const command_line::arg_descriptor<uint32_t> arg_p2p_io_shards;
 }
 
 POP_WARNINGS
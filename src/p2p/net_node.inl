@@ -139,18 +139,30 @@ namespace nodetool
     command_line::add_arg(desc, arg_limit_rate);
     command_line::add_arg(desc, arg_pad_transactions);
     command_line::add_arg(desc, arg_max_connections_per_ip);
+    command_line::add_arg(desc, arg_p2p_io_shards);
   }
   //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
   bool node_server<t_payload_net_handler>::init_config()
   {
     TRY_ENTRY();
-    auto storage = peerlist_storage::open(m_config_folder + "/" + P2P_NET_DATA_FILENAME);
-    if (storage)
-      m_peerlist_storage = std::move(*storage);
+    m_peerlist_db = peerlist_db::open(m_config_folder + "/" + P2P_NET_DB_DIRNAME);
+    if (m_peerlist_db && !m_peerlist_db->empty())
+      m_peerlist_storage = peerlist_storage::open(*m_peerlist_db);
+    else
+    {
+      // no peer database yet (or it cannot be opened), import the legacy state file
+      auto storage = peerlist_storage::open(m_config_folder + "/" + P2P_NET_DATA_FILENAME);
+      if (storage)
+        m_peerlist_storage = std::move(*storage);
+    }
 
     network_zone& public_zone = m_network_zones[epee::net_utils::zone::public_];
     public_zone.m_config.m_support_flags = P2P_SUPPORT_FLAGS;
+    if (m_tx_reconciliation)
+      public_zone.m_config.m_support_flags |= P2P_SUPPORT_FLAG_TX_RECONCILIATION;
+    if (epee::levin::compression_available())
+      public_zone.m_config.m_support_flags |= P2P_SUPPORT_FLAG_COMPRESSION;
     public_zone.m_config.m_peer_id = crypto::rand<uint64_t>();
     m_first_connection_maker_call = true;
 
@@ -435,8 +447,9 @@ namespace nodetool
     m_offline = command_line::get_arg(vm, cryptonote::arg_offline);
     m_use_ipv6 = command_line::get_arg(vm, arg_p2p_use_ipv6);
     m_require_ipv4 = !command_line::get_arg(vm, arg_p2p_ignore_ipv4);
+    m_tx_reconciliation = command_line::get_arg(vm, cryptonote::arg_tx_reconciliation);
     public_zone.m_notifier = cryptonote::levin::notify{
-      public_zone.m_net_server.get_io_service(), public_zone.m_net_server.get_config_shared(), nullptr, epee::net_utils::zone::public_, pad_txs, m_payload_handler.get_core()
+      public_zone.m_net_server.get_io_service(), public_zone.m_net_server.get_config_shared(), nullptr, epee::net_utils::zone::public_, pad_txs, m_payload_handler.get_core(), m_tx_reconciliation
     };
 
     if (command_line::has_arg(vm, arg_p2p_add_peer))
@@ -798,6 +811,7 @@ namespace nodetool
     //configure self
 
     public_zone.m_net_server.set_threads_prefix("P2P"); // all zones use these threads/asio::io_service
+    public_zone.m_net_server.set_io_service_shards(command_line::get_arg(vm, arg_p2p_io_shards));
 
     // from here onwards, it's online stuff
     if (m_offline)
@@ -954,11 +968,22 @@ namespace nodetool
     for (auto& zone : m_network_zones)
       zone.second.m_peerlist.get_peerlist(active);
 
-    const std::string state_file_path = m_config_folder + "/" + P2P_NET_DATA_FILENAME;
-    if (!m_peerlist_storage.store(state_file_path, active))
+    if (m_peerlist_db)
     {
-      MWARNING("Failed to save config to file " << state_file_path);
-      return false;
+      if (!m_peerlist_storage.store(*m_peerlist_db, active))
+      {
+        MWARNING("Failed to save peers to " << m_config_folder << "/" << P2P_NET_DB_DIRNAME);
+        return false;
+      }
+    }
+    else
+    {
+      const std::string state_file_path = m_config_folder + "/" + P2P_NET_DATA_FILENAME;
+      if (!m_peerlist_storage.store(state_file_path, active))
+      {
+        MWARNING("Failed to save config to file " << state_file_path);
+        return false;
+      }
     }
     CATCH_ENTRY_L0("node_server::store", false);
     return true;
@@ -1000,8 +1025,9 @@ namespace nodetool
     std::atomic<bool> hsh_result(false);
 	bool timeout = false;
 
+    const boost::posix_time::ptime request_time = boost::posix_time::microsec_clock::universal_time();
     bool r = epee::net_utils::async_invoke_remote_command2<typename COMMAND_HANDSHAKE::response>(context_, COMMAND_HANDSHAKE::ID, arg, zone.m_net_server.get_config_object(),
-      [this, &pi, &ev, &hsh_result, &just_take_peerlist, &context_, &timeout](int code, const typename COMMAND_HANDSHAKE::response& rsp, p2p_connection_context& context)
+      [this, &pi, &ev, &hsh_result, &just_take_peerlist, &context_, &timeout, request_time](int code, const typename COMMAND_HANDSHAKE::response& rsp, p2p_connection_context& context)
     {
       epee::misc_utils::auto_scope_leave_caller scope_exit_handler = epee::misc_utils::create_scope_leave_handler([&](){ev.raise();});
 
@@ -1052,11 +1078,13 @@ namespace nodetool
         }
 
         pi = context.peer_id = rsp.node_data.peer_id;
+        m_payload_handler.update_rtt(context, boost::posix_time::microsec_clock::universal_time() - request_time);
         context.m_rpc_port = rsp.node_data.rpc_port;
         context.m_rpc_credits_per_hash = rsp.node_data.rpc_credits_per_hash;
         context.support_flags = rsp.node_data.support_flags;
         const auto azone = context.m_remote_address.get_zone();
         network_zone& zone = m_network_zones.at(azone);
+        context.m_compress_levin = (context.support_flags & zone.m_config.m_support_flags & P2P_SUPPORT_FLAG_COMPRESSION);
         zone.m_peerlist.set_peer_just_seen(rsp.node_data.peer_id, context.m_remote_address, context.m_pruning_seed, context.m_rpc_port, context.m_rpc_credits_per_hash);
 
         // move
@@ -1106,8 +1134,9 @@ namespace nodetool
     m_payload_handler.get_payload_sync_data(arg.payload_data);
 
     network_zone& zone = m_network_zones.at(context_.m_remote_address.get_zone());
+    const boost::posix_time::ptime request_time = boost::posix_time::microsec_clock::universal_time();
     bool r = epee::net_utils::async_invoke_remote_command2<typename COMMAND_TIMED_SYNC::response>(context_, COMMAND_TIMED_SYNC::ID, arg, zone.m_net_server.get_config_object(),
-      [this](int code, const typename COMMAND_TIMED_SYNC::response& rsp, p2p_connection_context& context)
+      [this, request_time](int code, const typename COMMAND_TIMED_SYNC::response& rsp, p2p_connection_context& context)
     {
       context.m_in_timedsync = false;
       if(code < 0)
@@ -1115,6 +1144,8 @@ namespace nodetool
         LOG_WARNING_CC(context, "COMMAND_TIMED_SYNC invoke failed. (" << code <<  ", " << epee::levin::get_err_descr(code) << ")");
         return;
       }
+      // timed syncs are small and cheap to answer, so they double as pings
+      m_payload_handler.update_rtt(context, boost::posix_time::microsec_clock::universal_time() - request_time);
 
       if(!handle_remote_peerlist(rsp.local_peerlist_new, context))
       {
@@ -2390,6 +2421,7 @@ namespace nodetool
     context.m_rpc_port = arg.node_data.rpc_port;
     context.m_rpc_credits_per_hash = arg.node_data.rpc_credits_per_hash;
     context.support_flags = arg.node_data.support_flags;
+    context.m_compress_levin = (context.support_flags & zone.m_config.m_support_flags & P2P_SUPPORT_FLAG_COMPRESSION);
 
     if(arg.node_data.my_port && zone.m_can_pingback)
     {
@@ -32,6 +32,7 @@
 #include <functional>
 #include <fstream>
 #include <iterator>
+#include <sstream>
 
 #include <boost/archive/binary_iarchive.hpp>
 #include <boost/archive/portable_binary_oarchive.hpp>
@@ -40,6 +41,8 @@
 #include <boost/range/join.hpp>
 #include <boost/serialization/version.hpp>
 
+#include "lmdb/database.h"
+#include "lmdb/table.h"
 #include "net_peerlist_boost_serialization.h"
 
 
@@ -127,6 +130,67 @@ namespace nodetool
     {
       std::copy(src.begin(), src.end(), std::back_inserter(dest));
     }
+
+    void sort_by_zone(peerlist_types& types)
+    {
+      std::sort(types.white.begin(), types.white.end(), by_zone{});
+      std::sort(types.gray.begin(), types.gray.end(), by_zone{});
+      std::sort(types.anchor.begin(), types.anchor.end(), by_zone{});
+    }
+
+    //! Tables of `peerlist_db`, in the order of `peerlist_db::m_stored`
+    constexpr const lmdb::table peerlist_tables[] = {
+      {"white", MDB_CREATE, nullptr, nullptr},
+      {"gray", MDB_CREATE, nullptr, nullptr},
+      {"anchor", MDB_CREATE, nullptr, nullptr}
+    };
+    constexpr const MDB_dbi peerlist_tables_count = sizeof(peerlist_tables) / sizeof(peerlist_tables[0]);
+
+    using peer_records = std::unordered_map<std::string, std::string>;
+
+    MDB_val to_val(const std::string& src) noexcept
+    {
+      return MDB_val{src.size(), const_cast<char*>(src.data())};
+    }
+
+    template<typename T>
+    std::string serialize_peer(const T& elem)
+    {
+      std::ostringstream stream{};
+      {
+        boost::archive::portable_binary_oarchive a{stream};
+        a << elem;
+      }
+      return stream.str();
+    }
+
+    template<typename T>
+    void load_records(std::vector<T>& dest, const peer_records& src)
+    {
+      dest.reserve(src.size());
+      for (const auto& record : src)
+      {
+        try
+        {
+          std::istringstream stream{record.second};
+          boost::archive::portable_binary_iarchive a{stream};
+          T elem{};
+          a >> elem;
+          dest.push_back(std::move(elem));
+        }
+        catch (const std::exception& e)
+        {
+          MWARNING("Skipping unreadable peer record for " << record.first << ": " << e.what());
+        }
+      }
+    }
+
+    template<typename Range>
+    void save_records(peer_records& dest, const Range& elems)
+    {
+      for (const auto& elem : elems)
+        dest[elem.adr.str()] = serialize_peer(elem);
+    }
   } // anonymous
 
   struct peerlist_join
@@ -176,9 +240,7 @@ namespace nodetool
 
       if (src.good())
       {
-        std::sort(out.m_types.white.begin(), out.m_types.white.end(), by_zone{});
-        std::sort(out.m_types.gray.begin(), out.m_types.gray.end(), by_zone{});
-        std::sort(out.m_types.anchor.begin(), out.m_types.anchor.end(), by_zone{});
+        sort_by_zone(out.m_types);
         return {std::move(out)};
       }
     }
@@ -219,6 +281,14 @@ namespace nodetool
     return out;
   }
 
+  peerlist_storage peerlist_storage::open(const peerlist_db& db)
+  {
+    peerlist_storage out{};
+    out.m_types = db.load();
+    sort_by_zone(out.m_types);
+    return out;
+  }
+
   peerlist_storage::~peerlist_storage() noexcept
   {}
 
@@ -247,6 +317,149 @@ namespace nodetool
     return store(dest_file, other);
   }
 
+  bool peerlist_storage::store(peerlist_db& db, const peerlist_types& other) const
+  {
+    return db.store(m_types, other);
+  }
+
+  peerlist_db::peerlist_db(std::unique_ptr<lmdb::database> db)
+    : m_db(std::move(db)), m_stored{}
+  {}
+
+  peerlist_db::~peerlist_db() noexcept
+  {}
+
+  std::unique_ptr<peerlist_db> peerlist_db::open(const std::string& path)
+  {
+    try
+    {
+      boost::filesystem::create_directories(path);
+      expect<lmdb::environment> env = lmdb::open_environment(path.c_str(), peerlist_tables_count);
+      if (!env)
+      {
+        MERROR("Failed to open peer database " << path << ": " << env.error().message());
+        return nullptr;
+      }
+
+      std::unique_ptr<peerlist_db> out{new peerlist_db{std::unique_ptr<lmdb::database>{new lmdb::database{std::move(*env)}}}};
+
+      // write txn, as the tables are created on first use
+      const expect<void> read = out->m_db->try_write([&out] (MDB_txn& txn) -> expect<void>
+      {
+        for (MDB_dbi i = 0; i < peerlist_tables_count; ++i)
+        {
+          out->m_stored[i].clear();
+          const expect<MDB_dbi> table = peerlist_tables[i].open(txn);
+          if (!table)
+            return table.error();
+
+          MDB_cursor* cur = nullptr;
+          MONERO_LMDB_CHECK(mdb_cursor_open(&txn, *table, &cur));
+          const std::unique_ptr<MDB_cursor, lmdb::close_cursor> cursor{cur};
+
+          MDB_val key{};
+          MDB_val value{};
+          int err = mdb_cursor_get(cur, &key, &value, MDB_FIRST);
+          for (; !err; err = mdb_cursor_get(cur, &key, &value, MDB_NEXT))
+          {
+            out->m_stored[i].emplace(
+              std::string{static_cast<const char*>(key.mv_data), key.mv_size},
+              std::string{static_cast<const char*>(value.mv_data), value.mv_size}
+            );
+          }
+          if (err != MDB_NOTFOUND)
+            return {lmdb::error(err)};
+        }
+        return success();
+      });
+      if (!read)
+      {
+        MERROR("Failed to read peer database " << path << ": " << read.error().message());
+        return nullptr;
+      }
+      return out;
+    }
+    catch (const std::exception& e)
+    {
+      MERROR("Failed to open peer database " << path << ": " << e.what());
+    }
+    return nullptr;
+  }
+
+  bool peerlist_db::empty() const noexcept
+  {
+    for (const auto& records : m_stored)
+    {
+      if (!records.empty())
+        return false;
+    }
+    return true;
+  }
+
+  peerlist_types peerlist_db::load() const
+  {
+    peerlist_types out{};
+    load_records(out.white, m_stored[0]);
+    load_records(out.gray, m_stored[1]);
+    load_records(out.anchor, m_stored[2]);
+    return out;
+  }
+
+  bool peerlist_db::store(const peerlist_types& ours, const peerlist_types& other)
+  {
+    try
+    {
+      std::array<peer_records, 3> next{};
+      save_records(next[0], boost::range::join(ours.white, other.white));
+      save_records(next[1], boost::range::join(ours.gray, other.gray));
+      save_records(next[2], boost::range::join(ours.anchor, other.anchor));
+
+      const expect<void> written = m_db->try_write([this, &next] (MDB_txn& txn) -> expect<void>
+      {
+        for (MDB_dbi i = 0; i < peerlist_tables_count; ++i)
+        {
+          const expect<MDB_dbi> table = peerlist_tables[i].open(txn);
+          if (!table)
+            return table.error();
+
+          for (const auto& record : m_stored[i])
+          {
+            if (next[i].count(record.first))
+              continue;
+            MDB_val key = to_val(record.first);
+            const int err = mdb_del(&txn, *table, &key, nullptr);
+            if (err && err != MDB_NOTFOUND)
+              return {lmdb::error(err)};
+          }
+
+          for (const auto& record : next[i])
+          {
+            const auto old = m_stored[i].find(record.first);
+            if (old != m_stored[i].end() && old->second == record.second)
+              continue;
+            MDB_val key = to_val(record.first);
+            MDB_val value = to_val(record.second);
+            MONERO_LMDB_CHECK(mdb_put(&txn, *table, &key, &value, 0));
+          }
+        }
+        return success();
+      });
+      if (!written)
+      {
+        MERROR("Failed to store peers: " << written.error().message());
+        return false;
+      }
+
+      m_stored = std::move(next);
+      return true;
+    }
+    catch (const std::exception& e)
+    {
+      MERROR("Failed to store peers: " << e.what());
+    }
+    return false;
+  }
+
   peerlist_types peerlist_storage::take_zone(epee::net_utils::zone zone)
   {
     peerlist_types out{};
@@ -30,15 +30,19 @@
 
 #pragma once
 
+#include <array>
 #include <iosfwd>
 #include <list>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
 #include <boost/multi_index/identity.hpp>
 #include <boost/multi_index/member.hpp>
+#include <boost/multi_index/random_access_index.hpp>
 #include <boost/optional/optional.hpp>
 #include <boost/range/adaptor/reversed.hpp>
 
@@ -50,6 +54,11 @@
 #include "p2p_protocol_defs.h"
 #include "syncobj.h"
 
+namespace lmdb
+{
+  class database;
+}
+
 namespace nodetool
 {
   struct peerlist_types
@@ -59,6 +68,35 @@ namespace nodetool
     std::vector<anchor_peerlist_entry> anchor;
   };
 
+  //! Peerlists kept in a small LMDB environment, one table per list and one record per peer.
+  class peerlist_db
+  {
+  public:
+    //! \return Peer database in directory `path` (created if needed), or `nullptr` on error.
+    static std::unique_ptr<peerlist_db> open(const std::string& path);
+
+    peerlist_db(const peerlist_db&) = delete;
+
+    ~peerlist_db() noexcept;
+
+    peerlist_db& operator=(const peerlist_db&) = delete;
+
+    //! \return True if no peers are stored.
+    bool empty() const noexcept;
+
+    //! \return Peers in the database. Records that fail to parse are skipped.
+    peerlist_types load() const;
+
+    //! Replace stored peers with `ours` and `other`, only writing records that changed.
+    bool store(const peerlist_types& ours, const peerlist_types& other);
+
+  private:
+    explicit peerlist_db(std::unique_ptr<lmdb::database> db);
+
+    std::unique_ptr<lmdb::database> m_db;
+    std::array<std::unordered_map<std::string, std::string>, 3> m_stored; //!< white, gray, anchor: address -> record on disk
+  };
+
   class peerlist_storage
   {
   public:
@@ -72,6 +110,9 @@ namespace nodetool
     //! \return Peers stored in file at `path`
     static std::optional<peerlist_storage> open(const std::string& path);
 
+    //! \return Peers stored in `db`.
+    static peerlist_storage open(const peerlist_db& db);
+
     peerlist_storage(peerlist_storage&&) = default;
     peerlist_storage(const peerlist_storage&) = delete;
 
@@ -86,6 +127,9 @@ namespace nodetool
     //! Save peers from `this` and `other` in one file at `path`.
     bool store(const std::string& path, const peerlist_types& other) const;
 
+    //! Save peers from `this` and `other` in `db`, writing only what changed since the last store.
+    bool store(peerlist_db& db, const peerlist_types& other) const;
+
     //! \return Peers in `zone` and from remove from `this`.
     peerlist_types take_zone(epee::net_utils::zone zone);
 
@@ -126,6 +170,7 @@ namespace nodetool
     struct by_time{};
     struct by_id{};
     struct by_addr{};
+    struct by_random{};
 
     struct modify_all_but_id
     {
@@ -167,7 +212,9 @@ namespace nodetool
       // access by peerlist_entry::net_adress
       boost::multi_index::ordered_unique<boost::multi_index::tag<by_addr>, boost::multi_index::member<peerlist_entry,epee::net_utils::network_address,&peerlist_entry::adr> >,
       // sort by peerlist_entry::last_seen<
-      boost::multi_index::ordered_non_unique<boost::multi_index::tag<by_time>, boost::multi_index::member<peerlist_entry,int64_t,&peerlist_entry::last_seen> >
+      boost::multi_index::ordered_non_unique<boost::multi_index::tag<by_time>, boost::multi_index::member<peerlist_entry,int64_t,&peerlist_entry::last_seen> >,
+      // contiguous array of entries, for O(1) random sampling
+      boost::multi_index::random_access<boost::multi_index::tag<by_random> >
       >
     > peers_indexed;
 
@@ -436,10 +483,7 @@ namespace nodetool
       return false;
     }
 
-    size_t random_index = crypto::rand_idx(m_peers_gray.size());
-
-    peers_indexed::index<by_time>::type& by_time_index = m_peers_gray.get<by_time>();
-    pe = *epee::misc_utils::move_it_backward(--by_time_index.end(), random_index);
+    pe = m_peers_gray.get<by_random>()[crypto::rand_idx(m_peers_gray.size())];
 
     return true;
 
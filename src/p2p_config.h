@@ -51,6 +51,7 @@ namespace config
 #define BLOCKS_IDS_SYNCHRONIZING_DEFAULT_COUNT          10000  //by default, blocks ids count in synchronizing
 #define BLOCKS_IDS_SYNCHRONIZING_MAX_COUNT              25000  //max blocks ids count in synchronizing
 #define BLOCKS_SYNCHRONIZING_DEFAULT_COUNT              10     //by default, blocks count in blocks downloading
+#define BLOCK_HEADERS_SYNCHRONIZING_MAX_COUNT           2000   //max block headers count in headers-first synchronizing
 
 #define COMMAND_RPC_GET_BLOCKS_FAST_MAX_BLOCK_COUNT     1000
 #define COMMAND_RPC_GET_BLOCKS_FAST_MAX_TX_COUNT        20000
@@ -80,7 +81,10 @@ namespace config
 #define P2P_IDLE_CONNECTION_KILL_INTERVAL               (5*60) //5 minutes
 
 #define P2P_SUPPORT_FLAG_FLUFFY_BLOCKS                  0x01
-#define P2P_SUPPORT_FLAGS                               P2P_SUPPORT_FLAG_FLUFFY_BLOCKS
+#define P2P_SUPPORT_FLAG_BLOCK_HEADERS                  0x02
+#define P2P_SUPPORT_FLAG_TX_RECONCILIATION              0x04 // set only with --tx-reconciliation
+#define P2P_SUPPORT_FLAG_COMPRESSION                    0x08 // set only when built with zstd
+#define P2P_SUPPORT_FLAGS                               (P2P_SUPPORT_FLAG_FLUFFY_BLOCKS | P2P_SUPPORT_FLAG_BLOCK_HEADERS)
 
 #define RPC_IP_FAILS_BEFORE_BLOCK                       3
 
@@ -106,6 +110,16 @@ namespace config
 
 #define CRYPTONOTE_MAX_FRAGMENTS                        20 // ~20 * NOISE_BYTES max payload size for covert/noise send
 
+// see src/cryptonote_protocol/block_response_cache.h
+#define CRYPTONOTE_HOT_BLOCK_CACHE_SIZE                 20   // most recent blocks kept serialized for get_objects
+
+// see src/cryptonote_protocol/tx_reconciliation.h
+#define CRYPTONOTE_TX_RECONCILIATION_INTERVAL           2    // seconds between rounds with each outbound peer
+#define CRYPTONOTE_TX_RECONCILIATION_TIMEOUT            30   // seconds before an unanswered round falls back to flooding
+#define CRYPTONOTE_TX_RECONCILIATION_FLOOD_OUT_PEERS    8    // outbound peers that still receive every tx by flooding
+#define CRYPTONOTE_TX_RECONCILIATION_MAX_SET_SIZE       4000 // txs queued per peer before falling back to flooding
+#define CRYPTONOTE_TX_RECONCILIATION_MAX_CELLS          3000 // ~60 KB sketch
+
 namespace config
 {
   namespace testnet
@@ -143,6 +143,7 @@ namespace cryptonote
     command_line::add_arg(desc, arg_rpc_payment_difficulty);
     command_line::add_arg(desc, arg_rpc_payment_credits);
     command_line::add_arg(desc, arg_rpc_payment_allow_free_loopback);
+    command_line::add_arg(desc, arg_rpc_io_shards);
   }
   //------------------------------------------------------------------------------------------------------------------------------
   core_rpc_server::core_rpc_server(
@@ -249,6 +250,7 @@ namespace cryptonote
     m_restricted = restricted;
     m_net_server.set_threads_prefix("RPC");
     m_net_server.set_connection_filter(&m_p2p);
+    m_net_server.set_io_service_shards(command_line::get_arg(vm, arg_rpc_io_shards));
 
     auto rpc_config = cryptonote::rpc_args::process(vm, true);
     if (!rpc_config)
@@ -530,6 +532,14 @@ namespace cryptonote
       CRITICAL_REGION_LOCAL(epee::net_utils::network_throttle_manager::m_lock_get_global_throttle_out);
       epee::net_utils::network_throttle_manager::get_global_throttle_out().get_stats(res.total_packets_out, res.total_bytes_out);
     }
+    for (std::size_t i = 0; i < std::size_t(epee::net_utils::traffic_class::count); ++i)
+    {
+      const auto priority = epee::net_utils::traffic_class(i);
+      net_traffic_class_stats stats;
+      stats.name = epee::net_utils::traffic_class_to_string(priority);
+      epee::net_utils::connection_basic::get_traffic_class_stats(priority, stats.total_packets_out, stats.total_bytes_out);
+      res.traffic_classes_out.push_back(std::move(stats));
+    }
     res.status = CORE_RPC_STATUS_OK;
     return true;
   }
@@ -1299,8 +1309,19 @@ namespace cryptonote
       return true;
     }
     res.spent_status.clear();
+    res.spent_tx_hashes.assign(spent_status.size(), std::string());
+    res.spent_heights.assign(spent_status.size(), 0);
     for (size_t n = 0; n < spent_status.size(); ++n)
+    {
       res.spent_status.push_back(spent_status[n] ? COMMAND_RPC_IS_KEY_IMAGE_SPENT::SPENT_IN_BLOCKCHAIN : COMMAND_RPC_IS_KEY_IMAGE_SPENT::UNSPENT);
+      crypto::hash tx_hash;
+      uint64_t height;
+      if (spent_status[n] && m_core.get_key_image_spender(key_images[n], tx_hash, height))
+      {
+        res.spent_tx_hashes[n] = epee::string_tools::pod_to_hex(tx_hash);
+        res.spent_heights[n] = height;
+      }
+    }
 
     // check the pool too
     std::vector<cryptonote::tx_info> txs;
@@ -1325,6 +1346,8 @@ namespace cryptonote
             if (key_images[n] == spent_key_image)
             {
               res.spent_status[n] = COMMAND_RPC_IS_KEY_IMAGE_SPENT::SPENT_IN_POOL;
+              if (!i->txs_hashes.empty())
+                res.spent_tx_hashes[n] = i->txs_hashes.front();
               break;
             }
           }
@@ -3207,7 +3230,10 @@ namespace cryptonote
 
     try
     {
-      if (!(req.check ? m_core.check_blockchain_pruning() : m_core.prune_blockchain()))
+      // a check would only find what is not pruned yet while a run is going
+      pruning_progress_t progress;
+      const bool in_progress = m_core.get_blockchain_storage().get_pruning_progress(progress);
+      if (!(req.check ? in_progress || m_core.check_blockchain_pruning() : m_core.prune_blockchain()))
       {
         error_resp.code = CORE_RPC_ERROR_CODE_INTERNAL_ERROR;
         error_resp.message = req.check ? "Failed to check blockchain pruning" : "Failed to prune blockchain";
@@ -3215,6 +3241,12 @@ namespace cryptonote
       }
       res.pruning_seed = m_core.get_blockchain_pruning_seed();
       res.pruned = res.pruning_seed != 0;
+      res.in_progress = m_core.get_blockchain_storage().get_pruning_progress(progress);
+      if (res.in_progress)
+      {
+        res.pruning_height = progress.next_height;
+        res.pruning_target_height = progress.end_height;
+      }
     }
     catch (const std::exception &e)
     {
@@ -3226,6 +3258,67 @@ namespace cryptonote
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_compact_blockchain(const COMMAND_RPC_COMPACT_BLOCKCHAIN::request& req, COMMAND_RPC_COMPACT_BLOCKCHAIN::response& res, epee::json_rpc::error& error_resp, const connection_context *ctx)
+  {
+    RPC_TRACKER(compact_blockchain);
+
+    try
+    {
+      if (!m_core.compact_blockchain())
+      {
+        error_resp.code = CORE_RPC_ERROR_CODE_INTERNAL_ERROR;
+        error_resp.message = "Failed to compact blockchain";
+        return false;
+      }
+      res.database_size = m_core.get_blockchain_storage().get_db().get_database_size();
+    }
+    catch (const std::exception &e)
+    {
+      error_resp.code = CORE_RPC_ERROR_CODE_INTERNAL_ERROR;
+      error_resp.message = "Failed to compact blockchain";
+      return false;
+    }
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_db_stats(const COMMAND_RPC_GET_DB_STATS::request& req, COMMAND_RPC_GET_DB_STATS::response& res, epee::json_rpc::error& error_resp, const connection_context *ctx)
+  {
+    RPC_TRACKER(get_db_stats);
+
+    try
+    {
+      BlockchainDB &db = m_core.get_blockchain_storage().get_db();
+      std::vector<db_table_stats> tables;
+      std::vector<db_operation_stats> operations;
+      if (!db.get_db_stats(tables, operations))
+      {
+        error_resp.code = CORE_RPC_ERROR_CODE_INTERNAL_ERROR;
+        error_resp.message = "Database statistics are not available for " + db.get_db_name();
+        return false;
+      }
+      if (req.reset)
+        db.reset_db_stats();
+
+      res.db_name = db.get_db_name();
+      res.database_size = db.get_database_size();
+      res.tables.reserve(tables.size());
+      for (const auto &t: tables)
+        res.tables.push_back({t.name, t.entries, t.depth, t.branch_pages, t.leaf_pages, t.overflow_pages, t.page_size});
+      res.operations.reserve(operations.size());
+      for (auto &op: operations)
+        res.operations.push_back({op.name, op.count, op.total_us, op.max_us, std::move(op.histogram)});
+    }
+    catch (const std::exception &e)
+    {
+      error_resp.code = CORE_RPC_ERROR_CODE_INTERNAL_ERROR;
+      error_resp.message = "Failed to get database statistics";
+      return false;
+    }
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_rpc_access_info(const COMMAND_RPC_ACCESS_INFO::request& req, COMMAND_RPC_ACCESS_INFO::response& res, epee::json_rpc::error& error_resp, const connection_context *ctx)
   {
     RPC_TRACKER(rpc_access_info);
@@ -3538,4 +3631,10 @@ namespace cryptonote
     , "Allow free access from the loopback address (ie, the local host)"
     , false
     };
+
+  const command_line::arg_descriptor<uint32_t> core_rpc_server::arg_rpc_io_shards = {
+      "rpc-io-shards"
+    , "Run RPC connections on this many independent io_services, at least two threads each (0 to share a single io_service)"
+    , 0
+    };
 }  // namespace cryptonote
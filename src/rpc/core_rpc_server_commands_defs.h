@@ -88,7 +88,7 @@ namespace cryptonote
 // advance which version they will stop working with
 // Don't go over 32767 for any of these
 #define CORE_RPC_VERSION_MAJOR 3
-#define CORE_RPC_VERSION_MINOR 7
+#define CORE_RPC_VERSION_MINOR 14
 #define MAKE_CORE_RPC_VERSION(major,minor) (((major)<<16)|(minor))
 #define CORE_RPC_VERSION MAKE_CORE_RPC_VERSION(CORE_RPC_VERSION_MAJOR, CORE_RPC_VERSION_MINOR)
 
@@ -492,10 +492,14 @@ namespace cryptonote
     struct response_t: public rpc_access_response_base
     {
       std::vector<int> spent_status;
+      std::vector<std::string> spent_tx_hashes; // empty when the spender is not known
+      std::vector<uint64_t> spent_heights; // 0 when not spent in the blockchain, or the spender is not known
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE_PARENT(rpc_access_response_base)
         KV_SERIALIZE(spent_status)
+        KV_SERIALIZE(spent_tx_hashes)
+        KV_SERIALIZE(spent_heights)
       END_KV_SERIALIZE_MAP()
     };
     typedef epee::misc_utils::struct_init<response_t> response;
@@ -798,6 +802,19 @@ namespace cryptonote
 
 
   //-----------------------------------------------
+  struct net_traffic_class_stats
+  {
+    std::string name;
+    uint64_t total_packets_out;
+    uint64_t total_bytes_out;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(name)
+      KV_SERIALIZE(total_packets_out)
+      KV_SERIALIZE(total_bytes_out)
+    END_KV_SERIALIZE_MAP()
+  };
+
   struct COMMAND_RPC_GET_NET_STATS
   {
     struct request_t: public rpc_request_base
@@ -816,6 +833,7 @@ namespace cryptonote
       uint64_t total_bytes_in;
       uint64_t total_packets_out;
       uint64_t total_bytes_out;
+      std::vector<net_traffic_class_stats> traffic_classes_out;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE_PARENT(rpc_response_base)
@@ -824,6 +842,7 @@ namespace cryptonote
         KV_SERIALIZE(total_bytes_in)
         KV_SERIALIZE(total_packets_out)
         KV_SERIALIZE(total_bytes_out)
+        KV_SERIALIZE(traffic_classes_out)
       END_KV_SERIALIZE_MAP()
     };
     typedef epee::misc_utils::struct_init<response_t> response;
@@ -1568,8 +1587,17 @@ namespace cryptonote
     uint64_t histo_98pc;
     std::vector<txpool_histo> histo;
     uint32_t num_double_spends;
-
-    txpool_stats(): bytes_total(0), bytes_min(0), bytes_max(0), bytes_med(0), fee_total(0), oldest(0), txs_total(0), num_failing(0), num_10m(0), num_not_relayed(0), histo_98pc(0), num_double_spends(0) {}
+    uint64_t memory_sorted_txes;
+    uint64_t memory_key_images;
+    uint64_t memory_input_cache;
+    uint64_t memory_parsed_tx_cache;
+    uint64_t memory_timed_out;
+    uint64_t memory_total;
+    uint64_t memory_limit;
+    uint64_t weight_limit;
+    uint64_t num_pruned;
+
+    txpool_stats(): bytes_total(0), bytes_min(0), bytes_max(0), bytes_med(0), fee_total(0), oldest(0), txs_total(0), num_failing(0), num_10m(0), num_not_relayed(0), histo_98pc(0), num_double_spends(0), memory_sorted_txes(0), memory_key_images(0), memory_input_cache(0), memory_parsed_tx_cache(0), memory_timed_out(0), memory_total(0), memory_limit(0), weight_limit(0), num_pruned(0) {}
 
     BEGIN_KV_SERIALIZE_MAP()
       KV_SERIALIZE(bytes_total)
@@ -1585,6 +1613,15 @@ namespace cryptonote
       KV_SERIALIZE(histo_98pc)
       KV_SERIALIZE(histo)
       KV_SERIALIZE(num_double_spends)
+      KV_SERIALIZE_OPT(memory_sorted_txes, (uint64_t)0)
+      KV_SERIALIZE_OPT(memory_key_images, (uint64_t)0)
+      KV_SERIALIZE_OPT(memory_input_cache, (uint64_t)0)
+      KV_SERIALIZE_OPT(memory_parsed_tx_cache, (uint64_t)0)
+      KV_SERIALIZE_OPT(memory_timed_out, (uint64_t)0)
+      KV_SERIALIZE_OPT(memory_total, (uint64_t)0)
+      KV_SERIALIZE_OPT(memory_limit, (uint64_t)0)
+      KV_SERIALIZE_OPT(weight_limit, (uint64_t)0)
+      KV_SERIALIZE_OPT(num_pruned, (uint64_t)0)
     END_KV_SERIALIZE_MAP()
   };
 
@@ -2613,11 +2650,108 @@ namespace cryptonote
     {
       bool pruned;
       uint32_t pruning_seed;
+      bool in_progress;
+      uint64_t pruning_height;
+      uint64_t pruning_target_height;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE_PARENT(rpc_response_base)
         KV_SERIALIZE(pruned)
         KV_SERIALIZE(pruning_seed)
+        KV_SERIALIZE_OPT(in_progress, false)
+        KV_SERIALIZE_OPT(pruning_height, (uint64_t)0)
+        KV_SERIALIZE_OPT(pruning_target_height, (uint64_t)0)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<response_t> response;
+  };
+
+  struct COMMAND_RPC_COMPACT_BLOCKCHAIN
+  {
+    struct request_t: public rpc_request_base
+    {
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_PARENT(rpc_request_base)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<request_t> request;
+
+    struct response_t: public rpc_response_base
+    {
+      uint64_t database_size;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_PARENT(rpc_response_base)
+        KV_SERIALIZE(database_size)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<response_t> response;
+  };
+
+  struct COMMAND_RPC_GET_DB_STATS
+  {
+    struct request_t: public rpc_request_base
+    {
+      bool reset;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_PARENT(rpc_request_base)
+        KV_SERIALIZE_OPT(reset, false)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<request_t> request;
+
+    struct table
+    {
+      std::string name;
+      uint64_t entries;
+      uint32_t depth;
+      uint64_t branch_pages;
+      uint64_t leaf_pages;
+      uint64_t overflow_pages;
+      uint32_t page_size;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(name)
+        KV_SERIALIZE(entries)
+        KV_SERIALIZE(depth)
+        KV_SERIALIZE(branch_pages)
+        KV_SERIALIZE(leaf_pages)
+        KV_SERIALIZE(overflow_pages)
+        KV_SERIALIZE(page_size)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct operation
+    {
+      std::string name;
+      uint64_t count;
+      uint64_t total_us;
+      uint64_t max_us;
+      std::vector<uint64_t> histogram;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(name)
+        KV_SERIALIZE(count)
+        KV_SERIALIZE(total_us)
+        KV_SERIALIZE(max_us)
+        KV_SERIALIZE(histogram)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response_t: public rpc_response_base
+    {
+      std::string db_name;
+      uint64_t database_size;
+      std::vector<table> tables;
+      std::vector<operation> operations;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_PARENT(rpc_response_base)
+        KV_SERIALIZE(db_name)
+        KV_SERIALIZE(database_size)
+        KV_SERIALIZE(tables)
+        KV_SERIALIZE(operations)
       END_KV_SERIALIZE_MAP()
     };
     typedef epee::misc_utils::struct_init<response_t> response;
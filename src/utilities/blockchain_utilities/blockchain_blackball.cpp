@@ -37,6 +37,7 @@
 #include "cryptonote_basic/cryptonote_boost_serialization.h"
 #include "cryptonote_core/tx_pool.h"
 #include "cryptonote_core/cryptonote_core.h"
+#include "blockchain_db/lmdb/db_lmdb.h"
 #include "wallet/ringdb.h"
 #include "version.h"
 
@@ -471,7 +472,7 @@ static bool for_all_transactions(const std::string &filename, const uint64_t &st
       throw std::runtime_error("Bad key size");
     uint64_t height = *(const uint64_t*)k.mv_data;
     blobdata bd;
-    bd.assign(reinterpret_cast<char*>(v.mv_data), v.mv_size);
+    BlockchainLMDB::get_block_blob_from_value(v, bd);
     block b;
     if (!parse_and_validate_block_from_blob(bd, b))
       throw std::runtime_error("Failed to parse block from blob retrieved from the db");
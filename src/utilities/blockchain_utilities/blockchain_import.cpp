@@ -51,6 +51,7 @@ namespace
 bool opt_batch   = true;
 bool opt_verify  = true; // use add_new_block, which does verification before calling add_block
 bool opt_resume  = true;
+bool opt_bulk_load = false; // defer the hash keyed db indexes to a single sorted pass at the end
 bool opt_testnet = true;
 bool opt_stagenet = true;
 
@@ -309,6 +310,9 @@ int import_from_file(cryptonote::core& core, const std::string& import_file_path
     h = start_height;
   }
 
+  if (opt_bulk_load && !core.get_blockchain_storage().get_db().bulk_load_start())
+    MWARNING("The database does not support bulk loading, importing normally");
+
   if (use_batch)
   {
     uint64_t bytes, h2;
@@ -542,6 +546,8 @@ quitting:
     {
       // There was an error, so don't commit pending data.
       // Destructor will abort write txn.
+      if (opt_bulk_load)
+        core.get_blockchain_storage().get_db().batch_abort();
     }
     else
     {
@@ -549,6 +555,13 @@ quitting:
     }
   }
 
+  if (opt_bulk_load)
+  {
+    // index what was committed, even after an error, so the db can be opened again
+    std::cout << refresh_string << "Building indexes..." << ENDL;
+    core.get_blockchain_storage().get_db().bulk_load_finish();
+  }
+
   core.get_blockchain_storage().get_db().show_stats();
   MINFO("Number of blocks imported: " << num_imported);
   if (h > 0)
@@ -594,11 +607,14 @@ int main(int argc, char* argv[])
     "Batch transactions for faster import", true};
   const command_line::arg_descriptor<bool> arg_resume =  {"resume",
     "Resume from current height if output database already exists", true};
+  const command_line::arg_descriptor<bool> arg_bulk_load =  {"bulk-load",
+    "Build the block, tx and key image indexes in one sorted pass at the end instead of per block (requires --dangerous-unverified-import)", false};
 
   command_line::add_arg(desc_cmd_sett, arg_input_file);
   command_line::add_arg(desc_cmd_sett, arg_log_level);
   command_line::add_arg(desc_cmd_sett, arg_batch_size);
   command_line::add_arg(desc_cmd_sett, arg_block_stop);
+  command_line::add_arg(desc_cmd_sett, arg_bulk_load);
 
   command_line::add_arg(desc_cmd_only, arg_count_blocks);
   command_line::add_arg(desc_cmd_only, arg_pop_blocks);
@@ -632,6 +648,7 @@ int main(int argc, char* argv[])
   opt_resume    = command_line::get_arg(vm, arg_resume);
   block_stop    = command_line::get_arg(vm, arg_block_stop);
   db_batch_size = command_line::get_arg(vm, arg_batch_size);
+  opt_bulk_load = command_line::get_arg(vm, arg_bulk_load);
 
   if (command_line::get_arg(vm, command_line::arg_help))
   {
@@ -650,6 +667,11 @@ int main(int argc, char* argv[])
     std::cerr << "Error: batch-size must be > 0" << ENDL;
     return 1;
   }
+  if (opt_bulk_load && opt_verify)
+  {
+    std::cerr << "Error: bulk-load skips duplicate checks until the end, and needs " << arg_noverify.name << ENDL;
+    return 1;
+  }
   if (opt_verify && command_line::is_arg_defaulted(vm, arg_batch_size))
   {
     // usually want batch size default lower if verify on, so progress can be
@@ -708,6 +730,7 @@ int main(int argc, char* argv[])
     MINFO("batch:   " << std::boolalpha << opt_batch << std::noboolalpha);
   }
   MINFO("resume:  " << std::boolalpha << opt_resume  << std::noboolalpha);
+  MINFO("bulk load: " << std::boolalpha << opt_bulk_load << std::noboolalpha);
   MINFO("nettype: " << (opt_testnet ? "testnet" : opt_stagenet ? "stagenet" : "mainnet"));
 
   MINFO("bootstrap file path: " << import_file_path);
@@ -277,6 +277,20 @@ static void prune(MDB_env *env0, MDB_env *env1)
   dbr = mdb_cursor_open(txn0, dbi0_txs_prunable, &cur0_txs_prunable);
   if (dbr) throw std::runtime_error("Failed to create LMDB cursor: " + std::string(mdb_strerror(dbr)));
 
+  // prunable data moved to segment files is not in the tables we copy
+  MDB_dbi dbi0_txs_prunable_cold;
+  dbr = mdb_dbi_open(txn0, "txs_prunable_cold", MDB_INTEGERKEY, &dbi0_txs_prunable_cold);
+  if (dbr == 0)
+  {
+    MDB_stat cold_stats;
+    dbr = mdb_stat(txn0, dbi0_txs_prunable_cold, &cold_stats);
+    if (dbr) throw std::runtime_error("Failed to query size of txs_prunable_cold: " + std::string(mdb_strerror(dbr)));
+    if (cold_stats.ms_entries > 0)
+      throw std::runtime_error("The database keeps old prunable data in segment files, prune it with sumokoind --prune-blockchain instead");
+  }
+  else if (dbr != MDB_NOTFOUND)
+    throw std::runtime_error("Failed to open LMDB dbi: " + std::string(mdb_strerror(dbr)));
+
   dbr = mdb_dbi_open(txn0, "tx_indices", MDB_INTEGERKEY | MDB_DUPSORT | MDB_DUPFIXED, &dbi0_tx_indices);
   if (dbr) throw std::runtime_error("Failed to open LMDB dbi: " + std::string(mdb_strerror(dbr)));
   mdb_set_dupsort(txn0, dbi0_tx_indices, BlockchainLMDB::compare_hash32);
@@ -0,0 +1,286 @@
+// Copyright (c) 2014-2021, The Monero Project
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+#include "string_tools.h"
+#include "common/varint.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "cryptonote_core/tx_pool.h"
+#include "cryptonote_core/blockchain.h"
+#include "blockchain_db/testdb.h"
+
+namespace
+{
+
+struct test_block
+{
+  uint64_t timestamp;
+  cryptonote::difficulty_type cumulative_difficulty;
+  crypto::hash id;
+  uint8_t version;
+};
+
+class TestDB: public cryptonote::BaseTestDB
+{
+public:
+  TestDB(std::vector<test_block> chain): blocks(std::move(chain)) { m_open = true; }
+  virtual uint64_t height() const override { return blocks.size(); }
+  virtual uint64_t get_block_timestamp(const uint64_t &height) const override { return blocks[height].timestamp; }
+  virtual uint64_t get_top_block_timestamp() const override { return blocks.back().timestamp; }
+  virtual cryptonote::difficulty_type get_block_cumulative_difficulty(const uint64_t &height) const override { return blocks[height].cumulative_difficulty; }
+  virtual crypto::hash get_block_hash_from_height(const uint64_t &height) const override { return blocks[height].id; }
+  virtual uint8_t get_hard_fork_version(uint64_t height) const override { return blocks[height].version; }
+  virtual crypto::hash top_block_hash(uint64_t *block_height = NULL) const override
+  {
+    if (block_height)
+      *block_height = blocks.size() - 1;
+    return blocks.back().id;
+  }
+  virtual cryptonote::block get_block_from_height(const uint64_t &height) const override
+  {
+    cryptonote::block b;
+    b.major_version = blocks[height].version;
+    b.minor_version = blocks[height].version;
+    b.timestamp = blocks[height].timestamp;
+    return b;
+  }
+  virtual cryptonote::block get_top_block() const override { return get_block_from_height(blocks.size() - 1); }
+  virtual std::vector<uint64_t> get_block_weights(uint64_t start_height, size_t count) const override
+  {
+    return std::vector<uint64_t>(count, 1);
+  }
+
+private:
+  std::vector<test_block> blocks;
+};
+
+crypto::hash make_id(uint64_t height)
+{
+  crypto::hash id = crypto::null_hash;
+  *(uint64_t*)&id = height + 1;
+  return id;
+}
+
+// a chain of v1 blocks, where the ones after genesis span span_seconds and do total_work
+std::vector<test_block> make_chain(uint64_t span_seconds, cryptonote::difficulty_type total_work)
+{
+  std::vector<test_block> blocks;
+  blocks.push_back({0, 1, make_id(0), 1});
+  blocks.push_back({100000000, 2, make_id(1), 1});
+  blocks.push_back({100000000 + span_seconds / 2, 2 + total_work / 2, make_id(2), 1});
+  blocks.push_back({100000000 + span_seconds, 2 + total_work, make_id(3), 1});
+  return blocks;
+}
+
+cryptonote::blobdata make_header(uint8_t version, uint64_t timestamp, const crypto::hash &prev_id, uint32_t nonce = 0)
+{
+  cryptonote::block_header header;
+  header.major_version = version;
+  header.minor_version = version;
+  header.timestamp = timestamp;
+  header.prev_id = prev_id;
+  header.nonce = nonce;
+  cryptonote::blobdata blob = cryptonote::t_serializable_object_to_blob(header);
+  const crypto::hash tree_root_hash = crypto::null_hash;
+  blob.append(reinterpret_cast<const char*>(&tree_root_hash), sizeof(tree_root_hash));
+  blob.append(tools::get_varint_data((size_t)1));
+  return blob;
+}
+
+// the block id, which hashes the hashing blob as a serialized string
+crypto::hash header_id(const cryptonote::blobdata &header)
+{
+  crypto::hash id;
+  cryptonote::get_object_hash(header, id);
+  return id;
+}
+
+}
+
+#define PREFIX(blocks, fork_height) \
+  std::unique_ptr<cryptonote::Blockchain> bc; \
+  cryptonote::tx_memory_pool txpool(*bc); \
+  bc.reset(new cryptonote::Blockchain(txpool)); \
+  const std::pair<uint8_t, uint64_t> hard_forks[] = { \
+    std::make_pair((uint8_t)1, (uint64_t)0), std::make_pair((uint8_t)2, (uint64_t)fork_height), std::make_pair((uint8_t)0, (uint64_t)0) \
+  }; \
+  const cryptonote::test_options test_options = { hard_forks, 0 }; \
+  ASSERT_TRUE(bc->init(new TestDB(blocks), cryptonote::FAKECHAIN, true, &test_options, 0, NULL)); \
+  ASSERT_EQ(bc->get_verified_headers_height(), 4)
+
+TEST(block_headers, parse_hashing_blob)
+{
+  const crypto::hash prev_id = make_id(7);
+  const cryptonote::blobdata blob = make_header(2, 1234567, prev_id, 42);
+  cryptonote::block_header header;
+  ASSERT_TRUE(cryptonote::parse_block_hashing_blob(blob, header));
+  ASSERT_EQ(header.major_version, 2);
+  ASSERT_EQ(header.minor_version, 2);
+  ASSERT_EQ(header.timestamp, 1234567);
+  ASSERT_EQ(header.prev_id, prev_id);
+  ASSERT_EQ(header.nonce, 42);
+}
+
+TEST(block_headers, parse_hashing_blob_invalid)
+{
+  const cryptonote::blobdata blob = make_header(1, 1234567, make_id(7));
+  cryptonote::block_header header;
+
+  // no tx count
+  ASSERT_FALSE(cryptonote::parse_block_hashing_blob(blob.substr(0, blob.size() - 1), header));
+  // no tree root
+  ASSERT_FALSE(cryptonote::parse_block_hashing_blob(blob.substr(0, blob.size() - 1 - sizeof(crypto::hash)), header));
+  // trailing garbage
+  ASSERT_FALSE(cryptonote::parse_block_hashing_blob(blob + std::string(10, '\x01'), header));
+  // no miner tx
+  cryptonote::blobdata no_txes = blob;
+  no_txes.back() = 0;
+  ASSERT_FALSE(cryptonote::parse_block_hashing_blob(no_txes, header));
+  // truncated header
+  ASSERT_FALSE(cryptonote::parse_block_hashing_blob(blob.substr(0, 3), header));
+}
+
+TEST(block_headers, hashing_blob_from_block_blob)
+{
+  for (size_t version = 1; version <= 2; ++version)
+  {
+    for (size_t n_txes = 0; n_txes < 3; ++n_txes)
+    {
+      cryptonote::block b;
+      b.major_version = version;
+      b.minor_version = version;
+      b.timestamp = 1234567;
+      b.prev_id = make_id(7);
+      b.nonce = 42;
+      b.miner_tx.version = version;
+      b.miner_tx.unlock_time = 67;
+      b.miner_tx.vin.push_back(cryptonote::txin_gen{6});
+      b.miner_tx.vout.push_back({1000, cryptonote::txout_to_key(crypto::public_key{})});
+      b.miner_tx.extra.resize(33, 1);
+      b.miner_tx.rct_signatures.type = rct::RCTTypeNull;
+      for (size_t i = 0; i < n_txes; ++i)
+        b.tx_hashes.push_back(make_id(100 + i));
+      const cryptonote::blobdata block_blob = cryptonote::block_to_blob(b);
+
+      cryptonote::blobdata hashing_blob;
+      ASSERT_TRUE(cryptonote::get_block_hashing_blob(block_blob, hashing_blob));
+      ASSERT_EQ(hashing_blob, cryptonote::get_block_hashing_blob(b));
+
+      ASSERT_FALSE(cryptonote::get_block_hashing_blob(block_blob.substr(0, block_blob.size() - sizeof(crypto::hash)), hashing_blob));
+      ASSERT_FALSE(cryptonote::get_block_hashing_blob(block_blob + "x", hashing_blob));
+    }
+  }
+}
+
+TEST(block_headers, prevalidate_linkage)
+{
+  // spread out blocks, so the next difficulty is 1 and any hash passes
+  PREFIX(make_chain(1000000000, 1000000), 1000);
+
+  const cryptonote::blobdata header0 = make_header(1, 100000000 + 1000000240, make_id(3));
+  const crypto::hash id0 = header_id(header0);
+  const cryptonote::blobdata header1 = make_header(1, 100000000 + 1000000480, id0);
+  const crypto::hash id1 = header_id(header1);
+
+  // the id must match the header
+  ASSERT_FALSE(bc->prevalidate_block_headers(4, {id1}, {header0}));
+  // the header must build on the chain
+  ASSERT_FALSE(bc->prevalidate_block_headers(4, {id1}, {header1}));
+  // and on each other, or none of them is kept
+  const cryptonote::blobdata fork_header = make_header(1, 100000000 + 1000000480, make_id(3));
+  ASSERT_FALSE(bc->prevalidate_block_headers(4, {id0, header_id(fork_header)}, {header0, fork_header}));
+  ASSERT_EQ(bc->get_verified_headers_height(), 4);
+
+  ASSERT_TRUE(bc->prevalidate_block_headers(4, {id0}, {header0}));
+  ASSERT_EQ(bc->get_verified_headers_height(), 5);
+  // headers we already verified are skipped
+  ASSERT_TRUE(bc->prevalidate_block_headers(4, {id0, id1}, {header0, header1}));
+  ASSERT_EQ(bc->get_verified_headers_height(), 6);
+}
+
+TEST(block_headers, prevalidate_version)
+{
+  PREFIX(make_chain(1000000000, 1000000), 4);
+
+  const cryptonote::blobdata old_header = make_header(1, 100000000 + 1000000240, make_id(3));
+  ASSERT_FALSE(bc->prevalidate_block_headers(4, {header_id(old_header)}, {old_header}));
+  ASSERT_EQ(bc->get_verified_headers_height(), 4);
+}
+
+TEST(block_headers, prevalidate_pow)
+{
+  // all blocks at once, so the next difficulty is huge and an unmined header fails
+  PREFIX(make_chain(0, 1000000), 1000);
+
+  const cryptonote::blobdata header = make_header(1, 100000000, make_id(3));
+  ASSERT_FALSE(bc->prevalidate_block_headers(4, {header_id(header)}, {header}));
+  ASSERT_EQ(bc->get_verified_headers_height(), 4);
+}
+
+TEST(block_headers, prevalidate_checkpoint)
+{
+  PREFIX(make_chain(1000000000, 1000000), 1000);
+
+  const cryptonote::blobdata header = make_header(1, 100000000 + 1000000240, make_id(3));
+  const crypto::hash id = header_id(header);
+
+  cryptonote::checkpoints mismatch;
+  ASSERT_TRUE(mismatch.add_checkpoint(4, epee::string_tools::pod_to_hex(make_id(4))));
+  bc->set_checkpoints(std::move(mismatch));
+  ASSERT_FALSE(bc->prevalidate_block_headers(4, {id}, {header}));
+  ASSERT_EQ(bc->get_verified_headers_height(), 4);
+
+  cryptonote::checkpoints match;
+  ASSERT_TRUE(match.add_checkpoint(4, epee::string_tools::pod_to_hex(id)));
+  bc->set_checkpoints(std::move(match));
+  ASSERT_TRUE(bc->prevalidate_block_headers(4, {id}, {header}));
+  ASSERT_EQ(bc->get_verified_headers_height(), 5);
+}
+
+TEST(block_headers, prevalidate_fork_boundary)
+{
+  // v1 difficulty of the next block is 1, but v2 clamps the time span and asks for 96 * 240 / 2880
+  PREFIX(make_chain(1000000000, 96), 4);
+
+  // like consensus, the first v2 block already gets its difficulty from the v2 algorithm
+  ASSERT_EQ(bc->get_difficulty_for_next_block(), 8);
+
+  // so a nonce only good enough for v1 is rejected, and one good enough for v2 is accepted
+  cryptonote::blobdata weak, strong;
+  for (uint32_t nonce = 0; weak.empty() || strong.empty(); ++nonce)
+  {
+    const cryptonote::blobdata header = make_header(2, 100000000 + 1000000240, make_id(3), nonce);
+    crypto::hash pow;
+    ASSERT_TRUE(cryptonote::get_block_longhash(header, 2, pow, 4));
+    (cryptonote::check_hash(pow, 8) ? strong : weak) = header;
+  }
+  ASSERT_FALSE(bc->prevalidate_block_headers(4, {header_id(weak)}, {weak}));
+  ASSERT_EQ(bc->get_verified_headers_height(), 4);
+  ASSERT_TRUE(bc->prevalidate_block_headers(4, {header_id(strong)}, {strong}));
+  ASSERT_EQ(bc->get_verified_headers_height(), 5);
+}
@@ -31,6 +31,7 @@
 #include "crypto/crypto.h"
 #include "cryptonote_protocol/cryptonote_protocol_defs.h"
 #include "cryptonote_protocol/block_queue.h"
+#include "common/pruning.h"
 
 static const boost::uuids::uuid &uuid1()
 {
@@ -87,3 +88,29 @@ TEST(block_queue, flush_uuid)
   bq.add_blocks(0, 200, uuid1(), na);
   ASSERT_EQ(bq.get_max_block_height(), 399);
 }
+
+TEST(block_queue, reserve_span_full_data_stripe)
+{
+  cryptonote::block_queue bq;
+  epee::net_utils::network_address na;
+  std::vector<std::pair<crypto::hash, uint64_t>> hashes;
+  for (uint64_t h = 0; h < 100; ++h)
+    hashes.push_back(std::make_pair(crypto::rand<crypto::hash>(), 1));
+  const uint64_t blockchain_height = 100000;
+  const uint32_t seed1 = tools::make_pruning_seed(1, CRYPTONOTE_PRUNING_LOG_STRIPES);
+  const uint32_t seed2 = tools::make_pruning_seed(2, CRYPTONOTE_PRUNING_LOG_STRIPES);
+
+  // we're on stripe 1 and need full data for it, a stripe 2 peer can't serve it
+  std::pair<uint64_t, uint64_t> span = bq.reserve_span(1, 100, 50, uuid1(), na, true, seed1, seed2, blockchain_height, hashes);
+  ASSERT_EQ(span.second, 0);
+
+  // a peer on our stripe can
+  span = bq.reserve_span(1, 100, 50, uuid2(), na, true, seed1, seed1, blockchain_height, hashes);
+  ASSERT_EQ(span.first, 1);
+  ASSERT_EQ(span.second, 50);
+
+  // and so can an unpruned peer
+  span = bq.reserve_span(1, 100, 50, uuid1(), na, true, seed1, 0, blockchain_height, hashes);
+  ASSERT_EQ(span.first, 51);
+  ASSERT_EQ(span.second, 50);
+}
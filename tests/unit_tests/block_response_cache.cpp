@@ -0,0 +1,125 @@
+// Copyright (c) 2014-2021, The Monero Project
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include <gtest/gtest.h>
+
+#include "crypto/crypto.h"
+#include "cryptonote_protocol/block_response_cache.h"
+#include "cryptonote_protocol/cryptonote_protocol_defs.h"
+#include "storages/portable_storage_template_helper.h"
+
+namespace
+{
+  cryptonote::block_complete_entry make_entry(const bool pruned, const std::size_t txs)
+  {
+    cryptonote::block_complete_entry bce;
+    bce.pruned = pruned;
+    bce.block = std::string(200, 'b');
+    bce.block_weight = pruned ? 12345 : 0;
+    for (std::size_t i = 0; i < txs; ++i)
+      bce.txs.push_back({std::string(100 + i, char('0' + i)), pruned ? crypto::rand<crypto::hash>() : crypto::null_hash});
+    return bce;
+  }
+
+  std::string store(cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request& rsp)
+  {
+    epee::byte_slice out;
+    EXPECT_TRUE(epee::serialization::store_t_to_binary(rsp, out));
+    return {reinterpret_cast<const char*>(out.data()), out.size()};
+  }
+
+  std::string write(const std::vector<epee::byte_slice>& sections, const cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request& rsp)
+  {
+    epee::byte_stream out;
+    cryptonote::block_response_cache::write_get_objects(out, epee::to_span(sections), rsp.missed_ids, rsp.current_blockchain_height);
+    return {reinterpret_cast<const char*>(out.data()), out.size()};
+  }
+}
+
+TEST(block_response_cache, write_get_objects)
+{
+  cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request rsp{};
+  rsp.current_blockchain_height = 1000000;
+  EXPECT_EQ(store(rsp), write({}, rsp));
+
+  rsp.blocks.push_back(make_entry(false, 0));
+  rsp.blocks.push_back(make_entry(false, 3));
+  rsp.blocks.push_back(make_entry(true, 2));
+  rsp.missed_ids.push_back(crypto::rand<crypto::hash>());
+
+  std::vector<epee::byte_slice> sections;
+  for (const auto& bce : rsp.blocks)
+    sections.push_back(cryptonote::block_response_cache::serialize_section(bce));
+  EXPECT_EQ(store(rsp), write(sections, rsp));
+
+  rsp.missed_ids.clear();
+  EXPECT_EQ(store(rsp), write(sections, rsp));
+}
+
+TEST(block_response_cache, window)
+{
+  cryptonote::block_response_cache cache;
+  const crypto::hash a = crypto::rand<crypto::hash>();
+  const crypto::hash b = crypto::rand<crypto::hash>();
+  const cryptonote::block_complete_entry full = make_entry(false, 2);
+  const cryptonote::block_complete_entry pruned = make_entry(true, 2);
+
+  std::vector<epee::byte_slice> sections;
+  cryptonote::blobdata block;
+  std::vector<cryptonote::blobdata> txs;
+
+  // outside the window, serialized but not kept
+  EXPECT_FALSE(cache.add(a, full).empty());
+  EXPECT_FALSE(cache.get_sections({a}, false, sections));
+  EXPECT_EQ(0u, cache.size());
+
+  cache.set_chain(b, {a, b});
+  EXPECT_EQ(b, cache.top());
+  const epee::byte_slice section = cache.add(a, full);
+  ASSERT_FALSE(section.empty());
+  EXPECT_TRUE(cache.get_sections({a}, false, sections));
+  ASSERT_EQ(1u, sections.size());
+  EXPECT_EQ(section.data(), sections[0].data());
+  EXPECT_FALSE(cache.get_sections({a}, true, sections));
+  EXPECT_FALSE(cache.get_sections({a, b}, false, sections));
+
+  ASSERT_TRUE(cache.get_blobs(a, block, txs));
+  EXPECT_EQ(full.block, block);
+  ASSERT_EQ(2u, txs.size());
+  EXPECT_EQ(full.txs[1].blob, txs[1]);
+
+  cache.add(a, pruned);
+  EXPECT_TRUE(cache.get_sections({a, a}, true, sections));
+  EXPECT_EQ(2u, sections.size());
+  EXPECT_NE(0u, cache.size());
+
+  // reorganized away
+  const crypto::hash c = crypto::rand<crypto::hash>();
+  cache.set_chain(c, {b, c});
+  EXPECT_FALSE(cache.get_sections({a}, false, sections));
+  EXPECT_FALSE(cache.get_blobs(a, block, txs));
+  EXPECT_EQ(0u, cache.size());
+}
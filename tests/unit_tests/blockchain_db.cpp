@@ -28,9 +28,13 @@
 
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string/predicate.hpp>
+#include <algorithm>
 #include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <numeric>
 #include <chrono>
+#include <future>
 #include <thread>
 
 #include "gtest/gtest.h"
@@ -38,6 +42,7 @@
 #include "string_tools.h"
 #include "blockchain_db/blockchain_db.h"
 #include "blockchain_db/lmdb/db_lmdb.h"
+#include "blockchain_db/memory/db_memory.h"
 #include "cryptonote_basic/cryptonote_format_utils.h"
 
 using namespace cryptonote;
@@ -230,7 +235,7 @@ protected:
 
 using testing::Types;
 
-typedef Types<BlockchainLMDB> implementations;
+typedef Types<BlockchainLMDB, BlockchainMemory> implementations;
 
 TYPED_TEST_CASE(BlockchainDBTest, implementations);
 
@@ -341,4 +346,549 @@ TYPED_TEST(BlockchainDBTest, RetrieveBlockData)
   ASSERT_HASH_EQ(get_block_hash(this->m_blocks[1].first), hashes[1]);
 }
 
+TYPED_TEST(BlockchainDBTest, HasKeyImages)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  // make sure open does not throw
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  db_wtxn_guard guard(this->m_db);
+
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+
+  // spent key images interleaved with unspent ones, in no particular order
+  std::vector<crypto::key_image> key_images;
+  for (const auto& txs : this->m_txs)
+  {
+    for (const auto& tx : txs)
+    {
+      for (const auto& in : tx.first.vin)
+      {
+        if (in.type() == typeid(txin_to_key))
+          key_images.push_back(boost::get<txin_to_key>(in).k_image);
+        key_images.push_back(crypto::rand<crypto::key_image>());
+      }
+    }
+  }
+  key_images.push_back(crypto::rand<crypto::key_image>());
+  std::shuffle(key_images.begin(), key_images.end(), crypto::random_device{});
+
+  std::vector<bool> spent;
+  ASSERT_NO_THROW(this->m_db->has_key_images(epee::to_span(key_images), spent));
+  ASSERT_EQ(key_images.size(), spent.size());
+  for (size_t i = 0; i < key_images.size(); ++i)
+    ASSERT_EQ(this->m_db->has_key_image(key_images[i]), spent[i]);
+
+  ASSERT_NO_THROW(this->m_db->has_key_images(epee::span<const crypto::key_image>(), spent));
+  ASSERT_TRUE(spent.empty());
+}
+
+TYPED_TEST(BlockchainDBTest, CompressedStorage)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  // compression is a no-op when zstd support is not built in, and the blobs must round trip either way
+  ASSERT_NO_THROW(this->m_db->open(dirPath, DBF_COMPRESS));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  {
+    db_wtxn_guard guard(this->m_db);
+    ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+    ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+  }
+
+  // reopening without the flag keeps the database readable
+  ASSERT_NO_THROW(this->m_db->close());
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+
+  for (size_t i = 0; i < this->m_blocks.size(); ++i)
+  {
+    ASSERT_EQ(this->m_blocks[i].second, this->m_db->get_block_blob_from_height(i));
+    for (const auto &tx: this->m_txs[i])
+    {
+      blobdata bd;
+      ASSERT_TRUE(this->m_db->get_tx_blob(get_transaction_hash(tx.first), bd));
+      ASSERT_EQ(tx.second, bd);
+    }
+  }
+}
+
+TYPED_TEST(BlockchainDBTest, BlockStartingWithCompressionMarker)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath, DBF_COMPRESS));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  // version 255 serializes to a leading 0xff, the byte compressed blocks start with
+  block b = this->m_blocks[0].first;
+  b.major_version = 255;
+  const blobdata bd = block_to_blob(b);
+  ASSERT_EQ(0xff, (uint8_t)bd[0]);
+
+  db_wtxn_guard guard(this->m_db);
+#ifndef HAVE_ZSTD
+  // it cannot be told apart from a compressed block, so it is refused rather than stored unreadable
+  if (this->m_db->get_db_name() == "lmdb")
+  {
+    ASSERT_THROW(this->m_db->add_block(std::make_pair(b, bd), t_sizes[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]), DB_ERROR);
+    return;
+  }
+#endif
+  ASSERT_NO_THROW(this->m_db->add_block(std::make_pair(b, bd), t_sizes[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  ASSERT_EQ(bd, this->m_db->get_block_blob_from_height(0));
+}
+
+TYPED_TEST(BlockchainDBTest, BlockCacheInvalidatedByPop)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  {
+    db_wtxn_guard guard(this->m_db);
+    ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+    ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+  }
+
+  // read twice, the second time from the cache
+  for (int i = 0; i < 2; ++i)
+  {
+    ASSERT_HASH_EQ(get_block_hash(this->m_blocks[1].first), get_block_hash(this->m_db->get_block_from_height(1)));
+    ASSERT_EQ(t_diffs[1], this->m_db->get_block_cumulative_difficulty(1));
+    ASSERT_EQ(t_coins[1], this->m_db->get_block_already_generated_coins(1));
+  }
+
+  block b;
+  std::vector<transaction> txs;
+  ASSERT_NO_THROW(this->m_db->pop_block(b, txs));
+  ASSERT_THROW(this->m_db->get_block_from_height(1), BLOCK_DNE);
+  ASSERT_THROW(this->m_db->get_block_hash_from_height(1), BLOCK_DNE);
+  ASSERT_HASH_EQ(get_block_hash(this->m_blocks[0].first), get_block_hash(this->m_db->get_block_from_height(0)));
+}
+
+TYPED_TEST(BlockchainDBTest, OnlineCompaction)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  {
+    db_wtxn_guard guard(this->m_db);
+    ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  }
+
+  // a block added between the snapshot and the swap is replayed into the copy
+  ASSERT_TRUE(this->m_db->compact_start());
+  {
+    db_wtxn_guard guard(this->m_db);
+    ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+  }
+  ASSERT_TRUE(this->m_db->compact_finish());
+  ASSERT_FALSE(boost::filesystem::exists(dirPath + "-compact"));
+
+  ASSERT_EQ(this->m_blocks.size(), this->m_db->height());
+  for (size_t i = 0; i < this->m_blocks.size(); ++i)
+  {
+    ASSERT_EQ(this->m_blocks[i].second, this->m_db->get_block_blob_from_height(i));
+    ASSERT_EQ(t_diffs[i], this->m_db->get_block_cumulative_difficulty(i));
+    for (const auto &tx: this->m_txs[i])
+    {
+      blobdata bd;
+      ASSERT_TRUE(this->m_db->get_tx_blob(get_transaction_hash(tx.first), bd));
+      ASSERT_EQ(tx.second, bd);
+    }
+  }
+}
+
+TYPED_TEST(BlockchainDBTest, ReorgDuringCompaction)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  {
+    db_wtxn_guard guard(this->m_db);
+    ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+    ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+  }
+
+  // a thread which read from the db before the swap keeps reading after it
+  std::promise<void> read_before, compacted;
+  std::shared_future<void> compacted_future = compacted.get_future().share();
+  crypto::hash hash_before = crypto::null_hash, hash_after = crypto::null_hash;
+  uint64_t height_after = 0;
+  std::thread reader([&]() {
+    hash_before = this->m_db->get_block_hash_from_height(1);
+    read_before.set_value();
+    compacted_future.wait();
+    height_after = this->m_db->height();
+    hash_after = this->m_db->top_block_hash();
+  });
+  read_before.get_future().wait();
+
+  // the snapshot has both blocks, but the top one is popped before the swap
+  ASSERT_TRUE(this->m_db->compact_start());
+  block b;
+  std::vector<transaction> txs;
+  ASSERT_NO_THROW(this->m_db->pop_block(b, txs));
+  const bool finished = this->m_db->compact_finish();
+  compacted.set_value();
+  reader.join();
+  ASSERT_TRUE(finished);
+
+  ASSERT_HASH_EQ(get_block_hash(this->m_blocks[1].first), hash_before);
+  ASSERT_EQ(1, height_after);
+  ASSERT_HASH_EQ(get_block_hash(this->m_blocks[0].first), hash_after);
+
+  ASSERT_EQ(1, this->m_db->height());
+  ASSERT_THROW(this->m_db->get_block_hash_from_height(1), BLOCK_DNE);
+  for (const auto &tx: this->m_txs[1])
+    ASSERT_FALSE(this->m_db->tx_exists(get_transaction_hash(tx.first)));
+
+  // the popped block's outputs and key images are gone from the copy too, so it can be added again
+  {
+    db_wtxn_guard guard(this->m_db);
+    ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+  }
+  ASSERT_EQ(2, this->m_db->height());
+  ASSERT_EQ(this->m_blocks[1].second, this->m_db->get_block_blob_from_height(1));
+}
+
+TYPED_TEST(BlockchainDBTest, BulkLoad)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  {
+    db_wtxn_guard guard(this->m_db);
+    ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  }
+
+  // backends which do not defer their indexes just add blocks as usual
+  const bool bulk = this->m_db->bulk_load_start();
+
+  // what an aborted block spooled is dropped, so adding it again does not leave duplicates
+  this->m_db->block_wtxn_start();
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+  this->m_db->block_wtxn_abort();
+  ASSERT_EQ(1, this->m_db->height());
+  {
+    db_wtxn_guard guard(this->m_db);
+    ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+  }
+  if (bulk)
+  {
+    block b;
+    std::vector<transaction> txs;
+    ASSERT_THROW(this->m_db->pop_block(b, txs), DB_ERROR);
+  }
+  ASSERT_NO_THROW(this->m_db->bulk_load_finish());
+
+  // the deferred entries went in alongside those from before the bulk load
+  for (size_t i = 0; i < this->m_blocks.size(); ++i)
+  {
+    uint64_t height;
+    ASSERT_TRUE(this->m_db->block_exists(get_block_hash(this->m_blocks[i].first), &height));
+    ASSERT_EQ(i, height);
+    ASSERT_TRUE(this->m_db->tx_exists(get_transaction_hash(this->m_blocks[i].first.miner_tx)));
+    for (const auto &tx: this->m_txs[i])
+    {
+      ASSERT_TRUE(this->m_db->tx_exists(get_transaction_hash(tx.first)));
+      for (const auto &in: tx.first.vin)
+        if (in.type() == typeid(txin_to_key))
+        {
+          ASSERT_TRUE(this->m_db->has_key_image(boost::get<txin_to_key>(in).k_image));
+        }
+    }
+  }
+
+  // and the db opens normally again
+  ASSERT_NO_THROW(this->m_db->close());
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  ASSERT_TRUE(this->m_db->is_open());
+  ASSERT_EQ(this->m_blocks.size(), this->m_db->height());
+}
+
+TYPED_TEST(BlockchainDBTest, PruningResumesFromCheckpoint)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  for (size_t i = 0; i < this->m_blocks.size(); ++i)
+  {
+    db_wtxn_guard guard(this->m_db);
+    ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[i], t_sizes[i], t_sizes[i], t_diffs[i], t_coins[i], this->m_txs[i]));
+  }
+
+  uint64_t pruned_bytes;
+  pruning_progress_t progress;
+  if (this->m_db->get_db_name() == "memory")
+  {
+    ASSERT_THROW(this->m_db->prune_blockchain_step(0, 1, 1, pruned_bytes), DB_ERROR);
+    return;
+  }
+
+  // one block per step, the seed is recorded by the first one
+  ASSERT_FALSE(this->m_db->get_pruning_progress(progress));
+  ASSERT_FALSE(this->m_db->prune_blockchain_step(0, 1, std::numeric_limits<uint64_t>::max(), pruned_bytes));
+  const uint32_t pruning_seed = this->m_db->get_blockchain_pruning_seed();
+  ASSERT_NE(0, pruning_seed);
+  ASSERT_TRUE(this->m_db->get_pruning_progress(progress));
+  ASSERT_EQ(1, progress.next_height);
+  ASSERT_EQ(this->m_blocks.size(), progress.end_height);
+
+  // and the run survives a restart
+  ASSERT_NO_THROW(this->m_db->close());
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  ASSERT_TRUE(this->m_db->get_pruning_progress(progress));
+  ASSERT_EQ(1, progress.next_height);
+
+  ASSERT_TRUE(this->m_db->prune_blockchain_step(0, 1, std::numeric_limits<uint64_t>::max(), pruned_bytes));
+  ASSERT_FALSE(this->m_db->get_pruning_progress(progress));
+  ASSERT_EQ(pruning_seed, this->m_db->get_blockchain_pruning_seed());
+  ASSERT_TRUE(this->m_db->prune_blockchain_step(0, 1, std::numeric_limits<uint64_t>::max(), pruned_bytes));
+  ASSERT_TRUE(this->m_db->check_pruning());
+}
+
+TYPED_TEST(BlockchainDBTest, DbStats)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  {
+    db_wtxn_guard guard(this->m_db);
+    ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  }
+  ASSERT_FALSE(this->m_db->has_key_image(crypto::key_image{}));
+
+  std::vector<db_table_stats> tables;
+  std::vector<db_operation_stats> operations;
+  if (!this->m_db->get_db_stats(tables, operations))
+    return;
+
+  const auto table = std::find_if(tables.begin(), tables.end(), [](const db_table_stats &t) { return t.name == "blocks"; });
+  ASSERT_NE(tables.end(), table);
+  ASSERT_EQ(1, table->entries);
+
+  // every call lands in one histogram bucket
+  for (const auto &op: operations)
+    ASSERT_EQ(op.count, std::accumulate(op.histogram.begin(), op.histogram.end(), (uint64_t)0));
+  const auto count = [&operations](const std::string &name) {
+    for (const auto &op: operations)
+      if (op.name == name)
+        return op.count;
+    return (uint64_t)-1;
+  };
+  ASSERT_EQ(1, count("add_block"));
+  ASSERT_EQ(1, count("has_key_image"));
+
+  this->m_db->reset_db_stats();
+  ASSERT_TRUE(this->m_db->get_db_stats(tables, operations));
+  ASSERT_EQ(0, count("add_block"));
+}
+
+TYPED_TEST(BlockchainDBTest, AbortedBlockIsRolledBack)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  {
+    db_wtxn_guard guard(this->m_db);
+    ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  }
+
+  this->m_db->block_wtxn_start();
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+  ASSERT_EQ(2, this->m_db->height());
+  this->m_db->block_wtxn_abort();
+
+  ASSERT_EQ(1, this->m_db->height());
+  ASSERT_FALSE(this->m_db->block_exists(get_block_hash(this->m_blocks[1].first)));
+  ASSERT_FALSE(this->m_db->tx_exists(get_transaction_hash(this->m_blocks[1].first.miner_tx)));
+  for (const auto &tx: this->m_txs[1])
+    ASSERT_FALSE(this->m_db->tx_exists(get_transaction_hash(tx.first)));
+
+  // and the block can be added again
+  {
+    db_wtxn_guard guard(this->m_db);
+    ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+  }
+  ASSERT_EQ(2, this->m_db->height());
+}
+
+TYPED_TEST(BlockchainDBTest, KeyImageSpender)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  {
+    db_wtxn_guard guard(this->m_db);
+    ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  }
+
+  // the index is built for blocks added before it was enabled
+  if (this->m_db->get_db_name() != "memory")
+  {
+    crypto::hash tx_hash;
+    uint64_t height;
+    for (const auto &tx: this->m_txs[0])
+      for (const auto &in: tx.first.vin)
+        if (in.type() == typeid(txin_to_key))
+        {
+          ASSERT_FALSE(this->m_db->get_key_image_spender(boost::get<txin_to_key>(in).k_image, tx_hash, height));
+        }
+    ASSERT_NO_THROW(this->m_db->close());
+    ASSERT_NO_THROW(this->m_db->open(dirPath, DBF_SPENT_KEY_INDEX));
+  }
+
+  {
+    db_wtxn_guard guard(this->m_db);
+    ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+  }
+
+  auto check_spenders = [this](size_t blocks) {
+    for (size_t i = 0; i < this->m_txs.size(); ++i)
+    {
+      for (const auto &tx: this->m_txs[i])
+      {
+        for (const auto &in: tx.first.vin)
+        {
+          if (in.type() != typeid(txin_to_key))
+            continue;
+          crypto::hash tx_hash;
+          uint64_t height;
+          const bool found = this->m_db->get_key_image_spender(boost::get<txin_to_key>(in).k_image, tx_hash, height);
+          ASSERT_EQ(i < blocks, found);
+          if (found)
+          {
+            ASSERT_EQ(get_transaction_hash(tx.first), tx_hash);
+            ASSERT_EQ(i, height);
+          }
+        }
+      }
+    }
+  };
+  check_spenders(2);
+  crypto::hash tx_hash;
+  uint64_t height;
+  ASSERT_FALSE(this->m_db->get_key_image_spender(crypto::rand<crypto::key_image>(), tx_hash, height));
+
+  // and popped blocks take their entries with them
+  {
+    block b;
+    std::vector<transaction> txs;
+    ASSERT_NO_THROW(this->m_db->pop_block(b, txs));
+  }
+  check_spenders(1);
+}
+
+
+TYPED_TEST(BlockchainDBTest, ReopenAfterInterruptedSave)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  for (size_t i = 0; i < 2; ++i)
+  {
+    {
+      db_wtxn_guard guard(this->m_db);
+      ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[i], t_sizes[i], t_sizes[i], t_diffs[i], t_coins[i], this->m_txs[i]));
+    }
+    // the memory db rewrites its snapshot on the first save and appends to it on the second
+    ASSERT_NO_THROW(this->m_db->close());
+    ASSERT_NO_THROW(this->m_db->open(dirPath));
+    ASSERT_EQ(i + 1, this->m_db->height());
+  }
+
+  if (this->m_db->get_db_name() == "memory")
+  {
+    // an append cut short leaves a partial block past the one the header ends at
+    ASSERT_NO_THROW(this->m_db->close());
+    const boost::filesystem::path raw = tempPath / "blockchain.raw";
+    const auto saved_size = boost::filesystem::file_size(raw);
+    {
+      std::ofstream f(raw.string(), std::ios_base::binary | std::ios_base::app);
+      f.write("\x10\x00\x00\x00\x02", 5);
+    }
+    ASSERT_NO_THROW(this->m_db->open(dirPath));
+    ASSERT_EQ(2, this->m_db->height());
+
+    // and the next save drops it
+    ASSERT_NO_THROW(this->m_db->close());
+    ASSERT_EQ(saved_size, boost::filesystem::file_size(raw));
+    ASSERT_NO_THROW(this->m_db->open(dirPath));
+    ASSERT_EQ(2, this->m_db->height());
+  }
+
+  ASSERT_HASH_EQ(get_block_hash(this->m_blocks[1].first), this->m_db->top_block_hash());
+}
+
 }  // anonymous namespace
+
@@ -81,6 +81,74 @@ namespace
   };
 
   typedef epee::net_utils::boosted_tcp_server<test_protocol_handler> test_tcp_server;
+
+  struct test_send_handler_config
+  {
+    boost::mutex lock;
+    boost::condition_variable cond;
+    epee::net_utils::i_service_endpoint* endpoint = nullptr;
+  };
+
+  //! hands the server end of each connection to the test, so it can send on it
+  struct test_send_handler
+  {
+    typedef test_connection_context connection_context;
+    typedef test_send_handler_config config_type;
+
+    test_send_handler(epee::net_utils::i_service_endpoint* psnd_hndlr, config_type& config, connection_context& /*conn_context*/)
+      : m_endpoint(psnd_hndlr), m_config(config)
+    {
+    }
+
+    void after_init_connection()
+    {
+      boost::unique_lock<boost::mutex> lock(m_config.lock);
+      m_config.endpoint = m_endpoint;
+      m_config.cond.notify_all();
+    }
+
+    void handle_qued_callback()
+    {
+    }
+
+    bool release_protocol()
+    {
+      return true;
+    }
+
+    bool handle_recv(const void* /*data*/, size_t /*size*/)
+    {
+      return true;
+    }
+
+    epee::net_utils::i_service_endpoint* m_endpoint;
+    config_type& m_config;
+  };
+
+  typedef epee::net_utils::boosted_tcp_server<test_send_handler> test_send_server;
+
+  using send_slice = epee::net_utils::connection_basic::send_slice;
+
+  std::vector<epee::byte_slice> make_slices(std::initializer_list<const char*> parts)
+  {
+    std::vector<epee::byte_slice> slices;
+    for (const char* part : parts)
+      slices.emplace_back(std::string{part});
+    return slices;
+  }
+
+  std::string slice_string(const send_slice& slice)
+  {
+    return std::string{reinterpret_cast<const char*>(slice.data.data()), slice.data.size()};
+  }
+
+  std::vector<std::string> que_strings(const std::deque<send_slice>& que)
+  {
+    std::vector<std::string> out;
+    for (const send_slice& slice : que)
+      out.push_back(slice_string(slice));
+    return out;
+  }
 }
 
 TEST(boosted_tcp_server, worker_threads_are_exception_resistant)
@@ -133,3 +201,184 @@ TEST(boosted_tcp_server, worker_threads_are_exception_resistant)
   ASSERT_TRUE(srv.timed_wait_server_stop(5 * 1000));
   ASSERT_TRUE(srv.deinit_server());
 }
+
+TEST(boosted_tcp_server, send_queue_order)
+{
+  using epee::net_utils::connection_basic;
+  using epee::net_utils::traffic_class;
+
+  std::deque<send_slice> que;
+  connection_basic::queue_message(que, 0, make_slices({"p1", "p2"}), traffic_class::peers);
+  connection_basic::queue_message(que, 0, make_slices({"t1"}), traffic_class::tx);
+  connection_basic::queue_message(que, 0, make_slices({"b1", "b2"}), traffic_class::block);
+  connection_basic::queue_message(que, 0, make_slices({"p3"}), traffic_class::peers);
+  connection_basic::queue_message(que, 0, make_slices({"t2"}), traffic_class::tx);
+
+  // higher classes first, in order within a class, and messages are never split
+  EXPECT_EQ((std::vector<std::string>{"b1", "b2", "t1", "t2", "p1", "p2", "p3"}), que_strings(que));
+  const bool starts[] = {true, false, true, true, true, false, true};
+  const traffic_class classes[] = {
+    traffic_class::block, traffic_class::block, traffic_class::tx, traffic_class::tx, traffic_class::peers, traffic_class::peers, traffic_class::peers
+  };
+  ASSERT_EQ(7u, que.size());
+  for (size_t i = 0; i < que.size(); ++i)
+  {
+    EXPECT_EQ(starts[i], que[i].message_start);
+    EXPECT_EQ(classes[i], que[i].priority);
+  }
+}
+
+TEST(boosted_tcp_server, send_queue_order_in_flight)
+{
+  using epee::net_utils::connection_basic;
+  using epee::net_utils::traffic_class;
+
+  // the slices being written stay first, even when a block comes in
+  std::deque<send_slice> que;
+  connection_basic::queue_message(que, 0, make_slices({"p1"}), traffic_class::peers);
+  connection_basic::queue_message(que, 0, make_slices({"p2"}), traffic_class::peers);
+  connection_basic::queue_message(que, 1, make_slices({"b1"}), traffic_class::block);
+  EXPECT_EQ((std::vector<std::string>{"p1", "b1", "p2"}), que_strings(que));
+
+  // and so does the rest of a message that is partly written
+  que.clear();
+  connection_basic::queue_message(que, 0, make_slices({"p1", "p2", "p3"}), traffic_class::peers);
+  connection_basic::queue_message(que, 0, make_slices({"t1"}), traffic_class::tx);
+  ASSERT_EQ((std::vector<std::string>{"t1", "p1", "p2", "p3"}), que_strings(que));
+  connection_basic::queue_message(que, 2, make_slices({"b1"}), traffic_class::block);
+  EXPECT_EQ((std::vector<std::string>{"t1", "p1", "p2", "p3", "b1"}), que_strings(que));
+  connection_basic::queue_message(que, 2, make_slices({"b2"}), traffic_class::block);
+  EXPECT_EQ((std::vector<std::string>{"t1", "p1", "p2", "p3", "b1", "b2"}), que_strings(que));
+}
+
+TEST(boosted_tcp_server, send_gather)
+{
+  using epee::net_utils::connection_basic;
+  using epee::net_utils::traffic_class;
+
+  std::deque<send_slice> que;
+  EXPECT_EQ(0u, connection_basic::get_gather_count(que, 64, 256 * 1024));
+
+  connection_basic::queue_message(que, 0, make_slices({"b1", "b2"}), traffic_class::block);
+  connection_basic::queue_message(que, 0, make_slices({"s1"}), traffic_class::sync);
+  connection_basic::queue_message(que, 0, make_slices({"t1", "t2", "t3"}), traffic_class::tx);
+
+  // one write never mixes classes, so each is throttled as its own
+  EXPECT_EQ(2u, connection_basic::get_gather_count(que, 64, 256 * 1024));
+  que.erase(que.begin(), que.begin() + 2);
+  EXPECT_EQ(1u, connection_basic::get_gather_count(que, 64, 256 * 1024));
+  que.pop_front();
+  EXPECT_EQ(3u, connection_basic::get_gather_count(que, 64, 256 * 1024));
+
+  // the count and size limits
+  EXPECT_EQ(2u, connection_basic::get_gather_count(que, 2, 256 * 1024));
+  EXPECT_EQ(2u, connection_basic::get_gather_count(que, 64, 5));
+  EXPECT_EQ(3u, connection_basic::get_gather_count(que, 64, 6));
+
+  // a slice larger than the size limit is still written, alone
+  que.clear();
+  connection_basic::queue_message(que, 0, make_slices({"large", "x"}), traffic_class::tx);
+  EXPECT_EQ(1u, connection_basic::get_gather_count(que, 64, 4));
+}
+
+TEST(boosted_tcp_server, send_keeps_order_with_chunked_message)
+{
+  // unthrottled, so the test does not wait on the default 16 kB/s
+  const uint64_t rate_up_limit = epee::net_utils::connection_basic::get_rate_up_limit();
+  epee::net_utils::connection_basic::set_rate_up_limit(1024 * 1024 * 1024);
+  epee::misc_utils::auto_scope_leave_caller restore_limit = epee::misc_utils::create_scope_leave_handler([rate_up_limit]() {
+    epee::net_utils::connection_basic::set_rate_up_limit(rate_up_limit);
+  });
+
+  // p2p, since rpc connections do not chunk large messages
+  test_send_server srv(epee::net_utils::e_connection_type_P2P);
+  ASSERT_TRUE(srv.init_server(test_server_port, test_server_host));
+  ASSERT_TRUE(srv.run_server(2, false));
+
+  boost::asio::io_service io_service;
+  boost::asio::ip::tcp::socket client(io_service);
+  client.connect(boost::asio::ip::tcp::endpoint(boost::asio::ip::address::from_string(test_server_host), test_server_port));
+
+  test_send_handler_config& config = srv.get_config_object();
+  epee::net_utils::i_service_endpoint* endpoint;
+  {
+    boost::unique_lock<boost::mutex> lock(config.lock);
+    ASSERT_TRUE(config.cond.wait_for(lock, boost::chrono::seconds(5), [&config]() { return config.endpoint != nullptr; }));
+    endpoint = config.endpoint;
+  }
+
+  // more small messages than one write gathers, around a message sent in 32 kB chunks
+  std::string expected;
+  const auto send = [&expected, endpoint](std::string message) {
+    expected += message;
+    return endpoint->do_send(epee::byte_slice{std::move(message)});
+  };
+  for (size_t i = 0; i < 150; ++i)
+    ASSERT_TRUE(send(std::string(100 + i, char(i))));
+  std::string large(300 * 1024, 0);
+  for (size_t i = 0; i < large.size(); ++i)
+    large[i] = char(i % 251);
+  ASSERT_TRUE(send(std::move(large)));
+  for (size_t i = 0; i < 150; ++i)
+    ASSERT_TRUE(send(std::string(100 + i, char(255 - i))));
+
+  std::string received(expected.size(), 0);
+  boost::system::error_code ec;
+  ASSERT_EQ(expected.size(), boost::asio::read(client, boost::asio::buffer(&received[0], received.size()), ec));
+  ASSERT_FALSE(ec);
+  EXPECT_TRUE(expected == received);
+
+  client.close();
+  srv.send_stop_signal();
+  ASSERT_TRUE(srv.timed_wait_server_stop(5 * 1000));
+  ASSERT_TRUE(srv.deinit_server());
+}
+
+TEST(boosted_tcp_server, sharded_blocking_connects)
+{
+  test_tcp_server srv(epee::net_utils::e_connection_type_RPC); // RPC disables network limit for unit tests
+  srv.set_io_service_shards(2);
+  ASSERT_EQ(2u, srv.get_io_service_shards_count());
+  ASSERT_TRUE(srv.init_server(test_server_port, test_server_host));
+
+  boost::mutex mtx;
+  boost::condition_variable cond;
+  int started = 0;
+  int connected = 0;
+  int failed = 0;
+
+  // consecutive posts go to different shards, and each call only connects once both are running,
+  // so both shards have a thread stuck in a blocking connect, which the other thread must complete
+  const auto connect_back = [&]() {
+    {
+      boost::unique_lock<boost::mutex> lock(mtx);
+      ++started;
+      cond.notify_all();
+      cond.wait_for(lock, boost::chrono::seconds(5), [&]() { return started == 2; });
+    }
+    test_connection_context context{};
+    const bool r = srv.connect(test_server_host, std::to_string(test_server_port), 5000, context, "0.0.0.0", epee::net_utils::ssl_support_t::e_ssl_support_disabled);
+    boost::unique_lock<boost::mutex> lock(mtx);
+    ++(r ? connected : failed);
+    cond.notify_all();
+  };
+  ASSERT_TRUE(srv.async_call(connect_back));
+  ASSERT_TRUE(srv.async_call(connect_back));
+
+  // asking for fewer threads still gets two per shard
+  ASSERT_TRUE(srv.run_server(1, false));
+  ASSERT_EQ(4u, srv.get_threads_count());
+
+  {
+    boost::unique_lock<boost::mutex> lock(mtx);
+    ASSERT_TRUE(cond.wait_for(lock, boost::chrono::seconds(15), [&]() { return connected + failed == 2; }));
+    ASSERT_EQ(2, started);
+    ASSERT_EQ(2, connected);
+  }
+
+  // and stopping the server stops the threads of every shard
+  srv.send_stop_signal();
+  ASSERT_TRUE(srv.timed_wait_server_stop(5 * 1000));
+  ASSERT_TRUE(srv.get_io_service().stopped());
+  ASSERT_TRUE(srv.deinit_server());
+}
@@ -573,6 +573,99 @@ TEST(make_fragment, multiple)
     EXPECT_EQ(18, std::count(fragment.cbegin(), fragment.cend(), 0));
 }
 
+TEST(compress_message, round_trip)
+{
+    std::string bytes(LEVIN_COMPRESSION_MIN_SIZE * 4, 'a');
+    std::generate(bytes.begin(), bytes.begin() + 100, crypto::random_device{});
+
+    epee::levin::message_writer message;
+    message.buffer.write(epee::to_span(bytes));
+    const epee::byte_slice original = message.finalize_notify(114);
+    const epee::byte_slice compressed = epee::levin::compress_message(epee::to_span(original));
+
+    std::string body;
+    if (!epee::levin::compression_available())
+    {
+        EXPECT_TRUE(compressed.empty());
+        EXPECT_FALSE(epee::levin::decompress_body(epee::strspan<std::uint8_t>(bytes), bytes.size(), body));
+        return;
+    }
+
+    ASSERT_LT(sizeof(epee::levin::bucket_head2), compressed.size());
+    ASSERT_GT(original.size(), compressed.size());
+
+    epee::levin::bucket_head2 header;
+    std::memcpy(std::addressof(header), compressed.data(), sizeof(header));
+    EXPECT_EQ(LEVIN_PACKET_REQUEST | LEVIN_PACKET_COMPRESSED, header.m_flags);
+    EXPECT_EQ(114u, header.m_command);
+    ASSERT_EQ(compressed.size() - sizeof(header), header.m_cb);
+
+    const epee::span<const std::uint8_t> frame{compressed.data() + sizeof(header), header.m_cb};
+    ASSERT_TRUE(epee::levin::decompress_body(frame, bytes.size(), body));
+    EXPECT_EQ(bytes, body);
+
+    // oversized output and trailing bytes are rejected
+    EXPECT_FALSE(epee::levin::decompress_body(frame, bytes.size() - 1, body));
+    std::string padded{reinterpret_cast<const char*>(frame.data()), frame.size()};
+    padded.push_back(0);
+    EXPECT_FALSE(epee::levin::decompress_body(epee::strspan<std::uint8_t>(padded), bytes.size(), body));
+
+    // random bytes do not shrink
+    std::generate(bytes.begin(), bytes.end(), crypto::random_device{});
+    epee::levin::message_writer random;
+    random.buffer.write(epee::to_span(bytes));
+    EXPECT_TRUE(epee::levin::compress_message(epee::to_span(random.finalize_notify(114))).empty());
+}
+
+TEST(traffic_class, commands)
+{
+    using epee::net_utils::traffic_class;
+    using context = cryptonote::cryptonote_connection_context;
+
+    EXPECT_EQ(traffic_class::block, context::get_traffic_class(cryptonote::NOTIFY_NEW_BLOCK::ID));
+    EXPECT_EQ(traffic_class::block, context::get_traffic_class(cryptonote::NOTIFY_NEW_FLUFFY_BLOCK::ID));
+    EXPECT_EQ(traffic_class::block, context::get_traffic_class(cryptonote::NOTIFY_REQUEST_FLUFFY_MISSING_TX::ID));
+
+    EXPECT_EQ(traffic_class::sync, context::get_traffic_class(cryptonote::NOTIFY_REQUEST_GET_OBJECTS::ID));
+    EXPECT_EQ(traffic_class::sync, context::get_traffic_class(cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::ID));
+    EXPECT_EQ(traffic_class::sync, context::get_traffic_class(cryptonote::NOTIFY_REQUEST_CHAIN::ID));
+    EXPECT_EQ(traffic_class::sync, context::get_traffic_class(cryptonote::NOTIFY_RESPONSE_CHAIN_ENTRY::ID));
+    EXPECT_EQ(traffic_class::sync, context::get_traffic_class(cryptonote::NOTIFY_REQUEST_BLOCK_HEADERS::ID));
+    EXPECT_EQ(traffic_class::sync, context::get_traffic_class(cryptonote::NOTIFY_RESPONSE_BLOCK_HEADERS::ID));
+
+    EXPECT_EQ(traffic_class::tx, context::get_traffic_class(cryptonote::NOTIFY_NEW_TRANSACTIONS::ID));
+    EXPECT_EQ(traffic_class::tx, context::get_traffic_class(cryptonote::NOTIFY_GET_TXPOOL_COMPLEMENT::ID));
+    EXPECT_EQ(traffic_class::tx, context::get_traffic_class(cryptonote::NOTIFY_REQUEST_TX_RECONCILIATION::ID));
+    EXPECT_EQ(traffic_class::tx, context::get_traffic_class(cryptonote::NOTIFY_RESPONSE_TX_RECONCILIATION::ID));
+    EXPECT_EQ(traffic_class::tx, context::get_traffic_class(cryptonote::NOTIFY_TX_RECONCILIATION_DIFF::ID));
+
+    // handshakes, pings, and commands nobody classified
+    EXPECT_EQ(traffic_class::peers, context::get_traffic_class(nodetool::COMMAND_HANDSHAKE_T<cryptonote::CORE_SYNC_DATA>::ID));
+    EXPECT_EQ(traffic_class::peers, context::get_traffic_class(nodetool::COMMAND_TIMED_SYNC_T<cryptonote::CORE_SYNC_DATA>::ID));
+    EXPECT_EQ(traffic_class::peers, context::get_traffic_class(nodetool::COMMAND_PING::ID));
+    EXPECT_EQ(traffic_class::peers, context::get_traffic_class(0));
+    EXPECT_EQ(traffic_class::peers, context::get_traffic_class(-1));
+
+    // the base context, used by rpc and tests, sends everything as one class
+    EXPECT_EQ(traffic_class::peers, epee::net_utils::connection_context_base::get_traffic_class(cryptonote::NOTIFY_NEW_BLOCK::ID));
+}
+
+TEST(compress_command, commands)
+{
+    using context = cryptonote::cryptonote_connection_context;
+
+    EXPECT_TRUE(context::compress_command(cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::ID));
+    EXPECT_TRUE(context::compress_command(cryptonote::NOTIFY_RESPONSE_CHAIN_ENTRY::ID));
+
+    // relayed data is sent to many peers and would be compressed once per connection
+    EXPECT_FALSE(context::compress_command(cryptonote::NOTIFY_NEW_BLOCK::ID));
+    EXPECT_FALSE(context::compress_command(cryptonote::NOTIFY_NEW_FLUFFY_BLOCK::ID));
+    EXPECT_FALSE(context::compress_command(cryptonote::NOTIFY_NEW_TRANSACTIONS::ID));
+    EXPECT_FALSE(context::compress_command(nodetool::COMMAND_HANDSHAKE_T<cryptonote::CORE_SYNC_DATA>::ID));
+
+    EXPECT_FALSE(epee::net_utils::connection_context_base::compress_command(cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::ID));
+}
+
 TEST_F(levin_notify, defaulted)
 {
     cryptonote::levin::notify notifier{};
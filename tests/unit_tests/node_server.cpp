@@ -72,6 +72,7 @@ public:
   bool cleanup_handle_incoming_blocks(bool force_sync = false) { return true; }
   uint64_t get_target_blockchain_height() const { return 1; }
   size_t get_block_sync_size(uint64_t height) const { return BLOCKS_SYNCHRONIZING_DEFAULT_COUNT; }
+  bool is_block_sync_size_adaptive() const { return false; }
   virtual void on_transactions_relayed(epee::span<const cryptonote::blobdata> tx_blobs, cryptonote::relay_method tx_relay) {}
   cryptonote::network_type get_nettype() const { return cryptonote::MAINNET; }
   bool get_pool_transaction(const crypto::hash& id, cryptonote::blobdata& tx_blob, cryptonote::relay_category tx_category) const { return false; }
@@ -85,7 +86,11 @@ public:
   uint64_t get_earliest_ideal_height_for_version(uint8_t version) const { return 0; }
   cryptonote::difficulty_type get_block_cumulative_difficulty(uint64_t height) const { return 0; }
   bool fluffy_blocks_enabled() const { return false; }
+  bool headers_first_sync_enabled() const { return false; }
   uint64_t prevalidate_block_hashes(uint64_t height, const std::vector<crypto::hash> &hashes, const std::vector<uint64_t> &weights) { return 0; }
+  bool prevalidate_block_headers(uint64_t height, const std::vector<crypto::hash> &hashes, const std::vector<cryptonote::blobdata> &headers) { return true; }
+  uint64_t get_verified_headers_height() const { return 0; }
+  bool get_block_hashing_blobs(const std::vector<crypto::hash> &hashes, std::vector<cryptonote::blobdata> &blobs) const { return false; }
   bool pad_transactions() { return false; }
   uint32_t get_blockchain_pruning_seed() const { return 0; }
   bool prune_blockchain(uint32_t pruning_seed = 0) { return true; }
@@ -311,5 +316,95 @@ TEST(node_server, bind_same_p2p_port)
   EXPECT_TRUE(init(new_node(), port_another));
 }
 
+typedef cryptonote::t_cryptonote_protocol_handler<test_core> Protocol;
+
+TEST(span_size, default_until_measured)
+{
+  cryptonote::cryptonote_connection_context context;
+  EXPECT_EQ(17, Protocol::get_adaptive_span_size(context, 17));
+  context.m_span_rate = 1000.0f;
+  EXPECT_EQ(17, Protocol::get_adaptive_span_size(context, 17));
+  context.m_span_rate = 0.0f;
+  context.m_span_block_size = 100.0f;
+  EXPECT_EQ(17, Protocol::get_adaptive_span_size(context, 17));
+}
+
+TEST(span_size, fits_target_time)
+{
+  cryptonote::cryptonote_connection_context context;
+  context.m_span_rate = 1000.0f;
+  context.m_span_block_size = 100.0f;
+
+  // 3 seconds at 1000 bytes per second, with no known block weights
+  EXPECT_EQ(30, Protocol::get_adaptive_span_size(context, 17));
+
+  // the round trip comes out of the time left to transfer
+  context.m_rtt = 1.0f;
+  EXPECT_EQ(20, Protocol::get_adaptive_span_size(context, 17));
+
+  // but a quarter of the target time is always left
+  context.m_rtt = 10.0f;
+  EXPECT_EQ(7, Protocol::get_adaptive_span_size(context, 17));
+}
+
+TEST(span_size, uses_block_weights)
+{
+  cryptonote::cryptonote_connection_context context;
+  context.m_span_rate = 1000.0f;
+  context.m_span_block_size = 100.0f;
+
+  // known weights are used over the average
+  for (size_t i = 0; i < 10; ++i)
+    context.m_needed_objects.push_back(std::make_pair(crypto::null_hash, 1000));
+  EXPECT_EQ(3, Protocol::get_adaptive_span_size(context, 17));
+
+  // the average is used past the last needed block
+  context.m_needed_objects.resize(2);
+  EXPECT_EQ(12, Protocol::get_adaptive_span_size(context, 17));
+
+  // and for blocks the peer sent no weight for
+  context.m_needed_objects.assign(5, std::make_pair(crypto::null_hash, 0));
+  context.m_needed_objects.resize(10, std::make_pair(crypto::null_hash, 1000));
+  EXPECT_EQ(7, Protocol::get_adaptive_span_size(context, 17));
+}
+
+TEST(span_size, clamped)
+{
+  cryptonote::cryptonote_connection_context context;
+  context.m_span_block_size = 100.0f;
+
+  context.m_span_rate = 1.0f;
+  EXPECT_EQ(1, Protocol::get_adaptive_span_size(context, 17));
+  context.m_needed_objects.push_back(std::make_pair(crypto::null_hash, 1000000));
+  EXPECT_EQ(1, Protocol::get_adaptive_span_size(context, 17));
+
+  context.m_span_rate = 1e9f;
+  EXPECT_EQ(CURRENCY_PROTOCOL_MAX_OBJECT_REQUEST_COUNT, Protocol::get_adaptive_span_size(context, 17));
+}
+
+TEST(span_size, stats)
+{
+  cryptonote::cryptonote_connection_context context;
+
+  // the first measurements are taken as they are
+  Protocol::update_rtt(context, boost::posix_time::milliseconds(400));
+  EXPECT_FLOAT_EQ(0.4f, context.m_rtt);
+  Protocol::update_span_stats(context, boost::posix_time::milliseconds(2400), 4000, 10);
+  EXPECT_FLOAT_EQ(2000.0f, context.m_span_rate);
+  EXPECT_FLOAT_EQ(400.0f, context.m_span_block_size);
+
+  // later ones are smoothed
+  Protocol::update_rtt(context, boost::posix_time::milliseconds(800));
+  EXPECT_FLOAT_EQ(0.5f, context.m_rtt);
+  Protocol::update_span_stats(context, boost::posix_time::milliseconds(1500), 6000, 5);
+  EXPECT_FLOAT_EQ(2000.0f + (6000.0f - 2000.0f) * 0.25f, context.m_span_rate);
+  EXPECT_FLOAT_EQ(400.0f + (1200.0f - 400.0f) * 0.25f, context.m_span_block_size);
+
+  // a span faster than the round trip still gets a sane rate
+  Protocol::update_span_stats(context, boost::posix_time::milliseconds(100), 1000, 0);
+  EXPECT_LT(0.0f, context.m_span_rate);
+  EXPECT_FLOAT_EQ(400.0f + (1200.0f - 400.0f) * 0.25f, context.m_span_block_size);
+}
+
 namespace nodetool { template class node_server<cryptonote::t_cryptonote_protocol_handler<test_core>>; }
 namespace cryptonote { template class t_cryptonote_protocol_handler<test_core>; }
@@ -0,0 +1,152 @@
+// Copyright (c) 2014-2021, The Monero Project
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+
+#include "gtest/gtest.h"
+
+#include "blockchain_db/blockchain_db.h"
+#include "blockchain_db/segment_store.h"
+
+using namespace cryptonote;
+
+namespace
+{
+
+class SegmentStore : public testing::Test
+{
+protected:
+  SegmentStore(): m_folder((boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string()) {}
+  ~SegmentStore() { m_store.close(); boost::filesystem::remove_all(m_folder); }
+
+  static epee::span<const uint8_t> to_span(const std::string &s) { return {(const uint8_t*)s.data(), s.size()}; }
+  static std::string to_string(const epee::span<const uint8_t> &s) { return std::string((const char*)s.data(), s.size()); }
+
+  std::string m_folder;
+  segment_store m_store;
+};
+
+}
+
+#ifndef _WIN32
+
+TEST_F(SegmentStore, append_and_get)
+{
+  m_store.open(m_folder, false);
+  const std::vector<std::string> blobs = {"first", std::string(1000, 'x'), "", "last"};
+  std::vector<segment_store::location> locations;
+  for (const auto &blob: blobs)
+    locations.push_back(m_store.append(to_span(blob)));
+  for (size_t i = 0; i < blobs.size(); ++i)
+    ASSERT_EQ(blobs[i], to_string(m_store.get(locations[i])));
+  ASSERT_EQ(1009, m_store.get_size());
+}
+
+TEST_F(SegmentStore, reopen)
+{
+  m_store.open(m_folder, false);
+  const segment_store::location loc0 = m_store.append(to_span("persistent"));
+  m_store.close();
+
+  m_store.open(m_folder, true);
+  ASSERT_EQ("persistent", to_string(m_store.get(loc0)));
+  ASSERT_THROW(m_store.append(to_span("nope")), DB_ERROR);
+  m_store.close();
+
+  // appends continue after what is already there
+  m_store.open(m_folder, false);
+  const segment_store::location loc1 = m_store.append(to_span("more"));
+  ASSERT_EQ(loc0.segment, loc1.segment);
+  ASSERT_EQ(loc0.offset + loc0.size, loc1.offset);
+  ASSERT_EQ("persistent", to_string(m_store.get(loc0)));
+  ASSERT_EQ("more", to_string(m_store.get(loc1)));
+}
+
+TEST_F(SegmentStore, invalid_location)
+{
+  m_store.open(m_folder, false);
+  segment_store::location loc = m_store.append(to_span("data"));
+  ++loc.size;
+  ASSERT_THROW(m_store.get(loc), DB_ERROR);
+  loc.size = 1;
+  loc.segment = 1;
+  ASSERT_THROW(m_store.get(loc), DB_ERROR);
+}
+
+TEST_F(SegmentStore, clear)
+{
+  m_store.open(m_folder, false);
+  const segment_store::location loc = m_store.append(to_span("data"));
+  m_store.clear();
+  ASSERT_EQ(0, m_store.get_size());
+  ASSERT_THROW(m_store.get(loc), DB_ERROR);
+  ASSERT_EQ(0, m_store.append(to_span("again")).offset);
+}
+
+TEST_F(SegmentStore, grows_past_pages)
+{
+  m_store.open(m_folder, false);
+  std::vector<segment_store::location> locations;
+  for (size_t i = 0; i < 20; ++i)
+    locations.push_back(m_store.append(to_span(std::string(1000, 'a' + i))));
+  for (size_t i = 0; i < locations.size(); ++i)
+    ASSERT_EQ(std::string(1000, 'a' + i), to_string(m_store.get(locations[i])));
+  m_store.close();
+
+  m_store.open(m_folder, true);
+  for (size_t i = 0; i < locations.size(); ++i)
+    ASSERT_EQ(std::string(1000, 'a' + i), to_string(m_store.get(locations[i])));
+}
+
+TEST_F(SegmentStore, release)
+{
+  m_store.open(m_folder, false);
+  const segment_store::location loc0 = m_store.append(to_span(std::string(5000, 'x')));
+  const segment_store::location loc1 = m_store.append(to_span(std::string(5000, 'y')));
+  const segment_store::location loc2 = m_store.append(to_span(std::string(5000, 'z')));
+
+  // the end is truncated away, and its space reused
+  m_store.release(loc2);
+  ASSERT_EQ(10000, m_store.get_size());
+  ASSERT_THROW(m_store.get(loc2), DB_ERROR);
+  ASSERT_EQ(loc2.offset, m_store.append(to_span("again")).offset);
+  ASSERT_EQ(std::string(5000, 'y'), to_string(m_store.get(loc1)));
+
+  // anything else leaves its neighbours alone
+  m_store.release(loc0);
+  ASSERT_EQ(std::string(5000, 'y'), to_string(m_store.get(loc1)));
+  m_store.close();
+
+  m_store.open(m_folder, false);
+  ASSERT_EQ(10005, m_store.get_size());
+  ASSERT_EQ(std::string(5000, 'y'), to_string(m_store.get(loc1)));
+  ASSERT_THROW(m_store.release(loc2), DB_ERROR);
+}
+
+#endif
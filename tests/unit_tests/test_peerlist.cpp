@@ -28,6 +28,8 @@
 // 
 // Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
 
+#include <boost/filesystem/operations.hpp>
+
 #include "gtest/gtest.h"
 
 #include "common/util.h"
@@ -254,3 +256,52 @@ TEST(peerlist_storage, store)
   EXPECT_EQ(24u, types.anchor[1].id);
   EXPECT_EQ(22u, types.anchor[1].first_seen);
 }
+
+TEST(peerlist_db, store)
+{
+  using zone = epee::net_utils::zone;
+
+  const boost::filesystem::path path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  {
+    std::unique_ptr<nodetool::peerlist_db> db = nodetool::peerlist_db::open(path.string());
+    ASSERT_TRUE(db != nullptr);
+    EXPECT_TRUE(db->empty());
+
+    nodetool::peerlist_types types{};
+    types.white.push_back({epee::net_utils::ipv4_network_address{1000, 10}, 44, 55});
+    types.gray.push_back({epee::net_utils::ipv4_network_address{2000, 20}, 84, 45});
+    types.gray.push_back({epee::net_utils::ipv4_network_address{3000, 30}, 85, 46});
+    types.anchor.push_back({net::tor_address::unknown(), 14, 33});
+    EXPECT_TRUE(db->store(nodetool::peerlist_types{}, types));
+    EXPECT_FALSE(db->empty());
+
+    // drop one gray peer and update the white one
+    types.gray.pop_back();
+    types.white[0].last_seen = 66;
+    EXPECT_TRUE(db->store(nodetool::peerlist_types{}, types));
+  }
+  {
+    std::unique_ptr<nodetool::peerlist_db> db = nodetool::peerlist_db::open(path.string());
+    ASSERT_TRUE(db != nullptr);
+    EXPECT_FALSE(db->empty());
+
+    nodetool::peerlist_storage peers = nodetool::peerlist_storage::open(*db);
+    nodetool::peerlist_types types = peers.take_zone(zone::public_);
+    ASSERT_EQ(1u, types.white.size());
+    EXPECT_EQ(1000u, types.white[0].adr.template as<epee::net_utils::ipv4_network_address>().ip());
+    EXPECT_EQ(44u, types.white[0].id);
+    EXPECT_EQ(66u, types.white[0].last_seen);
+    ASSERT_EQ(1u, types.gray.size());
+    EXPECT_EQ(2000u, types.gray[0].adr.template as<epee::net_utils::ipv4_network_address>().ip());
+    EXPECT_EQ(84u, types.gray[0].id);
+    EXPECT_TRUE(types.anchor.empty());
+
+    types = peers.take_zone(zone::tor);
+    EXPECT_TRUE(types.white.empty());
+    EXPECT_TRUE(types.gray.empty());
+    ASSERT_EQ(1u, types.anchor.size());
+    EXPECT_EQ(14u, types.anchor[0].id);
+    EXPECT_EQ(33u, types.anchor[0].first_seen);
+  }
+  boost::filesystem::remove_all(path);
+}
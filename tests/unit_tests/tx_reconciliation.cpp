@@ -0,0 +1,117 @@
+// Copyright (c) 2014-2021, The Monero Project
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <gtest/gtest.h>
+
+#include "crypto/crypto.h"
+#include "cryptonote_config.h"
+#include "cryptonote_protocol/tx_reconciliation.h"
+
+namespace
+{
+  std::vector<std::uint64_t> get_ids(std::size_t count)
+  {
+    std::vector<std::uint64_t> out;
+    for (std::size_t i = 0; i < count; ++i)
+      out.push_back(cryptonote::reconciliation::get_short_id(crypto::rand<crypto::hash>(), 7));
+    return out;
+  }
+}
+
+TEST(tx_reconciliation, short_id)
+{
+  const crypto::hash txid = crypto::rand<crypto::hash>();
+  EXPECT_EQ(cryptonote::reconciliation::get_short_id(txid, 1), cryptonote::reconciliation::get_short_id(txid, 1));
+  EXPECT_NE(cryptonote::reconciliation::get_short_id(txid, 1), cryptonote::reconciliation::get_short_id(txid, 2));
+}
+
+TEST(tx_reconciliation, sketch_cells)
+{
+  EXPECT_NE(0u, cryptonote::reconciliation::get_sketch_cells(0, 0));
+  EXPECT_EQ(0u, cryptonote::reconciliation::get_sketch_cells(0, 0) % 4);
+  EXPECT_LT(cryptonote::reconciliation::get_sketch_cells(100, 100), cryptonote::reconciliation::get_sketch_cells(0, 100));
+  EXPECT_EQ(0u, cryptonote::reconciliation::get_sketch_cells(0, CRYPTONOTE_TX_RECONCILIATION_MAX_CELLS));
+}
+
+TEST(tx_reconciliation, decode)
+{
+  const std::vector<std::uint64_t> common = get_ids(200);
+  const std::vector<std::uint64_t> ours = get_ids(20);
+  const std::vector<std::uint64_t> theirs = get_ids(15);
+
+  const std::size_t cells = cryptonote::reconciliation::get_sketch_cells(common.size() + ours.size(), common.size() + theirs.size());
+  ASSERT_NE(0u, cells);
+  cryptonote::reconciliation::sketch local{cells};
+  cryptonote::reconciliation::sketch remote{cells};
+  for (const std::uint64_t id : common)
+  {
+    local.add(id);
+    remote.add(id);
+  }
+  for (const std::uint64_t id : ours)
+    local.add(id);
+  for (const std::uint64_t id : theirs)
+    remote.add(id);
+
+  const auto received = cryptonote::reconciliation::sketch::from_blob(remote.to_blob());
+  ASSERT_TRUE(bool(received));
+  EXPECT_EQ(remote.to_blob(), received->to_blob());
+
+  std::vector<std::uint64_t> local_only;
+  std::vector<std::uint64_t> remote_only;
+  ASSERT_TRUE(local.decode(*received, local_only, remote_only));
+  std::sort(local_only.begin(), local_only.end());
+  std::sort(remote_only.begin(), remote_only.end());
+  std::vector<std::uint64_t> expected_local = ours;
+  std::vector<std::uint64_t> expected_remote = theirs;
+  std::sort(expected_local.begin(), expected_local.end());
+  std::sort(expected_remote.begin(), expected_remote.end());
+  EXPECT_EQ(expected_local, local_only);
+  EXPECT_EQ(expected_remote, remote_only);
+}
+
+TEST(tx_reconciliation, decode_too_large)
+{
+  cryptonote::reconciliation::sketch local{32};
+  const cryptonote::reconciliation::sketch remote{32};
+  for (const std::uint64_t id : get_ids(100))
+    local.add(id);
+
+  std::vector<std::uint64_t> local_only;
+  std::vector<std::uint64_t> remote_only;
+  EXPECT_FALSE(local.decode(remote, local_only, remote_only));
+}
+
+TEST(tx_reconciliation, invalid_blob)
+{
+  EXPECT_FALSE(bool(cryptonote::reconciliation::sketch::from_blob({})));
+  EXPECT_FALSE(bool(cryptonote::reconciliation::sketch::from_blob(std::string(20, 'a'))));
+  EXPECT_FALSE(bool(cryptonote::reconciliation::sketch::from_blob(std::string(60, 'a'))));
+  EXPECT_FALSE(bool(cryptonote::reconciliation::sketch::from_blob(std::string(81, 'a'))));
+  EXPECT_TRUE(bool(cryptonote::reconciliation::sketch::from_blob(std::string(80, 'a'))));
+}